@@ -49,6 +49,22 @@
 
 #define CY_SMIF_INIT_TRY_COUNT           (10U)
 
+/* SFDP layout (JESD216) used to look up the quad page program commands */
+#define SFDP_READ_CMD                    (0x5AU)
+#define SFDP_READ_DUMMY_CYCLES           (8U)
+#define SFDP_SIGNATURE                   (0x50444653UL)  /* "SFDP" */
+#define SFDP_HEADER_SIZE                 (8U)
+#define SFDP_PARAM_HEADER_SIZE           (8U)
+#define SFDP_MAX_PARAM_HEADERS           (16U)
+#define SFDP_4BAIT_ID_LSB                (0x84U)         /* 4-byte Address Instruction Table */
+#define SFDP_4BAIT_ID_MSB                (0xFFU)
+#define SFDP_4BAIT_PP_1_1_4_Msk          (1UL << 6)
+#define SFDP_4BAIT_PP_1_4_4_Msk          (1UL << 7)
+
+/* 4-byte address quad page program commands */
+#define QSPI_CMD_4PP_1_1_4               (0x34U)
+#define QSPI_CMD_4PP_1_4_4               (0x3EU)
+
 /* This is the board specific stuff that should align with your board.
  *
  * QSPI resources:
@@ -453,6 +469,165 @@ cy_en_smif_status_t qspi_init_sfdp(uint32_t smif_id)
     return stat;
 }
 
+static uint32_t qspi_width_lines(cy_en_smif_txfr_width_t width)
+{
+    switch (width)
+    {
+        case CY_SMIF_WIDTH_DUAL:
+            return 2U;
+        case CY_SMIF_WIDTH_QUAD:
+            return 4U;
+        case CY_SMIF_WIDTH_OCTAL:
+            return 8U;
+        case CY_SMIF_WIDTH_SINGLE:
+        default:
+            return 1U;
+    }
+}
+
+static cy_en_smif_status_t qspi_read_sfdp(SMIF_Type *base, cy_stc_smif_mem_config_t const *memCfg,
+        cy_stc_smif_context_t *context, uint32_t addr, uint8_t *data, uint32_t len)
+{
+    cy_en_smif_status_t st;
+    uint8_t addr_bytes[3];
+
+    addr_bytes[0] = (uint8_t)(addr >> 16);
+    addr_bytes[1] = (uint8_t)(addr >> 8);
+    addr_bytes[2] = (uint8_t)(addr);
+
+    st = Cy_SMIF_TransmitCommand(base, SFDP_READ_CMD, CY_SMIF_WIDTH_SINGLE,
+            addr_bytes, sizeof(addr_bytes), CY_SMIF_WIDTH_SINGLE,
+            memCfg->slaveSelect, CY_SMIF_TX_NOT_LAST_BYTE, context);
+    if (st == CY_SMIF_SUCCESS)
+    {
+        st = Cy_SMIF_SendDummyCycles(base, SFDP_READ_DUMMY_CYCLES);
+    }
+    if (st == CY_SMIF_SUCCESS)
+    {
+        st = Cy_SMIF_ReceiveDataBlocking(base, data, len, CY_SMIF_WIDTH_SINGLE, context);
+    }
+    return st;
+}
+
+/*
+ * Switches the program command of the memory to the 4-byte address quad
+ * input page program (1-4-4 or 1-1-4) when the SFDP 4-byte Address
+ * Instruction Table reports it. The SFDP basic table does not describe the
+ * program commands, so 3-byte address parts keep the detected command.
+ * The Quad Enable bit must already be set.
+ *
+ * Returns CY_SMIF_SUCCESS when the command was switched; the program command
+ * is left unchanged on any other status.
+ */
+cy_en_smif_status_t qspi_select_quad_program(SMIF_Type *base, cy_stc_smif_mem_config_t *memCfg,
+        cy_stc_smif_context_t *context)
+{
+    cy_stc_smif_mem_cmd_t *pgmCmd = memCfg->deviceCfg->programCmd;
+    cy_en_smif_status_t st;
+    uint8_t header[SFDP_HEADER_SIZE];
+    uint8_t param[SFDP_PARAM_HEADER_SIZE];
+    uint8_t dword[4];
+    uint32_t num_params;
+    uint32_t table = 0U;
+    uint32_t i;
+
+    if ((pgmCmd == NULL) || (memCfg->deviceCfg->numOfAddrBytes != 4U))
+    {
+        return CY_SMIF_CMD_NOT_FOUND;
+    }
+    if (pgmCmd->dataWidth == CY_SMIF_WIDTH_QUAD)
+    {
+        /* Already a quad input program */
+        return CY_SMIF_SUCCESS;
+    }
+
+    st = qspi_read_sfdp(base, memCfg, context, 0U, header, sizeof(header));
+    if (st != CY_SMIF_SUCCESS)
+    {
+        return st;
+    }
+    if ((((uint32_t)header[3] << 24) | ((uint32_t)header[2] << 16) |
+         ((uint32_t)header[1] << 8) | header[0]) != SFDP_SIGNATURE)
+    {
+        return CY_SMIF_CMD_NOT_FOUND;
+    }
+
+    num_params = (uint32_t)header[6] + 1U;
+    if (num_params > SFDP_MAX_PARAM_HEADERS)
+    {
+        num_params = SFDP_MAX_PARAM_HEADERS;
+    }
+
+    for (i = 0U; i < num_params; i++)
+    {
+        st = qspi_read_sfdp(base, memCfg, context, SFDP_HEADER_SIZE + (i * SFDP_PARAM_HEADER_SIZE),
+                param, sizeof(param));
+        if (st != CY_SMIF_SUCCESS)
+        {
+            return st;
+        }
+        if ((param[0] == SFDP_4BAIT_ID_LSB) && (param[7] == SFDP_4BAIT_ID_MSB) && (param[3] >= 1U))
+        {
+            table = ((uint32_t)param[6] << 16) | ((uint32_t)param[5] << 8) | param[4];
+            break;
+        }
+    }
+    if (i == num_params)
+    {
+        return CY_SMIF_CMD_NOT_FOUND;
+    }
+
+    st = qspi_read_sfdp(base, memCfg, context, table, dword, sizeof(dword));
+    if (st != CY_SMIF_SUCCESS)
+    {
+        return st;
+    }
+
+    i = ((uint32_t)dword[3] << 24) | ((uint32_t)dword[2] << 16) | ((uint32_t)dword[1] << 8) | dword[0];
+    if ((i & SFDP_4BAIT_PP_1_4_4_Msk) != 0U)
+    {
+        pgmCmd->command = QSPI_CMD_4PP_1_4_4;
+        pgmCmd->addrWidth = CY_SMIF_WIDTH_QUAD;
+    }
+    else if ((i & SFDP_4BAIT_PP_1_1_4_Msk) != 0U)
+    {
+        pgmCmd->command = QSPI_CMD_4PP_1_1_4;
+        pgmCmd->addrWidth = CY_SMIF_WIDTH_SINGLE;
+    }
+    else
+    {
+        return CY_SMIF_CMD_NOT_FOUND;
+    }
+
+    pgmCmd->cmdWidth = CY_SMIF_WIDTH_SINGLE;
+    pgmCmd->mode = CY_SMIF_NO_COMMAND_OR_MODE;
+    pgmCmd->dummyCycles = 0U;
+    pgmCmd->dataWidth = CY_SMIF_WIDTH_QUAD;
+
+    return CY_SMIF_SUCCESS;
+}
+
+/*
+ * Estimates the SPI clock cycles spent on the bus to program len bytes with
+ * the current program command (write enable + program command, address and
+ * data per page; busy polling is not included).
+ */
+uint32_t qspi_get_program_bus_cycles(cy_stc_smif_mem_config_t const *memCfg, uint32_t len)
+{
+    cy_stc_smif_mem_device_cfg_t const *dev = memCfg->deviceCfg;
+    cy_stc_smif_mem_cmd_t const *pgmCmd = dev->programCmd;
+    uint32_t page = (dev->programSize != 0U) ? dev->programSize : 256U;
+    uint32_t pages = (len + page - 1U) / page;
+    uint32_t per_page;
+
+    per_page  = 8U;                                                     /* Write enable */
+    per_page += 8U / qspi_width_lines(pgmCmd->cmdWidth);
+    per_page += (dev->numOfAddrBytes * 8U) / qspi_width_lines(pgmCmd->addrWidth);
+    per_page += pgmCmd->dummyCycles;
+
+    return (pages * per_page) + ((len * 8U) / qspi_width_lines(pgmCmd->dataWidth));
+}
+
 uint32_t qspi_get_prog_size(void)
 {
     cy_stc_smif_mem_config_t **memCfg = smifBlockConfig_sfdp.memConfig;
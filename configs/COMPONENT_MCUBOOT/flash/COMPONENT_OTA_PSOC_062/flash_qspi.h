@@ -54,6 +54,19 @@ uint32_t qspi_get_prog_size(void);
 uint32_t qspi_get_erase_size(void);
 uint32_t qspi_get_mem_size(void);
 
+cy_en_smif_status_t qspi_select_quad_program(SMIF_Type *base, cy_stc_smif_mem_config_t *memCfg,
+        cy_stc_smif_context_t *context);
+uint32_t qspi_get_program_bus_cycles(cy_stc_smif_mem_config_t const *memCfg, uint32_t len);
+
+#ifdef OTA_SMIF_DMA
+cy_en_smif_status_t qspi_dma_init(SMIF_Type *base);
+cy_en_smif_status_t qspi_dma_read(SMIF_Type *base, cy_stc_smif_mem_config_t const *memCfg,
+        uint32_t addr, uint8_t *data, uint32_t len, cy_stc_smif_context_t *context);
+cy_en_smif_status_t qspi_dma_write(SMIF_Type *base, cy_stc_smif_mem_config_t const *memCfg,
+        uint32_t addr, uint8_t const *data, uint32_t len, cy_stc_smif_context_t *context);
+uint64_t qspi_dma_get_idle_cycles(void);
+#endif
+
 SMIF_Type *qspi_get_device(void);
 cy_stc_smif_context_t *qspi_get_context(void);
 cy_stc_smif_mem_config_t *qspi_get_memory_config(uint8_t index);
@@ -0,0 +1,492 @@
+/******************************************************************************
+* File Name:   flash_qspi_dma.c
+*
+* Description: This file contains the DMA based QSPI flash read and program APIs
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2023-2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+
+#if defined(OTA_USE_EXTERNAL_FLASH) && defined(OTA_SMIF_DMA)
+
+#include <string.h>
+#include "cy_pdl.h"
+#include "flash_qspi.h"
+
+/* FreeRTOS */
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+
+/* DataWire block and channels moving the data between the buffers and the
+ * SMIF FIFOs. The channels must be the ones the SMIF tr_tx_req / tr_rx_req
+ * triggers are routed to. The defaults are the one-to-one trigger routes of
+ * the PSoC 62 devices.
+ */
+#ifndef QSPI_DMA_HW
+#define QSPI_DMA_HW                      DW1
+#endif
+#ifndef QSPI_DMA_TX_CHANNEL
+#define QSPI_DMA_TX_CHANNEL              (22U)
+#endif
+#ifndef QSPI_DMA_RX_CHANNEL
+#define QSPI_DMA_RX_CHANNEL              (23U)
+#endif
+#ifndef QSPI_DMA_TX_IRQ
+#define QSPI_DMA_TX_IRQ                  ((IRQn_Type)((uint32_t)cpuss_interrupts_dw1_0_IRQn + QSPI_DMA_TX_CHANNEL))
+#endif
+#ifndef QSPI_DMA_RX_IRQ
+#define QSPI_DMA_RX_IRQ                  ((IRQn_Type)((uint32_t)cpuss_interrupts_dw1_0_IRQn + QSPI_DMA_RX_CHANNEL))
+#endif
+
+/* Must not be above configMAX_SYSCALL_INTERRUPT_PRIORITY, the handler gives a semaphore */
+#ifndef QSPI_DMA_IRQ_PRIORITY
+#define QSPI_DMA_IRQ_PRIORITY            (7U)
+#endif
+
+/* Time allowed for one DMA transfer, and for one page program to finish */
+#define QSPI_DMA_TIMEOUT_MS              (100U)
+
+/* The memory busy status is polled this long before the task starts to sleep
+ * between polls. Page programs usually finish within it.
+ */
+#define QSPI_DMA_BUSY_SPIN_US            (400U)
+#define QSPI_DMA_BUSY_POLL_US            (20U)
+
+/* SMIF FIFO levels the triggers fire at: TX while at most 4 of 8 entries are
+ * used, RX as soon as one byte is received.
+ */
+#define QSPI_DMA_TX_TRIGGER_LEVEL        (4U)
+#define QSPI_DMA_RX_TRIGGER_LEVEL        (0U)
+
+/* A DW 2D descriptor moves up to 256 x 256 elements */
+#define QSPI_DMA_X_COUNT_MAX             (256U)
+#define QSPI_DMA_XFER_MAX                (QSPI_DMA_X_COUNT_MAX * QSPI_DMA_X_COUNT_MAX)
+
+#if defined (__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+#define QSPI_DMA_DCACHE_LINE             (__SCB_DCACHE_LINE_SIZE)
+#endif
+
+typedef struct
+{
+    uint32_t                 channel;
+    IRQn_Type                irq;
+    cy_stc_dma_descriptor_t  descriptor[2];
+    SemaphoreHandle_t        done;
+    StaticSemaphore_t        done_buffer;
+    volatile bool            error;
+} qspi_dma_channel_t;
+
+static qspi_dma_channel_t qspi_dma_tx = { .channel = QSPI_DMA_TX_CHANNEL, .irq = QSPI_DMA_TX_IRQ };
+static qspi_dma_channel_t qspi_dma_rx = { .channel = QSPI_DMA_RX_CHANNEL, .irq = QSPI_DMA_RX_IRQ };
+
+/* CPU cycles the calling task spent blocked while the transfers were running */
+static uint64_t qspi_dma_idle_cycles;
+
+static void qspi_dma_irq_handler(qspi_dma_channel_t *dma)
+{
+    BaseType_t woken = pdFALSE;
+
+    if (Cy_DMA_Channel_GetStatus(QSPI_DMA_HW, dma->channel) != CY_DMA_INTR_CAUSE_COMPLETION)
+    {
+        dma->error = true;
+    }
+    Cy_DMA_Channel_ClearInterrupt(QSPI_DMA_HW, dma->channel);
+
+    xSemaphoreGiveFromISR(dma->done, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static void qspi_dma_tx_isr(void)
+{
+    qspi_dma_irq_handler(&qspi_dma_tx);
+}
+
+static void qspi_dma_rx_isr(void)
+{
+    qspi_dma_irq_handler(&qspi_dma_rx);
+}
+
+static cy_en_smif_status_t qspi_dma_init_channel(qspi_dma_channel_t *dma, cy_israddress isr)
+{
+    cy_stc_sysint_t irq_cfg =
+    {
+        .intrSrc = dma->irq,
+        .intrPriority = QSPI_DMA_IRQ_PRIORITY,
+    };
+    cy_stc_dma_channel_config_t channel_cfg =
+    {
+        .descriptor = &dma->descriptor[0],
+        .preemptable = false,
+        .priority = 0U,
+        .enable = false,
+        .bufferable = false,
+    };
+
+    dma->done = xSemaphoreCreateBinaryStatic(&dma->done_buffer);
+    if (dma->done == NULL)
+    {
+        return CY_SMIF_BAD_PARAM;
+    }
+
+    if (Cy_DMA_Channel_Init(QSPI_DMA_HW, dma->channel, &channel_cfg) != CY_DMA_SUCCESS)
+    {
+        return CY_SMIF_BAD_PARAM;
+    }
+    Cy_DMA_Channel_SetInterruptMask(QSPI_DMA_HW, dma->channel, CY_DMA_INTR_MASK);
+
+    if (Cy_SysInt_Init(&irq_cfg, isr) != CY_SYSINT_SUCCESS)
+    {
+        return CY_SMIF_BAD_PARAM;
+    }
+    NVIC_EnableIRQ(dma->irq);
+
+    return CY_SMIF_SUCCESS;
+}
+
+/*
+ * Sets up the channel to move len bytes between a buffer and a SMIF FIFO
+ * register, one byte per trigger. A 2D descriptor moves the whole 256 byte
+ * blocks, a chained 1D descriptor the rest.
+ */
+static void qspi_dma_start(qspi_dma_channel_t *dma, void const *src, void *dst, uint32_t len, bool to_fifo)
+{
+    cy_stc_dma_descriptor_config_t cfg =
+    {
+        .retrigger       = CY_DMA_RETRIG_4CYC,
+        .interruptType   = CY_DMA_DESCR_CHAIN,
+        .triggerOutType  = CY_DMA_1ELEMENT,
+        .triggerInType   = CY_DMA_1ELEMENT,
+        .dataSize        = CY_DMA_BYTE,
+        .srcTransferSize = to_fifo ? CY_DMA_TRANSFER_SIZE_DATA : CY_DMA_TRANSFER_SIZE_WORD,
+        .dstTransferSize = to_fifo ? CY_DMA_TRANSFER_SIZE_WORD : CY_DMA_TRANSFER_SIZE_DATA,
+        .srcXincrement   = to_fifo ? 1 : 0,
+        .dstXincrement   = to_fifo ? 0 : 1,
+        .srcYincrement   = to_fifo ? (int32_t)QSPI_DMA_X_COUNT_MAX : 0,
+        .dstYincrement   = to_fifo ? 0 : (int32_t)QSPI_DMA_X_COUNT_MAX,
+    };
+    uint32_t blocks = len / QSPI_DMA_X_COUNT_MAX;
+    uint32_t rest = len % QSPI_DMA_X_COUNT_MAX;
+    cy_stc_dma_descriptor_t *first = &dma->descriptor[0];
+
+    if (blocks != 0U)
+    {
+        cfg.descriptorType = CY_DMA_2D_TRANSFER;
+        cfg.srcAddress     = (void *)src;
+        cfg.dstAddress     = dst;
+        cfg.xCount         = QSPI_DMA_X_COUNT_MAX;
+        cfg.yCount         = blocks;
+        cfg.channelState   = (rest != 0U) ? CY_DMA_CHANNEL_ENABLED : CY_DMA_CHANNEL_DISABLED;
+        cfg.nextDescriptor = (rest != 0U) ? &dma->descriptor[1] : NULL;
+        (void)Cy_DMA_Descriptor_Init(&dma->descriptor[0], &cfg);
+
+        if (to_fifo)
+        {
+            src = (uint8_t const *)src + (blocks * QSPI_DMA_X_COUNT_MAX);
+        }
+        else
+        {
+            dst = (uint8_t *)dst + (blocks * QSPI_DMA_X_COUNT_MAX);
+        }
+    }
+    else
+    {
+        first = &dma->descriptor[1];
+    }
+
+    if (rest != 0U)
+    {
+        cfg.descriptorType = CY_DMA_1D_TRANSFER;
+        cfg.srcAddress     = (void *)src;
+        cfg.dstAddress     = dst;
+        cfg.xCount         = rest;
+        cfg.yCount         = 1U;
+        cfg.channelState   = CY_DMA_CHANNEL_DISABLED;
+        cfg.nextDescriptor = NULL;
+        (void)Cy_DMA_Descriptor_Init(&dma->descriptor[1], &cfg);
+    }
+
+    dma->error = false;
+    (void)xSemaphoreTake(dma->done, 0);
+    Cy_DMA_Channel_SetDescriptor(QSPI_DMA_HW, dma->channel, first);
+    Cy_DMA_Channel_Enable(QSPI_DMA_HW, dma->channel);
+}
+
+/* Blocks the calling task until the channel signals completion */
+static cy_en_smif_status_t qspi_dma_wait(qspi_dma_channel_t *dma)
+{
+    uint32_t start = DWT->CYCCNT;
+    BaseType_t taken;
+
+    taken = xSemaphoreTake(dma->done, pdMS_TO_TICKS(QSPI_DMA_TIMEOUT_MS));
+    qspi_dma_idle_cycles += (uint64_t)(DWT->CYCCNT - start);
+
+    if (taken != pdTRUE)
+    {
+        Cy_DMA_Channel_Disable(QSPI_DMA_HW, dma->channel);
+        return CY_SMIF_EXCEED_TIMEOUT;
+    }
+    return dma->error ? CY_SMIF_GENERAL_ERROR : CY_SMIF_SUCCESS;
+}
+
+/* Waits for the SMIF to shift out the last FIFO entries of the transfer */
+static cy_en_smif_status_t qspi_dma_wait_smif_idle(SMIF_Type *base)
+{
+    uint32_t timeout_us = QSPI_DMA_TIMEOUT_MS * 1000U;
+
+    while (Cy_SMIF_BusyCheck(base))
+    {
+        if (timeout_us == 0U)
+        {
+            return CY_SMIF_EXCEED_TIMEOUT;
+        }
+        Cy_SysLib_DelayUs(1U);
+        timeout_us--;
+    }
+    return CY_SMIF_SUCCESS;
+}
+
+/*
+ * Waits for the memory to finish a program. The status is polled for a short
+ * time first, then the task sleeps a tick between polls so the CPU is free
+ * for the other tasks during long programs.
+ */
+static cy_en_smif_status_t qspi_dma_wait_mem_ready(SMIF_Type *base, cy_stc_smif_mem_config_t const *memCfg,
+        cy_stc_smif_context_t const *context)
+{
+    uint32_t spin_us = 0U;
+    TickType_t start_tick = xTaskGetTickCount();
+
+    while (Cy_SMIF_MemIsBusy(base, memCfg, context))
+    {
+        if (spin_us < QSPI_DMA_BUSY_SPIN_US)
+        {
+            Cy_SysLib_DelayUs(QSPI_DMA_BUSY_POLL_US);
+            spin_us += QSPI_DMA_BUSY_POLL_US;
+        }
+        else
+        {
+            uint32_t start = DWT->CYCCNT;
+
+            if ((xTaskGetTickCount() - start_tick) > pdMS_TO_TICKS(QSPI_DMA_TIMEOUT_MS))
+            {
+                return CY_SMIF_EXCEED_TIMEOUT;
+            }
+            vTaskDelay(1);
+            qspi_dma_idle_cycles += (uint64_t)(DWT->CYCCNT - start);
+        }
+    }
+    return CY_SMIF_SUCCESS;
+}
+
+/*
+ * Sends the command, address, mode and dummy cycles of a memory command,
+ * leaving the chip select asserted for the data phase.
+ */
+static cy_en_smif_status_t qspi_dma_send_command(SMIF_Type *base, cy_stc_smif_mem_config_t const *memCfg,
+        cy_stc_smif_mem_cmd_t const *cmd, uint32_t addr, cy_stc_smif_context_t *context)
+{
+    cy_en_smif_status_t st;
+    uint32_t addr_size = memCfg->deviceCfg->numOfAddrBytes;
+    uint8_t addr_bytes[CY_SMIF_FOUR_BYTES_ADDR];
+    uint32_t i;
+
+    for (i = 0U; i < addr_size; i++)
+    {
+        addr_bytes[i] = (uint8_t)(addr >> (8U * (addr_size - 1U - i)));
+    }
+
+    st = Cy_SMIF_TransmitCommand(base, (uint8_t)cmd->command, cmd->cmdWidth,
+            addr_bytes, addr_size, cmd->addrWidth,
+            memCfg->slaveSelect, CY_SMIF_TX_NOT_LAST_BYTE, context);
+    if ((st == CY_SMIF_SUCCESS) && (cmd->mode != CY_SMIF_NO_COMMAND_OR_MODE))
+    {
+        uint8_t mode = (uint8_t)cmd->mode;
+
+        st = Cy_SMIF_TransmitCommand(base, mode, cmd->modeWidth, NULL, 0U, cmd->modeWidth,
+                memCfg->slaveSelect, CY_SMIF_TX_NOT_LAST_BYTE, context);
+    }
+    if ((st == CY_SMIF_SUCCESS) && (cmd->dummyCycles != 0U))
+    {
+        st = Cy_SMIF_SendDummyCycles(base, cmd->dummyCycles);
+    }
+    return st;
+}
+
+cy_en_smif_status_t qspi_dma_init(SMIF_Type *base)
+{
+    cy_en_smif_status_t st;
+
+    Cy_SMIF_SetTxFifoTriggerLevel(base, QSPI_DMA_TX_TRIGGER_LEVEL);
+    Cy_SMIF_SetRxFifoTriggerLevel(base, QSPI_DMA_RX_TRIGGER_LEVEL);
+
+    Cy_DMA_Enable(QSPI_DMA_HW);
+
+    st = qspi_dma_init_channel(&qspi_dma_tx, &qspi_dma_tx_isr);
+    if (st == CY_SMIF_SUCCESS)
+    {
+        st = qspi_dma_init_channel(&qspi_dma_rx, &qspi_dma_rx_isr);
+    }
+    return st;
+}
+
+/*
+ * Reads len bytes at addr with the read command of the memory, the RX FIFO
+ * is drained by the RX DMA channel. The calling task is blocked until the
+ * transfer is done.
+ */
+cy_en_smif_status_t qspi_dma_read(SMIF_Type *base, cy_stc_smif_mem_config_t const *memCfg,
+        uint32_t addr, uint8_t *data, uint32_t len, cy_stc_smif_context_t *context)
+{
+    cy_stc_smif_mem_cmd_t const *cmd = memCfg->deviceCfg->readCmd;
+    cy_en_smif_status_t st = CY_SMIF_SUCCESS;
+#if defined (QSPI_DMA_DCACHE_LINE)
+    uint8_t *buffer = data;
+    uint32_t buffer_len = len;
+#endif
+
+#if defined (QSPI_DMA_DCACHE_LINE)
+    /* Invalidating would drop the CPU writes sharing the partial cache lines */
+    if (((((uint32_t)data) | len) & (QSPI_DMA_DCACHE_LINE - 1U)) != 0U)
+    {
+        return Cy_SMIF_MemRead(base, memCfg, addr, data, len, context);
+    }
+    SCB_CleanInvalidateDCache_by_Addr((void *)data, (int32_t)len);
+#endif
+
+    while ((st == CY_SMIF_SUCCESS) && (len > 0U))
+    {
+        uint32_t size = (len > QSPI_DMA_XFER_MAX) ? QSPI_DMA_XFER_MAX : len;
+
+        qspi_dma_start(&qspi_dma_rx, (void const *)&base->RX_DATA_FIFO_RD1, data, size, false);
+
+        st = qspi_dma_send_command(base, memCfg, cmd, addr, context);
+        if (st == CY_SMIF_SUCCESS)
+        {
+            /* NULL buffer: no SMIF interrupt, the FIFO is drained by the DMA */
+            st = Cy_SMIF_ReceiveData(base, NULL, size, cmd->dataWidth, NULL, context);
+        }
+        if (st == CY_SMIF_SUCCESS)
+        {
+            st = qspi_dma_wait(&qspi_dma_rx);
+        }
+        else
+        {
+            Cy_DMA_Channel_Disable(QSPI_DMA_HW, qspi_dma_rx.channel);
+        }
+
+        addr += size;
+        data += size;
+        len -= size;
+    }
+
+#if defined (QSPI_DMA_DCACHE_LINE)
+    /* Drops the lines the CPU may have speculatively fetched during the transfer */
+    SCB_InvalidateDCache_by_Addr((void *)buffer, (int32_t)buffer_len);
+#endif
+
+    return st;
+}
+
+/*
+ * Programs len bytes at addr, one memory page per program command. The TX
+ * FIFO is filled by the TX DMA channel and the calling task is blocked
+ * while the data is sent and the memory programs it.
+ */
+cy_en_smif_status_t qspi_dma_write(SMIF_Type *base, cy_stc_smif_mem_config_t const *memCfg,
+        uint32_t addr, uint8_t const *data, uint32_t len, cy_stc_smif_context_t *context)
+{
+    cy_stc_smif_mem_cmd_t const *cmd = memCfg->deviceCfg->programCmd;
+    uint32_t page_size = memCfg->deviceCfg->programSize;
+    cy_en_smif_status_t st = CY_SMIF_SUCCESS;
+
+#if defined (QSPI_DMA_DCACHE_LINE)
+    /* The DMA reads the buffer from memory, not from the cache */
+    SCB_CleanDCache_by_Addr((void *)data, (int32_t)len);
+#endif
+
+    while ((st == CY_SMIF_SUCCESS) && (len > 0U))
+    {
+        uint32_t size = page_size - (addr % page_size);
+
+        if (size > len)
+        {
+            size = len;
+        }
+
+        st = Cy_SMIF_MemCmdWriteEnable(base, memCfg, context);
+        if (st == CY_SMIF_SUCCESS)
+        {
+            qspi_dma_start(&qspi_dma_tx, data, (void *)&base->TX_DATA_FIFO_WR1, size, true);
+
+            st = qspi_dma_send_command(base, memCfg, cmd, addr, context);
+            if (st == CY_SMIF_SUCCESS)
+            {
+                /* NULL buffer: no SMIF interrupt, the FIFO is filled by the DMA */
+                st = Cy_SMIF_TransmitData(base, NULL, size, cmd->dataWidth, NULL, context);
+            }
+            if (st == CY_SMIF_SUCCESS)
+            {
+                st = qspi_dma_wait(&qspi_dma_tx);
+            }
+            else
+            {
+                Cy_DMA_Channel_Disable(QSPI_DMA_HW, qspi_dma_tx.channel);
+            }
+        }
+        if (st == CY_SMIF_SUCCESS)
+        {
+            st = qspi_dma_wait_smif_idle(base);
+        }
+        if (st == CY_SMIF_SUCCESS)
+        {
+            st = qspi_dma_wait_mem_ready(base, memCfg, context);
+        }
+
+        addr += size;
+        data += size;
+        len -= size;
+    }
+
+    return st;
+}
+
+uint64_t qspi_dma_get_idle_cycles(void)
+{
+    return qspi_dma_idle_cycles;
+}
+
+#endif /* OTA_USE_EXTERNAL_FLASH & OTA_SMIF_DMA */
@@ -48,11 +48,21 @@
 #include "cyhal.h"
 #include "cybsp.h"
 #include "cy_ota_flash.h"
+#include "cy_ota_flash_ext.h"
+#include "ota_log_token.h"
+#include "ota_cycles.h"
 
 #if !(defined (CYW20829B0LKML) || defined (CYW89829B01MKSBG))
 #include <cycfg_pins.h>
 #endif
 
+#if defined (COMPONENT_OTA_PSOC_062)
+#include "flash_qspi.h"
+#endif
+
+#include "FreeRTOS.h"
+#include "task.h"
+
 /**********************************************************************************************************************************
  * local defines
  **********************************************************************************************************************************/
@@ -82,6 +92,20 @@
 #define DCACHE_BYTE_ALIGNEMNT       (__SCB_DCACHE_LINE_SIZE)
 #endif
 
+#if defined (XMC7100) || defined (XMC7200)
+/* Number of contiguous rows programmed within one critical section */
+#ifndef OTA_XMC_FLASH_ROWS_PER_BATCH
+#define OTA_XMC_FLASH_ROWS_PER_BATCH        (4u)
+#endif
+#if (OTA_XMC_FLASH_ROWS_PER_BATCH < 1) || (OTA_XMC_FLASH_ROWS_PER_BATCH > 32)
+#error "OTA_XMC_FLASH_ROWS_PER_BATCH must be 1 to 32"
+#endif
+
+/* Code flash large sector, the erase unit of the MCUboot slots */
+#define OTA_XMC_FLASH_SECTOR_SIZE           (0x8000u)
+#define OTA_XMC_FLASH_SECTORS               (CY_FLASH_SIZE / OTA_XMC_FLASH_SECTOR_SIZE)
+#endif /* XMC7100/XMC7200 */
+
 #if (defined (CY_IP_MXSMIF) && !defined (XMC7100) && !defined (XMC7200))
 /* UN-comment to test the write functionality */
 //#define READBACK_SMIF_WRITE_TEST
@@ -116,6 +140,25 @@
  * XIP environments.
  */
 
+#ifdef CY_OTA_XIP_RAM_ISR
+/*
+ * The RTOS tick, SDIO and host wake interrupt paths are linked into RAM by
+ * linker_xip_ram_isr.ld, so only the interrupts whose handler is placed in
+ * XIP are masked while XIP is off. The scheduler is suspended so that no
+ * task placed in XIP is switched in.
+ */
+#define PRE_SMIF_ACCESS_TURN_OFF_XIP \
+                    ota_xip_irq_state_t xipIrqState;                    \
+                    ota_xip_ram_isr_enter(&xipIrqState);                \
+                    while(Cy_SMIF_BusyCheck(SMIF0));    \
+                    (void)Cy_SMIF_SetMode(SMIF0, CY_SMIF_NORMAL);
+
+#define POST_SMIF_ACCESS_TURN_ON_XIP \
+                    while(Cy_SMIF_BusyCheck(SMIF0));    \
+                    (void)Cy_SMIF_SetMode(SMIF0, CY_SMIF_MEMORY);   \
+                    ota_xip_ram_isr_exit(&xipIrqState);
+
+#else
 #define PRE_SMIF_ACCESS_TURN_OFF_XIP \
                     uint32_t interruptState;                            \
                     interruptState = Cy_SysLib_EnterCriticalSection();  \
@@ -126,6 +169,7 @@
                     while(Cy_SMIF_BusyCheck(SMIF0));    \
                     (void)Cy_SMIF_SetMode(SMIF0, CY_SMIF_MEMORY);   \
                     Cy_SysLib_ExitCriticalSection(interruptState);
+#endif /* CY_OTA_XIP_RAM_ISR */
 
 
 #else
@@ -135,6 +179,43 @@
 
 #define CY_BOOT_TRAILER_MAX_UPDATE_SIZE             (16)
 
+/* Trailer writes are programmed in units of the SMIF AES block size */
+#define CY_BOOT_TRAILER_BLOCK_SIZE                  (16u)
+
+/* Set to 0 to keep the page program command detected by SFDP */
+#ifndef OTA_QSPI_QUAD_PROGRAM
+#define OTA_QSPI_QUAD_PROGRAM                       (1)
+#endif
+
+/* OTA_SMIF_DMA (SMIF_DMA=1 in the Makefile) moves the external flash data
+ * with DataWire channels and blocks the calling task instead of polling the
+ * SMIF FIFOs. The task must be able to sleep, so XIP builds cannot use it.
+ */
+#ifdef OTA_SMIF_DMA
+#if !defined (COMPONENT_OTA_PSOC_062) || defined (CY_XIP_SMIF_MODE_CHANGE)
+#error "OTA_SMIF_DMA is supported only with the external flash of PSOC_062_2M"
+#endif
+#endif
+
+/* Size the program time is reported for. When the quad input page program is
+ * selected, this many bytes of the first writes are programmed with the basic
+ * command detected by SFDP, so both commands are timed on the same part.
+ */
+#define OTA_PROGRAM_STATS_CHUNK_SIZE                (4096u)
+
+/* Number of external flash rows kept by the read cache, 0 disables the cache */
+#ifndef OTA_MEM_READ_CACHE_ROWS
+#define OTA_MEM_READ_CACHE_ROWS                     (4u)
+#endif
+
+/* Reads longer than this bypass the read cache */
+#define OTA_MEM_READ_CACHE_MAX_LEN                  (2u * CY_FLASH_SIZEOF_ROW)
+
+/* The external flash is held for at most this much of a read, one row of a
+ * write or one sector of an erase, see cy_ota_mem_acquire()
+ */
+#define OTA_MEM_ARBITER_READ_CHUNK                  (4096u)
+
 /**********************************************************************************************************************************
  * local variables & data
  **********************************************************************************************************************************/
@@ -162,13 +243,137 @@ extern const cy_stc_smif_block_config_t smifBlockConfig;
 /* Used for testing the write functionality */
 static uint8_t read_back_test[1024];
 #endif
+
+#if (OTA_MEM_READ_CACHE_ROWS > 0)
+/* Write-invalidated LRU cache of recently read external flash rows */
+typedef struct
+{
+    uint32_t row_base;                      /* SMIF offset of the cached row */
+    uint32_t last_use;                      /* LRU stamp, 0 if the entry is empty */
+    uint8_t  data[CY_FLASH_SIZEOF_ROW];
+} ota_read_cache_entry_t;
+
+static ota_read_cache_entry_t    ota_read_cache[OTA_MEM_READ_CACHE_ROWS];
+static uint32_t                  ota_read_cache_clock;
+#endif
+
+#if defined(CY_XIP_SMIF_MODE_CHANGE) && defined(CY_OTA_XIP_RAM_ISR)
+/* Number of 32-bit NVIC enable registers that can hold interrupts */
+#define OTA_XIP_NVIC_WORDS                          (8u)
+
+/* Offset of the first device interrupt in the vector table */
+#define OTA_XIP_VECTOR_IRQ_OFFSET                   (16u)
+
+typedef struct
+{
+    uint32_t masked[OTA_XIP_NVIC_WORDS];    /* Interrupts disabled by ota_xip_ram_isr_enter() */
+    bool     scheduler_suspended;
+} ota_xip_irq_state_t;
+
+/**
+ * @brief Suspends the scheduler and disables only the enabled interrupts
+ *        whose handler in the RAM vector table is placed in XIP.
+ *
+ * @param[out]  state   Interrupt state to be restored by ota_xip_ram_isr_exit()
+ */
+static void ota_xip_ram_isr_enter(ota_xip_irq_state_t *state)
+{
+    const uint32_t *vectors = (const uint32_t *)SCB->VTOR;
+    uint32_t words = (SCnSCB->ICTR & SCnSCB_ICTR_INTLINESNUM_Msk) + 1u;
+    uint32_t interruptState;
+    uint32_t word, bit;
+
+    if (words > OTA_XIP_NVIC_WORDS)
+    {
+        words = OTA_XIP_NVIC_WORDS;
+    }
+
+    state->scheduler_suspended = (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING);
+    if (state->scheduler_suspended)
+    {
+        vTaskSuspendAll();
+    }
+
+    interruptState = Cy_SysLib_EnterCriticalSection();
+    for (word = 0; word < OTA_XIP_NVIC_WORDS; word++)
+    {
+        state->masked[word] = 0u;
+        if (word >= words)
+        {
+            continue;
+        }
+        for (bit = 0; bit < 32u; bit++)
+        {
+            uint32_t handler;
+
+            if ((NVIC->ISER[word] & (1ul << bit)) == 0u)
+            {
+                continue;
+            }
+            handler = vectors[OTA_XIP_VECTOR_IRQ_OFFSET + (word * 32u) + bit] & ~1ul;
+            if ((handler >= CY_XIP_BASE) && (handler < (CY_XIP_BASE + CY_XIP_SIZE)))
+            {
+                state->masked[word] |= (1ul << bit);
+            }
+        }
+        NVIC->ICER[word] = state->masked[word];
+    }
+    __DSB();
+    __ISB();
+    Cy_SysLib_ExitCriticalSection(interruptState);
+}
+
+/**
+ * @brief Re-enables the interrupts disabled by ota_xip_ram_isr_enter()
+ *        and resumes the scheduler.
+ *
+ * @param[in]   state   Interrupt state saved by ota_xip_ram_isr_enter()
+ */
+static void ota_xip_ram_isr_exit(const ota_xip_irq_state_t *state)
+{
+    uint32_t word;
+
+    for (word = 0; word < OTA_XIP_NVIC_WORDS; word++)
+    {
+        if (state->masked[word] != 0u)
+        {
+            NVIC->ISER[word] = state->masked[word];
+        }
+    }
+
+    if (state->scheduler_suspended)
+    {
+        (void)xTaskResumeAll();
+    }
+}
+#endif /* CY_XIP_SMIF_MODE_CHANGE & CY_OTA_XIP_RAM_ISR */
 #endif /* CY_IP_MXSMIF & !XMC7100 & !XMC7200 */
 
+static cy_ota_mem_trailer_stats_t    ota_trailer_stats;
+static cy_ota_mem_read_cache_stats_t ota_read_cache_stats;
+static cy_ota_mem_program_stats_t    ota_program_stats;
+
+#if defined (COMPONENT_OTA_PSOC_062) && (OTA_QSPI_QUAD_PROGRAM != 0)
+/* Page program commands, the basic one is used for the timing sample only */
+static cy_stc_smif_mem_cmd_t ota_program_cmd_basic;
+static cy_stc_smif_mem_cmd_t ota_program_cmd_quad;
+#endif
+static cy_ota_mem_row_stats_t        ota_row_stats;
+static cy_ota_mem_transfer_stats_t   ota_transfer_stats;
+
+/* Task whose erases are skipped, see cy_ota_mem_erase_hold() */
+static TaskHandle_t                  ota_erase_hold_task;
+
 #ifdef ENABLE_ON_THE_FLY_ENCRYPTION
 /**
  * @brief Local buffer for data flash write
  */
 uint8_t *write_buffer = NULL;
+
+#ifdef OTA_STATIC_ALLOCATION
+/* cy_ota_mem_write() passes the external flash writes on one row at a time */
+CY_ALIGN(4) static uint8_t write_buffer_storage[CY_FLASH_SIZEOF_ROW];
+#endif
 #endif
 
 /**********************************************************************************************************************************
@@ -177,6 +382,10 @@ uint8_t *write_buffer = NULL;
 #ifdef ENABLE_ON_THE_FLY_ENCRYPTION
 static bool ota_allocate_write_buffer(uint64_t size)
 {
+#ifdef OTA_STATIC_ALLOCATION
+    write_buffer = (size <= sizeof(write_buffer_storage)) ? write_buffer_storage : NULL;
+    return (write_buffer != NULL);
+#else
     if(write_buffer != NULL)
     {
         free(write_buffer);
@@ -192,15 +401,18 @@ static bool ota_allocate_write_buffer(uint64_t size)
     {
         return true;
     }
+#endif
 }
 
 static void ota_free_write_buffer(void)
 {
+#ifndef OTA_STATIC_ALLOCATION
     if(write_buffer != NULL)
     {
         free(write_buffer);
-        write_buffer = NULL;
     }
+#endif
+    write_buffer = NULL;
 }
 
 static uint32_t cy_flash_addr_to_cbus_addr(uint32_t secondary_addr)
@@ -348,6 +560,23 @@ static int psoc6_internal_flash_write(uint8_t data[], uint32_t address, size_t l
         while((srcIndex < len) && (rc == CY_FLASH_DRV_SUCCESS))
         {
             rowsNotEqual = 0u;
+
+            /* A whole row from an aligned source is programmed in place */
+            if((byteOffset >= eeOffset) && ((len - srcIndex) >= CY_FLASH_SIZEOF_ROW) &&
+               ((((uint32_t)&data[srcIndex]) & (sizeof(uint32_t) - 1u)) == 0u))
+            {
+                if(memcmp((const void *)(CY_FLASH_BASE + byteOffset), &data[srcIndex], CY_FLASH_SIZEOF_ROW) != 0)
+                {
+                    rc = Cy_Flash_WriteRow((rowId * CY_FLASH_SIZEOF_ROW) + CY_FLASH_BASE, (const uint32_t *)&data[srcIndex]);
+                }
+                ota_row_stats.in_place++;
+                srcIndex += CY_FLASH_SIZEOF_ROW;
+                byteOffset += CY_FLASH_SIZEOF_ROW;
+                rowId++;
+                continue;
+            }
+
+            ota_row_stats.staged++;
             /* Copy data to the write buffer either from the source buffer or from the flash */
             for(dstIndex = 0u; dstIndex < CY_FLASH_SIZEOF_ROW; dstIndex++)
             {
@@ -484,44 +713,130 @@ static int psoc6_internal_flash_erase(uint32_t addr, size_t size)
 #endif
 
 #if defined (XMC7100) || defined (XMC7200)
+/*
+ * Sectors whose erase is deferred. cy_ota_mem_erase() only marks the sectors,
+ * they are erased when first programmed or read, and the sector after a
+ * programmed one is erased ahead of the program cursor. The slot erase then no
+ * longer delays the first chunk of a download, and the sectors past the image
+ * are erased at the first trailer write. A resumed download does not rely on
+ * this RAM state: ota_resume.c erases the storage past its checkpoint again.
+ */
+static uint8_t xmc_erase_pending[(OTA_XMC_FLASH_SECTORS + 7u) / 8u];
+
+static bool xmc_erase_is_pending(uint32_t sector)
+{
+    return (xmc_erase_pending[sector / 8u] & (1u << (sector % 8u))) != 0u;
+}
+
+/* The code flash cannot be read while a sector is erased, interrupts are
+ * disabled and the erase runs from RAM.
+ */
 CY_SECTION_RAMFUNC_BEGIN
-static int xmc_internal_flash_erase(uint32_t addr, size_t size)
+static int xmc_erase_sector(uint32_t sector)
 {
-    int rc                   = 0;
-    uint32_t row_addr        = 0u;
-    uint32_t erase_sz        = 0x8000U; //32KB
+    uint32_t sector_addr = CY_FLASH_BASE + (sector * OTA_XMC_FLASH_SECTOR_SIZE);
     cy_en_flashdrv_status_t flashEraseStatus;
+    int intr_status;
 
-    /* flash_area_write() uses offsets, we need absolute address here */
-    addr += CY_FLASH_BASE;
+    intr_status = Cy_SysLib_EnterCriticalSection();
+    flashEraseStatus = Cy_Flash_EraseSector(sector_addr);
+    Cy_SysLib_ExitCriticalSection(intr_status);
 
-    uintptr_t erase_end_addr = addr + size;
-    uint32_t row_start_addr  = (addr / erase_sz) * erase_sz;
-    uint32_t row_end_addr    = (erase_end_addr / erase_sz) * erase_sz;
-    uint32_t row_number      = (row_end_addr - row_start_addr) / erase_sz;
+#if !defined (CY_DISABLE_XMC7000_DATA_CACHE) && defined (__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+    /* Drop stale cached copies of the erased sector */
+    SCB_InvalidateDCache_by_Addr((void *)sector_addr, (int32_t)OTA_XMC_FLASH_SECTOR_SIZE);
+#endif
 
-    /* assume single row needs to be erased */
-    if (row_start_addr == row_end_addr) {
-        row_number = 1U;
+    if (flashEraseStatus != CY_FLASH_DRV_SUCCESS)
+    {
+        return 1;
     }
+    xmc_erase_pending[sector / 8u] &= (uint8_t)~(1u << (sector % 8u));
+    return 0;
+}
+CY_SECTION_RAMFUNC_END
 
-    while (row_number != 0u) {
-        row_number--;
-        row_addr = row_start_addr + row_number * (uint32_t)erase_sz;
+/*
+ * Erases the pending sectors of the absolute range [addr, addr + len), and
+ * with ahead set the sector after it.
+ */
+static int xmc_erase_ahead(uint32_t addr, size_t len, bool ahead)
+{
+    uint32_t sector;
+    uint32_t last;
+
+    if ((len == 0u) || (addr < CY_FLASH_BASE) || ((addr - CY_FLASH_BASE) >= CY_FLASH_SIZE))
+    {
+        return 0;
+    }
 
-        flashEraseStatus = Cy_Flash_EraseSector((uint32_t) row_addr);
-        if (flashEraseStatus != CY_FLASH_DRV_SUCCESS)
+    sector = (addr - CY_FLASH_BASE) / OTA_XMC_FLASH_SECTOR_SIZE;
+    last = ((addr - CY_FLASH_BASE) + (uint32_t)len - 1u) / OTA_XMC_FLASH_SECTOR_SIZE;
+    if (ahead)
+    {
+        last++;
+    }
+
+    for (; (sector <= last) && (sector < OTA_XMC_FLASH_SECTORS); sector++)
+    {
+        if (xmc_erase_is_pending(sector) && (xmc_erase_sector(sector) != 0))
         {
-            rc = 1;
-            break;
-        } else {
-            rc = 0;
+            return 1;
         }
     }
+    return 0;
+}
 
-    return rc;
+/* Erases every pending sector */
+static int xmc_erase_pending_all(void)
+{
+    uint32_t sector;
+
+    for (sector = 0u; sector < OTA_XMC_FLASH_SECTORS; sector++)
+    {
+        if (xmc_erase_is_pending(sector) && (xmc_erase_sector(sector) != 0))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Marks the 32 KB sectors of a range for erase, see xmc_erase_pending[]
+ */
+static int xmc_internal_flash_erase(uint32_t addr, size_t size)
+{
+    uint32_t sector;
+    uint32_t last;
+
+    /* flash_area_write() uses offsets, the sectors are counted from CY_FLASH_BASE */
+    if ((size == 0u) || (addr >= CY_FLASH_SIZE) || (size > (CY_FLASH_SIZE - addr)))
+    {
+        return 1;
+    }
+
+    sector = addr / OTA_XMC_FLASH_SECTOR_SIZE;
+    last = (addr + (uint32_t)size - 1u) / OTA_XMC_FLASH_SECTOR_SIZE;
+    for (; sector <= last; sector++)
+    {
+        xmc_erase_pending[sector / 8u] |= (uint8_t)(1u << (sector % 8u));
+    }
+
+    /* The last sector holds the trailer of a slot, an earlier trailer must
+     * not survive a download that stops before the trailer flush
+     */
+    return xmc_erase_sector(last);
 }
-CY_SECTION_RAMFUNC_END
+
+/*
+ * Rows staged for programming. Contiguous rows are programmed together within
+ * one critical section. The buffer is static and aligned to the D-cache line
+ * so that it can be cleaned to memory before the flash controller reads it.
+ * Whole rows of an aligned source are programmed from the source and cleaned
+ * in place.
+ */
+CY_ALIGN(32) static uint8_t xmc_write_buffer[OTA_XMC_FLASH_ROWS_PER_BATCH * CY_FLASH_SIZEOF_ROW];
 
 /*
  * Writes `len` bytes of flash memory at `off` from the buffer at `src`
@@ -537,74 +852,115 @@ static int xmc_internal_flash_write(uint8_t data[], uint32_t address, size_t len
     uint32_t srcIndex = 0u;
     uint32_t eeOffset;
     uint32_t byteOffset;
+    uint32_t batchRowId;
+    uint32_t batchRows;
     uint32_t rowsNotEqual;
+    uint32_t row;
     uint8_t *writeBufferPointer;
+    uint8_t *rowSource[OTA_XMC_FLASH_ROWS_PER_BATCH];
     eeOffset = (uint32_t)address;
     bool cond1;
 
-#if !defined (CY_DISABLE_XMC7000_DATA_CACHE) && defined (__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
-    uint8_t *local_buffer = 0, *aligned_local_buffer = 0;
-    bool iscacheable = false;
-
-    local_buffer = (uint8_t *)malloc((CY_FLASH_SIZEOF_ROW) + (2 * DCACHE_BYTE_ALIGNEMNT));
-    if(NULL == local_buffer)
-    {
-        return -1;
-    }
-    aligned_local_buffer = (uint8_t*)((size_t)local_buffer + ((size_t)32 - ((size_t)local_buffer & 0x1F)));
-    writeBufferPointer = aligned_local_buffer;
-    iscacheable = true;
-#else
-    uint32_t writeBuffer[CY_FLASH_SIZEOF_ROW / sizeof(uint32_t)];
-    writeBufferPointer = (uint8_t*)writeBuffer;
-#endif
-
     /* Make sure, that varFlash[] points to Flash */
     cond1 = ((eeOffset >= CY_FLASH_BASE) && ((eeOffset + len) <= (CY_FLASH_BASE + CY_FLASH_SIZE)));
 
     if(cond1)
     {
+        /* Erase the sectors of this write and the next one, ahead of the program cursor */
+        if(xmc_erase_ahead(eeOffset, len, true) != 0)
+        {
+            return 2;
+        }
+
         eeOffset -= CY_FLASH_BASE;
         rowId = eeOffset / CY_FLASH_SIZEOF_ROW;
         byteOffset = CY_FLASH_SIZEOF_ROW * rowId;
 
         while((srcIndex < len) && (rc == CY_FLASH_DRV_SUCCESS))
         {
+            /* Stage up to OTA_XMC_FLASH_ROWS_PER_BATCH rows, one bit per row that differs from the flash */
             rowsNotEqual = 0u;
-            /* Copy data to the write buffer either from the source buffer or from the flash */
-            for(dstIndex = 0u; dstIndex < CY_FLASH_SIZEOF_ROW; dstIndex++)
+            batchRowId = rowId;
+            for(batchRows = 0u; (batchRows < OTA_XMC_FLASH_ROWS_PER_BATCH) && (srcIndex < len); batchRows++)
             {
-                if((byteOffset >= eeOffset) && (srcIndex < len))
+                /* A whole row from an aligned source is programmed in place */
+                if((byteOffset >= eeOffset) && ((len - srcIndex) >= CY_FLASH_SIZEOF_ROW) &&
+                   ((((uint32_t)&data[srcIndex]) & (sizeof(uint32_t) - 1u)) == 0u))
                 {
-                    writeBufferPointer[dstIndex] = data[srcIndex];
-                    /* Detect that row programming is required */
-                    if((rowsNotEqual == 0u) && ( (CY_GET_REG8(CY_FLASH_BASE + byteOffset) != data[srcIndex]) ) )
+                    rowSource[batchRows] = &data[srcIndex];
+                    for(dstIndex = 0u; dstIndex < CY_FLASH_SIZEOF_ROW; dstIndex++)
                     {
-                        rowsNotEqual = 1u;
+                        if(CY_GET_REG8(CY_FLASH_BASE + byteOffset) != data[srcIndex])
+                        {
+                            rowsNotEqual |= (1ul << batchRows);
+                        }
+                        srcIndex++;
+                        byteOffset++;
                     }
-                    srcIndex++;
+                    ota_row_stats.in_place++;
+                    rowId++;
+                    continue;
                 }
-                else
+
+                writeBufferPointer = &xmc_write_buffer[batchRows * CY_FLASH_SIZEOF_ROW];
+                rowSource[batchRows] = writeBufferPointer;
+                ota_row_stats.staged++;
+
+                /* Copy data to the write buffer either from the source buffer or from the flash */
+                for(dstIndex = 0u; dstIndex < CY_FLASH_SIZEOF_ROW; dstIndex++)
                 {
-                    writeBufferPointer[dstIndex] = CY_GET_REG8(CY_FLASH_BASE + byteOffset);
+                    if((byteOffset >= eeOffset) && (srcIndex < len))
+                    {
+                        writeBufferPointer[dstIndex] = data[srcIndex];
+                        /* Detect that row programming is required */
+                        if(CY_GET_REG8(CY_FLASH_BASE + byteOffset) != data[srcIndex])
+                        {
+                            rowsNotEqual |= (1ul << batchRows);
+                        }
+                        srcIndex++;
+                    }
+                    else
+                    {
+                        writeBufferPointer[dstIndex] = CY_GET_REG8(CY_FLASH_BASE + byteOffset);
+                    }
+                    byteOffset++;
                 }
-                byteOffset++;
+
+                /* Go to the next row */
+                rowId++;
             }
 
             if(rowsNotEqual != 0u)
             {
                 int intr_status = 0;
+
+#if !defined (CY_DISABLE_XMC7000_DATA_CACHE) && defined (__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+                for(row = 0u; row < batchRows; row++)
+                {
+                    SCB_CleanDCache_by_Addr((void *)rowSource[row], (int32_t)CY_FLASH_SIZEOF_ROW);
+                }
+#endif
                 intr_status = Cy_SysLib_EnterCriticalSection();
-                rc = Cy_Flash_ProgramRow((rowId * CY_FLASH_SIZEOF_ROW) + CY_FLASH_BASE, (uint32_t*)writeBufferPointer);
-                Cy_SysLib_ExitCriticalSection(intr_status);
-                if(rc != CY_FLASH_DRV_SUCCESS)
+                for(row = 0u; row < batchRows; row++)
                 {
-                    break;
+                    if((rowsNotEqual & (1ul << row)) != 0u)
+                    {
+                        rc = Cy_Flash_ProgramRow(((batchRowId + row) * CY_FLASH_SIZEOF_ROW) + CY_FLASH_BASE,
+                                                 (uint32_t*)rowSource[row]);
+                        if(rc != CY_FLASH_DRV_SUCCESS)
+                        {
+                            break;
+                        }
+                    }
                 }
-            }
+                Cy_SysLib_ExitCriticalSection(intr_status);
 
-            /* Go to the next row */
-            rowId++;
+#if !defined (CY_DISABLE_XMC7000_DATA_CACHE) && defined (__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+                /* Drop stale cached copies of the programmed rows */
+                SCB_InvalidateDCache_by_Addr((void *)((batchRowId * CY_FLASH_SIZEOF_ROW) + CY_FLASH_BASE),
+                                             (int32_t)(batchRows * CY_FLASH_SIZEOF_ROW));
+#endif
+            }
         }
     }
     else
@@ -629,13 +985,6 @@ static int xmc_internal_flash_write(uint8_t data[], uint32_t address, size_t len
             break;
     }
 
-#if !defined (CY_DISABLE_XMC7000_DATA_CACHE) && defined (__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
-    if(iscacheable == true)
-    {
-        free(local_buffer);
-    }
-#endif
-
     return(retCode);
 }
 CY_SECTION_RAMFUNC_END
@@ -653,6 +1002,140 @@ static uint32_t ota_smif_get_memory_size(void)
 
     return size;
 }
+
+static cy_en_smif_status_t ota_smif_read(uint32_t addr, uint8_t *data, size_t len)
+{
+    cy_en_smif_status_t cy_smif_result;
+    uint32_t start;
+
+    /* pre-access to SMIF */
+    PRE_SMIF_ACCESS_TURN_OFF_XIP;
+
+    start = DWT->CYCCNT;
+#ifdef OTA_SMIF_DMA
+    cy_smif_result = qspi_dma_read(SMIF0, smifBlockConfig.memConfig[MEM_SLOT],
+            addr, data, len, &ota_QSPI_context);
+#else
+    cy_smif_result = Cy_SMIF_MemRead(SMIF0, smifBlockConfig.memConfig[MEM_SLOT],
+            addr, data, len, &ota_QSPI_context);
+#endif
+    ota_transfer_stats.cycles += (uint64_t)(DWT->CYCCNT - start);
+    ota_transfer_stats.read_bytes += len;
+    /* post-access to SMIF */
+    POST_SMIF_ACCESS_TURN_ON_XIP;
+
+    return cy_smif_result;
+}
+
+/**
+ * @brief Drops the cached rows overlapping a range that is written or erased
+ *
+ * @param[in]   addr       SMIF offset of the range.
+ * @param[in]   len        Number of bytes in the range.
+ */
+static void ota_read_cache_invalidate(uint32_t addr, size_t len)
+{
+#if (OTA_MEM_READ_CACHE_ROWS > 0)
+    uint32_t i;
+
+    for (i = 0; i < OTA_MEM_READ_CACHE_ROWS; i++)
+    {
+        if ((ota_read_cache[i].last_use != 0u) &&
+            (ota_read_cache[i].row_base < (addr + len)) &&
+            ((ota_read_cache[i].row_base + CY_FLASH_SIZEOF_ROW) > addr))
+        {
+            ota_read_cache[i].last_use = 0u;
+            ota_read_cache_stats.invalidations++;
+        }
+    }
+#else
+    (void)addr;
+    (void)len;
+#endif
+}
+
+/**
+ * @brief Reads from the external flash through the row cache
+ *
+ * @param[in]   addr       SMIF offset to read from.
+ * @param[out]  data       Pointer to the buffer to store the data read from the memory.
+ * @param[in]   len        Number of data bytes to read.
+ *
+ * @return  CY_SMIF_SUCCESS on success
+ */
+static cy_en_smif_status_t ota_read_cache_read(uint32_t addr, uint8_t *data, size_t len)
+{
+#if (OTA_MEM_READ_CACHE_ROWS > 0)
+    cy_en_smif_status_t cy_smif_result = CY_SMIF_SUCCESS;
+
+    if (len > OTA_MEM_READ_CACHE_MAX_LEN)
+    {
+        ota_read_cache_stats.bypassed++;
+        return ota_smif_read(addr, data, len);
+    }
+
+    while (len > 0u)
+    {
+        uint32_t row_base = (addr / CY_FLASH_SIZEOF_ROW) * CY_FLASH_SIZEOF_ROW;
+        uint32_t row_offset = addr - row_base;
+        size_t chunk = CY_FLASH_SIZEOF_ROW - row_offset;
+        ota_read_cache_entry_t *entry = NULL;
+        uint32_t i;
+
+        if (chunk > len)
+        {
+            chunk = len;
+        }
+
+        for (i = 0; i < OTA_MEM_READ_CACHE_ROWS; i++)
+        {
+            if ((ota_read_cache[i].last_use != 0u) && (ota_read_cache[i].row_base == row_base))
+            {
+                entry = &ota_read_cache[i];
+                break;
+            }
+        }
+
+        if (entry != NULL)
+        {
+            ota_read_cache_stats.hits++;
+        }
+        else
+        {
+            /* Replace an empty or the least recently used entry */
+            entry = &ota_read_cache[0];
+            for (i = 1; i < OTA_MEM_READ_CACHE_ROWS; i++)
+            {
+                if (ota_read_cache[i].last_use < entry->last_use)
+                {
+                    entry = &ota_read_cache[i];
+                }
+            }
+
+            ota_read_cache_stats.misses++;
+            entry->last_use = 0u;
+            cy_smif_result = ota_smif_read(row_base, entry->data, CY_FLASH_SIZEOF_ROW);
+            if (cy_smif_result != CY_SMIF_SUCCESS)
+            {
+                return cy_smif_result;
+            }
+            entry->row_base = row_base;
+        }
+
+        entry->last_use = ++ota_read_cache_clock;
+        memcpy(data, &entry->data[row_offset], chunk);
+
+        addr += chunk;
+        data += chunk;
+        len  -= chunk;
+    }
+
+    return cy_smif_result;
+#else
+    ota_read_cache_stats.bypassed++;
+    return ota_smif_read(addr, data, len);
+#endif
+}
 #endif /* CY_IP_MXSMIF & !XMC7100 & !XMC7200 */
 
 /**********************************************************************************************************************************
@@ -760,6 +1243,32 @@ cy_rslt_t cy_ota_mem_init( void )
         }
     }
 
+#if defined (COMPONENT_OTA_PSOC_062) && (OTA_QSPI_QUAD_PROGRAM != 0)
+    /* Use the quad input page program if the memory supports it */
+    ota_program_cmd_basic = *smifMemConfigs[0]->deviceCfg->programCmd;
+    ota_program_stats.basic_command = ota_program_cmd_basic.command;
+    ota_program_stats.basic_bus_cycles = qspi_get_program_bus_cycles(smifMemConfigs[0], OTA_PROGRAM_STATS_CHUNK_SIZE);
+    if (result == CY_RSLT_SUCCESS)
+    {
+        /* Keeps the detected command if SFDP does not report a quad input program */
+        (void)qspi_select_quad_program(SMIF0, (cy_stc_smif_mem_config_t *)smifMemConfigs[0], &ota_QSPI_context);
+    }
+    ota_program_cmd_quad = *smifMemConfigs[0]->deviceCfg->programCmd;
+    ota_program_stats.command = ota_program_cmd_quad.command;
+    ota_program_stats.bus_cycles = qspi_get_program_bus_cycles(smifMemConfigs[0], OTA_PROGRAM_STATS_CHUNK_SIZE);
+#endif
+
+    /* Count the CPU cycles spent programming */
+    ota_cycles_enable();
+
+#ifdef OTA_SMIF_DMA
+    if ((result == CY_RSLT_SUCCESS) && (qspi_dma_init(SMIF0) != CY_SMIF_SUCCESS))
+    {
+        result = CY_RSLT_TYPE_ERROR;
+    }
+    ota_transfer_stats.dma = 1u;
+#endif
+
     SET_FLAG(FLAG_HAL_INIT_DONE);
 
   _bail:
@@ -793,12 +1302,20 @@ cy_rslt_t cy_ota_mem_read( cy_ota_mem_type_t mem_type, uint32_t addr, void *data
         /* flash_area_read() uses offsets, we need absolute address here */
         addr += CY_FLASH_BASE;
 
+#if defined (XMC7100) || defined (XMC7200)
+        /* A sector marked for erase must read back erased */
+        if(xmc_erase_ahead(addr, len, false) != 0)
+        {
+            return CY_RSLT_TYPE_ERROR;
+        }
+#endif
+
         /* flash read by simple memory copying */
         memcpy((void *)data, (const void*)addr, (size_t)len);
         return result;
 #else
         (void)result;
-        printf("%s() READ not supported for memory type %d\n", __func__, (int)mem_type);
+        OTA_PRINTF("%s() READ not supported for memory type %d\n", __func__, (int)mem_type);
         return CY_RSLT_TYPE_ERROR;
 #endif
     }
@@ -813,13 +1330,22 @@ cy_rslt_t cy_ota_mem_read( cy_ota_mem_type_t mem_type, uint32_t addr, void *data
 
         if (IS_FLAG_SET(FLAG_HAL_INIT_DONE))
         {
-            /* pre-access to SMIF */
-            PRE_SMIF_ACCESS_TURN_OFF_XIP;
+            while ((cy_smif_result == CY_SMIF_SUCCESS) && (len > 0u))
+            {
+                size_t chunk = (len > OTA_MEM_ARBITER_READ_CHUNK) ? OTA_MEM_ARBITER_READ_CHUNK : len;
 
-            cy_smif_result = Cy_SMIF_MemRead(SMIF0, smifBlockConfig.memConfig[MEM_SLOT],
-                    addr, data, len, &ota_QSPI_context);
-            /* post-access to SMIF */
-            POST_SMIF_ACCESS_TURN_ON_XIP;
+                if (cy_ota_mem_acquire(CY_OTA_MEM_WAIT_FOREVER) != CY_RSLT_SUCCESS)
+                {
+                    return CY_RSLT_TYPE_ERROR;
+                }
+                /* Header, TLV and trailer rows are read repeatedly, serve them from the cache */
+                cy_smif_result = ota_read_cache_read(addr, (uint8_t *)data, chunk);
+                cy_ota_mem_release();
+
+                addr += chunk;
+                data = (uint8_t *)data + chunk;
+                len -= chunk;
+            }
         }
 
         return (cy_smif_result == CY_SMIF_SUCCESS) ? CY_RSLT_SUCCESS : CY_RSLT_TYPE_ERROR;
@@ -829,7 +1355,7 @@ cy_rslt_t cy_ota_mem_read( cy_ota_mem_type_t mem_type, uint32_t addr, void *data
     }
     else
     {
-        printf("%s() READ not supported for memory type %d\n", __func__, (int)mem_type);
+        OTA_PRINTF("%s() READ not supported for memory type %d\n", __func__, (int)mem_type);
         return CY_RSLT_TYPE_ERROR;
     }
 }
@@ -850,7 +1376,7 @@ static cy_rslt_t cy_ota_mem_write_row_size( cy_ota_mem_type_t mem_type, uint32_t
         rc = xmc_internal_flash_write((uint8_t *)data, addr, len);
         if (rc != 0 )
         {
-            printf("xmc_internal_flash_write(0x%08x, 0x%08x, %u) FAILED rc:%u\n", (unsigned int)data, (unsigned int)addr, len, rc);
+            OTA_PRINTF("xmc_internal_flash_write(0x%08x, 0x%08x, %u) FAILED rc:%u\n", (unsigned int)data, (unsigned int)addr, len, rc);
             result = CY_RSLT_TYPE_ERROR;
         }
         return result;
@@ -865,7 +1391,7 @@ static cy_rslt_t cy_ota_mem_write_row_size( cy_ota_mem_type_t mem_type, uint32_t
 
 #else
         (void)result;
-        printf("%s() Write not supported for memory type %d\n", __func__, (int)mem_type);
+        OTA_PRINTF("%s() Write not supported for memory type %d\n", __func__, (int)mem_type);
         return CY_RSLT_TYPE_ERROR;
 #endif
     }
@@ -884,11 +1410,13 @@ static cy_rslt_t cy_ota_mem_write_row_size( cy_ota_mem_type_t mem_type, uint32_t
 
         if (IS_FLAG_SET(FLAG_HAL_INIT_DONE))
         {
+            ota_read_cache_invalidate(addr, len);
 #ifdef ENABLE_ON_THE_FLY_ENCRYPTION
             cbus_addr = cy_flash_addr_to_cbus_addr(addr);
+            ota_row_stats.staged += (len + CY_FLASH_SIZEOF_ROW - 1u) / CY_FLASH_SIZEOF_ROW;
             if(ota_allocate_write_buffer(len) != true)
             {
-                printf("\n%s() - Memory allocation failed at %d\n", __func__, __LINE__);
+                OTA_PRINTF("\n%s() - Memory allocation failed at %d\n", __func__, __LINE__);
                 return CY_RSLT_TYPE_ERROR;
             }
 
@@ -912,11 +1440,53 @@ static cy_rslt_t cy_ota_mem_write_row_size( cy_ota_mem_type_t mem_type, uint32_t
 #else
             if(cy_smif_result == CY_SMIF_SUCCESS)
             {
+                uint32_t start;
+                uint32_t cycles;
+                bool     basic_sample = false;
+
+#if defined (COMPONENT_OTA_PSOC_062) && (OTA_QSPI_QUAD_PROGRAM != 0)
+                /* Time the first writes with the basic command, so the log
+                 * compares the measured time of both commands per 4 KB.
+                 */
+                basic_sample = (ota_program_cmd_quad.command != ota_program_cmd_basic.command) &&
+                               (ota_program_stats.basic_bytes < OTA_PROGRAM_STATS_CHUNK_SIZE);
+                if (basic_sample)
+                {
+                    *smifBlockConfig.memConfig[MEM_SLOT]->deviceCfg->programCmd = ota_program_cmd_basic;
+                }
+#endif
+
                 /* pre-access to SMIF */
                 PRE_SMIF_ACCESS_TURN_OFF_XIP;
+                start = DWT->CYCCNT;
+#ifdef OTA_SMIF_DMA
+                cy_smif_result = qspi_dma_write(SMIF0, smifBlockConfig.memConfig[MEM_SLOT], addr, data, len, &ota_QSPI_context);
+#else
                 cy_smif_result = Cy_SMIF_MemWrite(SMIF0, smifBlockConfig.memConfig[MEM_SLOT], addr, data, len, &ota_QSPI_context);
+#endif
+                cycles = DWT->CYCCNT - start;
+                if (basic_sample)
+                {
+                    ota_program_stats.basic_cycles += (uint64_t)cycles;
+                    ota_program_stats.basic_bytes += len;
+                }
+                else
+                {
+                    ota_program_stats.cycles += (uint64_t)cycles;
+                    ota_program_stats.bytes += len;
+                }
+                ota_transfer_stats.cycles += (uint64_t)cycles;
+                ota_transfer_stats.write_bytes += len;
+                ota_row_stats.in_place += (len + CY_FLASH_SIZEOF_ROW - 1u) / CY_FLASH_SIZEOF_ROW;
                 /* post-access to SMIF */
                 POST_SMIF_ACCESS_TURN_ON_XIP;
+
+#if defined (COMPONENT_OTA_PSOC_062) && (OTA_QSPI_QUAD_PROGRAM != 0)
+                if (basic_sample)
+                {
+                    *smifBlockConfig.memConfig[MEM_SLOT]->deviceCfg->programCmd = ota_program_cmd_quad;
+                }
+#endif
             }
 #endif
         }
@@ -933,12 +1503,12 @@ static cy_rslt_t cy_ota_mem_write_row_size( cy_ota_mem_type_t mem_type, uint32_t
             if(cy_smif_result == CY_RSLT_SUCCESS)
             {
 #ifdef ENABLE_ON_THE_FLY_ENCRYPTION
-                printf("\n\rEncrypted Data : ");
+                OTA_PRINTF("\n\rEncrypted Data : ");
                 for(i = 0; (i < 16 && i < len); i++)
                 {
-                    printf("0x%02x ", read_back_test[i]);
+                    OTA_PRINTF("0x%02x ", read_back_test[i]);
                 }
-                printf("\n\n\r");
+                OTA_PRINTF("\n\n\r");
 
                 cbus_addr = cy_flash_addr_to_cbus_addr(addr);
 
@@ -953,16 +1523,16 @@ static cy_rslt_t cy_ota_mem_write_row_size( cy_ota_mem_type_t mem_type, uint32_t
 
                 if(cy_smif_result != CY_SMIF_SUCCESS)
                 {
-                    printf("[Error] Data encryption failed with error %d\r\n\r\n", cy_smif_result);
+                    OTA_PRINTF("[Error] Data encryption failed with error %d\r\n\r\n", cy_smif_result);
                 }
                 else
                 {
-                    printf("\n\rDecrypted Data : ");
+                    OTA_PRINTF("\n\rDecrypted Data : ");
                     for(i = 0; (i < 16 && i < len); i++)
                     {
-                        printf("0x%02x ", read_back_test[i]);
+                        OTA_PRINTF("0x%02x ", read_back_test[i]);
                     }
-                    printf("\n\n\r");
+                    OTA_PRINTF("\n\n\r");
                 }
 #endif
                 for(i = 0; (i < 16 && i < len); i++)
@@ -970,7 +1540,7 @@ static cy_rslt_t cy_ota_mem_write_row_size( cy_ota_mem_type_t mem_type, uint32_t
                     if((((uint8_t *)data)[i]) != read_back_test[i])
                     {
                         result  = -1;
-                        printf("[Error] Data mismatch at index %d expected : %d got : %d \r\n", i, (((uint8_t *)data)[i]), read_back_test[i]);
+                        OTA_PRINTF("[Error] Data mismatch at index %d expected : %d got : %d \r\n", i, (((uint8_t *)data)[i]), read_back_test[i]);
                     }
                 }
             }
@@ -983,23 +1553,135 @@ static cy_rslt_t cy_ota_mem_write_row_size( cy_ota_mem_type_t mem_type, uint32_t
     }
     else
     {
-        printf("%s() Write not supported for memory type %d\n", __func__, (int)mem_type);
+        OTA_PRINTF("%s() Write not supported for memory type %d\n", __func__, (int)mem_type);
         return CY_RSLT_TYPE_ERROR;
     }
 }
 
+#if (defined (CY_IP_MXSMIF) && !defined (XMC7100) && !defined (XMC7200))
 /**
- * @brief Write to flash, QSPI flash, or any other external memory type
+ * @brief Programs a small (MCUboot trailer) write to the external flash in place
  *
- * @param[in]   mem_type   Memory type @ref cy_ota_mem_type_t
- * @param[in]   addr       Starting address to write to.
- * @param[in]   data       Pointer to the buffer containing the data to be written.
- * @param[in]   len        Number of bytes to write.
+ * NOR flash can be programmed over existing data as long as only 1 -> 0 bit
+ * transitions are needed, which is the case for every trailer field written
+ * to its erased slot position. The aligned block(s) holding the field are read
+ * back, the new raw content is computed (encrypted when on-the-fly encryption
+ * is enabled; the bytes around the field encrypt to their current value) and
+ * programmed without reading or rewriting the whole row and without an erase.
+ *
+ * @param[in]   addr    Starting address to write to.
+ * @param[in]   data    Pointer to the buffer containing the data to be written.
+ * @param[in]   len     Number of bytes to write.
+ * @param[out]  done    true if the write was handled, false if the caller has
+ *                      to fall back to the row read-modify-write.
  *
  * @return  CY_RSLT_SUCCESS on success
  *          CY_RSLT_TYPE_ERROR on failure
  */
-cy_rslt_t cy_ota_mem_write( cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len )
+static cy_rslt_t cy_ota_mem_write_trailer( uint32_t addr, const uint8_t *data, size_t len, bool *done )
+{
+    static uint8_t old_raw[2 * CY_BOOT_TRAILER_BLOCK_SIZE];
+    static uint8_t new_raw[2 * CY_BOOT_TRAILER_BLOCK_SIZE];
+    cy_en_smif_status_t cy_smif_result = CY_SMIF_SUCCESS;
+    uint32_t block_base;
+    uint32_t block_len;
+    uint32_t i;
+#ifdef ENABLE_ON_THE_FLY_ENCRYPTION
+    uint32_t cbus_addr = 0;
+#endif
+
+    *done = false;
+
+    if (addr >= CY_SMIF_BASE_MEM_OFFSET)
+    {
+        addr -= CY_SMIF_BASE_MEM_OFFSET;
+    }
+
+    block_base = addr & ~(CY_BOOT_TRAILER_BLOCK_SIZE - 1u);
+    block_len = ((addr + len + CY_BOOT_TRAILER_BLOCK_SIZE - 1u) & ~(CY_BOOT_TRAILER_BLOCK_SIZE - 1u)) - block_base;
+    if ((len == 0u) || (block_len > sizeof(new_raw)) || !IS_FLAG_SET(FLAG_HAL_INIT_DONE))
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    if (cy_ota_mem_read(CY_OTA_MEM_TYPE_EXTERNAL_FLASH, block_base, old_raw, block_len) != CY_RSLT_SUCCESS)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+    memcpy(new_raw, old_raw, block_len);
+
+#ifdef ENABLE_ON_THE_FLY_ENCRYPTION
+    cbus_addr = cy_flash_addr_to_cbus_addr(block_base);
+
+    /* Each PRE/POST pair in its own block, the macros declare the saved interrupt state */
+    {
+        /* pre-access to SMIF */
+        PRE_SMIF_ACCESS_TURN_OFF_XIP;
+
+        /* Decrypt the current content, patch the field and encrypt it again */
+        cy_smif_result = Cy_SMIF_Encrypt(SMIF0, cbus_addr, new_raw, block_len, &ota_QSPI_context);
+        if (cy_smif_result == CY_SMIF_SUCCESS)
+        {
+            memcpy(&new_raw[addr - block_base], data, len);
+            cy_smif_result = Cy_SMIF_Encrypt(SMIF0, cbus_addr, new_raw, block_len, &ota_QSPI_context);
+        }
+
+        /* post-access to SMIF */
+        POST_SMIF_ACCESS_TURN_ON_XIP;
+    }
+
+    if (cy_smif_result != CY_SMIF_SUCCESS)
+    {
+        OTA_PRINTF("[Error] Data encryption failed with error %d\r\n\r\n", cy_smif_result);
+        return CY_RSLT_TYPE_ERROR;
+    }
+#else
+    memcpy(&new_raw[addr - block_base], data, len);
+#endif
+
+    for (i = 0; i < block_len; i++)
+    {
+        if ((old_raw[i] & new_raw[i]) != new_raw[i])
+        {
+            /* A 1 bit would have to be restored, needs an erase */
+            ota_trailer_stats.fallback++;
+            return CY_RSLT_SUCCESS;
+        }
+    }
+
+    *done = true;
+    if (memcmp(old_raw, new_raw, block_len) == 0)
+    {
+        ota_trailer_stats.unchanged++;
+        return CY_RSLT_SUCCESS;
+    }
+
+    ota_read_cache_invalidate(block_base, block_len);
+
+    {
+        /* pre-access to SMIF */
+        PRE_SMIF_ACCESS_TURN_OFF_XIP;
+        cy_smif_result = Cy_SMIF_MemWrite(SMIF0, smifBlockConfig.memConfig[MEM_SLOT], block_base, new_raw, block_len, &ota_QSPI_context);
+        /* post-access to SMIF */
+        POST_SMIF_ACCESS_TURN_ON_XIP;
+    }
+
+    if (cy_smif_result != CY_SMIF_SUCCESS)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    ota_trailer_stats.in_place++;
+    return CY_RSLT_SUCCESS;
+}
+#endif /* CY_IP_MXSMIF & !XMC7100 & !XMC7200 */
+
+/*
+ * trailer is decided by the caller on the length of the whole write: a long
+ * write reaches this function in row pieces, and a short head or tail piece
+ * of image data must not be taken for a trailer update.
+ */
+static cy_rslt_t ota_mem_write( cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len, bool trailer )
 {
     cy_rslt_t result = CY_RSLT_SUCCESS;
 
@@ -1007,7 +1689,7 @@ cy_rslt_t cy_ota_mem_write( cy_ota_mem_type_t mem_type, uint32_t addr, void *dat
      * This is used if a block is < Block size to satisfy requirements
      * of flash_area_write(). "static" so it is not on the stack.
      */
-    static uint8_t block_buffer[CY_FLASH_SIZEOF_ROW];
+    CY_ALIGN(4) static uint8_t block_buffer[CY_FLASH_SIZEOF_ROW];
     uint32_t chunk_size = 0;
 
     uint32_t bytes_to_write = len;
@@ -1019,6 +1701,34 @@ cy_rslt_t cy_ota_mem_write( cy_ota_mem_type_t mem_type, uint32_t addr, void *dat
     uint32_t cbus_addr = 0;
 #endif
 
+#if (defined (CY_IP_MXSMIF) && !defined (XMC7100) && !defined (XMC7200))
+    /* Trailer field updates are programmed in place, without erasing or rewriting the row */
+    if((mem_type == CY_OTA_MEM_TYPE_EXTERNAL_FLASH) && trailer)
+    {
+        bool done = false;
+
+        result = cy_ota_mem_write_trailer(addr, (const uint8_t *)data, len, &done);
+        if((result != CY_RSLT_SUCCESS) || done)
+        {
+            return result;
+        }
+    }
+#endif
+
+#if defined (XMC7100) || defined (XMC7200)
+    /* MCUboot reads the trailer and status areas past the image, the sectors
+     * still marked for erase are erased before the first trailer write
+     */
+    if((mem_type == CY_OTA_MEM_TYPE_INTERNAL_FLASH) && trailer)
+    {
+        if(xmc_erase_pending_all() != 0)
+        {
+            OTA_PRINTF("%s() Erase of the pending sectors failed\n", __func__);
+            return CY_RSLT_TYPE_ERROR;
+        }
+    }
+#endif
+
     while(bytes_to_write > 0x0U)
     {
         chunk_size = bytes_to_write;
@@ -1062,21 +1772,22 @@ cy_rslt_t cy_ota_mem_write( cy_ota_mem_type_t mem_type, uint32_t addr, void *dat
 
             if(cy_smif_result != CY_SMIF_SUCCESS)
             {
-                printf("[Error] Data encryption failed with error %d\r\n\r\n", cy_smif_result);
+                OTA_PRINTF("[Error] Data encryption failed with error %d\r\n\r\n", cy_smif_result);
             }
 #endif
             memcpy (&block_buffer[row_offset], curr_src, chunk_size);
+            ota_row_stats.merged++;
 
 #ifdef ENABLE_ON_THE_FLY_ENCRYPTION
             if(mem_type == CY_OTA_MEM_TYPE_EXTERNAL_FLASH)
             {
                 /* Erase while updating Image trailers */
-                if(len <= CY_BOOT_TRAILER_MAX_UPDATE_SIZE)
+                if(trailer)
                 {
                     result = cy_ota_mem_erase(mem_type, curr_addr, bytes_to_write);
                     if(result != CY_RSLT_SUCCESS)
                     {
-                        printf("%s() Erase failed for memory type %d\n", __func__, (int)mem_type);
+                        OTA_PRINTF("%s() Erase failed for memory type %d\n", __func__, (int)mem_type);
                         return CY_RSLT_TYPE_ERROR;
                     }
                 }
@@ -1105,6 +1816,54 @@ cy_rslt_t cy_ota_mem_write( cy_ota_mem_type_t mem_type, uint32_t addr, void *dat
     return CY_RSLT_SUCCESS;
 }
 
+/**
+ * @brief Write to flash, QSPI flash, or any other external memory type
+ *
+ * @param[in]   mem_type   Memory type @ref cy_ota_mem_type_t
+ * @param[in]   addr       Starting address to write to.
+ * @param[in]   data       Pointer to the buffer containing the data to be written.
+ * @param[in]   len        Number of bytes to write.
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+cy_rslt_t cy_ota_mem_write( cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    bool trailer = (len <= CY_BOOT_TRAILER_MAX_UPDATE_SIZE);
+
+    if (mem_type != CY_OTA_MEM_TYPE_EXTERNAL_FLASH)
+    {
+        return ota_mem_write(mem_type, addr, data, len, trailer);
+    }
+
+    /* The external flash is held for one row at a time, so that higher
+     * priority clients get in between the rows of a long write.
+     */
+    while ((result == CY_RSLT_SUCCESS) && (len > 0u))
+    {
+        size_t chunk = CY_FLASH_SIZEOF_ROW - (addr % CY_FLASH_SIZEOF_ROW);
+
+        if (chunk > len)
+        {
+            chunk = len;
+        }
+
+        result = cy_ota_mem_acquire(CY_OTA_MEM_WAIT_FOREVER);
+        if (result == CY_RSLT_SUCCESS)
+        {
+            result = ota_mem_write(mem_type, addr, data, chunk, trailer);
+            cy_ota_mem_release();
+        }
+
+        addr += chunk;
+        data = (uint8_t *)data + chunk;
+        len -= chunk;
+    }
+
+    return result;
+}
+
 /**
  * @brief Erase flash, QSPI flash, or any other external memory type
  *
@@ -1119,19 +1878,22 @@ cy_rslt_t cy_ota_mem_erase( cy_ota_mem_type_t mem_type, uint32_t addr, size_t le
 {
     cy_rslt_t result = CY_RSLT_SUCCESS;
 
+    if ((ota_erase_hold_task != NULL) && (ota_erase_hold_task == xTaskGetCurrentTaskHandle()))
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
     if( mem_type == CY_OTA_MEM_TYPE_INTERNAL_FLASH )
     {
 #if !(defined (CYW20829B0LKML) || defined (CYW89829B01MKSBG))
         int rc = 0;
 
 #if defined (XMC7100) || defined (XMC7200)
-        int intr_status = 0;
-        intr_status = Cy_SysLib_EnterCriticalSection();
+        /* Interrupts are disabled for each sector erase, not for the whole range */
         rc = xmc_internal_flash_erase(addr, len);
-        Cy_SysLib_ExitCriticalSection(intr_status);
         if (rc != 0 )
         {
-            printf("xmc_internal_flash_erase(0x%08x, %u) FAILED rc:%d\n", (unsigned int)addr, len, rc);
+            OTA_PRINTF("xmc_internal_flash_erase(0x%08x, %u) FAILED rc:%d\n", (unsigned int)addr, len, rc);
             result = CY_RSLT_TYPE_ERROR;
         }
 #else
@@ -1144,7 +1906,7 @@ cy_rslt_t cy_ota_mem_erase( cy_ota_mem_type_t mem_type, uint32_t addr, size_t le
         return result;
 #else
         (void)result;
-        printf("%s() Erase not supported for memory type %d\n", __func__, (int)mem_type);
+        OTA_PRINTF("%s() Erase not supported for memory type %d\n", __func__, (int)mem_type);
         return CY_RSLT_TYPE_ERROR;
 #endif
     }
@@ -1160,15 +1922,24 @@ cy_rslt_t cy_ota_mem_erase( cy_ota_mem_type_t mem_type, uint32_t addr, size_t le
 
         if (IS_FLAG_SET(FLAG_HAL_INIT_DONE))
         {
-            /* pre-access to SMIF */
-            PRE_SMIF_ACCESS_TURN_OFF_XIP;
-
             // If the erase is for the entire chip, use chip erase command
             if ((addr == 0u) && (len == ota_smif_get_memory_size()))
             {
+                if (cy_ota_mem_acquire(CY_OTA_MEM_WAIT_FOREVER) != CY_RSLT_SUCCESS)
+                {
+                    return CY_RSLT_TYPE_ERROR;
+                }
+                ota_read_cache_invalidate(0u, len);
+
+                /* pre-access to SMIF */
+                PRE_SMIF_ACCESS_TURN_OFF_XIP;
                 cy_smif_result = Cy_SMIF_MemEraseChip(SMIF0,
                                                     smifBlockConfig.memConfig[MEM_SLOT],
                                                     &ota_QSPI_context);
+                /* post-access to SMIF */
+                POST_SMIF_ACCESS_TURN_ON_XIP;
+
+                cy_ota_mem_release();
             }
             else
             {
@@ -1178,21 +1949,41 @@ cy_rslt_t cy_ota_mem_erase( cy_ota_mem_type_t mem_type, uint32_t addr, size_t le
                 /* Make sure the base offset is correct */
                 uint32_t erase_size;
                 uint32_t diff;
+                uint32_t end;
                 erase_size = cy_ota_mem_get_erase_size(CY_OTA_MEM_TYPE_EXTERNAL_FLASH, addr);
                 diff = addr & (erase_size - 1);
                 addr -= diff;
                 len += diff;
                 /* Make sure the length is correct */
                 len = (len + (erase_size - 1)) & ~(erase_size - 1);
-                Cy_SMIF_SetReadyPollingDelay(20000, &ota_QSPI_context);
-                cy_smif_result = Cy_SMIF_MemEraseSector(SMIF0,
-                                                      smifBlockConfig.memConfig[MEM_SLOT],
-                                                      addr, len, &ota_QSPI_context);
-                Cy_SMIF_SetReadyPollingDelay(0, &ota_QSPI_context);
-            }
+                end = addr + len;
 
-            /* post-access to SMIF */
-            POST_SMIF_ACCESS_TURN_ON_XIP;
+                /* The external flash is held for one sector at a time, so
+                 * that higher priority clients get in between the sectors.
+                 */
+                while ((cy_smif_result == CY_SMIF_SUCCESS) && (addr < end))
+                {
+                    erase_size = cy_ota_mem_get_erase_size(CY_OTA_MEM_TYPE_EXTERNAL_FLASH, addr);
+                    if (cy_ota_mem_acquire(CY_OTA_MEM_WAIT_FOREVER) != CY_RSLT_SUCCESS)
+                    {
+                        return CY_RSLT_TYPE_ERROR;
+                    }
+                    ota_read_cache_invalidate(addr, erase_size);
+
+                    /* pre-access to SMIF */
+                    PRE_SMIF_ACCESS_TURN_OFF_XIP;
+                    Cy_SMIF_SetReadyPollingDelay(20000, &ota_QSPI_context);
+                    cy_smif_result = Cy_SMIF_MemEraseSector(SMIF0,
+                                                          smifBlockConfig.memConfig[MEM_SLOT],
+                                                          addr, erase_size, &ota_QSPI_context);
+                    Cy_SMIF_SetReadyPollingDelay(0, &ota_QSPI_context);
+                    /* post-access to SMIF */
+                    POST_SMIF_ACCESS_TURN_ON_XIP;
+
+                    cy_ota_mem_release();
+                    addr += erase_size;
+                }
+            }
         }
         else
         {
@@ -1206,7 +1997,7 @@ cy_rslt_t cy_ota_mem_erase( cy_ota_mem_type_t mem_type, uint32_t addr, size_t le
     }
     else
     {
-        printf("%s() Erase not supported for memory type %d\n", __func__, (int)mem_type);
+        OTA_PRINTF("%s() Erase not supported for memory type %d\n", __func__, (int)mem_type);
         return CY_RSLT_TYPE_ERROR;
     }
 }
@@ -1267,7 +2058,10 @@ size_t cy_ota_mem_get_erase_size ( cy_ota_mem_type_t mem_type, uint32_t addr )
 {
     if( mem_type == CY_OTA_MEM_TYPE_INTERNAL_FLASH )
     {
-#if !(defined (CYW20829B0LKML) || defined (CYW89829B01MKSBG))
+#if defined (XMC7100) || defined (XMC7200)
+        /* The slots are erased in code flash large sectors */
+        return OTA_XMC_FLASH_SECTOR_SIZE;
+#elif !(defined (CYW20829B0LKML) || defined (CYW89829B01MKSBG))
         return CY_FLASH_SIZEOF_ROW;
 #else
         return 0;
@@ -1312,3 +2106,106 @@ size_t cy_ota_mem_get_erase_size ( cy_ota_mem_type_t mem_type, uint32_t addr )
         return 0;
     }
 }
+
+/**
+ * @brief Returns the size of the external flash, as read by SFDP
+ *
+ * @param[in]   mem_type   Memory type @ref cy_ota_mem_type_t
+ *
+ * @return    Size in bytes, 0 if not known (other memory types, or before cy_ota_mem_init()).
+ */
+size_t cy_ota_mem_get_size( cy_ota_mem_type_t mem_type )
+{
+#if (defined (CY_IP_MXSMIF) && !defined (XMC7100) && !defined (XMC7200))
+    if ((mem_type == CY_OTA_MEM_TYPE_EXTERNAL_FLASH) && IS_FLAG_SET(FLAG_HAL_INIT_DONE))
+    {
+        return ota_smif_get_memory_size();
+    }
+#else
+    (void)mem_type;
+#endif
+    return 0;
+}
+
+/**
+ * @brief Skips the erases of the calling task until released
+ *
+ * Used to open the OTA storage of a resumed download without erasing the
+ * data already received. Erases from other tasks are not affected.
+ *
+ * @param[in]   hold       true to skip the erases, false to release.
+ */
+void cy_ota_mem_erase_hold( bool hold )
+{
+    ota_erase_hold_task = hold ? xTaskGetCurrentTaskHandle() : NULL;
+}
+
+/**
+ * @brief Returns the counters of the small (MCUboot trailer) writes to the external flash
+ *
+ * @param[out]  stats      Pointer to the structure to store the counters.
+ */
+void cy_ota_mem_get_trailer_stats( cy_ota_mem_trailer_stats_t *stats )
+{
+    if (stats != NULL)
+    {
+        *stats = ota_trailer_stats;
+    }
+}
+
+/**
+ * @brief Returns the counters of the external flash read cache
+ *
+ * @param[out]  stats      Pointer to the structure to store the counters.
+ */
+void cy_ota_mem_get_read_cache_stats( cy_ota_mem_read_cache_stats_t *stats )
+{
+    if (stats != NULL)
+    {
+        *stats = ota_read_cache_stats;
+    }
+}
+
+/**
+ * @brief Returns the external flash program command and timing counters
+ *
+ * @param[out]  stats      Pointer to the structure to store the counters.
+ */
+void cy_ota_mem_get_program_stats( cy_ota_mem_program_stats_t *stats )
+{
+    if (stats != NULL)
+    {
+        *stats = ota_program_stats;
+    }
+}
+
+/**
+ * @brief Returns the counters of the rows programmed in place, staged and merged
+ *
+ * Merged rows are counted again as in place or staged when they are programmed.
+ *
+ * @param[out]  stats      Pointer to the structure to store the counters.
+ */
+void cy_ota_mem_get_row_stats( cy_ota_mem_row_stats_t *stats )
+{
+    if (stats != NULL)
+    {
+        *stats = ota_row_stats;
+    }
+}
+
+/**
+ * @brief Returns the CPU load counters of the external flash transfers
+ *
+ * @param[out]  stats      Pointer to the structure to store the counters.
+ */
+void cy_ota_mem_get_transfer_stats( cy_ota_mem_transfer_stats_t *stats )
+{
+    if (stats != NULL)
+    {
+        *stats = ota_transfer_stats;
+#ifdef OTA_SMIF_DMA
+        stats->idle_cycles = qspi_dma_get_idle_cycles();
+#endif
+    }
+}
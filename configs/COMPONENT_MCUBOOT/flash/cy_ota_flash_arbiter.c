@@ -0,0 +1,293 @@
+/******************************************************************************
+* File Name:   cy_ota_flash_arbiter.c
+*
+* Description: This file contains the external flash access arbiter shared by
+*              the OTA flash APIs and the application
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2023-2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+
+/* Header file includes */
+#include <stdio.h>
+#include <string.h>
+#include "cy_pdl.h"
+#include "cy_ota_flash.h"
+#include "cy_ota_flash_ext.h"
+#include "ota_cycles.h"
+
+/* FreeRTOS */
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+
+/**********************************************************************************************************************************
+ * local defines
+ **********************************************************************************************************************************/
+/* A hold of the external flash longer than this is counted as a long hold.
+ * The OTA flash APIs hold the flash for a 4 KB read, one row of a write or one
+ * sector of an erase. Reads and row writes take well below this time; a sector
+ * erase cannot be split, so the long holds are mostly erases of large sectors.
+ */
+#ifndef OTA_MEM_ARBITER_LONG_HOLD_US
+#define OTA_MEM_ARBITER_LONG_HOLD_US                (5000u)
+#endif
+
+/**********************************************************************************************************************************
+ * local variables & data
+ **********************************************************************************************************************************/
+static SemaphoreHandle_t         ota_mem_arbiter_mutex;
+static StaticSemaphore_t         ota_mem_arbiter_mutex_buffer;
+
+/* Registered clients, the default client accounts for the unregistered tasks */
+static cy_ota_mem_client_t       ota_mem_default_client = { .name = "other" };
+static cy_ota_mem_client_t       *ota_mem_clients = &ota_mem_default_client;
+
+/* Client holding the external flash, nesting depth and start of the hold */
+static cy_ota_mem_client_t       *ota_mem_owner;
+static uint32_t                  ota_mem_depth;
+static uint32_t                  ota_mem_hold_start;
+
+/**********************************************************************************************************************************
+ * Internal Functions
+ **********************************************************************************************************************************/
+/**
+ * @brief Creates the mutex on first use, so clients may use the arbiter before cy_ota_mem_init()
+ */
+static bool ota_mem_arbiter_init(void)
+{
+    if (ota_mem_arbiter_mutex == NULL)
+    {
+        taskENTER_CRITICAL();
+        if (ota_mem_arbiter_mutex == NULL)
+        {
+            /* Wait and hold times are measured with the cycle counter */
+            ota_cycles_enable();
+
+            ota_mem_arbiter_mutex = xSemaphoreCreateRecursiveMutexStatic(&ota_mem_arbiter_mutex_buffer);
+        }
+        taskEXIT_CRITICAL();
+    }
+    return (ota_mem_arbiter_mutex != NULL);
+}
+
+static cy_ota_mem_client_t *ota_mem_arbiter_find_client(TaskHandle_t task)
+{
+    cy_ota_mem_client_t *client;
+
+    for (client = ota_mem_clients; client != &ota_mem_default_client; client = client->next)
+    {
+        if (client->task == (void *)task)
+        {
+            return client;
+        }
+    }
+    return &ota_mem_default_client;
+}
+
+/**********************************************************************************************************************************
+ * External Functions
+ **********************************************************************************************************************************/
+/**
+ * @brief Registers the calling task as a client of the external flash arbiter
+ *
+ * The wait and hold times of the task are accounted to the client. Tasks that
+ * are not registered are accounted to a shared default client. Registering a
+ * client again binds it to the calling task.
+ *
+ * @param[in]   client     Client, must stay valid for the application lifetime.
+ * @param[in]   name       Name used when the statistics are printed.
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_TYPE_ERROR
+ */
+cy_rslt_t cy_ota_mem_client_register( cy_ota_mem_client_t *client, const char *name )
+{
+    cy_ota_mem_client_t *curr;
+
+    if ((client == NULL) || !ota_mem_arbiter_init())
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    taskENTER_CRITICAL();
+    for (curr = ota_mem_clients; curr != &ota_mem_default_client; curr = curr->next)
+    {
+        if (curr == client)
+        {
+            break;
+        }
+    }
+    if (curr != client)
+    {
+        memset(client, 0x00, sizeof(cy_ota_mem_client_t));
+        client->next = ota_mem_clients;
+        ota_mem_clients = client;
+    }
+    client->name = name;
+    client->task = (void *)xTaskGetCurrentTaskHandle();
+    taskEXIT_CRITICAL();
+
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Takes exclusive access to the external flash
+ *
+ * The mutex inherits the priority of the highest priority waiter and hands
+ * the flash to it on release, so the OTA flash APIs, which hold the flash
+ * for one page, row read or sector erase at a time, let a higher priority
+ * client in between two pages. Calls nest within the same task.
+ *
+ * @param[in]   timeout_ms Maximum time to wait, CY_OTA_MEM_WAIT_FOREVER to wait forever.
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_TYPE_ERROR on timeout
+ */
+cy_rslt_t cy_ota_mem_acquire( uint32_t timeout_ms )
+{
+    cy_ota_mem_client_t *client;
+    TickType_t ticks;
+    uint32_t start;
+
+    /* Before the scheduler starts there is a single user */
+    if ((xTaskGetSchedulerState() != taskSCHEDULER_RUNNING) || !ota_mem_arbiter_init())
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    if (xSemaphoreGetMutexHolder(ota_mem_arbiter_mutex) == xTaskGetCurrentTaskHandle())
+    {
+        (void)xSemaphoreTakeRecursive(ota_mem_arbiter_mutex, 0);
+        ota_mem_depth++;
+        return CY_RSLT_SUCCESS;
+    }
+
+    client = ota_mem_arbiter_find_client(xTaskGetCurrentTaskHandle());
+
+    ticks = (timeout_ms == CY_OTA_MEM_WAIT_FOREVER) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+    start = DWT->CYCCNT;
+    if (xSemaphoreTakeRecursive(ota_mem_arbiter_mutex, 0) != pdTRUE)
+    {
+        uint32_t wait_us;
+
+        if (xSemaphoreTakeRecursive(ota_mem_arbiter_mutex, ticks) != pdTRUE)
+        {
+            /* Not holding the mutex, other unregistered tasks share the default client */
+            taskENTER_CRITICAL();
+            client->stats.timeouts++;
+            taskEXIT_CRITICAL();
+            return CY_RSLT_TYPE_ERROR;
+        }
+
+        wait_us = ota_cycles_to_us(DWT->CYCCNT - start);
+        client->stats.contended++;
+        client->stats.total_wait_us += wait_us;
+        if (wait_us > client->stats.max_wait_us)
+        {
+            client->stats.max_wait_us = wait_us;
+        }
+    }
+
+    ota_mem_owner = client;
+    ota_mem_depth = 1u;
+    ota_mem_hold_start = DWT->CYCCNT;
+    client->stats.acquisitions++;
+
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Releases the external flash taken by cy_ota_mem_acquire()
+ */
+void cy_ota_mem_release( void )
+{
+    cy_ota_mem_client_t *client = ota_mem_owner;
+
+    if ((xTaskGetSchedulerState() != taskSCHEDULER_RUNNING) || (ota_mem_arbiter_mutex == NULL) ||
+        (client == NULL) || (xSemaphoreGetMutexHolder(ota_mem_arbiter_mutex) != xTaskGetCurrentTaskHandle()))
+    {
+        return;
+    }
+
+    if (--ota_mem_depth == 0u)
+    {
+        uint32_t hold_us = ota_cycles_to_us(DWT->CYCCNT - ota_mem_hold_start);
+
+        if (hold_us > client->stats.max_hold_us)
+        {
+            client->stats.max_hold_us = hold_us;
+        }
+        if (hold_us > OTA_MEM_ARBITER_LONG_HOLD_US)
+        {
+            client->stats.long_holds++;
+        }
+        ota_mem_owner = NULL;
+    }
+    (void)xSemaphoreGiveRecursive(ota_mem_arbiter_mutex);
+}
+
+/**
+ * @brief Returns the wait and hold counters of a client of the external flash arbiter
+ *
+ * @param[in]   index      Client index, starting at 0.
+ * @param[out]  stats      Pointer to the structure to store the counters.
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_TYPE_ERROR when there is no client at index
+ */
+cy_rslt_t cy_ota_mem_get_client_stats( uint32_t index, cy_ota_mem_client_stats_t *stats )
+{
+    cy_ota_mem_client_t *client = ota_mem_clients;
+
+    while ((index > 0u) && (client != &ota_mem_default_client))
+    {
+        client = client->next;
+        index--;
+    }
+
+    if ((index != 0u) || (stats == NULL))
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    taskENTER_CRITICAL();
+    *stats = client->stats;
+    taskEXIT_CRITICAL();
+    stats->name = client->name;
+
+    return CY_RSLT_SUCCESS;
+}
@@ -0,0 +1,210 @@
+/******************************************************************************
+* File Name:   cy_ota_flash_ext.h
+*
+* Description: This file contains the declarations of the application specific
+*              extensions to the OTA flash APIs in cy_ota_flash.c
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2023-2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef CY_OTA_FLASH_EXT_H_
+#define CY_OTA_FLASH_EXT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "cy_result.h"
+#include "cy_ota_flash.h"
+
+/* cy_ota_mem_acquire() timeout waiting until the external flash is free */
+#define CY_OTA_MEM_WAIT_FOREVER     (0xFFFFFFFFu)
+
+/*******************************************************************************
+* Data structure and enumeration
+********************************************************************************/
+/* Counters of the small (MCUboot trailer) writes to the external flash */
+typedef struct
+{
+    uint32_t in_place;      /* Programmed in place, no erase and no row rewrite */
+    uint32_t unchanged;     /* Flash already held the data, nothing programmed */
+    uint32_t fallback;      /* Needed a 0 -> 1 transition, row rewritten */
+} cy_ota_mem_trailer_stats_t;
+
+/* Counters of the external flash read cache */
+typedef struct
+{
+    uint32_t hits;          /* Rows served from the cache */
+    uint32_t misses;        /* Rows read from the flash into the cache */
+    uint32_t bypassed;      /* Long reads not going through the cache */
+    uint32_t invalidations; /* Cached rows dropped by a write or erase */
+} cy_ota_mem_read_cache_stats_t;
+
+/* Flash rows written, by how the data reached the flash. A row is programmed
+ * in place, from the caller's buffer, when the write covers it whole and the
+ * buffer is 4-byte aligned; chunks that start on a row boundary at an aligned
+ * address take no copy.
+ */
+typedef struct
+{
+    uint32_t in_place;      /* Programmed from the caller's buffer */
+    uint32_t staged;        /* Copied to a row buffer first (unaligned buffer, encryption) */
+    uint32_t merged;        /* Partial rows read, merged with the data and written back */
+} cy_ota_mem_row_stats_t;
+
+/* External flash program command and timing, bus cycles are per 4 KB. When
+ * command differs from basic_command, the first 4 KB written are programmed
+ * with basic_command and counted in basic_bytes and basic_cycles.
+ */
+typedef struct
+{
+    uint8_t  basic_command;     /* Page program command detected by SFDP */
+    uint8_t  command;           /* Page program command in use */
+    uint32_t basic_bus_cycles;  /* Estimated SPI clock cycles with basic_command */
+    uint32_t bus_cycles;        /* Estimated SPI clock cycles with command */
+    uint32_t basic_bytes;       /* Bytes programmed with basic_command */
+    uint64_t basic_cycles;      /* CPU cycles spent programming them */
+    uint32_t bytes;             /* Bytes programmed with command */
+    uint64_t cycles;            /* CPU cycles spent programming them */
+} cy_ota_mem_program_stats_t;
+
+/* CPU load of the external flash transfers. The CPU is busy for
+ * (cycles - idle_cycles), compare the busy cycles per KB of a build with and
+ * without SMIF_DMA=1 at the same download throughput.
+ */
+typedef struct
+{
+    uint8_t  dma;           /* 1 when the transfers use DMA */
+    uint32_t read_bytes;
+    uint32_t write_bytes;
+    uint64_t cycles;        /* CPU cycles from start to end of the transfers */
+    uint64_t idle_cycles;   /* Part of cycles the calling task was blocked */
+} cy_ota_mem_transfer_stats_t;
+
+/* Operations accepted by cy_ota_mem_submit() */
+typedef enum
+{
+    CY_OTA_MEM_OP_READ,
+    CY_OTA_MEM_OP_WRITE,
+    CY_OTA_MEM_OP_ERASE,
+    CY_OTA_MEM_OP_FLUSH,    /* Completes once every operation submitted before it is done */
+} cy_ota_mem_op_type_t;
+
+struct cy_ota_mem_op;
+
+/* Called from the flash worker task when the operation is done */
+typedef void (*cy_ota_mem_op_cb_t)(struct cy_ota_mem_op *op, cy_rslt_t result);
+
+/*
+ * Asynchronous flash operation. The operation is owned by the caller and must
+ * stay valid until its callback is called. The write data is copied when the
+ * write is merged into a page, but must also stay valid until completion.
+ */
+typedef struct cy_ota_mem_op
+{
+    cy_ota_mem_op_type_t    type;
+    cy_ota_mem_type_t       mem_type;
+    uint32_t                addr;
+    void                    *data;      /* Source (write) or destination (read) */
+    size_t                  len;
+    cy_ota_mem_op_cb_t      cb;         /* May be NULL */
+    void                    *cb_arg;
+
+    /* Private, set by cy_ota_mem_submit() */
+    uint32_t                submit_tick;
+    struct cy_ota_mem_op    *next;
+} cy_ota_mem_op_t;
+
+/* Counters of the asynchronous flash operation queue */
+typedef struct
+{
+    uint32_t submitted;
+    uint32_t completed;
+    uint32_t failed;
+    uint32_t merged_writes;     /* Writes merged into a page with adjacent writes */
+    uint32_t page_writes;       /* Page programs issued for the merged writes */
+    uint32_t erases_ahead;      /* Erases issued ahead of pending non-overlapping writes */
+    uint32_t depth;             /* Operations waiting in the queue */
+    uint32_t max_depth;
+    uint32_t total_latency_ms;  /* Sum of submit to completion times */
+    uint32_t max_latency_ms;
+} cy_ota_mem_queue_stats_t;
+
+/* Wait and hold counters of a client of the external flash arbiter */
+typedef struct
+{
+    const char *name;
+    uint32_t acquisitions;
+    uint32_t contended;         /* Acquisitions that had to wait for another client */
+    uint32_t timeouts;
+    uint32_t total_wait_us;
+    uint32_t max_wait_us;
+    uint32_t max_hold_us;
+    uint32_t long_holds;        /* Holds longer than OTA_MEM_ARBITER_LONG_HOLD_US */
+} cy_ota_mem_client_stats_t;
+
+/* Client of the external flash arbiter, registered by cy_ota_mem_client_register() */
+typedef struct cy_ota_mem_client
+{
+    /* Private */
+    const char                  *name;
+    void                        *task;
+    cy_ota_mem_client_stats_t   stats;
+    struct cy_ota_mem_client    *next;
+} cy_ota_mem_client_t;
+
+/*******************************************************************************
+* Function prototype
+********************************************************************************/
+void cy_ota_mem_get_trailer_stats(cy_ota_mem_trailer_stats_t *stats);
+void cy_ota_mem_get_read_cache_stats(cy_ota_mem_read_cache_stats_t *stats);
+void cy_ota_mem_get_program_stats(cy_ota_mem_program_stats_t *stats);
+void cy_ota_mem_get_row_stats(cy_ota_mem_row_stats_t *stats);
+void cy_ota_mem_get_transfer_stats(cy_ota_mem_transfer_stats_t *stats);
+
+void cy_ota_mem_erase_hold(bool hold);
+size_t cy_ota_mem_get_size(cy_ota_mem_type_t mem_type);
+
+cy_rslt_t cy_ota_mem_queue_init(void);
+cy_rslt_t cy_ota_mem_submit(cy_ota_mem_op_t *op);
+cy_rslt_t cy_ota_mem_flush(void);
+void cy_ota_mem_get_queue_stats(cy_ota_mem_queue_stats_t *stats);
+
+cy_rslt_t cy_ota_mem_client_register(cy_ota_mem_client_t *client, const char *name);
+cy_rslt_t cy_ota_mem_acquire(uint32_t timeout_ms);
+void cy_ota_mem_release(void);
+cy_rslt_t cy_ota_mem_get_client_stats(uint32_t index, cy_ota_mem_client_stats_t *stats);
+
+#endif /* CY_OTA_FLASH_EXT_H_ */
@@ -0,0 +1,461 @@
+/******************************************************************************
+* File Name:   cy_ota_flash_queue.c
+*
+* Description: This file contains the asynchronous OTA flash operation queue
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2023-2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+
+/* Header file includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cy_pdl.h"
+#include "cyhal.h"
+#include "cy_ota_flash.h"
+#include "cy_ota_flash_ext.h"
+
+/* FreeRTOS */
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+#include <semphr.h>
+
+/**********************************************************************************************************************************
+ * local defines
+ **********************************************************************************************************************************/
+/* Number of operations that can wait in the queue */
+#ifndef OTA_MEM_QUEUE_LENGTH
+#define OTA_MEM_QUEUE_LENGTH                        (16u)
+#endif
+
+/* Adjacent writes are merged up to this size, aligned to it */
+#ifndef OTA_MEM_QUEUE_PAGE_SIZE
+#define OTA_MEM_QUEUE_PAGE_SIZE                     (8u * CY_FLASH_SIZEOF_ROW)
+#endif
+
+/* A partially merged page is written once the queue is idle for this long */
+#ifndef OTA_MEM_QUEUE_IDLE_FLUSH_MS
+#define OTA_MEM_QUEUE_IDLE_FLUSH_MS                 (5u)
+#endif
+
+/* Flash worker task configurations */
+#define OTA_MEM_QUEUE_TASK_STACK_SIZE               (1024 * 2)
+#define OTA_MEM_QUEUE_TASK_PRIORITY                 (configMAX_PRIORITIES - 3)
+
+/**********************************************************************************************************************************
+ * local variables & data
+ **********************************************************************************************************************************/
+static QueueHandle_t             ota_mem_queue;
+static TaskHandle_t              ota_mem_queue_task_handle;
+static cy_ota_mem_queue_stats_t  ota_mem_queue_stats;
+static cy_ota_mem_client_t       ota_mem_queue_client;
+
+/* Page being merged from adjacent writes */
+static uint8_t                   *page_buffer;
+static uint32_t                  page_addr;
+static size_t                    page_len;
+static cy_ota_mem_type_t         page_mem_type;
+static cy_ota_mem_op_t           *page_ops_head;
+static cy_ota_mem_op_t           *page_ops_tail;
+
+#ifdef OTA_STATIC_ALLOCATION
+/* Queue, worker task and page, in place of the heap */
+static StaticQueue_t             ota_mem_queue_buffer;
+static uint8_t                   ota_mem_queue_storage[OTA_MEM_QUEUE_LENGTH * sizeof(cy_ota_mem_op_t *)];
+static StaticTask_t              ota_mem_queue_task_tcb;
+static StackType_t               ota_mem_queue_task_stack[OTA_MEM_QUEUE_TASK_STACK_SIZE];
+CY_ALIGN(4) static uint8_t       page_buffer_storage[OTA_MEM_QUEUE_PAGE_SIZE];
+#endif
+
+/**********************************************************************************************************************************
+ * Internal Functions
+ **********************************************************************************************************************************/
+static void ota_mem_queue_complete(cy_ota_mem_op_t *op, cy_rslt_t result)
+{
+    uint32_t latency_ms = (uint32_t)(xTaskGetTickCount() - op->submit_tick) * portTICK_PERIOD_MS;
+
+    taskENTER_CRITICAL();
+    ota_mem_queue_stats.completed++;
+    if (result != CY_RSLT_SUCCESS)
+    {
+        ota_mem_queue_stats.failed++;
+    }
+    ota_mem_queue_stats.total_latency_ms += latency_ms;
+    if (latency_ms > ota_mem_queue_stats.max_latency_ms)
+    {
+        ota_mem_queue_stats.max_latency_ms = latency_ms;
+    }
+    taskEXIT_CRITICAL();
+
+    if (op->cb != NULL)
+    {
+        op->cb(op, result);
+    }
+}
+
+static bool ota_mem_queue_page_overlaps(cy_ota_mem_type_t mem_type, uint32_t addr, size_t len)
+{
+    return ((page_len != 0u) && (mem_type == page_mem_type) &&
+            (addr < (page_addr + page_len)) && ((addr + len) > page_addr));
+}
+
+/**
+ * @brief Programs the merged page and completes the writes merged into it
+ */
+static void ota_mem_queue_page_flush(void)
+{
+    cy_ota_mem_op_t *op;
+    cy_rslt_t result;
+
+    if (page_len == 0u)
+    {
+        return;
+    }
+
+    result = cy_ota_mem_write(page_mem_type, page_addr, page_buffer, page_len);
+    ota_mem_queue_stats.page_writes++;
+    page_len = 0u;
+
+    op = page_ops_head;
+    page_ops_head = NULL;
+    page_ops_tail = NULL;
+    while (op != NULL)
+    {
+        cy_ota_mem_op_t *next = op->next;
+
+        op->next = NULL;
+        ota_mem_queue_complete(op, result);
+        op = next;
+    }
+}
+
+static void ota_mem_queue_write(cy_ota_mem_op_t *op)
+{
+    /* Only writes continuing the merged page in the same memory can be merged */
+    if ((page_len != 0u) &&
+        ((op->mem_type != page_mem_type) ||
+         (op->addr != (page_addr + page_len)) ||
+         ((page_len + op->len) > OTA_MEM_QUEUE_PAGE_SIZE)))
+    {
+        ota_mem_queue_page_flush();
+    }
+
+    if ((page_len == 0u) && (op->len >= OTA_MEM_QUEUE_PAGE_SIZE))
+    {
+        /* Already a full page, nothing to merge */
+        ota_mem_queue_complete(op, cy_ota_mem_write(op->mem_type, op->addr, op->data, op->len));
+        return;
+    }
+
+    if (page_len == 0u)
+    {
+        page_addr = op->addr;
+        page_mem_type = op->mem_type;
+    }
+    else
+    {
+        ota_mem_queue_stats.merged_writes++;
+    }
+
+    memcpy(&page_buffer[page_len], op->data, op->len);
+    page_len += op->len;
+
+    if (page_ops_tail != NULL)
+    {
+        page_ops_tail->next = op;
+    }
+    else
+    {
+        page_ops_head = op;
+    }
+    page_ops_tail = op;
+
+    /* Program as soon as the page is full or ends on a page boundary */
+    if ((page_len == OTA_MEM_QUEUE_PAGE_SIZE) || (((page_addr + page_len) % OTA_MEM_QUEUE_PAGE_SIZE) == 0u))
+    {
+        ota_mem_queue_page_flush();
+    }
+}
+
+static void ota_mem_queue_erase(cy_ota_mem_op_t *op)
+{
+    size_t erase_size = cy_ota_mem_get_erase_size(op->mem_type, op->addr);
+    uint32_t start = op->addr;
+    uint32_t end = op->addr + op->len;
+
+    /* The erase is widened to the sector boundaries */
+    if (erase_size != 0u)
+    {
+        start -= (start % erase_size);
+        end = ((end + erase_size - 1u) / erase_size) * erase_size;
+    }
+
+    if (ota_mem_queue_page_overlaps(op->mem_type, start, end - start))
+    {
+        /* Writes submitted before the erase must land before it */
+        ota_mem_queue_page_flush();
+    }
+    else if (page_len != 0u)
+    {
+        ota_mem_queue_stats.erases_ahead++;
+    }
+
+    ota_mem_queue_complete(op, cy_ota_mem_erase(op->mem_type, op->addr, op->len));
+}
+
+/**
+ * @brief Flash worker task, executes the submitted operations in order
+ */
+static void ota_mem_queue_task(void *arg)
+{
+    cy_ota_mem_op_t *op;
+    TickType_t wait;
+
+    (void)arg;
+
+    (void)cy_ota_mem_client_register(&ota_mem_queue_client, "flash queue");
+
+    for (;;)
+    {
+        wait = (page_len != 0u) ? pdMS_TO_TICKS(OTA_MEM_QUEUE_IDLE_FLUSH_MS) : portMAX_DELAY;
+        if (xQueueReceive(ota_mem_queue, &op, wait) != pdTRUE)
+        {
+            ota_mem_queue_page_flush();
+            continue;
+        }
+
+        taskENTER_CRITICAL();
+        ota_mem_queue_stats.depth = (uint32_t)uxQueueMessagesWaiting(ota_mem_queue);
+        taskEXIT_CRITICAL();
+
+        switch (op->type)
+        {
+            case CY_OTA_MEM_OP_WRITE:
+                ota_mem_queue_write(op);
+                break;
+
+            case CY_OTA_MEM_OP_READ:
+                if (ota_mem_queue_page_overlaps(op->mem_type, op->addr, op->len))
+                {
+                    ota_mem_queue_page_flush();
+                }
+                ota_mem_queue_complete(op, cy_ota_mem_read(op->mem_type, op->addr, op->data, op->len));
+                break;
+
+            case CY_OTA_MEM_OP_ERASE:
+                ota_mem_queue_erase(op);
+                break;
+
+            case CY_OTA_MEM_OP_FLUSH:
+            default:
+                ota_mem_queue_page_flush();
+                ota_mem_queue_complete(op, CY_RSLT_SUCCESS);
+                break;
+        }
+    }
+}
+
+static void ota_mem_flush_cb(cy_ota_mem_op_t *op, cy_rslt_t result)
+{
+    (void)result;
+    xSemaphoreGive((SemaphoreHandle_t)op->cb_arg);
+}
+
+/**********************************************************************************************************************************
+ * External Functions
+ **********************************************************************************************************************************/
+/**
+ * @brief Creates the operation queue and the flash worker task
+ *
+ * Once the queue is used, the internal flash must be accessed only through
+ * it, as the cy_ota_mem_* APIs are not re-entrant for it. External flash
+ * accesses are serialized by the arbiter, see cy_ota_mem_acquire().
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+cy_rslt_t cy_ota_mem_queue_init( void )
+{
+    if (ota_mem_queue != NULL)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+#ifdef OTA_STATIC_ALLOCATION
+    page_buffer = page_buffer_storage;
+    ota_mem_queue = xQueueCreateStatic(OTA_MEM_QUEUE_LENGTH, sizeof(cy_ota_mem_op_t *),
+                                       ota_mem_queue_storage, &ota_mem_queue_buffer);
+    if (ota_mem_queue == NULL)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    ota_mem_queue_task_handle = xTaskCreateStatic(ota_mem_queue_task, "Flash Worker",
+                                                  OTA_MEM_QUEUE_TASK_STACK_SIZE, NULL,
+                                                  OTA_MEM_QUEUE_TASK_PRIORITY,
+                                                  ota_mem_queue_task_stack, &ota_mem_queue_task_tcb);
+    if (ota_mem_queue_task_handle == NULL)
+    {
+        vQueueDelete(ota_mem_queue);
+        ota_mem_queue = NULL;
+        return CY_RSLT_TYPE_ERROR;
+    }
+    return CY_RSLT_SUCCESS;
+#else
+    page_buffer = (uint8_t *)malloc(OTA_MEM_QUEUE_PAGE_SIZE);
+    if (page_buffer == NULL)
+    {
+        printf("\n%s() - Memory allocation failed at %d\n", __func__, __LINE__);
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    ota_mem_queue = xQueueCreate(OTA_MEM_QUEUE_LENGTH, sizeof(cy_ota_mem_op_t *));
+    if (ota_mem_queue == NULL)
+    {
+        free(page_buffer);
+        page_buffer = NULL;
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    if (xTaskCreate(ota_mem_queue_task, "Flash Worker", OTA_MEM_QUEUE_TASK_STACK_SIZE, NULL,
+                    OTA_MEM_QUEUE_TASK_PRIORITY, &ota_mem_queue_task_handle) != pdPASS)
+    {
+        vQueueDelete(ota_mem_queue);
+        ota_mem_queue = NULL;
+        free(page_buffer);
+        page_buffer = NULL;
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    return CY_RSLT_SUCCESS;
+#endif
+}
+
+/**
+ * @brief Queues a flash operation, the callback is called from the flash worker task on completion
+ *
+ * Blocks while the queue is full.
+ *
+ * @param[in]   op         Operation to execute @ref cy_ota_mem_op_t
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+cy_rslt_t cy_ota_mem_submit( cy_ota_mem_op_t *op )
+{
+    uint32_t depth;
+
+    if ((ota_mem_queue == NULL) || (op == NULL) ||
+        ((op->type != CY_OTA_MEM_OP_FLUSH) && (op->len == 0u)) ||
+        (((op->type == CY_OTA_MEM_OP_READ) || (op->type == CY_OTA_MEM_OP_WRITE)) && (op->data == NULL)))
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    op->submit_tick = xTaskGetTickCount();
+    op->next = NULL;
+
+    if (xQueueSend(ota_mem_queue, &op, portMAX_DELAY) != pdTRUE)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    depth = (uint32_t)uxQueueMessagesWaiting(ota_mem_queue);
+
+    taskENTER_CRITICAL();
+    ota_mem_queue_stats.submitted++;
+    ota_mem_queue_stats.depth = depth;
+    if (depth > ota_mem_queue_stats.max_depth)
+    {
+        ota_mem_queue_stats.max_depth = depth;
+    }
+    taskEXIT_CRITICAL();
+
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief Waits until every operation submitted before the call is done
+ *
+ * Must not be called from a completion callback.
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+cy_rslt_t cy_ota_mem_flush( void )
+{
+    cy_ota_mem_op_t op;
+    StaticSemaphore_t done_buffer;
+    SemaphoreHandle_t done;
+    cy_rslt_t result;
+
+    done = xSemaphoreCreateBinaryStatic(&done_buffer);
+    if (done == NULL)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    memset(&op, 0, sizeof(op));
+    op.type = CY_OTA_MEM_OP_FLUSH;
+    op.cb = ota_mem_flush_cb;
+    op.cb_arg = done;
+
+    result = cy_ota_mem_submit(&op);
+    if (result == CY_RSLT_SUCCESS)
+    {
+        (void)xSemaphoreTake(done, portMAX_DELAY);
+    }
+
+    vSemaphoreDelete(done);
+    return result;
+}
+
+/**
+ * @brief Returns the counters of the operation queue
+ *
+ * @param[out]  stats      Pointer to the structure to store the counters.
+ */
+void cy_ota_mem_get_queue_stats( cy_ota_mem_queue_stats_t *stats )
+{
+    if (stats != NULL)
+    {
+        taskENTER_CRITICAL();
+        *stats = ota_mem_queue_stats;
+        taskEXIT_CRITICAL();
+    }
+}
@@ -126,6 +126,20 @@ extern "C" {
  */
 #define CY_OTA_MAX_DOWNLOAD_TRIES           (3)             /* 3 download OTA Image retries */
 
+/**
+ * @brief Size of the chunk data the agent receives
+ *
+ * The MQTT receive buffer of the agent is sized from it, with room for the
+ * MQTT header, the topic and the chunk header. The chunk size negotiation
+ * (ota_chunk_size.h) never advertises a larger "MaxChunkSize". 4 KB unless
+ * LARGE_CHUNKS=1 in the Makefile.
+ */
+#ifdef OTA_LARGE_CHUNKS
+#define CY_OTA_CHUNK_SIZE                   (16 * 1024)     /* 16 KB chunks at most */
+#else
+#define CY_OTA_CHUNK_SIZE                   (4 * 1024)      /* 4 KB chunks at most */
+#endif
+
 /**********************************************************************
  * Message Defines
  **********************************************************************/
@@ -1143,4 +1143,16 @@
 
 #endif /* DISABLE_MBEDTLS_ACCELERATION */
 
+/**
+ * Static allocation build (STATIC_ALLOC=1): mbed TLS allocates from the static
+ * buffer that ota_static_alloc_init() hands to mbedtls_memory_buffer_alloc_init()
+ * instead of the heap. Platforms that already enable the buffer allocator
+ * above keep their own buffer.
+ */
+#if defined(OTA_STATIC_ALLOCATION) && !defined(MBEDTLS_MEMORY_BUFFER_ALLOC_C)
+#define MBEDTLS_PLATFORM_MEMORY
+#define MBEDTLS_MEMORY_BUFFER_ALLOC_C
+#define OTA_MBEDTLS_STATIC_ARENA
+#endif
+
 #endif /* MBEDTLS_USER_CONFIG_HEADER */
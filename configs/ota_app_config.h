@@ -59,6 +59,13 @@
  */
 #define WIFI_SECURITY       (CY_WCM_SECURITY_WPA2_AES_PSK)
 
+/* Set to 1 to configure the IP address, netmask and gateway last obtained
+ * from DHCP as a static IP address on the first connection attempt. DHCP does
+ * not run then and the address is not leased from the server, so only enable
+ * it when the DHCP server reserves the address for this device.
+ */
+#define WIFI_CACHED_STATIC_IP (0)
+
 /* MQTT Broker endpoint */
 #define MQTT_BROKER_URL     "" 
 
@@ -76,6 +83,15 @@
 /* MQTT identifier - less than 17 characters*/
 #define OTA_MQTT_ID         "CY_IOT_DEVICE"
 
+/* Set to 1 to connect with a persistent MQTT session. The broker then keeps
+ * the QoS 1 subscriptions across reconnects and queues the messages published
+ * while the device is offline. This needs a client identifier that is stable
+ * and unique per device: OTA_MQTT_ID_PREFIX (at most 4 characters) followed
+ * by the Wi-Fi MAC address is used instead of OTA_MQTT_ID.
+ */
+#define OTA_MQTT_PERSISTENT_SESSION (0)
+#define OTA_MQTT_ID_PREFIX          "CY_"
+
 /* Number of MQTT topic filters */
 #define MQTT_TOPIC_FILTER_NUM   (1)
 
@@ -85,6 +101,26 @@ const char * my_topics[ MQTT_TOPIC_FILTER_NUM ] =
         COMPANY_TOPIC_PREPEND "/" CY_TARGET_BOARD_STRING "/" PUBLISHER_DIRECT_TOPIC
 };
 
+/* Topic of the download telemetry messages, see ota_telemetry.c */
+#define OTA_TELEMETRY_TOPIC     COMPANY_TOPIC_PREPEND "/" CY_TARGET_BOARD_STRING "/" "telemetry"
+
+/* Time between two telemetry messages while the image is downloaded */
+#define OTA_TELEMETRY_PERIOD_MS (2000)
+
+/* Topic the Publisher listens to, a resumed download asks it for the missing
+ * chunks there, see ota_resume.c
+ */
+#define OTA_CHUNK_REQUEST_TOPIC COMPANY_TOPIC_PREPEND "/" CY_TARGET_BOARD_STRING "/" PUBLISHER_LISTEN_TOPIC
+
+/* Bytes downloaded between two checkpoints of the download in the KV store */
+#define OTA_RESUME_CHECKPOINT_BYTES (64 * 1024)
+
+/* 1: the chunks of every download are requested from the Publisher, several
+ * at a time. 0: only the rest of an interrupted download is requested, a new
+ * download is sent by the Publisher as a whole.
+ */
+#define OTA_CHUNK_REQUESTS          (0)
+
 /*
  * AWS IoT MQTT Mode - This parameter must be 1 when using the AWS IoT MQTT
  *                     server, 0 otherwise.
@@ -0,0 +1,160 @@
+import re
+import subprocess
+import sys
+
+#
+#   Post-build check for XIP_RAM_ISR=1 builds.
+#
+#   cy_ota_flash.c leaves the RAM-resident interrupts enabled while XIP is
+#   turned off for SMIF programming. Any instruction fetched from XIP at that
+#   point faults, so every function reachable from those interrupt handlers
+#   must be linked outside the XIP region.
+#
+#   The script disassembles the ELF file, builds the static call graph from
+#   the direct branches (b, bl, b.w, cbz, ...), walks it from the interrupt
+#   handlers and fails the build if any reachable function lives in XIP, or
+#   refers to an address in XIP: a literal pool word (.word), a pc-relative
+#   load from a pool placed in XIP, or a movw/movt pair. These are constant
+#   data, strings and function pointers the handler path would read or call
+#   with XIP off. Indirect calls (blx rN) cannot be followed and are reported
+#   as warnings.
+#
+# Usage:
+#   python check_ram_isr.py <elf file> <objdump> [<handler> ...]
+#
+
+# XIP (SMIF memory-mapped) region of PSoC 6
+XIP_START = 0x18000000
+XIP_END   = 0x20000000
+
+# Interrupt handlers that are left enabled while XIP is off
+DEFAULT_ROOTS = [
+    "SVC_Handler",
+    "PendSV_Handler",
+    "SysTick_Handler",
+    "_cyhal_sdhc_irq_handler",
+    "_cyhal_gpio_irq_handler",
+    "whd_bus_sdio_irq_handler",
+    "whd_thread_notify_irq",
+]
+
+FUNC_RE   = re.compile(r'^([0-9a-f]+) <([^>]+)>:$')
+BRANCH_RE = re.compile(r'^\s*[0-9a-f]+:\s+(?:[0-9a-f]{4}(?: [0-9a-f]{4})?\s+)?'
+                       r'(b|bl|b\.w|b\.n|bl\.w|cbz|cbnz|b[a-z]{2}|b[a-z]{2}\.w|b[a-z]{2}\.n)\s+'
+                       r'(?:r\d+,\s*)?([0-9a-f]+) <([^>+]+)(?:\+0x[0-9a-f]+)?>')
+INDIRECT_RE = re.compile(r'^\s*[0-9a-f]+:.*\s(blx|bx)\s+(r\d+|ip|lr)\b')
+# Literal pool word:                    1a4:  .word  0x18004567
+WORD_RE   = re.compile(r'^\s*[0-9a-f]+:\s+(?:[0-9a-f]{8}\s+)?\.word\s+0x([0-9a-f]+)')
+# Load from a literal pool:             ldr r3, [pc, #24]  @ (1c0 <foo+0x1c>)
+LITERAL_RE = re.compile(r'\[pc,\s*#-?\d+\]\s*[@;]\s*\(([0-9a-f]+)')
+# Address built in a register:          movw r3, #4660 / movt r3, #6144
+MOVW_RE   = re.compile(r'^\s*[0-9a-f]+:.*\smovw\s+(r\d+|ip|lr),\s*#(\d+)')
+MOVT_RE   = re.compile(r'^\s*[0-9a-f]+:.*\smovt\s+(r\d+|ip|lr),\s*#(\d+)')
+
+def in_xip(address):
+    return XIP_START <= address < XIP_END
+
+def parse_disassembly(elf_file, objdump):
+    functions = {}      # name -> address
+    calls = {}          # name -> set of callee names
+    indirect = {}       # name -> number of indirect calls
+    references = {}     # name -> set of addresses in XIP it refers to
+    movw = {}           # register -> low half of the address being built
+    current = None
+
+    output = subprocess.run([objdump, "-d", "--no-show-raw-insn", elf_file],
+                            stdout=subprocess.PIPE, universal_newlines=True, check=True).stdout
+
+    for line in output.splitlines():
+        match = FUNC_RE.match(line)
+        if match:
+            current = match.group(2)
+            functions[current] = int(match.group(1), 16)
+            calls.setdefault(current, set())
+            movw = {}
+            continue
+        if current is None:
+            continue
+        match = BRANCH_RE.match(line)
+        if match:
+            target = match.group(3)
+            if target != current:
+                calls[current].add(target)
+            continue
+        match = INDIRECT_RE.match(line)
+        if match and match.group(2) != "lr":
+            indirect[current] = indirect.get(current, 0) + 1
+            continue
+
+        address = None
+        match = WORD_RE.match(line)
+        if match:
+            address = int(match.group(1), 16)
+        match = LITERAL_RE.search(line)
+        if match:
+            address = int(match.group(1), 16)
+        match = MOVW_RE.match(line)
+        if match:
+            movw[match.group(1)] = int(match.group(2))
+        match = MOVT_RE.match(line)
+        if match and match.group(1) in movw:
+            address = (int(match.group(2)) << 16) | movw.pop(match.group(1))
+        if address is not None and in_xip(address):
+            references.setdefault(current, set()).add(address)
+
+    return functions, calls, indirect, references
+
+def check(elf_file, objdump, roots):
+    functions, calls, indirect, references = parse_disassembly(elf_file, objdump)
+
+    failed = False
+    visited = {}
+    pending = []
+    for root in roots:
+        if root not in functions:
+            print("check_ram_isr: WARNING: handler '" + root + "' not found in " + elf_file)
+            continue
+        visited[root] = None
+        pending.append(root)
+
+    while pending:
+        name = pending.pop()
+        for callee in calls.get(name, ()):
+            if callee not in visited:
+                visited[callee] = name
+                pending.append(callee)
+
+    for name in sorted(visited):
+        address = functions.get(name)
+        if address is None:
+            continue
+        if in_xip(address):
+            failed = True
+            chain = [name]
+            caller = visited[name]
+            while caller is not None:
+                chain.append(caller)
+                caller = visited[caller]
+            print("check_ram_isr: ERROR: " + name + " @ 0x%08x is in XIP, reached from: " % address +
+                  " <- ".join(chain[1:]))
+        if (address is not None) and not in_xip(address):
+            for target in sorted(references.get(name, ())):
+                failed = True
+                print("check_ram_isr: ERROR: " + name + " refers to 0x%08x in XIP" % target)
+        if name in indirect:
+            print("check_ram_isr: WARNING: " + name + " makes " + str(indirect[name]) +
+                  " indirect call(s) that were not followed")
+
+    print("check_ram_isr: " + str(len(visited)) + " functions reachable from " +
+          str(len(roots)) + " interrupt handlers")
+    return not failed
+
+if __name__ == "__main__":
+    if len(sys.argv) < 3:
+        print("Usage: python check_ram_isr.py <elf file> <objdump> [<handler> ...]")
+        sys.exit(2)
+
+    roots = sys.argv[3:] if len(sys.argv) > 3 else DEFAULT_ROOTS
+    if not check(sys.argv[1], sys.argv[2], roots):
+        print("check_ram_isr: interrupt path reaches XIP. Add the objects above, with their constant data, to linker_xip_ram_isr.ld")
+        sys.exit(1)
@@ -0,0 +1,197 @@
+import base64
+import re
+import struct
+import sys
+
+#
+#   Host decoder of the tokenized console output (TOKENIZED_LOG=1).
+#
+#   OTA_PRINTF() prints '$' followed by a base64 record: the 32-bit token
+#   (65599 hash of the format string) and the encoded arguments. The format
+#   strings are only in the .ota_log_fmt section of the ELF file, which is not
+#   loaded into the device. The script reads that section, hashes every string
+#   the same way as OTA_LOG_TOKEN() in source/ota_log_token.h and replaces each
+#   record with the formatted text. Other console output is copied unchanged.
+#
+# Usage:
+#   python decode_log_tokens.py <elf file> [<log file>]
+#
+#   Without a log file the console output is read from stdin, for example:
+#   python decode_log_tokens.py build/APP_CY8CPROTO-062-4343W/Release/mtb-example-ota-mqtt.elf < /dev/ttyACM0
+#
+
+# Must match OTA_LOG_TOKEN_HASH_LENGTH in source/ota_log_token.h
+HASH_LENGTH = 96
+HASH_COEFFICIENT = 65599
+
+SECTION_NAME = b".ota_log_fmt"
+
+ARG_INT    = 0
+ARG_INT64  = 1
+ARG_DOUBLE = 2
+ARG_STRING = 3
+
+RECORD_RE = re.compile(r'\$([A-Za-z0-9+/]+={0,2})')
+SPEC_RE   = re.compile(r'%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(hh|h|ll|l|j|z|t|L)?([diouxXcsfFeEgGp%])')
+
+def token_hash(fmt):
+    token = len(fmt)
+    coefficient = HASH_COEFFICIENT
+    for char in fmt[:HASH_LENGTH]:
+        token = (token + coefficient * char) & 0xFFFFFFFF
+        coefficient = (coefficient * HASH_COEFFICIENT) & 0xFFFFFFFF
+    return token
+
+def read_section(elf_file, name):
+    with open(elf_file, "rb") as f:
+        elf = f.read()
+    if elf[:4] != b"\x7fELF" or elf[4] != 1 or elf[5] != 1:
+        raise ValueError(elf_file + " is not a 32-bit little endian ELF file")
+
+    shoff, = struct.unpack_from("<I", elf, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from("<HHH", elf, 0x2E)
+    headers = [struct.unpack_from("<IIIIII", elf, shoff + i * shentsize) for i in range(shnum)]
+    strtab_offset = headers[shstrndx][4]
+
+    for sh_name, _, _, _, offset, size in headers:
+        end = elf.index(b"\0", strtab_offset + sh_name)
+        if elf[strtab_offset + sh_name:end] == name:
+            return elf[offset:offset + size]
+    return None
+
+def load_tokens(elf_file):
+    section = read_section(elf_file, SECTION_NAME)
+    if section is None:
+        raise ValueError(elf_file + " has no " + SECTION_NAME.decode() + " section, build with TOKENIZED_LOG=1")
+
+    tokens = {}
+    for fmt in section.split(b"\0"):
+        if not fmt:
+            continue
+        token = token_hash(fmt)
+        if token in tokens and tokens[token] != fmt:
+            sys.stderr.write("decode_log_tokens: WARNING: token 0x%08x collision: %r %r\n" %
+                             (token, tokens[token], fmt))
+        tokens[token] = fmt
+    return tokens
+
+def read_varint(record, pos):
+    value = 0
+    shift = 0
+    while True:
+        byte = record[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            break
+    return (value >> 1) ^ -(value & 1), pos
+
+def decode_args(record, types):
+    args = []
+    pos = 0
+    for arg_type in types:
+        if pos >= len(record):
+            break
+        if arg_type == ARG_STRING:
+            length = record[pos] & 0x7F
+            value = record[pos + 1:pos + 1 + length].decode("latin-1")
+            if record[pos] & 0x80:
+                value += "..."
+            pos += 1 + length
+        elif arg_type == ARG_DOUBLE:
+            value, = struct.unpack_from("<f", record, pos)
+            pos += 4
+        else:
+            value, pos = read_varint(record, pos)
+        args.append(value)
+    return args
+
+def arg_types(fmt):
+    types = []
+    for match in SPEC_RE.finditer(fmt):
+        flags, width, precision, length, conversion = match.groups()
+        if conversion == "%":
+            continue
+        if width == "*":
+            types.append(ARG_INT)
+        if precision == "*":
+            types.append(ARG_INT)
+        if conversion == "s":
+            types.append(ARG_STRING)
+        elif conversion in "fFeEgG":
+            types.append(ARG_DOUBLE)
+        elif length in ("ll", "j"):
+            types.append(ARG_INT64)
+        else:
+            types.append(ARG_INT)
+    return types
+
+def format_record(fmt, args):
+    args = list(args)
+    missing = [False]
+
+    def next_arg():
+        if args:
+            return args.pop(0)
+        missing[0] = True
+        return None
+
+    def replace(match):
+        flags, width, precision, length, conversion = match.groups()
+        if conversion == "%":
+            return "%"
+        if width == "*":
+            width = next_arg()
+        if precision == "*":
+            precision = next_arg()
+        value = next_arg()
+        if value is None:
+            return "<?>"
+
+        spec = "%" + flags + (str(width) if width is not None else "")
+        if precision is not None:
+            spec += "." + str(precision)
+        if conversion in "ouxX":
+            value &= 0xFFFFFFFFFFFFFFFF if length in ("ll", "j") else 0xFFFFFFFF
+        elif conversion in "di":
+            conversion = "d"
+        elif conversion == "p":
+            return "0x%08x" % (value & 0xFFFFFFFF)
+        elif conversion == "c":
+            value = chr(value & 0xFF)
+        return (spec + conversion) % value
+
+    text = SPEC_RE.sub(replace, fmt)
+    if missing[0]:
+        text += " <truncated>"
+    return text
+
+def decode_line(line, tokens):
+    def replace(match):
+        try:
+            record = base64.b64decode(match.group(1))
+        except ValueError:
+            return match.group(0)
+        if len(record) < 4:
+            return match.group(0)
+        token, = struct.unpack_from("<I", record)
+        fmt = tokens.get(token)
+        if fmt is None:
+            return "<unknown token 0x%08x>\n" % token
+        fmt = fmt.decode("latin-1")
+        return format_record(fmt, decode_args(record[4:], arg_types(fmt)))
+
+    # The record's own '\n' is part of the decoded format string
+    return RECORD_RE.sub(replace, line.rstrip("\r\n")) if RECORD_RE.search(line) else line
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print("Usage: python decode_log_tokens.py <elf file> [<log file>]")
+        sys.exit(2)
+
+    tokens = load_tokens(sys.argv[1])
+    log = open(sys.argv[2], "r", errors="replace") if len(sys.argv) > 2 else sys.stdin
+    for line in log:
+        sys.stdout.write(decode_line(line, tokens))
+        sys.stdout.flush()
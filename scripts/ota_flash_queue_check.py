@@ -0,0 +1,816 @@
+import os
+import subprocess
+import sys
+import tempfile
+
+#
+#   Host check of the asynchronous flash operation queue.
+#
+#   cy_ota_flash_queue.c and its caller ota_kv_store.c are built for the host
+#   with the C compiler, against small stand-ins for the PSoC, FreeRTOS, and
+#   MCUboot headers: the FreeRTOS tasks, queues, and semaphores are POSIX
+#   threads, and the external flash is a NOR flash in RAM, whose programs can
+#   only clear bits. The harness checks that
+#    - adjacent writes are merged into one page program,
+#    - an erase overlapping the pending page waits for it, and one that does
+#      not is issued ahead of it,
+#    - a read of the pending page returns the data written,
+#    - a failed program reaches the callback and the failed counter,
+#    - the depth and latency counters follow the queue,
+#    - the KV store keeps every value through compactions and a new
+#      ota_kv_init(), with its records programmed through the queue.
+#
+# Usage:
+#   python ota_flash_queue_check.py
+#
+#   The C compiler is taken from the CC environment variable, "cc" by default.
+#
+
+# Sources built for the host, from the repository root
+DEVICE_SOURCES = [
+    os.path.join("configs", "COMPONENT_MCUBOOT", "flash", "cy_ota_flash_queue.c"),
+    os.path.join("source", "ota_kv_store.c"),
+]
+
+# Include directories of the device headers, from the repository root
+DEVICE_INCLUDES = [
+    os.path.join("configs", "COMPONENT_MCUBOOT", "flash"),
+    "source",
+]
+
+# A page is only programmed early when the queue stays idle this long, well
+# above the scheduling jitter of the host
+DEFINES = ["-DOTA_MEM_QUEUE_IDLE_FLUSH_MS=200u", "-D_POSIX_C_SOURCE=200809L"]
+
+# Stand-ins for the headers of the libraries the device sources include
+STUB_HEADERS = {
+    "cy_result.h": """
+#include <stdint.h>
+typedef uint32_t cy_rslt_t;
+#define CY_RSLT_SUCCESS                     (0u)
+#define CY_RSLT_TYPE_ERROR                  (2u)
+#define CY_RSLT_MODULE_MIDDLEWARE_BASE      (0x200u)
+#define CY_RSLT_CREATE(type, module, code)  ((cy_rslt_t)(((type) << 16) | ((module) << 18) | (code)))
+""",
+    "cy_pdl.h": """
+#include <stdint.h>
+#include "cy_result.h"
+#define CY_IP_MXSMIF
+#define CY_XIP_BASE                         (0x18000000u)
+#define CY_FLASH_SIZEOF_ROW                 (512u)
+#define CY_ALIGN(align)                     __attribute__((aligned(align)))
+typedef struct { volatile uint32_t CTRL; volatile uint32_t CYCCNT; } stub_dwt_t;
+typedef struct { volatile uint32_t DEMCR; } stub_core_debug_t;
+extern stub_dwt_t stub_dwt;
+extern stub_core_debug_t stub_core_debug;
+extern uint32_t SystemCoreClock;
+#define DWT                                 (&stub_dwt)
+#define CoreDebug                           (&stub_core_debug)
+#define DWT_CTRL_CYCCNTENA_Msk              (1u)
+#define CoreDebug_DEMCR_TRCENA_Msk          (1u << 24)
+""",
+    "cyhal.h": "",
+    "cy_ota_flash.h": """
+#include <stddef.h>
+#include "cy_result.h"
+typedef enum { CY_OTA_MEM_TYPE_INTERNAL_FLASH, CY_OTA_MEM_TYPE_EXTERNAL_FLASH } cy_ota_mem_type_t;
+cy_rslt_t cy_ota_mem_read(cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len);
+cy_rslt_t cy_ota_mem_write(cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len);
+cy_rslt_t cy_ota_mem_erase(cy_ota_mem_type_t mem_type, uint32_t addr, size_t len);
+size_t cy_ota_mem_get_erase_size(cy_ota_mem_type_t mem_type, uint32_t addr);
+""",
+    "flash_map_backend.h": """
+#include <stdint.h>
+struct flash_area { uint8_t fa_id; uint8_t fa_device_id; uint16_t pad16; uint32_t fa_off; uint32_t fa_size; };
+#define FLASH_DEVICE_INTERNAL_FLASH         (0u)
+#define FLASH_DEVICE_EXTERNAL_FLASH(n)      (0x80u | (n))
+int flash_area_open(uint8_t id, const struct flash_area **fa);
+void flash_area_close(const struct flash_area *fa);
+""",
+    "sysflash.h": """
+#define FLASH_AREA_IMAGE_SECONDARY(image)   (2u)
+""",
+    "FreeRTOS.h": """
+#include <stdint.h>
+#include <pthread.h>
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t StackType_t;
+typedef struct { int unused; } StaticTask_t;
+typedef struct { int unused; } StaticQueue_t;
+typedef struct { pthread_mutex_t mutex; pthread_cond_t cond; int count; } StaticSemaphore_t;
+typedef struct stub_task *TaskHandle_t;
+typedef struct stub_queue *QueueHandle_t;
+typedef StaticSemaphore_t *SemaphoreHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+#define pdTRUE                              (1)
+#define pdFALSE                             (0)
+#define pdPASS                              (1)
+#define portMAX_DELAY                       (0xFFFFFFFFu)
+#define portTICK_PERIOD_MS                  (1u)
+#define pdMS_TO_TICKS(ms)                   ((TickType_t)(ms))
+#define configMAX_PRIORITIES                (8)
+void stub_enter_critical(void);
+void stub_exit_critical(void);
+#define taskENTER_CRITICAL()                stub_enter_critical()
+#define taskEXIT_CRITICAL()                 stub_exit_critical()
+""",
+    "task.h": """
+#include "FreeRTOS.h"
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *handle);
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                               StackType_t *stack_buffer, StaticTask_t *tcb);
+TickType_t xTaskGetTickCount(void);
+""",
+    "queue.h": """
+#include "FreeRTOS.h"
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage, StaticQueue_t *buffer);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+void vQueueDelete(QueueHandle_t queue);
+""",
+    "semphr.h": """
+#include "FreeRTOS.h"
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+""",
+}
+
+# FreeRTOS on POSIX threads, enough for the queue and its worker task
+FREERTOS_STUB = r"""
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+
+struct stub_task
+{
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *arg;
+};
+
+struct stub_queue
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    uint8_t *items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+static pthread_mutex_t critical_mutex;
+static pthread_once_t critical_once = PTHREAD_ONCE_INIT;
+
+static void critical_init(void)
+{
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&critical_mutex, &attr);
+}
+
+void stub_enter_critical(void)
+{
+    pthread_once(&critical_once, critical_init);
+    pthread_mutex_lock(&critical_mutex);
+}
+
+void stub_exit_critical(void)
+{
+    pthread_mutex_unlock(&critical_mutex);
+}
+
+static void deadline(struct timespec *ts, TickType_t wait)
+{
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += wait / 1000u;
+    ts->tv_nsec += (long)(wait % 1000u) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L)
+    {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static void *task_entry(void *arg)
+{
+    struct stub_task *task = arg;
+
+    task->fn(task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *handle)
+{
+    struct stub_task *task = calloc(1u, sizeof(*task));
+
+    (void)name;
+    (void)stack;
+    (void)prio;
+    task->fn = fn;
+    task->arg = arg;
+    if (pthread_create(&task->thread, NULL, task_entry, task) != 0)
+    {
+        free(task);
+        return pdFALSE;
+    }
+    pthread_detach(task->thread);
+    if (handle != NULL)
+    {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                               StackType_t *stack_buffer, StaticTask_t *tcb)
+{
+    TaskHandle_t handle = NULL;
+
+    (void)stack_buffer;
+    (void)tcb;
+    (void)xTaskCreate(fn, name, stack, arg, prio, &handle);
+    return handle;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t)((ts.tv_sec * 1000) + (ts.tv_nsec / 1000000L));
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct stub_queue *queue = calloc(1u, sizeof(*queue));
+
+    queue->items = calloc(length, item_size);
+    queue->length = length;
+    queue->item_size = item_size;
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_cond_init(&queue->cond, NULL);
+    return queue;
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage, StaticQueue_t *buffer)
+{
+    (void)storage;
+    (void)buffer;
+    return xQueueCreate(length, item_size);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait)
+{
+    struct timespec ts;
+
+    deadline(&ts, wait);
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == queue->length)
+    {
+        if ((wait != portMAX_DELAY) && (pthread_cond_timedwait(&queue->cond, &queue->mutex, &ts) != 0))
+        {
+            pthread_mutex_unlock(&queue->mutex);
+            return pdFALSE;
+        }
+        if (wait == portMAX_DELAY)
+        {
+            pthread_cond_wait(&queue->cond, &queue->mutex);
+        }
+    }
+    memcpy(&queue->items[((queue->head + queue->count) % queue->length) * queue->item_size], item, queue->item_size);
+    queue->count++;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait)
+{
+    struct timespec ts;
+
+    deadline(&ts, wait);
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == 0u)
+    {
+        if ((wait != portMAX_DELAY) && (pthread_cond_timedwait(&queue->cond, &queue->mutex, &ts) != 0))
+        {
+            pthread_mutex_unlock(&queue->mutex);
+            return pdFALSE;
+        }
+        if (wait == portMAX_DELAY)
+        {
+            pthread_cond_wait(&queue->cond, &queue->mutex);
+        }
+    }
+    memcpy(item, &queue->items[queue->head * queue->item_size], queue->item_size);
+    queue->head = (queue->head + 1u) % queue->length;
+    queue->count--;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    UBaseType_t count;
+
+    pthread_mutex_lock(&queue->mutex);
+    count = queue->count;
+    pthread_mutex_unlock(&queue->mutex);
+    return count;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    free(queue->items);
+    free(queue);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer)
+{
+    pthread_mutex_init(&buffer->mutex, NULL);
+    pthread_cond_init(&buffer->cond, NULL);
+    buffer->count = 0;
+    return buffer;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait)
+{
+    (void)wait;
+    pthread_mutex_lock(&sem->mutex);
+    while (sem->count == 0)
+    {
+        pthread_cond_wait(&sem->cond, &sem->mutex);
+    }
+    sem->count = 0;
+    pthread_mutex_unlock(&sem->mutex);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    pthread_mutex_lock(&sem->mutex);
+    sem->count = 1;
+    pthread_cond_signal(&sem->cond);
+    pthread_mutex_unlock(&sem->mutex);
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    pthread_cond_destroy(&sem->cond);
+    pthread_mutex_destroy(&sem->mutex);
+}
+"""
+
+# External flash in RAM and the checks. Every flash operation is logged, so
+# that the order the worker issued them in can be checked.
+HARNESS = r"""
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cy_pdl.h"
+#include "cy_ota_flash.h"
+#include "cy_ota_flash_ext.h"
+#include "flash_map_backend.h"
+#include "ota_kv_store.h"
+#include "FreeRTOS.h"
+#include "semphr.h"
+
+#define FLASH_SIZE          (1024u * 1024u)
+#define FLASH_SECTOR_SIZE   (4096u)
+#define FLASH_WRITE_US      (2000)
+#define LOG_SIZE            (4096u)
+
+stub_dwt_t stub_dwt;
+stub_core_debug_t stub_core_debug;
+uint32_t SystemCoreClock = 100000000u;
+
+typedef struct
+{
+    char type;              /* 'W'rite, 'E'rase */
+    uint32_t addr;
+    size_t len;
+} flash_log_t;
+
+static uint8_t flash[FLASH_SIZE];
+static flash_log_t flash_log[LOG_SIZE];
+static unsigned int flash_log_count;
+static uint32_t flash_fail_addr = 0xFFFFFFFFu;
+static struct flash_area secondary_area = { 2u, FLASH_DEVICE_EXTERNAL_FLASH(0), 0u, CY_XIP_BASE, 512u * 1024u };
+static int failures;
+
+#define CHECK(cond, ...)                                                        \
+    do                                                                          \
+    {                                                                           \
+        if (!(cond))                                                            \
+        {                                                                       \
+            printf("FAILED line %d: ", __LINE__);                               \
+            printf(__VA_ARGS__);                                                \
+            printf("\n");                                                       \
+            failures++;                                                         \
+        }                                                                       \
+    } while (0)
+
+static void flash_log_add(char type, uint32_t addr, size_t len)
+{
+    stub_enter_critical();
+    if (flash_log_count < LOG_SIZE)
+    {
+        flash_log[flash_log_count].type = type;
+        flash_log[flash_log_count].addr = addr;
+        flash_log[flash_log_count].len = len;
+        flash_log_count++;
+    }
+    stub_exit_critical();
+}
+
+/* Index of the first logged operation of a type at an address, -1 if none */
+static int flash_log_find(char type, uint32_t addr)
+{
+    unsigned int i;
+
+    for (i = 0u; i < flash_log_count; i++)
+    {
+        if ((flash_log[i].type == type) && (flash_log[i].addr == addr))
+        {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static unsigned int flash_log_writes(void)
+{
+    unsigned int i;
+    unsigned int writes = 0u;
+
+    for (i = 0u; i < flash_log_count; i++)
+    {
+        writes += (flash_log[i].type == 'W') ? 1u : 0u;
+    }
+    return writes;
+}
+
+cy_rslt_t cy_ota_mem_read(cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len)
+{
+    (void)mem_type;
+    if ((addr + len) > FLASH_SIZE)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+    memcpy(data, &flash[addr], len);
+    return CY_RSLT_SUCCESS;
+}
+
+/* NOR flash: a program only clears bits */
+cy_rslt_t cy_ota_mem_write(cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+    struct timespec delay = { 0, FLASH_WRITE_US * 1000L };
+    size_t i;
+
+    (void)mem_type;
+    flash_log_add('W', addr, len);
+    nanosleep(&delay, NULL);
+    if (((addr + len) > FLASH_SIZE) || ((flash_fail_addr >= addr) && (flash_fail_addr < (addr + len))))
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+    for (i = 0u; i < len; i++)
+    {
+        if ((flash[addr + i] & bytes[i]) != bytes[i])
+        {
+            printf("program over unerased byte at 0x%08x\n", (unsigned int)(addr + i));
+            return CY_RSLT_TYPE_ERROR;
+        }
+        flash[addr + i] = bytes[i];
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+cy_rslt_t cy_ota_mem_erase(cy_ota_mem_type_t mem_type, uint32_t addr, size_t len)
+{
+    uint32_t start = addr - (addr % FLASH_SECTOR_SIZE);
+    uint32_t end = ((addr + len + FLASH_SECTOR_SIZE - 1u) / FLASH_SECTOR_SIZE) * FLASH_SECTOR_SIZE;
+
+    (void)mem_type;
+    flash_log_add('E', addr, len);
+    if (end > FLASH_SIZE)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+    memset(&flash[start], 0xFF, end - start);
+    return CY_RSLT_SUCCESS;
+}
+
+size_t cy_ota_mem_get_erase_size(cy_ota_mem_type_t mem_type, uint32_t addr)
+{
+    (void)mem_type;
+    (void)addr;
+    return FLASH_SECTOR_SIZE;
+}
+
+size_t cy_ota_mem_get_size(cy_ota_mem_type_t mem_type)
+{
+    (void)mem_type;
+    return FLASH_SIZE;
+}
+
+cy_rslt_t cy_ota_mem_client_register(cy_ota_mem_client_t *client, const char *name)
+{
+    (void)client;
+    (void)name;
+    return CY_RSLT_SUCCESS;
+}
+
+int flash_area_open(uint8_t id, const struct flash_area **fa)
+{
+    if (id != secondary_area.fa_id)
+    {
+        return -1;
+    }
+    *fa = &secondary_area;
+    return 0;
+}
+
+void flash_area_close(const struct flash_area *fa)
+{
+    (void)fa;
+}
+
+typedef struct
+{
+    cy_ota_mem_op_t op;
+    uint8_t data[FLASH_SECTOR_SIZE];
+    volatile int done;
+    cy_rslt_t result;
+} test_op_t;
+
+static test_op_t ops[32];
+
+static void test_op_done(cy_ota_mem_op_t *op, cy_rslt_t result)
+{
+    test_op_t *test_op = op->cb_arg;
+
+    test_op->result = result;
+    test_op->done = 1;
+}
+
+static cy_rslt_t submit(unsigned int index, cy_ota_mem_op_type_t type, uint32_t addr, size_t len, uint8_t fill)
+{
+    test_op_t *test_op = &ops[index];
+
+    memset(test_op, 0, sizeof(*test_op));
+    memset(test_op->data, fill, sizeof(test_op->data));
+    test_op->op.type = type;
+    test_op->op.mem_type = CY_OTA_MEM_TYPE_EXTERNAL_FLASH;
+    test_op->op.addr = addr;
+    test_op->op.data = test_op->data;
+    test_op->op.len = len;
+    test_op->op.cb = test_op_done;
+    test_op->op.cb_arg = test_op;
+    return cy_ota_mem_submit(&test_op->op);
+}
+
+static int flash_equals(uint32_t addr, size_t len, uint8_t value)
+{
+    size_t i;
+
+    for (i = 0u; i < len; i++)
+    {
+        if (flash[addr + i] != value)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void check_merge(void)
+{
+    cy_ota_mem_queue_stats_t before;
+    cy_ota_mem_queue_stats_t after;
+    unsigned int writes = flash_log_writes();
+    unsigned int i;
+
+    /* 16 writes of 256 bytes fill one page of 8 rows */
+    cy_ota_mem_get_queue_stats(&before);
+    for (i = 0u; i < 16u; i++)
+    {
+        CHECK(submit(i, CY_OTA_MEM_OP_WRITE, 0x10000u + (i * 256u), 256u, (uint8_t)i) == CY_RSLT_SUCCESS, "submit %u", i);
+    }
+    CHECK(cy_ota_mem_flush() == CY_RSLT_SUCCESS, "flush");
+    cy_ota_mem_get_queue_stats(&after);
+
+    for (i = 0u; i < 16u; i++)
+    {
+        CHECK(ops[i].done && (ops[i].result == CY_RSLT_SUCCESS), "write %u not completed", i);
+        CHECK(flash_equals(0x10000u + (i * 256u), 256u, (uint8_t)i), "write %u not in the flash", i);
+    }
+    CHECK((after.merged_writes - before.merged_writes) == 15u, "%u writes merged, expected 15",
+          (unsigned int)(after.merged_writes - before.merged_writes));
+    CHECK((after.page_writes - before.page_writes) == 1u, "%u pages written, expected 1",
+          (unsigned int)(after.page_writes - before.page_writes));
+    CHECK((flash_log_writes() - writes) == 1u, "%u flash programs, expected 1", flash_log_writes() - writes);
+    printf("ota_flash_queue_check: 16 adjacent writes, %u page program\n", flash_log_writes() - writes);
+}
+
+static void check_erase_order(void)
+{
+    cy_ota_mem_queue_stats_t before;
+    cy_ota_mem_queue_stats_t after;
+
+    /* The erase covers the pending page: the write lands first, then is erased */
+    CHECK(submit(0, CY_OTA_MEM_OP_WRITE, 0x20000u, 100u, 0x5Au) == CY_RSLT_SUCCESS, "submit write");
+    CHECK(submit(1, CY_OTA_MEM_OP_ERASE, 0x20000u, FLASH_SECTOR_SIZE, 0u) == CY_RSLT_SUCCESS, "submit erase");
+    CHECK(cy_ota_mem_flush() == CY_RSLT_SUCCESS, "flush");
+    CHECK((flash_log_find('W', 0x20000u) >= 0) && (flash_log_find('W', 0x20000u) < flash_log_find('E', 0x20000u)),
+          "overlapping erase issued before the pending write");
+    CHECK(flash_equals(0x20000u, FLASH_SECTOR_SIZE, 0xFFu), "sector not erased");
+
+    /* The erase is elsewhere: issued ahead of the pending page, which keeps its data */
+    cy_ota_mem_get_queue_stats(&before);
+    CHECK(submit(0, CY_OTA_MEM_OP_WRITE, 0x30000u, 100u, 0xA5u) == CY_RSLT_SUCCESS, "submit write");
+    CHECK(submit(1, CY_OTA_MEM_OP_ERASE, 0x40000u, FLASH_SECTOR_SIZE, 0u) == CY_RSLT_SUCCESS, "submit erase");
+    CHECK(cy_ota_mem_flush() == CY_RSLT_SUCCESS, "flush");
+    cy_ota_mem_get_queue_stats(&after);
+    CHECK((after.erases_ahead - before.erases_ahead) == 1u, "erase not issued ahead");
+    CHECK((flash_log_find('E', 0x40000u) >= 0) && (flash_log_find('E', 0x40000u) < flash_log_find('W', 0x30000u)),
+          "erase not ahead of the pending write");
+    CHECK(flash_equals(0x30000u, 100u, 0xA5u), "pending write lost");
+    printf("ota_flash_queue_check: overlapping erase after the write, other erase ahead of it\n");
+}
+
+static void check_read(void)
+{
+    uint8_t buffer[64];
+
+    CHECK(submit(0, CY_OTA_MEM_OP_WRITE, 0x50000u, sizeof(buffer), 0x3Cu) == CY_RSLT_SUCCESS, "submit write");
+    CHECK(submit(1, CY_OTA_MEM_OP_READ, 0x50000u, sizeof(buffer), 0u) == CY_RSLT_SUCCESS, "submit read");
+    while (!ops[1].done)
+    {
+        struct timespec delay = { 0, 1000000L };
+        nanosleep(&delay, NULL);
+    }
+    memcpy(buffer, ops[1].data, sizeof(buffer));
+    CHECK((ops[1].result == CY_RSLT_SUCCESS) && (buffer[0] == 0x3Cu) && (buffer[sizeof(buffer) - 1u] == 0x3Cu),
+          "read of the pending page does not return the write");
+    CHECK(cy_ota_mem_flush() == CY_RSLT_SUCCESS, "flush");
+    printf("ota_flash_queue_check: read of the pending page returns the write\n");
+}
+
+static void check_failure(void)
+{
+    cy_ota_mem_queue_stats_t before;
+    cy_ota_mem_queue_stats_t after;
+
+    cy_ota_mem_get_queue_stats(&before);
+    flash_fail_addr = 0x60000u;
+    CHECK(submit(0, CY_OTA_MEM_OP_WRITE, 0x60000u, 32u, 0x11u) == CY_RSLT_SUCCESS, "submit write");
+    CHECK(cy_ota_mem_flush() == CY_RSLT_SUCCESS, "flush");
+    flash_fail_addr = 0xFFFFFFFFu;
+    cy_ota_mem_get_queue_stats(&after);
+    CHECK(ops[0].done && (ops[0].result != CY_RSLT_SUCCESS), "failed write completed with success");
+    CHECK((after.failed - before.failed) == 1u, "failed write not counted");
+    printf("ota_flash_queue_check: failed program reported to its callback\n");
+}
+
+static void check_stats(void)
+{
+    cy_ota_mem_queue_stats_t stats;
+    unsigned int i;
+
+    /* Whole pages are not merged, each takes a program and the queue fills up */
+    for (i = 0u; i < 8u; i++)
+    {
+        CHECK(submit(i, CY_OTA_MEM_OP_WRITE, 0x80000u + (i * FLASH_SECTOR_SIZE), FLASH_SECTOR_SIZE, (uint8_t)i) ==
+              CY_RSLT_SUCCESS, "submit %u", i);
+    }
+    CHECK(cy_ota_mem_flush() == CY_RSLT_SUCCESS, "flush");
+    cy_ota_mem_get_queue_stats(&stats);
+    CHECK(stats.submitted == stats.completed, "%u submitted, %u completed", (unsigned int)stats.submitted,
+          (unsigned int)stats.completed);
+    CHECK(stats.max_depth >= 2u, "max depth %u", (unsigned int)stats.max_depth);
+    CHECK(stats.max_latency_ms >= (FLASH_WRITE_US / 1000), "max latency %u ms", (unsigned int)stats.max_latency_ms);
+    printf("ota_flash_queue_check: ops:%u failed:%u merged:%u pages:%u erases ahead:%u max depth:%u max latency:%u ms\n",
+           (unsigned int)stats.submitted, (unsigned int)stats.failed, (unsigned int)stats.merged_writes,
+           (unsigned int)stats.page_writes, (unsigned int)stats.erases_ahead, (unsigned int)stats.max_depth,
+           (unsigned int)stats.max_latency_ms);
+}
+
+static void check_kv_store(void)
+{
+    static uint8_t expected[8][200];
+    uint8_t value[200];
+    ota_kv_stats_t kv_stats;
+    unsigned int writes;
+    unsigned int round;
+    unsigned int key;
+    size_t len;
+
+    CHECK(ota_kv_init() == CY_RSLT_SUCCESS, "ota_kv_init");
+
+    /* Enough records for several compactions of the 4 KB halves */
+    writes = flash_log_writes();
+    for (round = 0u; round < 20u; round++)
+    {
+        for (key = 0u; key < 8u; key++)
+        {
+            memset(expected[key], (int)((round * 8u) + key), sizeof(expected[key]));
+            expected[key][0] = (uint8_t)key;
+            CHECK(ota_kv_set((uint16_t)(key + 1u), expected[key], sizeof(expected[key])) == CY_RSLT_SUCCESS,
+                  "ota_kv_set round %u key %u", round, key);
+        }
+    }
+    CHECK(ota_kv_sync() == CY_RSLT_SUCCESS, "ota_kv_sync");
+    ota_kv_get_stats(&kv_stats);
+    CHECK(kv_stats.gc_runs >= 2u, "%u compactions", (unsigned int)kv_stats.gc_runs);
+    CHECK((flash_log_writes() - writes) < 160u, "%u programs for 160 records", flash_log_writes() - writes);
+    printf("ota_flash_queue_check: KV store, 160 records in %u flash programs, %u compactions\n",
+           flash_log_writes() - writes, (unsigned int)kv_stats.gc_runs);
+
+    /* The values are read back, then again from the flash alone */
+    for (round = 0u; round < 2u; round++)
+    {
+        for (key = 0u; key < 8u; key++)
+        {
+            memset(value, 0, sizeof(value));
+            CHECK((ota_kv_get((uint16_t)(key + 1u), value, sizeof(value), &len) == CY_RSLT_SUCCESS) &&
+                  (len == sizeof(value)) && (memcmp(value, expected[key], sizeof(value)) == 0),
+                  "key %u not read back%s", key, (round == 0u) ? "" : " after ota_kv_init()");
+        }
+        CHECK(ota_kv_init() == CY_RSLT_SUCCESS, "ota_kv_init again");
+    }
+}
+
+int main(void)
+{
+    memset(flash, 0xFF, sizeof(flash));
+
+    CHECK(cy_ota_mem_queue_init() == CY_RSLT_SUCCESS, "cy_ota_mem_queue_init");
+    CHECK(cy_ota_mem_queue_init() == CY_RSLT_SUCCESS, "cy_ota_mem_queue_init again");
+
+    check_merge();
+    check_erase_order();
+    check_read();
+    check_failure();
+    check_stats();
+    check_kv_store();
+
+    return (failures == 0) ? 0 : 1;
+}
+"""
+
+def build_harness(root_dir, work_dir):
+    for name, text in STUB_HEADERS.items():
+        guard = "STUB_" + name.replace(".", "_").upper() + "_"
+        with open(os.path.join(work_dir, name), 'w') as header:
+            header.write("#ifndef " + guard + "\n#define " + guard + "\n" + text + "#endif\n")
+    sources = []
+    for name, text in (("freertos_stub.c", FREERTOS_STUB), ("harness.c", HARNESS)):
+        sources.append(os.path.join(work_dir, name))
+        with open(sources[-1], 'w') as source:
+            source.write(text)
+
+    program = os.path.join(work_dir, "harness")
+    command = ([os.environ.get("CC", "cc"), "-std=c99", "-Wall", "-Wextra", "-pthread"] + DEFINES +
+               ["-I" + work_dir] + ["-I" + os.path.join(root_dir, path) for path in DEVICE_INCLUDES] +
+               ["-o", program] + sources + [os.path.join(root_dir, path) for path in DEVICE_SOURCES])
+    if subprocess.run(command).returncode != 0:
+        return None
+    return program
+
+def check():
+    root_dir = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
+    with tempfile.TemporaryDirectory() as work_dir:
+        program = build_harness(root_dir, work_dir)
+        if program is None:
+            print("ota_flash_queue_check: ERROR: the device sources do not build for the host")
+            return False
+        return subprocess.run([program]).returncode == 0
+
+if __name__ == "__main__":
+    if len(sys.argv) != 1:
+        print("Usage: python ota_flash_queue_check.py")
+        sys.exit(2)
+
+    if not check():
+        print("ota_flash_queue_check: the flash queue does not behave as documented")
+        sys.exit(1)
+    print("ota_flash_queue_check: all checks passed")
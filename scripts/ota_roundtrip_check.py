@@ -0,0 +1,389 @@
+import ast
+import json
+import os
+import random
+import struct
+import subprocess
+import sys
+import tempfile
+import zlib
+
+#
+#   Host round-trip check of the compressed and delta OTA images.
+#
+#   The images are made by the functions of publisher.py (compress_image()
+#   and delta_image()) and applied by the device code itself: ota_decompress.c,
+#   ota_delta.c, ota_block.c, and ota_json.c are built for the host with the C
+#   compiler, against small stand-ins for the PSoC, FreeRTOS, MCUboot, and OTA
+#   agent headers. The base image is placed in a simulated primary slot, the
+#   "DeltaBaseSize" and "DeltaBaseCrc" the device adds to its request are fed
+#   to delta_image(), and each image is written through the storage chain in
+#   chunks. The check fails unless the written image has the CRC-32 of the new
+#   image, for the plain, compressed, delta, and compressed delta images.
+#
+#   Without images, a pair of MCUboot formatted images is generated: the new
+#   one is the base with changed words, an insertion, a removal, and moved
+#   blocks, as a rebuild of the application gives.
+#
+# Usage:
+#   python ota_roundtrip_check.py [<base image> <new image>]
+#
+#   The C compiler is taken from the CC environment variable, "cc" by default.
+#
+
+# Chunks the storage chain is fed with, as the publisher sends them
+CHUNK_SIZE = 4096
+
+# LZSS window of the compressed images, OTA_DECOMPRESS_WINDOW_BITS_MAX of the device
+WINDOW_BITS = 11
+
+# Size of the generated base image body
+GENERATED_SIZE = 256 * 1024
+
+# Device sources applying the images, from the source directory
+DEVICE_SOURCES = ["ota_decompress.c", "ota_delta.c", "ota_block.c", "ota_json.c"]
+
+# Stand-ins for the headers of the libraries the device sources include
+STUB_HEADERS = {
+    "cy_result.h": """
+#include <stdint.h>
+typedef uint32_t cy_rslt_t;
+#define CY_RSLT_SUCCESS                     (0u)
+#define CY_RSLT_TYPE_ERROR                  (2u)
+#define CY_RSLT_MODULE_MIDDLEWARE_BASE      (0x200u)
+#define CY_RSLT_CREATE(type, module, code)  ((cy_rslt_t)(((type) << 16) | ((module) << 18) | (code)))
+""",
+    "cy_utils.h": """
+#define CY_ALIGN(align)                     __attribute__((aligned(align)))
+""",
+    "cy_ota_api.h": """
+#include "cy_result.h"
+""",
+    "cy_ota_storage_api.h": """
+#include <stdint.h>
+typedef struct { int unused; } cy_ota_storage_context_t;
+typedef struct
+{
+    uint32_t    total_size;
+    uint32_t    offset;
+    uint8_t     *buffer;
+    uint32_t    size;
+    uint16_t    packet_number;
+    uint16_t    total_packets;
+} cy_ota_storage_write_info_t;
+""",
+    "cy_ota_flash.h": """
+#include <stddef.h>
+#include "cy_result.h"
+typedef enum { CY_OTA_MEM_TYPE_INTERNAL_FLASH, CY_OTA_MEM_TYPE_EXTERNAL_FLASH } cy_ota_mem_type_t;
+cy_rslt_t cy_ota_mem_read(cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len);
+""",
+    "flash_map_backend.h": """
+#include <stdint.h>
+struct flash_area { uint8_t fa_id; uint8_t fa_device_id; uint16_t pad16; uint32_t fa_off; uint32_t fa_size; };
+#define FLASH_DEVICE_INTERNAL_FLASH         (0u)
+int flash_area_open(uint8_t id, const struct flash_area **fa);
+void flash_area_close(const struct flash_area *fa);
+""",
+    "sysflash.h": """
+#define FLASH_AREA_IMAGE_PRIMARY(image)     (1u)
+""",
+    "FreeRTOS.h": """
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+""",
+    "task.h": "",
+}
+
+# Storage chain of ota_task.c, decompression then delta, writing to a file.
+# <harness> <base image> [<image> <output> <chunk size>]: without an image,
+# prints the update request members of the device.
+HARNESS = r"""
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cy_ota_flash.h"
+#include "flash_map_backend.h"
+#include "ota_decompress.h"
+#include "ota_delta.h"
+
+static uint8_t *primary;
+static struct flash_area primary_area = { 1u, 0u, 0u, 0u, 0u };
+static FILE *output;
+
+/* As ota_kv_store.c, the CRC-32 of zlib */
+uint32_t ota_kv_crc32(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+    uint32_t bit;
+
+    crc = ~crc;
+    while (len-- != 0u)
+    {
+        crc ^= *bytes++;
+        for (bit = 0; bit < 8u; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+int flash_area_open(uint8_t id, const struct flash_area **fa)
+{
+    (void)id;
+    *fa = &primary_area;
+    return 0;
+}
+
+void flash_area_close(const struct flash_area *fa)
+{
+    (void)fa;
+}
+
+cy_rslt_t cy_ota_mem_read(cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len)
+{
+    (void)mem_type;
+    if ((addr + len) > primary_area.fa_size)
+    {
+        return 1u;
+    }
+    memcpy(data, &primary[addr], len);
+    return CY_RSLT_SUCCESS;
+}
+
+static cy_rslt_t output_write(cy_ota_storage_context_t *storage_ptr, cy_ota_storage_write_info_t *chunk_info)
+{
+    (void)storage_ptr;
+    if ((fseek(output, (long)chunk_info->offset, SEEK_SET) != 0) ||
+        (fwrite(chunk_info->buffer, 1u, chunk_info->size, output) != chunk_info->size))
+    {
+        return 1u;
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+static uint8_t *read_file(const char *name, uint32_t *size)
+{
+    FILE *file = fopen(name, "rb");
+    uint8_t *data;
+    long len;
+
+    if ((file == NULL) || (fseek(file, 0, SEEK_END) != 0) || ((len = ftell(file)) < 0))
+    {
+        exit(2);
+    }
+    rewind(file);
+    data = malloc((size_t)len + 1u);
+    if ((data == NULL) || (fread(data, 1u, (size_t)len, file) != (size_t)len))
+    {
+        exit(2);
+    }
+    fclose(file);
+    *size = (uint32_t)len;
+    return data;
+}
+
+int main(int argc, char *argv[])
+{
+    cy_ota_storage_write_info_t chunk_info;
+    char json_doc[256] = "{\"Message\":\"Update Availability\"}";
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint32_t chunk_size;
+    uint32_t offset;
+    uint32_t size;
+    uint8_t *image;
+
+    primary = read_file(argv[1], &primary_area.fa_size);
+    ota_delta_init(output_write);
+    ota_decompress_init(ota_delta_storage_write);
+
+    if (argc < 5)
+    {
+        (void)ota_decompress_append(json_doc, sizeof(json_doc));
+        (void)ota_delta_append(json_doc, sizeof(json_doc));
+        printf("%s\n", json_doc);
+        return 0;
+    }
+
+    image = read_file(argv[2], &size);
+    output = fopen(argv[3], "wb");
+    chunk_size = (uint32_t)strtoul(argv[4], NULL, 0);
+    if ((output == NULL) || (chunk_size == 0u))
+    {
+        return 2;
+    }
+
+    for (offset = 0; (offset < size) && (result == CY_RSLT_SUCCESS); offset += chunk_size)
+    {
+        memset(&chunk_info, 0, sizeof(chunk_info));
+        chunk_info.offset = offset;
+        chunk_info.buffer = &image[offset];
+        chunk_info.size = ((size - offset) < chunk_size) ? (size - offset) : chunk_size;
+        chunk_info.total_size = size;
+        chunk_info.packet_number = (uint16_t)(offset / chunk_size);
+        chunk_info.total_packets = (uint16_t)((size + chunk_size - 1u) / chunk_size);
+        result = ota_decompress_storage_write(NULL, &chunk_info);
+    }
+
+    fclose(output);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        printf("storage write failed 0x%08x at %u\n", (unsigned int)result, (unsigned int)chunk_info.offset);
+        return 1;
+    }
+    return 0;
+}
+"""
+
+def load_publisher(script_dir):
+    # publisher.py runs the publisher when imported: take its constants and
+    # functions only, without the MQTT client
+    path = os.path.join(script_dir, "publisher.py")
+    with open(path) as source:
+        tree = ast.parse(source.read(), path)
+
+    body = []
+    for node in tree.body:
+        if isinstance(node, ast.If) and "__main__" in ast.dump(node.test):
+            break
+        if isinstance(node, ast.Import) and any(alias.name.startswith("paho") for alias in node.names):
+            continue
+        if isinstance(node, (ast.Import, ast.ImportFrom, ast.Assign, ast.FunctionDef)):
+            body.append(node)
+
+    publisher = {"__name__": "publisher"}
+    exec(compile(ast.Module(body=body, type_ignores=[]), path, "exec"), publisher)
+    return publisher
+
+def mcuboot_image(body, rand):
+    # Header: magic, load address, header size, protected TLV size, image size
+    header = struct.pack('<IIHHI', 0x96f3b83d, 0, 0x400, 0, len(body)).ljust(0x400, b'\0')
+    tlvs = bytes(rand.randrange(256) for _ in range(36))
+    return header + body + struct.pack('<HH', 0x6907, 4 + len(tlvs)) + tlvs
+
+def generate_images(work_dir):
+    rand = random.Random(1)
+    words = [bytes(rand.randrange(256) for _ in range(rand.randint(4, 40))) for _ in range(400)]
+    body = bytearray()
+    while len(body) < GENERATED_SIZE:
+        body += rand.choice(words)
+    base = mcuboot_image(bytes(body), rand)
+
+    for _ in range(30):
+        position = rand.randrange(len(body) - 4)
+        body[position:position + 4] = struct.pack('<I', rand.getrandbits(32))
+    position = len(body) // 3
+    body[position:position] = bytes(rand.randrange(256) for _ in range(500))
+    position = len(body) // 2
+    del body[position:position + 2000]
+    fifth = len(body) // 5
+    body = body[2 * fifth:3 * fifth] + body[:2 * fifth] + body[3 * fifth:]
+    new = mcuboot_image(bytes(body), rand)
+
+    names = []
+    for name, data in (("base.bin", base), ("new.bin", new)):
+        names.append(os.path.join(work_dir, name))
+        with open(names[-1], 'wb') as image:
+            image.write(data)
+    return names
+
+def build_harness(source_dir, work_dir):
+    for name, text in STUB_HEADERS.items():
+        guard = "STUB_" + name.replace(".", "_").upper() + "_"
+        with open(os.path.join(work_dir, name), 'w') as header:
+            header.write("#ifndef " + guard + "\n#define " + guard + "\n" + text + "#endif\n")
+    harness = os.path.join(work_dir, "harness.c")
+    with open(harness, 'w') as source:
+        source.write(HARNESS)
+
+    program = os.path.join(work_dir, "harness")
+    command = [os.environ.get("CC", "cc"), "-std=c99", "-Wall", "-Wextra", "-I" + work_dir, "-I" + source_dir,
+               "-o", program, harness] + [os.path.join(source_dir, name) for name in DEVICE_SOURCES]
+    if subprocess.run(command).returncode != 0:
+        return None
+    return program
+
+def apply(program, base_file, image_file, work_dir):
+    output_file = os.path.join(work_dir, "output.bin")
+    result = subprocess.run([program, base_file, image_file, output_file, str(CHUNK_SIZE)],
+                            stdout=subprocess.PIPE, universal_newlines=True)
+    if result.returncode != 0:
+        print(result.stdout, end="")
+        return None
+    with open(output_file, 'rb') as output:
+        return output.read()
+
+def check(base_file, new_file):
+    script_dir = os.path.dirname(os.path.abspath(__file__))
+    source_dir = os.path.join(script_dir, "..", "source")
+    publisher = load_publisher(script_dir)
+    failed = False
+
+    with tempfile.TemporaryDirectory() as work_dir:
+        if base_file is None:
+            base_file, new_file = generate_images(work_dir)
+        program = build_harness(source_dir, work_dir)
+        if program is None:
+            print("ota_roundtrip_check: ERROR: the device sources do not build for the host")
+            return False
+
+        with open(new_file, 'rb') as image:
+            new = image.read()
+        new_crc = zlib.crc32(new) & 0xFFFFFFFF
+
+        request = json.loads(subprocess.run([program, base_file], stdout=subprocess.PIPE,
+                                            universal_newlines=True, check=True).stdout.splitlines()[-1])
+        print("ota_roundtrip_check: device request " + json.dumps(request))
+        if "DeltaBaseSize" not in request:
+            print("ota_roundtrip_check: ERROR: no running image found in " + base_file)
+            return False
+
+        # delta_image() looks for the base in DELTA_BASE_DIR and writes next to the image
+        image_dir = os.path.join(work_dir, "images")
+        base_dir = os.path.join(work_dir, "bases")
+        os.mkdir(image_dir)
+        os.mkdir(base_dir)
+        image_file = os.path.join(image_dir, "new.bin")
+        with open(image_file, 'wb') as image:
+            image.write(new)
+        with open(base_file, 'rb') as base, open(os.path.join(base_dir, "base.bin"), 'wb') as copy:
+            copy.write(base.read())
+        publisher["DELTA_BASE_DIR"] = base_dir
+
+        window_bits = min(WINDOW_BITS, int(request["CompressionWindowBits"]))
+        base_size = int(request["DeltaBaseSize"])
+        base_crc = int(request["DeltaBaseCrc"])
+        images = [
+            ("plain", image_file),
+            ("compressed", publisher["compress_image"](image_file, window_bits)),
+            ("delta", publisher["delta_image"](image_file, base_size, base_crc, 0)),
+            ("compressed delta", publisher["delta_image"](image_file, base_size, base_crc, window_bits)),
+        ]
+
+        for kind, sent_file in images:
+            if sent_file is None:
+                print("ota_roundtrip_check: ERROR: no %s image made" % kind)
+                failed = True
+                continue
+            written = apply(program, base_file, sent_file, work_dir)
+            written_crc = None if written is None else zlib.crc32(written) & 0xFFFFFFFF
+            print("ota_roundtrip_check: %-16s %8u bytes sent, %8s bytes written, CRC %s" %
+                  (kind, os.path.getsize(sent_file), "-" if written is None else str(len(written)),
+                   "-" if written_crc is None else "0x%08x" % written_crc))
+            if written_crc != new_crc or len(written) != len(new):
+                print("ota_roundtrip_check: ERROR: %s image written with CRC %s, expected 0x%08x" %
+                      (kind, "-" if written_crc is None else "0x%08x" % written_crc, new_crc))
+                failed = True
+
+    return not failed
+
+if __name__ == "__main__":
+    if len(sys.argv) not in (1, 3):
+        print("Usage: python ota_roundtrip_check.py [<base image> <new image>]")
+        sys.exit(2)
+
+    if not check(sys.argv[1] if len(sys.argv) == 3 else None, sys.argv[2] if len(sys.argv) == 3 else None):
+        print("ota_roundtrip_check: the device does not write the image publisher.py sent")
+        sys.exit(1)
+    print("ota_roundtrip_check: all images written with CRC-32 of the new image")
@@ -1,6 +1,8 @@
 import json
 import paho.mqtt.client as mqtt
 import os
+import zlib
+import queue
 import random
 import signal
 import struct
@@ -205,14 +207,49 @@ KIT = BOARD.replace("APP_","")
 
 SEND_IMAGE_MQTT_CLIENT_ID = "OTASend"
 
+# Compressed images (command line arg "-z"): the image is sent LZSS compressed
+# to the Devices that advertise "Compression" in their request
+# (source/ota_decompress.c). Chunk requests are always answered with the
+# plain image.
+COMPRESS_IMAGE = False
+COMPRESS_WINDOW_BITS = 11
+COMPRESS_LOOKAHEAD_BITS = 5
+COMPRESS_HEADER_MAGIC = b"OTAZ"
+COMPRESS_ALGORITHM_LZSS = 1
+compressed_images = {}
+compressed_images_lock = threading.Lock()
+
+# Delta updates (command line arg "-d <dir>"): the Devices advertise the size
+# and CRC-32 of the image they run ("DeltaBaseSize", "DeltaBaseCrc"). When one
+# of the images in <dir> matches, the Device is sent a patch against it
+# (source/ota_delta.c), LZSS compressed if the Device accepts compressed
+# images. Chunk requests are always answered with the plain image.
+DELTA_BASE_DIR = None
+DELTA_HEADER_MAGIC = b"OTAD"
+DELTA_FORMAT = 1
+DELTA_MATCH_SIZE = 8        # Bytes of an indexed base image sequence
+DELTA_MATCH_STEP = 4        # Base image positions indexed
+DELTA_COPY_MIN = 16         # Unchanged bytes written as a copy record
+delta_patches = {}
+delta_patches_lock = threading.Lock()
+
+# Persistent session (command line arg "-p"): the publisher connects with a
+# stable client ID and clean_session off, so the broker keeps its subscriptions
+# and queues the requests sent while it is not running. Use with
+# OTA_MQTT_PERSISTENT_SESSION = 1 in ota_app_config.h.
+PERSISTENT_SESSION = False
+PUBLISHER_MQTT_CLIENT_ID = "OTAPublisher"
+
 # Subscriptions
 COMPANY_TOPIC_PREPEND = "MyUniqueTopic"
 PUBLISHER_LISTEN_TOPIC = "publish_notify"
 PUBLISHER_DIRECT_TOPIC = "OTAImage"
+PUBLISHER_TELEMETRY_TOPIC = "telemetry"
 
 # These are created at runtime so that KIT can be replaced
 PUBLISHER_JOB_REQUEST_TOPIC = ""
 PUBLISHER_DIRECT_REQUEST_TOPIC = ""
+PUBLISHER_TELEMETRY_REQUEST_TOPIC = ""
 
 
 BAD_JSON_DOC = "MALFORMED JSON DOCUMENT"            # Bad incoming message
@@ -272,14 +309,35 @@ MQTT_KEEP_ALIVE = 60 # in seconds
 
 # Each Chunk of the OTA Image needs a header for the Device to handle the chunk properly
 #
-# Size of each chunk of data sent to the Device when splitting the OTA Image
+# Size of each chunk of data sent to the Device when splitting the OTA Image,
+# used when the Device does not advertise "ChunkSize" in its request
 CHUNK_SIZE = (4 * 1024)
 
+# Bounds of the chunk sizes a Device may ask for
+MIN_CHUNK_SIZE = 256
+MAX_CHUNK_SIZE = (64 * 1024)
+
+# Chunk size of each Device, by unique topic, from its "Update Availability" request
+device_chunk_sizes = {}
+
+# Alignment of the chunk data of each Device, by unique topic, from its
+# "DataAlignment". The chunk header is padded so that the data starts at that
+# alignment in the MQTT PUBLISH packet the Device receives, and the Device
+# programs it to flash without a copy.
+device_data_alignments = {}
+
+# QoS the chunks are delivered at to each Device, by unique topic: the lower of
+# PUBLISHER_PUBLISH_QOS and its "DataQos", the QoS of its subscription. A QoS 0
+# PUBLISH packet has no packet identifier.
+device_data_qos = {}
+
 # OTA header information - MUST match Device structure cy_ota_mqtt_chunk_payload_header_s
 #                          defined in ota-update/source/cy_ota_mqtt.c !!
 HEADER_SIZE = 32            # Total header size in bytes
 HEADER_MAGIC = "OTAImage"   # "Magic" string to identify the header
 IMAGE_TYPE = 0
+IMAGE_TYPE_COMPRESSED = 1   # Image data is the LZSS stream of compress_image()
+IMAGE_TYPE_DELTA = 2        # Image data is the patch of delta_image()
 VERSION_MAJOR = 1           # Version of software in OTA Image
 VERSION_MINOR = 1
 VERSION_BUILD = 0
@@ -312,6 +370,7 @@ class MQTTPublisher(mqtt.Client):
       self.connected_flag=False
       self.subscribe_mid=-1
       self.publish_mid=-1
+      self.session_present=False
 
 #==============================================================================
 # Handle ctrl-c to end program gracefully
@@ -344,14 +403,44 @@ def on_send_log(client, userdata, level, buf):
 #
 #==============================================================================
 
+# -----------------------------------------------------------
+#   chunk_data_offset()
+#       Offset of the chunk data in the payload (offset_to_data), at least
+#       HEADER_SIZE, such that the data starts aligned in the MQTT PUBLISH
+#       packet: fixed header, remaining length, topic and, at QoS 1 and 2,
+#       the packet identifier. The MQTT library of the Device receives the
+#       packet from the start of its (aligned) receive buffer.
+#   topic       - The unique topic the chunk is sent on
+#   data_size   - Size of the chunk data
+#   alignment   - "DataAlignment" of the Device
+#   qos         - QoS the chunk is delivered at to the Device
+# -----------------------------------------------------------
+def chunk_data_offset(topic, data_size, alignment, qos):
+    data_offset = HEADER_SIZE
+    if topic is None or alignment <= 1:
+        return data_offset
+    topic_size = len(topic.encode('utf-8'))
+    packet_id_size = 2 if qos > 0 else 0
+    while True:
+        remaining = 2 + topic_size + packet_id_size + data_offset + data_size
+        length_size = 1
+        while remaining >= 128:
+            remaining >>= 7
+            length_size += 1
+        pad = -(1 + length_size + 2 + topic_size + packet_id_size + data_offset) % alignment
+        if pad == 0:
+            return data_offset
+        data_offset += pad
+
+
 # ---------------------------------------------------------
 #   do_chunking()
 #       Break the large file into smaller chunks,
 #       add header, and publish
 #   image_file    - name of OTA Image file to send to Device
+#   topic         - unique topic of the Device, aligns the chunk data
 # ---------------------------------------------------------
-
-def do_chunking(image_file, whole_file, file_offset, send_size):
+def do_chunking(image_file, whole_file, file_offset, send_size, image_type=IMAGE_TYPE, topic=None):
     global terminate
     offset = 0                                      # assume start at 0
     image_size = os.path.getsize(image_file)        # assume full file
@@ -382,7 +471,9 @@ def do_chunking(image_file, whole_file, file_offset, send_size):
             if chunk:
                 chunk_size = len(chunk)
                 # print("Trying to send chunk_size: " + str(chunk_size))
-                packet = bytearray(HEADER_SIZE)
+                data_offset = chunk_data_offset(topic, chunk_size, device_data_alignments.get(topic, 1),
+                                                device_data_qos.get(topic, PUBLISHER_PUBLISH_QOS))
+                packet = bytearray(data_offset)
 
                 # MQTT payload (chunk) header format is defined in ota-update/source/cy_ota_mqtt.c
                 # typedef struct cy_ota_mqtt_chunk_payload_header_s {
@@ -401,7 +492,7 @@ def do_chunking(image_file, whole_file, file_offset, send_size):
 
                 # s - 1 byte character, H - 2 bytes integer, I - 4 bytes integer
                 struct.pack_into('<8s5H2I3H', packet, 0, HEADER_MAGIC.encode('ascii'),
-                                  HEADER_SIZE, IMAGE_TYPE, VERSION_MAJOR, VERSION_MINOR,
+                                  data_offset, image_type, VERSION_MAJOR, VERSION_MINOR,
                                   VERSION_BUILD, image_size, offset, chunk_size, pub_total_payloads,
                                   payload_index)
 
@@ -527,15 +618,26 @@ def on_send_publish(client, userdata, mid):
     client.publish_mid = mid
 
 
+# -----------------------------------------------------------
+#   on send disconnect callback
+# -----------------------------------------------------------
+def on_send_disconnect(client, userdata, rc):
+    client.connected_flag = False
+
+
 # ---------------------------------------------------------
 #   send_image_chunk_thread()
-#       This is used in a separate thread.
-#       Call do_chunking() to send one chunk to the Device.
-#   message_string  - The Initial "Update Availability" message
-#   unique_topic    - The unique topic to send the OTA Image on.
+#       This is used in a separate thread, started on the first
+#       "Request Data Chunk" request.
+#       Answers the chunk requests queued in chunk_requests on one
+#       connection. The chunks are published back to back, without
+#       waiting for each PUBACK, so that all the requests a Device keeps
+#       in flight are answered at once.
 # ---------------------------------------------------------
+chunk_requests = queue.Queue()
+chunk_thread = None
 
-def send_image_chunk_thread(message_string, unique_topic):
+def send_image_chunk_thread():
     global terminate
 
     # Create unique MQTT ID
@@ -543,7 +645,7 @@ def send_image_chunk_thread(message_string, unique_topic):
     client_id = str.ljust(client_id, 24)  # limit to 24 characters
     client_id = str.rstrip(client_id)
     if DEBUG_LOG:
-        print("Send Image chunks: MQTT Connect on topic: " + unique_topic)
+        print("Send Image chunks: MQTT Connect with id: " + client_id)
 
     # Create a new client
     send_client = MQTTSender(client_id)
@@ -551,6 +653,7 @@ def send_image_chunk_thread(message_string, unique_topic):
         send_client.on_log = on_send_log
 
     send_client.on_connect = on_send_connect
+    send_client.on_disconnect = on_send_disconnect
     send_client.on_publish = on_send_publish
     if TLS_ENABLED:
         if BROKER_ADDRESS == MOSQUITTO_BROKER_LOCAL_ADDRESS:
@@ -559,43 +662,436 @@ def send_image_chunk_thread(message_string, unique_topic):
         else:
             send_client.tls_set(ca_certs, certfile, keyfile)
     send_client.connect(BROKER_ADDRESS, BROKER_PORT, MQTT_KEEP_ALIVE)
-    while send_client.connected_flag == False:
-        send_client.loop(0.1)
-        time.sleep(0.1)
-        if terminate:
-            exit(0)
 
+    # The network loop runs in its own thread and reconnects after a drop
+    send_client.loop_start()
+
+    while not terminate:
+        try:
+            message_string, unique_topic = chunk_requests.get(timeout=0.1)
+        except queue.Empty:
+            continue
+
+        # Chunks requested while disconnected are lost, the Device requests them again
+        if not send_client.connected_flag:
+            continue
+
+        try:
+            job_dict = json.loads(message_string)
+            offset = int(job_dict["Offset"])
+            size = int(job_dict["Size"])
+
+            pub_mqtt_msgs,pub_total_payloads = do_chunking(OTA_IMAGE_FILE, False, offset, size, IMAGE_TYPE, unique_topic)
+            if len(pub_mqtt_msgs) == 0:
+                print("Publisher: No chunk at offset " + str(offset) + " for " + unique_topic)
+                continue
+
+            if (DEBUG_LOG):
+                print(" Sending Chunk  offset:" + str(offset) + " size:" + str(size) + " to: " + unique_topic)
+            send_client.publish(unique_topic, pub_mqtt_msgs[0], PUBLISHER_PUBLISH_QOS)
+
+        except Exception as e:
+            print("Exception Occurred while sending a chunk...")
+            print(str(e) + os.linesep)
+            traceback.print_exc()
+
+    send_client.loop_stop()
+    exit(0)
+
+
+# -----------------------------------------------------------
+#   lzss_compress()
+#       LZSS as in heatshrink: a literal is a 1 bit and the byte, a
+#       back reference a 0 bit, the distance - 1 in window_bits and the
+#       length - 1 in lookahead_bits, most significant bit first.
+#   data            - The bytes to compress
+#   window_bits     - Back reference distance bits
+#   lookahead_bits  - Back reference length bits
+# -----------------------------------------------------------
+def lzss_compress(data, window_bits, lookahead_bits):
+    window = 1 << window_bits
+    max_len = 1 << lookahead_bits
+    size = len(data)
+    out = bytearray()
+    bits = 0
+    bit_count = 0
+    heads = {}                  # Last position of each 3 byte sequence
+    prev = [-1] * size          # Previous position of the same sequence
+
+    def put(value, count):
+        nonlocal bits, bit_count
+        bits = (bits << count) | value
+        bit_count += count
+        while bit_count >= 8:
+            bit_count -= 8
+            out.append((bits >> bit_count) & 0xFF)
+        bits &= (1 << bit_count) - 1
+
+    def insert(position):
+        if position + 3 <= size:
+            key = data[position:position + 3]
+            prev[position] = heads.get(key, -1)
+            heads[key] = position
+
+    position = 0
+    while position < size:
+        best_len = 0
+        best_dist = 0
+        if position + 3 <= size:
+            candidate = heads.get(data[position:position + 3], -1)
+            limit = min(max_len, size - position)
+            chain = 32
+            while candidate >= 0 and position - candidate <= window and chain > 0:
+                length = 3
+                while length < limit and data[candidate + length] == data[position + length]:
+                    length += 1
+                if length > best_len:
+                    best_len = length
+                    best_dist = position - candidate
+                    if length == limit:
+                        break
+                candidate = prev[candidate]
+                chain -= 1
+
+        if best_len >= 3:
+            put(0, 1)
+            put(best_dist - 1, window_bits)
+            put(best_len - 1, lookahead_bits)
+            for p in range(position, position + best_len):
+                insert(p)
+            position += best_len
+        else:
+            put(0x100 | data[position], 9)
+            insert(position)
+            position += 1
+
+    if bit_count:
+        out.append((bits << (8 - bit_count)) & 0xFF)
+    return bytes(out)
+
+
+# -----------------------------------------------------------
+#   compress_image()
+#       Writes the LZSS compressed image next to the image file, once
+#       per window size, and returns its name. The compressed image
+#       starts with the header the Device checks (ota_decompress.h).
+#   image_file      - The OTA Image file
+#   window_bits     - Back reference distance bits
+# -----------------------------------------------------------
+def compress_image(image_file, window_bits):
+    with compressed_images_lock:
+        if window_bits in compressed_images:
+            return compressed_images[window_bits]
+
+        with open(image_file, 'rb') as image:
+            data = image.read()
+        start = time.time()
+        stream = lzss_compress(data, window_bits, COMPRESS_LOOKAHEAD_BITS)
+        header = COMPRESS_HEADER_MAGIC + struct.pack('<4B2I', COMPRESS_ALGORITHM_LZSS, window_bits,
+                                                     COMPRESS_LOOKAHEAD_BITS, 0, len(data),
+                                                     zlib.crc32(data) & 0xFFFFFFFF)
+        compressed_file = image_file + ".lzss" + str(window_bits)
+        with open(compressed_file, 'wb') as compressed:
+            compressed.write(header + stream)
+        print("Publisher: Compressed " + str(len(data)) + " bytes to " + str(len(header) + len(stream)) +
+              " bytes (" + str(((len(header) + len(stream)) * 100) // len(data)) + "%) in " +
+              str(round(time.time() - start, 1)) + " s")
+
+        compressed_images[window_bits] = compressed_file
+        return compressed_file
+
+
+# -----------------------------------------------------------
+#   device_window_bits()
+#       LZSS window for a Device that accepts compressed images, 0 if
+#       the image is sent plain.
+#   message_string  - The request from the Device
+# -----------------------------------------------------------
+def device_window_bits(message_string):
+    if not COMPRESS_IMAGE:
+        return 0
     try:
-        time_string = time.asctime()
-        if (DEBUG_LOG):
-            print("Send Chunk Begins..." + time_string + " ")
+        request_json = json.loads(message_string)
+        if request_json.get("Compression") != "LZSS":
+            return 0
+        return min(COMPRESS_WINDOW_BITS, int(request_json.get("CompressionWindowBits", COMPRESS_WINDOW_BITS)))
+    except Exception as e:
+        print("Publisher: Bad compression in request: " + str(e))
+        return 0
 
-        job_dict = json.loads(message_string)
-        offset = int(job_dict["Offset"])
-        size = int(job_dict["Size"])
 
-        pub_mqtt_msgs,pub_total_payloads = do_chunking(OTA_IMAGE_FILE, False, offset, size)
+# -----------------------------------------------------------
+#   leb128()
+#       Unsigned LEB128 encoding of value
+# -----------------------------------------------------------
+def leb128(value):
+    out = bytearray()
+    while value >= 0x80:
+        out.append((value & 0x7F) | 0x80)
+        value >>= 7
+    out.append(value)
+    return out
 
-        # print(" Sending Chunk  offset:" + str(offset) + " size:" + str(size) + " packet sz: " + str( len(pub_mqtt_msgs[0])) + " to: " + unique_topic)
-        result,messageID = send_client.publish(unique_topic, pub_mqtt_msgs[0], PUBLISHER_PUBLISH_QOS)
-        while send_client.publish_mid != messageID:
-            send_client.loop(0.1)
-            time.sleep(0.1)
-            if terminate:
-                exit(0)
 
-        time_string = time.asctime()
-        if (DEBUG_LOG):
-            print("Send Chunk Ends..." + time_string )
+# -----------------------------------------------------------
+#   match_length()
+#       Number of equal bytes of old from old_pos and new from new_pos
+# -----------------------------------------------------------
+def match_length(old, old_pos, new, new_pos):
+    length = 0
+    step = 256
+    limit = min(len(old) - old_pos, len(new) - new_pos)
+    while step > 0:
+        while (length + step <= limit and
+               old[old_pos + length:old_pos + length + step] == new[new_pos + length:new_pos + length + step]):
+            length += step
+        step //= 16
+    return length
 
+
+# -----------------------------------------------------------
+#   delta_record()
+#       Appends the records making new[new_pos:new_pos + diff_len] from
+#       old[old_pos:] followed by extra, then seeking the old image by
+#       seek. Runs of at least DELTA_COPY_MIN unchanged bytes are copied.
+# -----------------------------------------------------------
+def delta_record(patch, old, old_pos, new, new_pos, diff_len, extra, seek):
+    diff = bytes((new[new_pos + i] - old[old_pos + i]) & 0xFF for i in range(diff_len))
+    start = 0
+    while True:
+        run = diff.find(bytes(DELTA_COPY_MIN), start)
+        if run < 0:
+            break
+        end = run + DELTA_COPY_MIN
+        while end < diff_len and diff[end] == 0:
+            end += 1
+        if run > start:
+            patch += leb128((run - start) << 1) + leb128(0) + leb128(0) + diff[start:run]
+        patch += leb128(((end - run) << 1) | 1) + leb128(0) + leb128(0)
+        start = end
+
+    patch += leb128((diff_len - start) << 1) + leb128(len(extra))
+    patch += leb128((seek << 1) if seek >= 0 else ((-seek << 1) - 1))
+    patch += diff[start:] + extra
+
+
+# -----------------------------------------------------------
+#   bsdiff_patch()
+#       Patch making new from old, as bsdiff: the new image is scanned
+#       for exact matches in the old image, each match is extended with
+#       the approximate matches around it to make the diff bytes, and
+#       what is left between them is sent as extra bytes.
+#   old     - The image the Device runs
+#   new     - The OTA Image
+# -----------------------------------------------------------
+def bsdiff_patch(old, new):
+    index = {}
+    for position in range(0, len(old) - DELTA_MATCH_SIZE + 1, DELTA_MATCH_STEP):
+        index.setdefault(old[position:position + DELTA_MATCH_SIZE], position)
+
+    patch = bytearray()
+    scan = 0
+    last_scan = 0
+    last_pos = 0
+    last_offset = 0
+    while scan < len(new):
+        # Look for a match better than going on with the current alignment
+        position = -1
+        length = 0
+        while scan < len(new):
+            key = new[scan:scan + DELTA_MATCH_SIZE]
+            current = scan + last_offset
+            if current < 0 or old[current:current + DELTA_MATCH_SIZE] != key:
+                candidate = index.get(key, -1) if len(key) == DELTA_MATCH_SIZE else -1
+                if candidate >= 0:
+                    length = match_length(old, candidate, new, scan)
+                    start = max(0, current)
+                    end = max(start, min(scan + length + last_offset, len(old)))
+                    old_score = sum(1 for a, b in zip(old[start:end], new[scan:scan + length]) if a == b)
+                    if length >= old_score + DELTA_MATCH_SIZE:
+                        position = candidate
+                        break
+            scan += 1
+
+        # Extend the previous match forward and this match backward
+        score = 0
+        best_score = 0
+        length_f = 0
+        i = 0
+        while last_scan + i < scan and last_pos + i < len(old):
+            if old[last_pos + i] == new[last_scan + i]:
+                score += 1
+            i += 1
+            if score * 2 - i > best_score * 2 - length_f:
+                best_score = score
+                length_f = i
+
+        length_b = 0
+        if position >= 0:
+            score = 0
+            best_score = 0
+            i = 1
+            while scan >= last_scan + i and position >= i:
+                if old[position - i] == new[scan - i]:
+                    score += 1
+                if score * 2 - i > best_score * 2 - length_b:
+                    best_score = score
+                    length_b = i
+                i += 1
+
+        # Split an overlap where it loses least
+        if last_scan + length_f > scan - length_b:
+            overlap = (last_scan + length_f) - (scan - length_b)
+            score = 0
+            best_score = 0
+            length_s = 0
+            for i in range(overlap):
+                if new[last_scan + length_f - overlap + i] == old[last_pos + length_f - overlap + i]:
+                    score += 1
+                if new[scan - length_b + i] == old[position - length_b + i]:
+                    score -= 1
+                if score > best_score:
+                    best_score = score
+                    length_s = i + 1
+            length_f += length_s - overlap
+            length_b -= length_s
+
+        if position < 0:
+            next_pos = last_pos + length_f
+        else:
+            next_pos = position - length_b
+        delta_record(patch, old, last_pos, new, last_scan, length_f,
+                     new[last_scan + length_f:scan - length_b], next_pos - (last_pos + length_f))
+
+        if position < 0:
+            break
+        last_scan = scan - length_b
+        last_pos = position - length_b
+        last_offset = position - scan
+        scan += length
+
+    return bytes(patch)
+
+
+# -----------------------------------------------------------
+#   delta_image()
+#       Writes the patch making the OTA Image from the image in
+#       DELTA_BASE_DIR the Device runs, once per base image and window
+#       size, and returns its name. None when no image in DELTA_BASE_DIR
+#       matches or the patch is not smaller than the image sent plain.
+#   image_file      - The OTA Image file
+#   base_size       - "DeltaBaseSize" of the Device
+#   base_crc        - "DeltaBaseCrc" of the Device
+#   window_bits     - LZSS window of the Device, 0 to send the patch plain
+# -----------------------------------------------------------
+def delta_image(image_file, base_size, base_crc, window_bits):
+    with delta_patches_lock:
+        key = (base_size, base_crc, window_bits)
+        if key in delta_patches:
+            return delta_patches[key]
+        delta_patches[key] = None
+
+        base = None
+        for name in sorted(os.listdir(DELTA_BASE_DIR)):
+            path = os.path.join(DELTA_BASE_DIR, name)
+            if not name.endswith(".bin") or not os.path.isfile(path) or os.path.getsize(path) < base_size:
+                continue
+            with open(path, 'rb') as base_file:
+                data = base_file.read(base_size)
+            if zlib.crc32(data) & 0xFFFFFFFF == base_crc:
+                base = data
+                break
+        if base is None:
+            print("Publisher: No image of " + str(base_size) + " bytes with CRC " + hex(base_crc) +
+                  " in " + DELTA_BASE_DIR)
+            return None
+
+        with open(image_file, 'rb') as image:
+            data = image.read()
+        start = time.time()
+        header = DELTA_HEADER_MAGIC + struct.pack('<4B4I', DELTA_FORMAT, 0, 0, 0, base_size, base_crc,
+                                                  len(data), zlib.crc32(data) & 0xFFFFFFFF)
+        patch = header + bsdiff_patch(base, data)
+        if window_bits != 0:
+            stream = lzss_compress(patch, window_bits, COMPRESS_LOOKAHEAD_BITS)
+            patch = COMPRESS_HEADER_MAGIC + struct.pack('<4B2I', COMPRESS_ALGORITHM_LZSS, window_bits,
+                                                        COMPRESS_LOOKAHEAD_BITS, 0, len(patch),
+                                                        zlib.crc32(patch) & 0xFFFFFFFF) + stream
+        print("Publisher: Patch of " + str(len(patch)) + " bytes for the " + str(len(data)) +
+              " bytes image (" + str((len(patch) * 100) // len(data)) + "%) in " +
+              str(round(time.time() - start, 1)) + " s")
+        if len(patch) >= len(data):
+            return None
+
+        patch_file = image_file + ".delta" + format(base_crc, "08x") + (".lzss" + str(window_bits) if window_bits else "")
+        with open(patch_file, 'wb') as patch_out:
+            patch_out.write(patch)
+        delta_patches[key] = patch_file
+        return patch_file
+
+
+# -----------------------------------------------------------
+#   device_delta_image()
+#       Patch file for a Device that runs an image of DELTA_BASE_DIR,
+#       None if the image is sent whole.
+#   message_string  - The request from the Device
+# -----------------------------------------------------------
+def device_delta_image(message_string):
+    if DELTA_BASE_DIR is None:
+        return None
+    try:
+        request_json = json.loads(message_string)
+        if "DeltaBaseSize" not in request_json or "DeltaBaseCrc" not in request_json:
+            return None
+        window_bits = 0
+        if request_json.get("Compression") == "LZSS":
+            window_bits = min(COMPRESS_WINDOW_BITS, int(request_json.get("CompressionWindowBits", COMPRESS_WINDOW_BITS)))
+        return delta_image(OTA_IMAGE_FILE, int(request_json["DeltaBaseSize"]), int(request_json["DeltaBaseCrc"]),
+                           window_bits)
     except Exception as e:
-        print("Exception Occurred... Exiting...")
-        print(str(e) + os.linesep)
-        traceback.print_exc()
-        exit(0)
+        print("Publisher: Bad delta base in request: " + str(e))
+        return None
+
+
+# -----------------------------------------------------------
+#   device_chunk_size()
+#       Chunk size for a Device: the "ChunkSize" of its request, limited
+#       by its "MaxChunkSize". A request without them uses the size the
+#       Device advertised last on the same unique topic, or CHUNK_SIZE.
+#   message_string  - The request from the Device
+#   unique_topic    - The unique topic of the Device
+# -----------------------------------------------------------
+def device_chunk_size(message_string, unique_topic):
+    chunk_size = device_chunk_sizes.get(unique_topic, CHUNK_SIZE)
+    try:
+        request_json = json.loads(message_string)
+        if "ChunkSize" in request_json:
+            chunk_size = int(request_json["ChunkSize"])
+            if "MaxChunkSize" in request_json:
+                chunk_size = min(chunk_size, int(request_json["MaxChunkSize"]))
+    except Exception as e:
+        print("Publisher: Bad chunk size in request: " + str(e))
+
+    return max(MIN_CHUNK_SIZE, min(chunk_size, MAX_CHUNK_SIZE))
 
-    # we're done
-    exit(0)
+
+# -----------------------------------------------------------
+#   device_data_alignment()
+#       Records the "DataAlignment" and "DataQos" of a Device, used for
+#       all the chunks sent on its unique topic. 1 (no padding) without
+#       the alignment, PUBLISHER_PUBLISH_QOS without the QoS.
+#   message_string  - The request from the Device
+#   unique_topic    - The unique topic of the Device
+# -----------------------------------------------------------
+def device_data_alignment(message_string, unique_topic):
+    try:
+        request_json = json.loads(message_string)
+        if "DataAlignment" in request_json:
+            device_data_alignments[unique_topic] = max(1, min(int(request_json["DataAlignment"]), 64))
+        if "DataQos" in request_json:
+            device_data_qos[unique_topic] = max(0, min(int(request_json["DataQos"]), PUBLISHER_PUBLISH_QOS))
+    except Exception as e:
+        print("Publisher: Bad data alignment in request: " + str(e))
 
 
 # -----------------------------------------------------------
@@ -604,9 +1100,10 @@ def send_image_chunk_thread(message_string, unique_topic):
 #       Call do_chunking() and send the chunks to the Device.
 #   message_string  - The Initial "Update Availability" message
 #   unique_topic    - The unique topic to send the OTA Image on.
+#   chunk_size      - Size of the chunks for this Device.
 #
 # -----------------------------------------------------------
-def send_image_thread(message_string, unique_topic):
+def send_image_thread(message_string, unique_topic, chunk_size):
     global terminate
 
     # Create unique MQTT ID
@@ -637,8 +1134,18 @@ def send_image_thread(message_string, unique_topic):
 
     try:
         time_string = time.asctime()
-        print("Publishing Begins..." + time_string + " ")
-        pub_mqtt_msgs,pub_total_payloads = do_chunking(OTA_IMAGE_FILE, True, 0, CHUNK_SIZE)
+        print("Publishing Begins..." + time_string + " chunk size: " + str(chunk_size))
+        window_bits = device_window_bits(message_string)
+        patch_file = device_delta_image(message_string)
+        if patch_file is not None:
+            pub_mqtt_msgs,pub_total_payloads = do_chunking(patch_file, True, 0, chunk_size, IMAGE_TYPE_DELTA,
+                                                           unique_topic)
+        elif window_bits != 0:
+            pub_mqtt_msgs,pub_total_payloads = do_chunking(compress_image(OTA_IMAGE_FILE, window_bits), True, 0,
+                                                           chunk_size, IMAGE_TYPE_COMPRESSED, unique_topic)
+        else:
+            pub_mqtt_msgs,pub_total_payloads = do_chunking(OTA_IMAGE_FILE, True, 0, chunk_size, IMAGE_TYPE,
+                                                           unique_topic)
 
         # for chunk in pub_mqtt_msgs:
         for chunk in range(0,pub_total_payloads):
@@ -673,10 +1180,54 @@ def send_image_thread(message_string, unique_topic):
 #   userdata -
 #   message  - Message sent from the Device
 # -----------------------------------------------------------
+# -----------------------------------------------------------
+#   print_telemetry()
+#       Print one download telemetry message of a Device
+#       (source/ota_telemetry.c)
+# -----------------------------------------------------------
+def print_telemetry(message_string):
+    try:
+        telemetry = json.loads(message_string)
+        total = telemetry["Total"]
+        percent = (telemetry["Bytes"] * 100 // total) if total else 0
+        print("Telemetry " + telemetry["Device"] + ": " + str(percent) + "% " +
+              str(telemetry["BytesPerSec"]) + " B/s, chunk interval avg " +
+              str(telemetry["IntervalMs"]["Avg"]) + " max " + str(telemetry["IntervalMs"]["Max"]) +
+              " ms, write avg " + str(telemetry["WriteUs"]["Avg"]) + " max " +
+              str(telemetry["WriteUs"]["Max"]) + " us")
+        if (DEBUG_LOG):
+            print("    interval ms histogram: " + str(telemetry["IntervalHist"]))
+            print("    write us histogram   : " + str(telemetry["WriteHist"]))
+    except Exception as e:
+        print("Malformed telemetry message: '" + message_string + "' " + str(e))
+
+# -----------------------------------------------------------
+#   print_phases()
+#       Print the phase times [ms, retries] a Device adds to its
+#       result report (ota_telemetry_append_phases())
+# -----------------------------------------------------------
+def print_phases(message_string):
+    try:
+        phases = json.loads(message_string).get("Phases")
+    except Exception:
+        return
+    if phases is None:
+        return
+    print("Publisher: Device update phases:")
+    for name, value in phases.items():
+        if isinstance(value, list):
+            print("    {:<12} {:>8} ms  retries: {}".format(name, value[0], value[1]))
+        else:
+            print("    {:<12} {:>8}".format(name, value))
+
 def publisher_recv_message(client, userdata, message):
     global VERSION_MAJOR
     global VERSION_MINOR
     global VERSION_BUILD
+
+    if message.topic == PUBLISHER_TELEMETRY_REQUEST_TOPIC:
+        print_telemetry(str(message.payload.decode("utf-8")))
+        return
     # print("message received " ,str(message.payload.decode("utf-8")))
     # print("message topic=",message.topic)
     # print("message qos=",message.qos)
@@ -701,6 +1252,10 @@ def publisher_recv_message(client, userdata, message):
         #       for board/product/version/etc.
         #   Open a specific response file or generate the JSON on the fly.
         #
+        # Remember the chunk size the Device can take for its download
+        device_chunk_sizes[unique_topic] = device_chunk_size(message_string, unique_topic)
+        device_data_alignment(message_string, unique_topic)
+
         # Get the Job file (or create a JSON document )
         job_file = open (JSON_JOB_MESSAGE_FILE)
         job_source = job_file.read()
@@ -740,7 +1295,10 @@ def publisher_recv_message(client, userdata, message):
         #   Keep track that Device update was sent so response can be tested
         #
         # Create a new thread to send the data. This will allow for multiple, overlapping requests.
-        send_thread = threading.Thread(None, send_image_thread, None, args=(message_string, unique_topic))
+        chunk_size = device_chunk_size(message_string, unique_topic)
+        device_data_alignment(message_string, unique_topic)
+        device_chunk_sizes.pop(unique_topic, None)
+        send_thread = threading.Thread(None, send_image_thread, None, args=(message_string, unique_topic, chunk_size))
         send_thread.start()
         return
 
@@ -753,7 +1311,10 @@ def publisher_recv_message(client, userdata, message):
         print( "Publisher: Send Direct OTA on topic:" + unique_topic )
 
         # Create a new thread to send the data. This will allow for multiple, overlapping requests.
-        send_thread = threading.Thread(None, send_image_thread, None, args=(message_string, unique_topic))
+        chunk_size = device_chunk_size(message_string, unique_topic)
+        device_data_alignment(message_string, unique_topic)
+        device_chunk_sizes.pop(unique_topic, None)
+        send_thread = threading.Thread(None, send_image_thread, None, args=(message_string, unique_topic, chunk_size))
         send_thread.start()
         return
 
@@ -764,16 +1325,18 @@ def publisher_recv_message(client, userdata, message):
         # Possible Enhancement:
         #   Determine the OTA Image file to send to the Device.
 
-        # print( "Publisher: Send Chunk of OTA Image on topic:" + unique_topic )
-
-        # Create a new thread to send the data. This will allow for multiple, overlapping requests.
-        print("Publisher: Start Sending CHUNK Thread")
-        send_thread = threading.Thread(None, send_image_chunk_thread, None, args=(message_string, unique_topic))
-        send_thread.start()
+        # One thread answers the chunk requests of all the Devices in order
+        global chunk_thread
+        if chunk_thread is None:
+            print("Publisher: Start Sending CHUNK Thread")
+            chunk_thread = threading.Thread(None, send_image_chunk_thread, None)
+            chunk_thread.start()
+        chunk_requests.put((message_string, unique_topic))
         return
 
     # Handle incoming "result" notification
     if (message_type == MSG_TYPE_RESULT_SUCCESS) | (message_type == MSG_TYPE_RESULT_FAILURE):
+        print_phases(message_string)
         #
         # Possible Enhancement:
         #   Match the Device that requested the updte
@@ -802,6 +1365,7 @@ def publisher_recv_message(client, userdata, message):
 #   on connection callback
 # -----------------------------------------------------------
 def on_connect(client, userdata, flags, rc):
+    client.session_present = flags.get("session present", 0) == 1
     client.connected_flag = True
 
 # -----------------------------------------------------------
@@ -815,11 +1379,14 @@ def on_subscribe(client, userdata, mid, granted_qos):
 # -----------------------------------------------------------
 def publisher_loop():
     global terminate
-    client_id = SEND_IMAGE_MQTT_CLIENT_ID + str(random.randint(0, 1024*1024*1024))
-    client_id = str.ljust(client_id, 24)  # limit to 24 characters
-    client_id = str.rstrip(client_id)
+    if PERSISTENT_SESSION:
+        client_id = PUBLISHER_MQTT_CLIENT_ID
+    else:
+        client_id = SEND_IMAGE_MQTT_CLIENT_ID + str(random.randint(0, 1024*1024*1024))
+        client_id = str.ljust(client_id, 24)  # limit to 24 characters
+        client_id = str.rstrip(client_id)
     print("Publisher: MQTT Connect with id: " + client_id)
-    pub_client = MQTTPublisher(client_id)
+    pub_client = MQTTPublisher(client_id, clean_session=not PERSISTENT_SESSION)
     pub_client.on_message = publisher_recv_message
     if (DEBUG_LOG):
         pub_client.on_log = on_pub_log
@@ -840,19 +1407,30 @@ def publisher_loop():
         if terminate:
             exit(0)
 
-    print("Publisher: Waiting for Job request on: '" + PUBLISHER_JOB_REQUEST_TOPIC + "'" )
-    result,messageID = pub_client.subscribe(PUBLISHER_JOB_REQUEST_TOPIC, PUBLISHER_SUBSCRIBE_QOS)
-    while pub_client.subscribe_mid != messageID:
-        pub_client.loop(0.1)
-        time.sleep(0.1)
-        if terminate:
-            exit(0)
+    # The broker kept the subscriptions of a persistent session
+    if pub_client.session_present:
+        print("Publisher: Session present, subscriptions kept by the broker")
+    else:
+        print("Publisher: Waiting for Job request on: '" + PUBLISHER_JOB_REQUEST_TOPIC + "'" )
+        result,messageID = pub_client.subscribe(PUBLISHER_JOB_REQUEST_TOPIC, PUBLISHER_SUBSCRIBE_QOS)
+        while pub_client.subscribe_mid != messageID:
+            pub_client.loop(0.1)
+            time.sleep(0.1)
+            if terminate:
+                exit(0)
+
+        print("Publisher: Listening for telemetry on: '" + PUBLISHER_TELEMETRY_REQUEST_TOPIC + "'" )
+        result,messageID = pub_client.subscribe(PUBLISHER_TELEMETRY_REQUEST_TOPIC, 0)
+        while pub_client.subscribe_mid != messageID:
+            pub_client.loop(0.1)
+            time.sleep(0.1)
+            if terminate:
+                exit(0)
 
     print("Publisher: Connected and Subscribed. Waiting for Requests.")
-    # Loop forever
+    # Loop forever, loop() waits for the next message itself
     while True:
         pub_client.loop(0.1)
-        time.sleep(0.1)
         if terminate:
             exit(0)
 
@@ -872,15 +1450,18 @@ def publisher_loop():
 if __name__ == "__main__":
     print("################################################################################################################################")
     print("Infineon Test MQTT Publisher.")
-    print("Usage: 'python publisher.py [tls] [-l] [-b <broker>] [-k <kit>] [-f <filepath>]'")
+    print("Usage: 'python publisher.py [tls] [-l] [-p] [-z] [-d <basedir>] [-b <broker>] [-k <kit>] [-f <filepath>]'")
     print("<broker>       | [a] or [amazon] | [e] or [eclipse] | [m] or [mosquitto] | [ml] or [mosquitto_local] |")
     print("<kit>          CY8CPROTO_062S2_43439 | CY8CPROTO_062_4343W | CY8CKIT_062S2_43012 | CY8CEVAL_062S2_LAI_4373M2 | CY8CEVAL_062S2_MUR_43439M2 | CY8CPROTO_062S3_4343W | KIT_XMC72_EVK_MUR_43439M2 |")
     print("<filepath>     The location of the OTA Image file to server to the device")
+    print("<basedir>      Directory of the images (*.bin) the devices may run, to send them patches")
     print("Defaults: <non-TLS>")
     print("        : -f " + OTA_IMAGE_FILE)
     print("        : -b mosquitto_local ")
     print("        : -k " + KIT)
     print("        : -l turn on extra logging")
+    print("        : -p persistent MQTT session")
+    print("        : -z send compressed images")
     print("################################################################################################################################")
     last_arg = ""
     OTA_IMAGE_FILE_NEW = None
@@ -893,8 +1474,14 @@ if __name__ == "__main__":
         if arg == "-l":
             DEBUG_LOG = 1
             DEBUG_LOG_STRING = "1"
+        if arg == "-p":
+            PERSISTENT_SESSION = True
+        if arg == "-z":
+            COMPRESS_IMAGE = True
         if last_arg == "-f":
             OTA_IMAGE_FILE_NEW = arg
+        if last_arg == "-d":
+            DELTA_BASE_DIR = arg
         if last_arg == "-b":
             if ((arg == "amazon") | (arg == "a")):
                 BROKER_ADDRESS = AMAZON_BROKER_ADDRESS
@@ -927,6 +1514,9 @@ print("   Using BROKER: " + BROKER_ADDRESS)
 print("   Using    KIT: " + KIT)
 print("   Using   File: " + OTA_IMAGE_FILE)
 print("   extra debug : " + DEBUG_LOG_STRING)
+print("   persistent  : " + str(PERSISTENT_SESSION))
+print("   compressed  : " + str(COMPRESS_IMAGE))
+print("   delta bases : " + str(DELTA_BASE_DIR))
 
 
 PUBLISHER_JOB_REQUEST_TOPIC = COMPANY_TOPIC_PREPEND + "/APP_" + KIT + "/" + PUBLISHER_LISTEN_TOPIC
@@ -934,6 +1524,9 @@ print("PUBLISHER_JOB_REQUEST_TOPIC   : " + PUBLISHER_JOB_REQUEST_TOPIC)
 
 PUBLISHER_DIRECT_REQUEST_TOPIC = COMPANY_TOPIC_PREPEND + "/APP_" + KIT + "/" + PUBLISHER_DIRECT_TOPIC
 print("PUBLISHER_DIRECT_REQUEST_TOPIC: " + PUBLISHER_DIRECT_REQUEST_TOPIC)
+
+PUBLISHER_TELEMETRY_REQUEST_TOPIC = COMPANY_TOPIC_PREPEND + "/APP_" + KIT + "/" + PUBLISHER_TELEMETRY_TOPIC
+print("PUBLISHER_TELEMETRY_REQUEST_TOPIC: " + PUBLISHER_TELEMETRY_REQUEST_TOPIC)
 print("\n")
 
 #
@@ -0,0 +1,105 @@
+import re
+import subprocess
+import sys
+
+#
+#   Post-build RAM report for STATIC_ALLOC=1 builds.
+#
+#   With OTA_STATIC_ALLOCATION the task stacks, the flash queue buffers, the
+#   encryption write buffer and the mbedtls memory are static buffers, so their RAM is known at link time
+#   instead of being taken from the heap at run time. The script prints the
+#   size of the RAM sections of the ELF file, the heap and stack reserved by
+#   the linker script, and the largest RAM objects grouped by source file.
+#
+# Usage:
+#   python ram_report.py <elf file> <objdump> [<number of objects>]
+#
+
+# Objects listed by default
+DEFAULT_TOP = 20
+
+#  Idx Name          Size      VMA       LMA       File off  Algn
+#    5 .bss          0001a2c8  28004e60  28004e60  00000000  2**3
+#                    ALLOC
+SECTION_RE = re.compile(r'^\s*\d+\s+(\S+)\s+([0-9a-f]+)\s+([0-9a-f]+)\s+[0-9a-f]+\s+[0-9a-f]+\s+2\*\*\d+$')
+#  28004e60 l     O .bss	00006000 ota_task_stack
+#  The 7 flag characters: scope (l, g, ...) first, type (O object, f file) last
+SYMBOL_RE  = re.compile(r'^([0-9a-f]+) (.{7}) (\S+)\s+([0-9a-f]+)\s+(\S+)$')
+
+def read_sections(elf_file, objdump):
+    sections = []       # (name, size, address)
+    pending = None
+
+    output = subprocess.run([objdump, "-h", elf_file],
+                            stdout=subprocess.PIPE, universal_newlines=True, check=True).stdout
+
+    for line in output.splitlines():
+        match = SECTION_RE.match(line)
+        if match:
+            pending = (match.group(1), int(match.group(2), 16), int(match.group(3), 16))
+            continue
+        if pending is not None:
+            flags = [flag.strip() for flag in line.split(",")]
+            # RAM: allocated at run time and writable
+            if "ALLOC" in flags and "READONLY" not in flags and pending[1] != 0:
+                sections.append(pending)
+            pending = None
+
+    return sections
+
+def read_objects(elf_file, objdump, sections):
+    objects = []        # (size, name, file, section)
+    names = set(name for name, _, _ in sections)
+    source = "?"
+
+    output = subprocess.run([objdump, "-t", elf_file],
+                            stdout=subprocess.PIPE, universal_newlines=True, check=True).stdout
+
+    for line in output.splitlines():
+        match = SYMBOL_RE.match(line)
+        if not match:
+            continue
+        flags, section, size, name = match.group(2), match.group(3), int(match.group(4), 16), match.group(5)
+        # The local symbols of a file follow its FILE symbol
+        if flags[6] == "f":
+            source = name
+            continue
+        if flags[6] == "O" and section in names and size != 0:
+            objects.append((size, name, source if flags[0] == "l" else "global", section))
+
+    return objects
+
+def report(elf_file, objdump, top):
+    sections = read_sections(elf_file, objdump)
+    objects = read_objects(elf_file, objdump, sections)
+
+    total = 0
+    print("ram_report: RAM sections of " + elf_file)
+    for name, size, address in sections:
+        print("ram_report:   %-24s 0x%08x %8u bytes" % (name, address, size))
+        total += size
+    print("ram_report:   %-24s            %8u bytes" % ("total", total))
+
+    for name, size, _ in sections:
+        if "heap" in name:
+            print("ram_report: heap reserved: %u bytes, allocations left on it show in the update summary" % size)
+        elif "stack" in name:
+            print("ram_report: main stack: %u bytes" % size)
+
+    by_file = {}
+    for size, _, source, _ in objects:
+        by_file[source] = by_file.get(source, 0) + size
+    print("ram_report: static RAM by source file:")
+    for source, size in sorted(by_file.items(), key=lambda item: item[1], reverse=True)[:top]:
+        print("ram_report:   %-40s %8u bytes" % (source, size))
+
+    print("ram_report: largest RAM objects:")
+    for size, name, source, section in sorted(objects, reverse=True)[:top]:
+        print("ram_report:   %-40s %8u bytes  %s (%s)" % (name, size, section, source))
+
+if __name__ == "__main__":
+    if len(sys.argv) < 3:
+        print("Usage: python ram_report.py <elf file> <objdump> [<number of objects>]")
+        sys.exit(2)
+
+    report(sys.argv[1], sys.argv[2], int(sys.argv[3]) if len(sys.argv) > 3 else DEFAULT_TOP)
@@ -47,6 +47,7 @@
 #include <stdint.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include "ota_log_token.h"
 
 /* ARM compiler also defines __GNUC__ */
 #if defined (__GNUC__) && !defined(__ARMCC_VERSION)
@@ -84,17 +85,17 @@ void print_heap_usage(char *msg)
     uint8_t* heap_limit = (uint8_t *)&__HeapLimit;
     uint32_t heap_size = (uint32_t)(heap_limit - heap_base);
 
-    printf("\r\n\n********** Heap Usage **********\r\n");
-    printf(msg);
-    printf("\r\nTotal available heap        : %"PRIu32" bytes/%.2f KB\r\n", heap_size, TO_KB(heap_size));
+    OTA_PRINTF("\r\n\n********** Heap Usage **********\r\n");
+    OTA_PRINTF("%s", msg);
+    OTA_PRINTF("\r\nTotal available heap        : %"PRIu32" bytes/%.2f KB\r\n", heap_size, TO_KB(heap_size));
 
-    printf("Maximum heap utilized so far: %u bytes/%.2f KB, %.2f%% of available heap\r\n",
+    OTA_PRINTF("Maximum heap utilized so far: %u bytes/%.2f KB, %.2f%% of available heap\r\n",
             mall_info.arena, TO_KB(mall_info.arena), ((float) mall_info.arena * 100u)/heap_size);
 
-    printf("Heap in use at this point   : %u bytes/%.2f KB, %.2f%% of available heap\r\n",
+    OTA_PRINTF("Heap in use at this point   : %u bytes/%.2f KB, %.2f%% of available heap\r\n",
             mall_info.uordblks, TO_KB(mall_info.uordblks), ((float) mall_info.uordblks * 100u)/heap_size);
 
-    printf("********************************\r\n\n");
+    OTA_PRINTF("********************************\r\n\n");
 #endif /* #if defined(PRINT_HEAP_USAGE) && defined (__GNUC__) && !defined(__ARMCC_VERSION) */
 }
 
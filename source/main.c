@@ -1,158 +1,215 @@
-/******************************************************************************
-* File Name: main.c
-*
-* Description: This code example demonstrates OTA update with PSoC 6 MCU and
-* CYW43xxx connectivity devices. The device establishes a connection with the
-* designated MQTT Broker (AWS is used in this example) and subscribes to
-* a topic. It periodically checks the job document to see if a new update is
-* available. When a new update is available, it will be downloaded and written
-* to the secondary slot. On the next reboot, MCUBoot will copy the new image
-* over to the primary slot and run the application.
-*
-* Related Document: See README.md
-********************************************************************************
-* Copyright 2020-2024, Cypress Semiconductor Corporation (an Infineon company) or
-* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
-*
-* This software, including source code, documentation and related
-* materials ("Software") is owned by Cypress Semiconductor Corporation
-* or one of its affiliates ("Cypress") and is protected by and subject to
-* worldwide patent protection (United States and foreign),
-* United States copyright laws and international treaty provisions.
-* Therefore, you may use this Software only as provided in the license
-* agreement accompanying the software package from which you
-* obtained this Software ("EULA").
-* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
-* non-transferable license to copy, modify, and compile the Software
-* source code solely for use in connection with Cypress's
-* integrated circuit products.  Any reproduction, modification, translation,
-* compilation, or representation of this Software except as specified
-* above is prohibited without the express written permission of Cypress.
-*
-* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
-* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
-* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
-* reserves the right to make changes to the Software without notice. Cypress
-* does not assume any liability arising out of the application or use of the
-* Software or any product or circuit described in the Software. Cypress does
-* not authorize its products for use in any products where a malfunction or
-* failure of the Cypress product may reasonably be expected to result in
-* significant property damage, injury or death ("High Risk Product"). By
-* including Cypress's product in a High Risk Product, the manufacturer
-* of such system or application assumes all risk of such use and in doing
-* so agrees to indemnify Cypress against all liability.
-*******************************************************************************/
-
-/* Header file includes */
-#include "cyhal.h"
-#include "cybsp.h"
-#include "cy_retarget_io.h"
-#include "ota_task.h"
-#include "led_task.h"
-#include "cy_log.h"
-
-/* FreeRTOS header file */
-#include <FreeRTOS.h>
-#include <task.h>
-
-/*******************************************************************************
-* Macros
-********************************************************************************/
-/* OTA task configurations */
-#define OTA_TASK_STACK_SIZE                 (1024 * 6)
-#define OTA_TASK_PRIORITY                   (configMAX_PRIORITIES - 3)
-
-/* OTA task configurations */
-#define LED_TASK_STACK_SIZE                 (configMINIMAL_STACK_SIZE)
-#define LED_TASK_PRIORITY                   (configMAX_PRIORITIES - 3)
-
-/*******************************************************************************
-* Global Variables
-********************************************************************************/
-/* OTA task handle */
-TaskHandle_t ota_task_handle;
-
-/* LED task handle */
-TaskHandle_t led_task_handle;
-
-/*******************************************************************************
- * Function Name: main
- ********************************************************************************
- * Summary:
- *  System entrance point. This function sets up OTA task and starts
- *  the RTOS scheduler.
- *
- * Parameters:
- *  void
- *
- * Return:
- *  int
- *
- *******************************************************************************/
-int main(void)
-{
-    cy_rslt_t result = CY_RSLT_TYPE_ERROR;
-
-    /* Prevent the WDT from timing out and resetting the device. */
-    /* Watchdog timer started by the bootloader */
-    cyhal_wdt_kick(NULL);
-
-    /* Initialize the board support package */
-    result = cybsp_init();
-
-    /* Board init failed. Stop program execution */
-    if (CY_RSLT_SUCCESS != result)
-    {
-        CY_ASSERT(0);
-    }
-
-    /* Initialize retarget-io to use the debug UART port */
-    result = cy_retarget_io_init(CYBSP_DEBUG_UART_TX, CYBSP_DEBUG_UART_RX,
-                                 CY_RETARGET_IO_BAUDRATE);
-
-    /* Retarget-io init failed. Stop program execution */
-    if (CY_RSLT_SUCCESS != result)
-    {
-        CY_ASSERT(0);
-    }
-
- #ifdef XMC7200
-    /* Initialize the XMC7200 flash */
-    Cy_Flash_Init();
-    Cy_Flashc_MainWriteEnable();
- #endif
-
-    /* Enable global interrupts. */
-    __enable_irq();
-
-    printf("\r===============================================================\n");
-    printf("TEST Application: OTA Update version: %d.%d.%d\n",
-            APP_VERSION_MAJOR, APP_VERSION_MINOR, APP_VERSION_BUILD);
-    printf("===============================================================\n\n");
-
-#ifdef TEST_REVERT
-    printf("===============================================================\n");
-    printf("Testing revert feature, entering infinite loop !!!\n\n");
-    printf("===============================================================\n\n");
-    while(true);
-#endif
-
-    /* Update watchdog timer to mark successful start up of application */
-    /* Watchdog timer started by the bootloader */
-    cyhal_wdt_free(NULL);
-    printf("\nWatchdog timer started by the bootloader is now turned off!!!\n\n");
-
-    /* Create the tasks */
-    xTaskCreate(ota_task, "OTA TASK", OTA_TASK_STACK_SIZE, NULL,
-                OTA_TASK_PRIORITY, &ota_task_handle);
-    xTaskCreate(led_task, "LED TASK", LED_TASK_STACK_SIZE, NULL,
-                LED_TASK_PRIORITY, &led_task_handle);
-
-    /* Start the FreeRTOS scheduler. */
-    vTaskStartScheduler();
-
-    /* Should never get here. */
-    CY_ASSERT(0);
-}
-
-/* [] END OF FILE */
+/******************************************************************************
+* File Name: main.c
+*
+* Description: This code example demonstrates OTA update with PSoC 6 MCU and
+* CYW43xxx connectivity devices. The device establishes a connection with the
+* designated MQTT Broker (AWS is used in this example) and subscribes to
+* a topic. It periodically checks the job document to see if a new update is
+* available. When a new update is available, it will be downloaded and written
+* to the secondary slot. On the next reboot, MCUBoot will copy the new image
+* over to the primary slot and run the application.
+*
+* Related Document: See README.md
+********************************************************************************
+* Copyright 2020-2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/* Header file includes */
+#include "cyhal.h"
+#include "cybsp.h"
+#include "cy_retarget_io.h"
+#include "ota_task.h"
+#include "led_task.h"
+#include "ota_log.h"
+#include "ota_log_token.h"
+#include "retarget_io_dma.h"
+#include "ota_telemetry.h"
+#include "cy_log.h"
+
+/* FreeRTOS header file */
+#include <FreeRTOS.h>
+#include <task.h>
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* OTA task configurations */
+#define OTA_TASK_STACK_SIZE                 (1024 * 6)
+#define OTA_TASK_PRIORITY                   (configMAX_PRIORITIES - 3)
+
+/* OTA task configurations */
+#define LED_TASK_STACK_SIZE                 (configMINIMAL_STACK_SIZE)
+#define LED_TASK_PRIORITY                   (configMAX_PRIORITIES - 3)
+
+/* OTA callback logger task configurations */
+#define LOG_TASK_STACK_SIZE                 (1024 * 2)
+#define LOG_TASK_PRIORITY                   (tskIDLE_PRIORITY + 1)
+
+/* OTA download telemetry task configurations */
+#define TELEMETRY_TASK_STACK_SIZE           (1024 * 3)
+#define TELEMETRY_TASK_PRIORITY             (tskIDLE_PRIORITY + 1)
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* OTA task handle */
+TaskHandle_t ota_task_handle;
+
+/* LED task handle */
+TaskHandle_t led_task_handle;
+
+/* OTA callback logger task handle */
+TaskHandle_t log_task_handle;
+
+/* OTA download telemetry task handle */
+TaskHandle_t telemetry_task_handle;
+
+#ifdef OTA_STATIC_ALLOCATION
+/* Stacks and control blocks of the tasks, in place of the heap */
+static StackType_t  ota_task_stack[OTA_TASK_STACK_SIZE];
+static StaticTask_t ota_task_tcb;
+static StackType_t  led_task_stack[LED_TASK_STACK_SIZE];
+static StaticTask_t led_task_tcb;
+static StackType_t  log_task_stack[LOG_TASK_STACK_SIZE];
+static StaticTask_t log_task_tcb;
+static StackType_t  telemetry_task_stack[TELEMETRY_TASK_STACK_SIZE];
+static StaticTask_t telemetry_task_tcb;
+#endif
+
+/*******************************************************************************
+ * Function Name: main
+ ********************************************************************************
+ * Summary:
+ *  System entrance point. This function sets up OTA task and starts
+ *  the RTOS scheduler.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  int
+ *
+ *******************************************************************************/
+int main(void)
+{
+    cy_rslt_t result = CY_RSLT_TYPE_ERROR;
+
+    /* Prevent the WDT from timing out and resetting the device. */
+    /* Watchdog timer started by the bootloader */
+    cyhal_wdt_kick(NULL);
+
+    /* Initialize the board support package */
+    result = cybsp_init();
+
+    /* Board init failed. Stop program execution */
+    if (CY_RSLT_SUCCESS != result)
+    {
+        CY_ASSERT(0);
+    }
+
+    /* Initialize retarget-io to use the debug UART port */
+    result = cy_retarget_io_init(CYBSP_DEBUG_UART_TX, CYBSP_DEBUG_UART_RX,
+                                 CY_RETARGET_IO_BAUDRATE);
+
+    /* Retarget-io init failed. Stop program execution */
+    if (CY_RSLT_SUCCESS != result)
+    {
+        CY_ASSERT(0);
+    }
+
+#ifdef RETARGET_IO_DMA
+    /* Send the console output through a ring buffer drained by UART DMA */
+    result = retarget_io_dma_init();
+    if (CY_RSLT_SUCCESS != result)
+    {
+        CY_ASSERT(0);
+    }
+#endif
+
+ #ifdef XMC7200
+    /* Initialize the XMC7200 flash */
+    Cy_Flash_Init();
+    Cy_Flashc_MainWriteEnable();
+ #endif
+
+    /* Enable global interrupts. */
+    __enable_irq();
+
+    OTA_PRINTF("\r===============================================================\n");
+    OTA_PRINTF("TEST Application: OTA Update version: %d.%d.%d\n",
+            APP_VERSION_MAJOR, APP_VERSION_MINOR, APP_VERSION_BUILD);
+    OTA_PRINTF("===============================================================\n\n");
+
+#ifdef TEST_REVERT
+    OTA_PRINTF("===============================================================\n");
+    OTA_PRINTF("Testing revert feature, entering infinite loop !!!\n\n");
+    OTA_PRINTF("===============================================================\n\n");
+    while(true);
+#endif
+
+    /* Update watchdog timer to mark successful start up of application */
+    /* Watchdog timer started by the bootloader */
+    cyhal_wdt_free(NULL);
+    OTA_PRINTF("\nWatchdog timer started by the bootloader is now turned off!!!\n\n");
+
+    /* Create the tasks */
+#ifdef OTA_STATIC_ALLOCATION
+    ota_task_handle = xTaskCreateStatic(ota_task, "OTA TASK", OTA_TASK_STACK_SIZE, NULL,
+                OTA_TASK_PRIORITY, ota_task_stack, &ota_task_tcb);
+    led_task_handle = xTaskCreateStatic(led_task, "LED TASK", LED_TASK_STACK_SIZE, NULL,
+                LED_TASK_PRIORITY, led_task_stack, &led_task_tcb);
+    log_task_handle = xTaskCreateStatic(ota_log_task, "LOG TASK", LOG_TASK_STACK_SIZE, NULL,
+                LOG_TASK_PRIORITY, log_task_stack, &log_task_tcb);
+    telemetry_task_handle = xTaskCreateStatic(ota_telemetry_task, "TELEMETRY TASK",
+                TELEMETRY_TASK_STACK_SIZE, NULL, TELEMETRY_TASK_PRIORITY,
+                telemetry_task_stack, &telemetry_task_tcb);
+    CY_ASSERT((ota_task_handle != NULL) && (led_task_handle != NULL) &&
+              (log_task_handle != NULL) && (telemetry_task_handle != NULL));
+#else
+    xTaskCreate(ota_task, "OTA TASK", OTA_TASK_STACK_SIZE, NULL,
+                OTA_TASK_PRIORITY, &ota_task_handle);
+    xTaskCreate(led_task, "LED TASK", LED_TASK_STACK_SIZE, NULL,
+                LED_TASK_PRIORITY, &led_task_handle);
+    xTaskCreate(ota_log_task, "LOG TASK", LOG_TASK_STACK_SIZE, NULL,
+                LOG_TASK_PRIORITY, &log_task_handle);
+    xTaskCreate(ota_telemetry_task, "TELEMETRY TASK", TELEMETRY_TASK_STACK_SIZE, NULL,
+                TELEMETRY_TASK_PRIORITY, &telemetry_task_handle);
+#endif
+
+    /* Start the FreeRTOS scheduler. */
+    vTaskStartScheduler();
+
+    /* Should never get here. */
+    CY_ASSERT(0);
+}
+
+/* [] END OF FILE */
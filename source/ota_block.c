@@ -0,0 +1,112 @@
+/******************************************************************************
+* File Name: ota_block.c
+*
+* Description: This file contains the block writer shared by the storage write
+* stages that produce the image themselves, the decompression and the delta
+* updates: the image is written to the next stage in fixed size blocks,
+* numbered as the publisher numbers plain chunks.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+
+/*******************************************************************************
+ * Header file includes
+ ******************************************************************************/
+#include <string.h>
+#include "ota_block.h"
+#include "ota_kv_store.h"
+
+/*******************************************************************************
+ * Function Name: ota_block_init
+ *******************************************************************************
+ * Summary:
+ *  Sets the block buffer and the storage write the blocks are passed on to.
+ *
+ *******************************************************************************/
+void ota_block_init(ota_block_t *block, uint8_t *buffer, uint32_t size, ota_block_write_t write)
+{
+    block->write = write;
+    block->buffer = buffer;
+    block->size = size;
+    ota_block_start(block, 0);
+}
+
+/*******************************************************************************
+ * Function Name: ota_block_start
+ *******************************************************************************
+ * Summary:
+ *  Starts a new image of image_size bytes.
+ *
+ *******************************************************************************/
+void ota_block_start(ota_block_t *block, uint32_t image_size)
+{
+    block->len = 0;
+    block->out_bytes = 0;
+    block->image_size = image_size;
+    block->crc = 0;
+}
+
+/*******************************************************************************
+ * Function Name: ota_block_flush
+ *******************************************************************************
+ * Summary:
+ *  Writes the block to the storage through the next write callback,
+ *  numbered as the publisher numbers plain chunks.
+ *
+ *******************************************************************************/
+cy_rslt_t ota_block_flush(ota_block_t *block, cy_ota_storage_context_t *storage_ptr)
+{
+    cy_ota_storage_write_info_t block_info;
+    cy_rslt_t result;
+
+    if (block->len == 0u)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    memset(&block_info, 0, sizeof(block_info));
+    block_info.offset = block->out_bytes - block->len;
+    block_info.buffer = block->buffer;
+    block_info.size = block->len;
+    block_info.total_size = block->image_size;
+    block_info.packet_number = block_info.offset / block->size;
+    block_info.total_packets = (block->image_size + block->size - 1u) / block->size;
+
+    block->crc = ota_kv_crc32(block->crc, block->buffer, block->len);
+    result = block->write(storage_ptr, &block_info);
+    block->len = 0;
+    return result;
+}
+
+/* [] END OF FILE */
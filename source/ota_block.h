@@ -0,0 +1,93 @@
+/******************************************************************************
+* File Name: ota_block.h
+*
+* Description: This file contains the declarations of the block writer shared by
+* the storage write stages that produce the image themselves.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef SOURCE_OTA_BLOCK_H_
+#define SOURCE_OTA_BLOCK_H_
+
+#include <stdint.h>
+#include "cy_result.h"
+#include "cy_ota_api.h"
+#include "cy_ota_storage_api.h"
+
+/*******************************************************************************
+* Data structure and enumeration
+********************************************************************************/
+typedef cy_rslt_t (*ota_block_write_t)(cy_ota_storage_context_t *storage_ptr,
+        cy_ota_storage_write_info_t *chunk_info);
+
+typedef struct
+{
+    ota_block_write_t   write;          /* Next storage write */
+    uint8_t             *buffer;        /* Block being filled, aligned so that its rows are programmed in place */
+    uint32_t            size;           /* Size of the blocks */
+    uint32_t            len;            /* Bytes in the block */
+    uint32_t            out_bytes;      /* Image bytes produced */
+    uint32_t            image_size;
+    uint32_t            crc;            /* CRC-32 of the bytes written */
+} ota_block_t;
+
+/*******************************************************************************
+* Function prototype
+********************************************************************************/
+void ota_block_init(ota_block_t *block, uint8_t *buffer, uint32_t size, ota_block_write_t write);
+void ota_block_start(ota_block_t *block, uint32_t image_size);
+cy_rslt_t ota_block_flush(ota_block_t *block, cy_ota_storage_context_t *storage_ptr);
+
+/*******************************************************************************
+ * Function Name: ota_block_put
+ *******************************************************************************
+ * Summary:
+ *  Appends one image byte to the block, written once full or at the end of
+ *  the image. Inline, it is called for every byte of the image.
+ *
+ *******************************************************************************/
+static inline cy_rslt_t ota_block_put(ota_block_t *block, cy_ota_storage_context_t *storage_ptr,
+        uint8_t value)
+{
+    block->buffer[block->len++] = value;
+    block->out_bytes++;
+
+    if ((block->len == block->size) || (block->out_bytes == block->image_size))
+    {
+        return ota_block_flush(block, storage_ptr);
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+#endif /* SOURCE_OTA_BLOCK_H_ */
@@ -0,0 +1,253 @@
+/******************************************************************************
+* File Name: ota_chunk_size.c
+*
+* Description: This file contains the chunk size negotiation with the
+* publisher. The device advertises a preferred and a maximum chunk size in its
+* update requests, computed from the free heap and the measured flash write
+* rate, and publisher.py chunks the image accordingly.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+
+/*******************************************************************************
+ * Header file includes
+ ******************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include "cy_pdl.h"
+#include "cy_ota_flash_ext.h"
+#include "ota_chunk_size.h"
+#include "ota_json.h"
+#include "ota_telemetry.h"
+#include "ota_log_token.h"
+
+/* ARM compiler also defines __GNUC__ */
+#if defined (__GNUC__) && !defined(__ARMCC_VERSION)
+#include <malloc.h>
+#endif /* #if defined (__GNUC__) && !defined(__ARMCC_VERSION) */
+
+/* FreeRTOS header file */
+#include <FreeRTOS.h>
+#include <task.h>
+
+/*******************************************************************************
+ * Macros
+ ******************************************************************************/
+#if ((OTA_CHUNK_SIZE_MIN & (OTA_CHUNK_SIZE_MIN - 1u)) != 0u) || \
+    ((OTA_CHUNK_SIZE_MAX & (OTA_CHUNK_SIZE_MAX - 1u)) != 0u)
+#error "OTA_CHUNK_SIZE_MIN and OTA_CHUNK_SIZE_MAX must be powers of 2"
+#endif
+
+/* Members added to the update requests */
+#define OTA_CHUNK_SIZE_MEMBERS              ",\"ChunkSize\": \"%u\", \"MaxChunkSize\": \"%u\", \"DataAlignment\": \"%u\", \"DataQos\": \"%u\""
+
+/*******************************************************************************
+ * Global Variables
+ ******************************************************************************/
+static ota_chunk_size_t chunk_sizes =
+{
+    .preferred = OTA_CHUNK_SIZE_DEFAULT,
+    .max = OTA_CHUNK_SIZE_DEFAULT,
+};
+
+/*******************************************************************************
+ * Function Name: chunk_size_floor
+ *******************************************************************************
+ * Summary:
+ *  Rounds a size down to a power of 2 within OTA_CHUNK_SIZE_MIN and limit.
+ *
+ *******************************************************************************/
+static uint32_t chunk_size_floor(uint32_t size, uint32_t limit)
+{
+    uint32_t chunk = OTA_CHUNK_SIZE_MIN;
+
+    while (((chunk * 2u) <= size) && ((chunk * 2u) <= limit))
+    {
+        chunk *= 2u;
+    }
+    return chunk;
+}
+
+/*******************************************************************************
+ * Function Name: chunk_size_free_heap
+ *******************************************************************************
+ * Summary:
+ *  Returns the heap that can still be allocated, 0 if it cannot be told with
+ *  this toolchain.
+ *
+ *******************************************************************************/
+static uint32_t chunk_size_free_heap(void)
+{
+    /* ARM compiler also defines __GNUC__ */
+#if defined (__GNUC__) && !defined(__ARMCC_VERSION)
+    struct mallinfo mall_info = mallinfo();
+
+    extern uint8_t __HeapBase;  /* Symbol exported by the linker. */
+    extern uint8_t __HeapLimit; /* Symbol exported by the linker. */
+
+    uint32_t heap_size = (uint32_t)(&__HeapLimit - &__HeapBase);
+
+    /* Never claimed from the system plus freed inside the arena */
+    return (heap_size - (uint32_t)mall_info.arena) + (uint32_t)mall_info.fordblks;
+#else
+    return 0u;
+#endif /* #if defined (__GNUC__) && !defined(__ARMCC_VERSION) */
+}
+
+/*******************************************************************************
+ * Function Name: chunk_size_write_rate
+ *******************************************************************************
+ * Summary:
+ *  Returns the flash write rate in bytes per ms, 0 if nothing was written yet.
+ *  The storage writes of the last download are used when there was one, they
+ *  include the erases; otherwise the programs done since boot, e.g. by the KV
+ *  store, serve as a benchmark.
+ *
+ *******************************************************************************/
+static uint32_t chunk_size_write_rate(void)
+{
+    ota_telemetry_stats_t telemetry_stats;
+    cy_ota_mem_program_stats_t program_stats;
+
+    ota_telemetry_get_stats(&telemetry_stats);
+    if ((telemetry_stats.chunks != 0u) && (telemetry_stats.total_write_us != 0u))
+    {
+        return (uint32_t)(((uint64_t)telemetry_stats.bytes * 1000u) / telemetry_stats.total_write_us);
+    }
+
+    cy_ota_mem_get_program_stats(&program_stats);
+    if ((program_stats.bytes != 0u) && (program_stats.cycles != 0u))
+    {
+        return (uint32_t)(((uint64_t)program_stats.bytes * (SystemCoreClock / 1000u)) / program_stats.cycles);
+    }
+    return 0u;
+}
+
+/*******************************************************************************
+ * Function Name: ota_chunk_size_update
+ *******************************************************************************
+ * Summary:
+ *  Computes the chunk sizes to advertise. The maximum leaves
+ *  OTA_CHUNK_HEAP_RESERVE of the free heap and room for two chunks, the one
+ *  being written and the next one being received. The preferred size is what
+ *  the flash writes in OTA_CHUNK_WRITE_BUDGET_MS. Called before each update
+ *  request, so the sizes follow the heap and the last download.
+ *
+ *******************************************************************************/
+void ota_chunk_size_update(void)
+{
+    ota_chunk_size_t sizes;
+
+    sizes.free_heap = chunk_size_free_heap();
+    sizes.write_bytes_per_ms = chunk_size_write_rate();
+
+    if (sizes.free_heap == 0u)
+    {
+        sizes.max = chunk_size_floor(OTA_CHUNK_SIZE_DEFAULT, OTA_CHUNK_SIZE_MAX);
+    }
+    else if (sizes.free_heap > OTA_CHUNK_HEAP_RESERVE)
+    {
+        sizes.max = chunk_size_floor((sizes.free_heap - OTA_CHUNK_HEAP_RESERVE) / 2u, OTA_CHUNK_SIZE_MAX);
+    }
+    else
+    {
+        sizes.max = OTA_CHUNK_SIZE_MIN;
+    }
+
+    if (sizes.write_bytes_per_ms == 0u)
+    {
+        sizes.preferred = chunk_size_floor(OTA_CHUNK_SIZE_DEFAULT, sizes.max);
+    }
+    else
+    {
+        sizes.preferred = chunk_size_floor(sizes.write_bytes_per_ms * OTA_CHUNK_WRITE_BUDGET_MS, sizes.max);
+    }
+
+    if ((sizes.preferred != chunk_sizes.preferred) || (sizes.max != chunk_sizes.max))
+    {
+        OTA_PRINTF("Chunk size: preferred:%u max:%u (free heap:%u flash:%u B/ms)\n",
+                (unsigned int)sizes.preferred, (unsigned int)sizes.max,
+                (unsigned int)sizes.free_heap, (unsigned int)sizes.write_bytes_per_ms);
+    }
+
+    taskENTER_CRITICAL();
+    chunk_sizes = sizes;
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+ * Function Name: ota_chunk_size_get
+ *******************************************************************************/
+void ota_chunk_size_get(ota_chunk_size_t *sizes)
+{
+    taskENTER_CRITICAL();
+    *sizes = chunk_sizes;
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+ * Function Name: ota_chunk_size_preferred
+ *******************************************************************************/
+uint32_t ota_chunk_size_preferred(void)
+{
+    return chunk_sizes.preferred;
+}
+
+/*******************************************************************************
+ * Function Name: ota_chunk_size_append
+ *******************************************************************************
+ * Summary:
+ *  Adds the "ChunkSize", "MaxChunkSize", "DataAlignment" and "DataQos"
+ *  members to an update request. The document is left unchanged when it is not a JSON
+ *  object or the members do not fit.
+ *
+ * Parameters:
+ *  json_doc : NUL terminated JSON object
+ *  size     : Size of the json_doc buffer
+ *
+ * Return:
+ *  bool : true if the members were added
+ *
+ *******************************************************************************/
+bool ota_chunk_size_append(char *json_doc, size_t size)
+{
+    ota_chunk_size_t sizes;
+
+    ota_chunk_size_get(&sizes);
+    return ota_json_append(json_doc, size, OTA_CHUNK_SIZE_MEMBERS,
+            (unsigned int)sizes.preferred, (unsigned int)sizes.max, (unsigned int)OTA_CHUNK_DATA_ALIGNMENT,
+            (unsigned int)OTA_CHUNK_DATA_QOS);
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,124 @@
+/******************************************************************************
+* File Name: ota_chunk_size.h
+*
+* Description: This file contains the declarations of the chunk size
+* negotiation with the publisher.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef SOURCE_OTA_CHUNK_SIZE_H_
+#define SOURCE_OTA_CHUNK_SIZE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "cy_ota_api.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Bounds of the advertised chunk sizes. The MQTT receive buffer of the OTA
+ * agent holds CY_OTA_CHUNK_SIZE bytes of chunk data (cy_ota_config.h) plus the
+ * MQTT header, the topic and the 32-byte chunk header, so OTA_CHUNK_SIZE_MAX
+ * must not exceed it.
+ */
+#ifndef OTA_CHUNK_SIZE_MIN
+#define OTA_CHUNK_SIZE_MIN                  (1024u)
+#endif
+#ifndef OTA_CHUNK_SIZE_MAX
+#define OTA_CHUNK_SIZE_MAX                  (CY_OTA_CHUNK_SIZE)
+#endif
+
+#if (OTA_CHUNK_SIZE_MAX > CY_OTA_CHUNK_SIZE)
+#error "OTA_CHUNK_SIZE_MAX must fit in the MQTT receive buffer of the OTA agent, set LARGE_CHUNKS=1 or raise CY_OTA_CHUNK_SIZE"
+#endif
+#if (OTA_CHUNK_SIZE_MIN > OTA_CHUNK_SIZE_MAX)
+#error "OTA_CHUNK_SIZE_MIN must not exceed OTA_CHUNK_SIZE_MAX"
+#endif
+
+/* Preferred chunk size until the flash write rate is known */
+#ifndef OTA_CHUNK_SIZE_DEFAULT
+#define OTA_CHUNK_SIZE_DEFAULT              (4096u)
+#endif
+
+/* Alignment of the chunk data in the MQTT receive buffer, advertised to the
+ * publisher. The agent hands the storage write callback a pointer into that
+ * buffer, so that aligned data is programmed in place, without a copy.
+ */
+#ifndef OTA_CHUNK_DATA_ALIGNMENT
+#define OTA_CHUNK_DATA_ALIGNMENT            (4u)
+#endif
+
+/* QoS of the subscription of the agent to the unique topic of the chunks,
+ * advertised with the alignment. The packets delivered at QoS 0 carry no
+ * packet identifier, which moves the chunk data by two bytes.
+ */
+#ifndef OTA_CHUNK_DATA_QOS
+#define OTA_CHUNK_DATA_QOS                  (1u)
+#endif
+
+/* Storage write time of one chunk of the preferred size. Longer writes hold
+ * the MQTT receive path of the agent for longer.
+ */
+#ifndef OTA_CHUNK_WRITE_BUDGET_MS
+#define OTA_CHUNK_WRITE_BUDGET_MS           (50u)
+#endif
+
+/* Free heap left to the rest of the application when the maximum chunk size
+ * is taken from the free heap.
+ */
+#ifndef OTA_CHUNK_HEAP_RESERVE
+#define OTA_CHUNK_HEAP_RESERVE              (32u * 1024u)
+#endif
+
+/*******************************************************************************
+* Data structure and enumeration
+********************************************************************************/
+typedef struct
+{
+    uint32_t    preferred;          /* "ChunkSize" advertised to the publisher */
+    uint32_t    max;                /* "MaxChunkSize" advertised to the publisher */
+    uint32_t    free_heap;          /* 0 when not known */
+    uint32_t    write_bytes_per_ms; /* Measured flash write rate, 0 when not known */
+} ota_chunk_size_t;
+
+/*******************************************************************************
+* Function prototype
+********************************************************************************/
+void ota_chunk_size_update(void);
+void ota_chunk_size_get(ota_chunk_size_t *sizes);
+uint32_t ota_chunk_size_preferred(void);
+bool ota_chunk_size_append(char *json_doc, size_t size);
+
+#endif /* SOURCE_OTA_CHUNK_SIZE_H_ */
@@ -0,0 +1,79 @@
+/******************************************************************************
+* File Name: ota_cycles.h
+*
+* Description: This file contains the cycle counter helpers shared by the
+* flash, key-value store, resume, and telemetry statistics.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef SOURCE_OTA_CYCLES_H_
+#define SOURCE_OTA_CYCLES_H_
+
+#include <stdint.h>
+#include "cy_pdl.h"
+
+/*******************************************************************************
+* Function Name: ota_cycles_enable
+********************************************************************************
+* Summary:
+*  Starts the DWT cycle counter. The counter is shared by every module that
+*  measures with it, so it is only enabled here and never reset: each user
+*  keeps its own start value and takes the unsigned difference.
+*
+*******************************************************************************/
+static inline void ota_cycles_enable(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/*******************************************************************************
+* Function Name: ota_cycles_to_us
+********************************************************************************
+* Summary:
+*  Converts a number of CPU cycles to microseconds.
+*
+* Parameters:
+*  cycles: CPU cycles, at SystemCoreClock
+*
+* Return:
+*  uint32_t: Microseconds
+*
+*******************************************************************************/
+static inline uint32_t ota_cycles_to_us(uint64_t cycles)
+{
+    return (uint32_t)(cycles / (SystemCoreClock / 1000000u));
+}
+
+#endif /* SOURCE_OTA_CYCLES_H_ */
@@ -0,0 +1,416 @@
+/******************************************************************************
+* File Name: ota_decompress.c
+*
+* Description: This file contains the streaming decompression of compressed
+* OTA images. It sits in front of the storage write callback: the chunks of a
+* compressed image are decompressed through a small window and the
+* decompressed image is written to the storage in fixed size blocks, so that
+* the rest of the storage chain and the verification see the plain image.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+
+/*******************************************************************************
+ * Header file includes
+ ******************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include "cy_utils.h"
+#include "ota_decompress.h"
+#include "ota_block.h"
+#include "ota_json.h"
+#include "ota_log_token.h"
+
+/* FreeRTOS header file */
+#include <FreeRTOS.h>
+#include <task.h>
+
+/*******************************************************************************
+ * Macros
+ ******************************************************************************/
+#define OTA_DECOMPRESS_WINDOW_SIZE          (1u << OTA_DECOMPRESS_WINDOW_BITS_MAX)
+
+/* Member added to the update requests, the publisher only compresses the
+ * image of a device that sent it.
+ */
+#define OTA_DECOMPRESS_MEMBER               ",\"Compression\": \"LZSS\", \"CompressionWindowBits\": \"%u\""
+
+/*******************************************************************************
+ * Data structure and enumeration
+ ******************************************************************************/
+typedef enum
+{
+    DECOMPRESS_MODE_UNKNOWN,        /* No chunk received yet */
+    DECOMPRESS_MODE_PLAIN,          /* Chunks passed on unchanged */
+    DECOMPRESS_MODE_LZSS,
+} decompress_mode_t;
+
+/* Next field of the LZSS bit stream */
+typedef enum
+{
+    DECOMPRESS_FIELD_TAG,           /* 1: literal follows, 0: back reference follows */
+    DECOMPRESS_FIELD_LITERAL,
+    DECOMPRESS_FIELD_DISTANCE,
+    DECOMPRESS_FIELD_LENGTH,
+} decompress_field_t;
+
+/*******************************************************************************
+ * Global Variables
+ ******************************************************************************/
+static decompress_mode_t        decompress_mode;
+static decompress_field_t       decompress_field;
+
+static uint32_t                 decompress_window_bits;
+static uint32_t                 decompress_lookahead_bits;
+static uint32_t                 decompress_image_crc;
+static uint32_t                 decompress_consumed;    /* Compressed bytes already decoded */
+static uint32_t                 decompress_bits;
+static uint32_t                 decompress_bit_count;
+static uint32_t                 decompress_distance;
+
+static ota_decompress_stats_t   decompress_stats;
+
+static uint8_t                  decompress_window[OTA_DECOMPRESS_WINDOW_SIZE];
+/* Aligned so that its rows are programmed in place */
+CY_ALIGN(4) static uint8_t      decompress_block[OTA_DECOMPRESS_BLOCK_SIZE];
+static ota_block_t              decompress_out;
+
+/*******************************************************************************
+ * Function Name: decompress_get_le32
+ *******************************************************************************/
+static uint32_t decompress_get_le32(const uint8_t *data)
+{
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+           ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+/*******************************************************************************
+ * Function Name: decompress_start
+ *******************************************************************************
+ * Summary:
+ *  Sets the mode of the download from its first chunk: a compressed image
+ *  starts with the OTA_DECOMPRESS_MAGIC header.
+ *
+ *******************************************************************************/
+static cy_rslt_t decompress_start(const cy_ota_storage_write_info_t *chunk_info)
+{
+    const uint8_t *header = chunk_info->buffer;
+
+    if ((chunk_info->offset != 0u) || (chunk_info->size < OTA_DECOMPRESS_HEADER_SIZE) ||
+        (memcmp(header, OTA_DECOMPRESS_MAGIC, 4u) != 0))
+    {
+        decompress_mode = DECOMPRESS_MODE_PLAIN;
+        return CY_RSLT_SUCCESS;
+    }
+
+    if ((header[4] != OTA_DECOMPRESS_ALGORITHM_LZSS) ||
+        (header[5] < 4u) || (header[5] > OTA_DECOMPRESS_WINDOW_BITS_MAX) ||
+        (header[6] < 2u) || (header[6] > 8u) ||
+        (decompress_get_le32(&header[8]) == 0u))
+    {
+        OTA_PRINTF("Decompress: unsupported image, algorithm:%u window bits:%u length bits:%u\n",
+                (unsigned int)header[4], (unsigned int)header[5], (unsigned int)header[6]);
+        return OTA_DECOMPRESS_RSLT_BAD_HEADER;
+    }
+
+    decompress_window_bits = header[5];
+    decompress_lookahead_bits = header[6];
+    ota_block_start(&decompress_out, decompress_get_le32(&header[8]));
+    decompress_image_crc = decompress_get_le32(&header[12]);
+    decompress_stats.compressed = true;
+    decompress_consumed = OTA_DECOMPRESS_HEADER_SIZE;
+    decompress_mode = DECOMPRESS_MODE_LZSS;
+
+    OTA_PRINTF("Decompress: %u bytes image compressed to %u bytes\n",
+            (unsigned int)decompress_out.image_size, (unsigned int)chunk_info->total_size);
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: decompress_emit
+ *******************************************************************************
+ * Summary:
+ *  Appends one decompressed byte to the window and to the output block.
+ *
+ *******************************************************************************/
+static cy_rslt_t decompress_emit(cy_ota_storage_context_t *storage_ptr, uint8_t value)
+{
+    decompress_window[decompress_out.out_bytes & (OTA_DECOMPRESS_WINDOW_SIZE - 1u)] = value;
+    return ota_block_put(&decompress_out, storage_ptr, value);
+}
+
+/*******************************************************************************
+ * Function Name: decompress_take_bits
+ *******************************************************************************
+ * Summary:
+ *  Takes the next count bits of the stream, most significant bit first.
+ *
+ *******************************************************************************/
+static uint32_t decompress_take_bits(uint32_t count)
+{
+    uint32_t value;
+
+    decompress_bit_count -= count;
+    value = (decompress_bits >> decompress_bit_count) & ((1u << count) - 1u);
+    decompress_bits &= (1u << decompress_bit_count) - 1u;
+    return value;
+}
+
+/*******************************************************************************
+ * Function Name: decompress_byte
+ *******************************************************************************
+ * Summary:
+ *  Decodes one byte of the LZSS stream: a literal is a 1 bit and 8 bits of
+ *  data, a back reference a 0 bit, the distance - 1 in window_bits and the
+ *  length - 1 in lookahead_bits, as in heatshrink. The padding bits after the
+ *  last field are ignored.
+ *
+ *******************************************************************************/
+static cy_rslt_t decompress_byte(cy_ota_storage_context_t *storage_ptr, uint8_t value)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint32_t length;
+    bool more = true;
+
+    decompress_bits = (decompress_bits << 8) | value;
+    decompress_bit_count += 8u;
+
+    while (more && (result == CY_RSLT_SUCCESS) &&
+           (decompress_out.out_bytes < decompress_out.image_size))
+    {
+        switch (decompress_field)
+        {
+            case DECOMPRESS_FIELD_TAG:
+                more = (decompress_bit_count >= 1u);
+                if (more)
+                {
+                    decompress_field = (decompress_take_bits(1u) != 0u) ?
+                            DECOMPRESS_FIELD_LITERAL : DECOMPRESS_FIELD_DISTANCE;
+                }
+                break;
+
+            case DECOMPRESS_FIELD_LITERAL:
+                more = (decompress_bit_count >= 8u);
+                if (more)
+                {
+                    result = decompress_emit(storage_ptr, (uint8_t)decompress_take_bits(8u));
+                    decompress_field = DECOMPRESS_FIELD_TAG;
+                }
+                break;
+
+            case DECOMPRESS_FIELD_DISTANCE:
+                more = (decompress_bit_count >= decompress_window_bits);
+                if (more)
+                {
+                    decompress_distance = decompress_take_bits(decompress_window_bits) + 1u;
+                    decompress_field = DECOMPRESS_FIELD_LENGTH;
+                }
+                break;
+
+            case DECOMPRESS_FIELD_LENGTH:
+                more = (decompress_bit_count >= decompress_lookahead_bits);
+                if (more)
+                {
+                    length = decompress_take_bits(decompress_lookahead_bits) + 1u;
+                    if ((decompress_distance > decompress_out.out_bytes) ||
+                        (length > (decompress_out.image_size - decompress_out.out_bytes)))
+                    {
+                        return OTA_DECOMPRESS_RSLT_CORRUPT;
+                    }
+                    while ((length-- != 0u) && (result == CY_RSLT_SUCCESS))
+                    {
+                        result = decompress_emit(storage_ptr,
+                                decompress_window[(decompress_out.out_bytes - decompress_distance) &
+                                                  (OTA_DECOMPRESS_WINDOW_SIZE - 1u)]);
+                    }
+                    decompress_field = DECOMPRESS_FIELD_TAG;
+                }
+                break;
+
+            default:
+                return OTA_DECOMPRESS_RSLT_CORRUPT;
+        }
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: ota_decompress_init
+ *******************************************************************************
+ * Summary:
+ *  Sets the storage write the decompressed image is passed on to.
+ *
+ *******************************************************************************/
+void ota_decompress_init(ota_decompress_write_t write)
+{
+    ota_block_init(&decompress_out, decompress_block, OTA_DECOMPRESS_BLOCK_SIZE, write);
+    ota_decompress_reset();
+}
+
+/*******************************************************************************
+ * Function Name: ota_decompress_reset
+ *******************************************************************************
+ * Summary:
+ *  Starts a new download, the first chunk tells whether it is compressed.
+ *
+ *******************************************************************************/
+void ota_decompress_reset(void)
+{
+    taskENTER_CRITICAL();
+    decompress_mode = DECOMPRESS_MODE_UNKNOWN;
+    decompress_field = DECOMPRESS_FIELD_TAG;
+    decompress_consumed = 0;
+    decompress_bits = 0;
+    decompress_bit_count = 0;
+    ota_block_start(&decompress_out, 0);
+    memset(&decompress_stats, 0, sizeof(decompress_stats));
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+ * Function Name: ota_decompress_storage_write
+ *******************************************************************************
+ * Summary:
+ *  Storage write callback of the OTA agent. A download whose first chunk
+ *  starts with the OTA_DECOMPRESS_MAGIC header is decompressed, any other
+ *  download is passed on unchanged. The compressed chunks must arrive in
+ *  order, which the publisher does when it sends the whole image: a chunk
+ *  received again is dropped, a missing chunk fails the download.
+ *
+ *  The agent counts the compressed bytes against the size of the compressed
+ *  image, the storage chain behind sees the offsets and size of the
+ *  decompressed image. Its CRC-32 is checked once the last byte is written,
+ *  before the agent verifies the image in the storage.
+ *
+ *******************************************************************************/
+cy_rslt_t ota_decompress_storage_write(cy_ota_storage_context_t *storage_ptr,
+        cy_ota_storage_write_info_t *chunk_info)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    const uint8_t *data = chunk_info->buffer;
+    uint32_t skip;
+    uint32_t i;
+
+    if (decompress_mode == DECOMPRESS_MODE_UNKNOWN)
+    {
+        result = decompress_start(chunk_info);
+        if (result != CY_RSLT_SUCCESS)
+        {
+            return result;
+        }
+    }
+    if (decompress_mode == DECOMPRESS_MODE_PLAIN)
+    {
+        return decompress_out.write(storage_ptr, chunk_info);
+    }
+
+    if ((chunk_info->offset + chunk_info->size) <= decompress_consumed)
+    {
+        decompress_stats.duplicates++;
+        chunk_info->size = 0;
+        return CY_RSLT_SUCCESS;
+    }
+    if (chunk_info->offset > decompress_consumed)
+    {
+        OTA_PRINTF("Decompress: chunk at %u received before the one at %u\n",
+                (unsigned int)chunk_info->offset, (unsigned int)decompress_consumed);
+        return OTA_DECOMPRESS_RSLT_GAP;
+    }
+
+    skip = decompress_consumed - chunk_info->offset;
+    for (i = skip; (i < chunk_info->size) && (result == CY_RSLT_SUCCESS); i++)
+    {
+        result = decompress_byte(storage_ptr, data[i]);
+    }
+    decompress_consumed = chunk_info->offset + i;
+    decompress_stats.in_bytes = decompress_consumed;
+    if (result != CY_RSLT_SUCCESS)
+    {
+        return result;
+    }
+
+    if (decompress_out.out_bytes == decompress_out.image_size)
+    {
+        if (decompress_out.crc != decompress_image_crc)
+        {
+            OTA_PRINTF("Decompress: CRC 0x%08x of the image, expected 0x%08x\n",
+                    (unsigned int)decompress_out.crc, (unsigned int)decompress_image_crc);
+            return OTA_DECOMPRESS_RSLT_CORRUPT;
+        }
+    }
+    else if (decompress_consumed >= chunk_info->total_size)
+    {
+        OTA_PRINTF("Decompress: image ends after %u of %u bytes\n",
+                (unsigned int)decompress_out.out_bytes, (unsigned int)decompress_out.image_size);
+        return OTA_DECOMPRESS_RSLT_CORRUPT;
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: ota_decompress_append
+ *******************************************************************************
+ * Summary:
+ *  Adds the "Compression" and "CompressionWindowBits" members to an update
+ *  request. The document is left unchanged when it is not a JSON object or
+ *  the members do not fit.
+ *
+ * Parameters:
+ *  json_doc : NUL terminated JSON object
+ *  size     : Size of the json_doc buffer
+ *
+ * Return:
+ *  bool : true if the members were added
+ *
+ *******************************************************************************/
+bool ota_decompress_append(char *json_doc, size_t size)
+{
+    return ota_json_append(json_doc, size, OTA_DECOMPRESS_MEMBER, (unsigned int)OTA_DECOMPRESS_WINDOW_BITS_MAX);
+}
+
+/*******************************************************************************
+ * Function Name: ota_decompress_get_stats
+ *******************************************************************************/
+void ota_decompress_get_stats(ota_decompress_stats_t *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = decompress_stats;
+    stats->out_bytes = decompress_out.out_bytes;
+    stats->image_size = decompress_out.image_size;
+    taskEXIT_CRITICAL();
+}
+
+/* [] END OF FILE */
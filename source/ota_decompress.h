@@ -0,0 +1,105 @@
+/******************************************************************************
+* File Name: ota_decompress.h
+*
+* Description: This file contains the declarations of the streaming
+* decompression of compressed OTA images.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef SOURCE_OTA_DECOMPRESS_H_
+#define SOURCE_OTA_DECOMPRESS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "cy_result.h"
+#include "cy_ota_api.h"
+#include "cy_ota_storage_api.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Header in front of a compressed image, all fields little endian:
+ *  magic[4]        "OTAZ"
+ *  algorithm       OTA_DECOMPRESS_ALGORITHM_LZSS
+ *  window_bits     Back reference distance bits, the window is 2^window_bits
+ *  lookahead_bits  Back reference length bits
+ *  reserved
+ *  image_size      Size of the decompressed image
+ *  image_crc       CRC-32 of the decompressed image
+ */
+#define OTA_DECOMPRESS_HEADER_SIZE          (16u)
+#define OTA_DECOMPRESS_MAGIC                "OTAZ"
+#define OTA_DECOMPRESS_ALGORITHM_LZSS       (1u)
+
+/* Largest window accepted, the window buffer is 2^OTA_DECOMPRESS_WINDOW_BITS_MAX bytes */
+#ifndef OTA_DECOMPRESS_WINDOW_BITS_MAX
+#define OTA_DECOMPRESS_WINDOW_BITS_MAX      (11u)
+#endif
+
+/* The decompressed image is written in blocks of this size */
+#ifndef OTA_DECOMPRESS_BLOCK_SIZE
+#define OTA_DECOMPRESS_BLOCK_SIZE           (4096u)
+#endif
+
+#define OTA_DECOMPRESS_RSLT_BAD_HEADER      (CY_RSLT_CREATE(CY_RSLT_TYPE_ERROR, CY_RSLT_MODULE_MIDDLEWARE_BASE, 0x20u))
+#define OTA_DECOMPRESS_RSLT_GAP             (CY_RSLT_CREATE(CY_RSLT_TYPE_ERROR, CY_RSLT_MODULE_MIDDLEWARE_BASE, 0x21u))
+#define OTA_DECOMPRESS_RSLT_CORRUPT         (CY_RSLT_CREATE(CY_RSLT_TYPE_ERROR, CY_RSLT_MODULE_MIDDLEWARE_BASE, 0x22u))
+
+/*******************************************************************************
+* Data structure and enumeration
+********************************************************************************/
+typedef cy_rslt_t (*ota_decompress_write_t)(cy_ota_storage_context_t *storage_ptr,
+        cy_ota_storage_write_info_t *chunk_info);
+
+typedef struct
+{
+    bool        compressed;         /* The image of the last download was compressed */
+    uint32_t    in_bytes;           /* Compressed bytes received */
+    uint32_t    out_bytes;          /* Decompressed bytes written */
+    uint32_t    image_size;
+    uint32_t    duplicates;         /* Chunks received again and dropped */
+} ota_decompress_stats_t;
+
+/*******************************************************************************
+* Function prototype
+********************************************************************************/
+void ota_decompress_init(ota_decompress_write_t write);
+void ota_decompress_reset(void);
+cy_rslt_t ota_decompress_storage_write(cy_ota_storage_context_t *storage_ptr,
+        cy_ota_storage_write_info_t *chunk_info);
+bool ota_decompress_append(char *json_doc, size_t size);
+void ota_decompress_get_stats(ota_decompress_stats_t *stats);
+
+#endif /* SOURCE_OTA_DECOMPRESS_H_ */
@@ -0,0 +1,612 @@
+/******************************************************************************
+* File Name: ota_delta.c
+*
+* Description: This file contains the delta OTA updates. The device tells the
+* publisher the size and CRC of the image it runs; the publisher may then send
+* a bsdiff style patch against that image instead of the new image. The patch
+* is applied while it is received, reading the running image from the primary
+* slot and writing the new image through the storage chain, so that the new
+* image is verified as usual.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+
+/*******************************************************************************
+ * Header file includes
+ ******************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include "cy_utils.h"
+#include "cy_ota_flash.h"
+#include "flash_map_backend.h"
+#include "sysflash.h"
+#include "ota_delta.h"
+#include "ota_block.h"
+#include "ota_json.h"
+#include "ota_kv_store.h"
+#include "ota_log_token.h"
+
+/* FreeRTOS header file */
+#include <FreeRTOS.h>
+#include <task.h>
+
+/*******************************************************************************
+ * Macros
+ ******************************************************************************/
+/* Bytes of the primary slot read at a time */
+#define OTA_DELTA_BASE_READ_SIZE            (256u)
+
+/* MCUboot image header and TLV area, the running image ends after its TLVs */
+#define OTA_DELTA_IMAGE_MAGIC               (0x96f3b83dUL)
+#define OTA_DELTA_IMAGE_HEADER_SIZE         (32u)
+#define OTA_DELTA_TLV_INFO_MAGIC            (0x6907u)
+
+/* Members added to the update requests, the publisher only sends a patch to a
+ * device that sent them.
+ */
+#define OTA_DELTA_MEMBER                    ",\"DeltaBaseSize\": \"%u\", \"DeltaBaseCrc\": \"%u\""
+
+/*******************************************************************************
+ * Data structure and enumeration
+ ******************************************************************************/
+typedef enum
+{
+    DELTA_MODE_UNKNOWN,             /* No chunk received yet */
+    DELTA_MODE_PLAIN,               /* Chunks passed on unchanged */
+    DELTA_MODE_PATCH,
+} delta_mode_t;
+
+/* Next part of a patch record */
+typedef enum
+{
+    DELTA_FIELD_DIFF_LEN,
+    DELTA_FIELD_EXTRA_LEN,
+    DELTA_FIELD_SEEK,
+    DELTA_FIELD_DIFF,
+    DELTA_FIELD_EXTRA,
+} delta_field_t;
+
+typedef enum
+{
+    DELTA_BASE_UNKNOWN,
+    DELTA_BASE_VALID,
+    DELTA_BASE_INVALID,             /* No image in the primary slot that can be read */
+} delta_base_state_t;
+
+/*******************************************************************************
+ * Global Variables
+ ******************************************************************************/
+static delta_mode_t             delta_mode;
+static delta_field_t            delta_field;
+
+/* Running image in the primary slot */
+static delta_base_state_t       delta_base_state;
+static cy_ota_mem_type_t        delta_base_mem_type;
+static uint32_t                 delta_base_addr;
+static uint32_t                 delta_base_size;
+static uint32_t                 delta_base_crc;
+
+static uint8_t                  delta_base_buf[OTA_DELTA_BASE_READ_SIZE];
+static uint32_t                 delta_base_buf_offset;
+static uint32_t                 delta_base_buf_len;
+
+/* Patch being applied */
+static uint32_t                 delta_image_crc;
+static uint32_t                 delta_consumed;     /* Patch bytes already applied */
+static uint32_t                 delta_base_pos;
+static uint32_t                 delta_value;        /* LEB128 field being read */
+static uint32_t                 delta_shift;
+static uint32_t                 delta_diff_len;
+static uint32_t                 delta_extra_len;
+static int32_t                  delta_seek;
+static bool                     delta_copy;
+
+static ota_delta_stats_t        delta_stats;
+
+/* Aligned so that its rows are programmed in place */
+CY_ALIGN(4) static uint8_t      delta_block[OTA_DELTA_BLOCK_SIZE];
+static ota_block_t              delta_out;
+
+/*******************************************************************************
+ * Function Name: delta_get_le32
+ *******************************************************************************/
+static uint32_t delta_get_le32(const uint8_t *data)
+{
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+           ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+/*******************************************************************************
+ * Function Name: delta_base_read
+ *******************************************************************************/
+static cy_rslt_t delta_base_read(uint32_t offset, void *data, size_t len)
+{
+    delta_stats.base_reads++;
+    return cy_ota_mem_read(delta_base_mem_type, delta_base_addr + offset, data, len);
+}
+
+/*******************************************************************************
+ * Function Name: delta_base_load
+ *******************************************************************************
+ * Summary:
+ *  Finds the running image in the primary slot and computes its CRC-32, over
+ *  the MCUboot header, the image and its TLVs: the bytes of the image file the
+ *  publisher sent. Done once, the primary slot does not change while the
+ *  application runs.
+ *
+ * Return:
+ *  true if the running image can serve as the base of a patch
+ *
+ *******************************************************************************/
+static bool delta_base_load(void)
+{
+    const struct flash_area *fap = NULL;
+    uint8_t header[OTA_DELTA_IMAGE_HEADER_SIZE];
+    uint32_t tlv_offset;
+    uint32_t offset;
+    uint32_t len;
+    uint32_t crc = 0;
+
+    if (delta_base_state != DELTA_BASE_UNKNOWN)
+    {
+        return (delta_base_state == DELTA_BASE_VALID);
+    }
+    delta_base_state = DELTA_BASE_INVALID;
+
+    if (flash_area_open(FLASH_AREA_IMAGE_PRIMARY(0), &fap) != 0)
+    {
+        return false;
+    }
+    delta_base_addr = fap->fa_off;
+    delta_base_mem_type = (fap->fa_device_id == FLASH_DEVICE_INTERNAL_FLASH) ?
+            CY_OTA_MEM_TYPE_INTERNAL_FLASH : CY_OTA_MEM_TYPE_EXTERNAL_FLASH;
+    len = fap->fa_size;
+    flash_area_close(fap);
+
+    /* ih_hdr_size, ih_protect_tlv_size and ih_img_size */
+    if ((delta_base_read(0u, header, sizeof(header)) != CY_RSLT_SUCCESS) ||
+        (delta_get_le32(&header[0]) != OTA_DELTA_IMAGE_MAGIC))
+    {
+        return false;
+    }
+    tlv_offset = (uint32_t)header[8] + ((uint32_t)header[9] << 8) +
+                 delta_get_le32(&header[12]) +
+                 (uint32_t)header[10] + ((uint32_t)header[11] << 8);
+    if (((tlv_offset + 4u) > len) ||
+        (delta_base_read(tlv_offset, header, 4u) != CY_RSLT_SUCCESS) ||
+        (((uint32_t)header[0] | ((uint32_t)header[1] << 8)) != OTA_DELTA_TLV_INFO_MAGIC))
+    {
+        return false;
+    }
+    delta_base_size = tlv_offset + ((uint32_t)header[2] | ((uint32_t)header[3] << 8));
+    if (delta_base_size > len)
+    {
+        return false;
+    }
+
+    for (offset = 0; offset < delta_base_size; offset += len)
+    {
+        len = delta_base_size - offset;
+        if (len > sizeof(delta_base_buf))
+        {
+            len = sizeof(delta_base_buf);
+        }
+        if (delta_base_read(offset, delta_base_buf, len) != CY_RSLT_SUCCESS)
+        {
+            return false;
+        }
+        crc = ota_kv_crc32(crc, delta_base_buf, len);
+    }
+    delta_base_crc = crc;
+    delta_base_buf_len = 0;
+    delta_base_state = DELTA_BASE_VALID;
+
+    OTA_PRINTF("Delta: running image %u bytes, CRC 0x%08x\n",
+            (unsigned int)delta_base_size, (unsigned int)delta_base_crc);
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: delta_base_byte
+ *******************************************************************************
+ * Summary:
+ *  Returns the byte of the running image at the base position, read through
+ *  a small buffer as the records mostly go forward.
+ *
+ *******************************************************************************/
+static cy_rslt_t delta_base_byte(uint8_t *value)
+{
+    uint32_t len;
+
+    if ((delta_base_pos < delta_base_buf_offset) ||
+        (delta_base_pos >= (delta_base_buf_offset + delta_base_buf_len)))
+    {
+        len = delta_base_size - delta_base_pos;
+        if (len > sizeof(delta_base_buf))
+        {
+            len = sizeof(delta_base_buf);
+        }
+        delta_base_buf_len = 0;
+        if (delta_base_read(delta_base_pos, delta_base_buf, len) != CY_RSLT_SUCCESS)
+        {
+            return OTA_DELTA_RSLT_CORRUPT;
+        }
+        delta_base_buf_offset = delta_base_pos;
+        delta_base_buf_len = len;
+    }
+
+    *value = delta_base_buf[delta_base_pos - delta_base_buf_offset];
+    delta_base_pos++;
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: delta_start
+ *******************************************************************************
+ * Summary:
+ *  Sets the mode of the download from its first chunk: a patch starts with
+ *  the OTA_DELTA_MAGIC header and must apply to the running image.
+ *
+ *******************************************************************************/
+static cy_rslt_t delta_start(const cy_ota_storage_write_info_t *chunk_info)
+{
+    const uint8_t *header = chunk_info->buffer;
+
+    if ((chunk_info->offset != 0u) || (chunk_info->size < OTA_DELTA_HEADER_SIZE) ||
+        (memcmp(header, OTA_DELTA_MAGIC, 4u) != 0))
+    {
+        delta_mode = DELTA_MODE_PLAIN;
+        return CY_RSLT_SUCCESS;
+    }
+
+    if ((header[4] != OTA_DELTA_FORMAT) || (delta_get_le32(&header[16]) == 0u))
+    {
+        OTA_PRINTF("Delta: unsupported patch format %u\n", (unsigned int)header[4]);
+        return OTA_DELTA_RSLT_BAD_HEADER;
+    }
+    if (!delta_base_load() ||
+        (delta_get_le32(&header[8]) != delta_base_size) ||
+        (delta_get_le32(&header[12]) != delta_base_crc))
+    {
+        OTA_PRINTF("Delta: the patch is for the image of %u bytes, CRC 0x%08x\n",
+                (unsigned int)delta_get_le32(&header[8]), (unsigned int)delta_get_le32(&header[12]));
+        return OTA_DELTA_RSLT_BASE_MISMATCH;
+    }
+
+    ota_block_start(&delta_out, delta_get_le32(&header[16]));
+    delta_image_crc = delta_get_le32(&header[20]);
+    delta_stats.delta = true;
+    delta_consumed = OTA_DELTA_HEADER_SIZE;
+    delta_mode = DELTA_MODE_PATCH;
+
+    OTA_PRINTF("Delta: %u bytes image patched with %u bytes\n",
+            (unsigned int)delta_out.image_size, (unsigned int)chunk_info->total_size);
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: delta_next_part
+ *******************************************************************************
+ * Summary:
+ *  Moves to the next part of the record with data. Once the record is done,
+ *  its seek moves the base position and the next record starts.
+ *
+ *******************************************************************************/
+static void delta_next_part(void)
+{
+    if (delta_diff_len != 0u)
+    {
+        delta_field = DELTA_FIELD_DIFF;
+    }
+    else if (delta_extra_len != 0u)
+    {
+        delta_field = DELTA_FIELD_EXTRA;
+    }
+    else
+    {
+        delta_base_pos = (uint32_t)((int32_t)delta_base_pos + delta_seek);
+        delta_field = DELTA_FIELD_DIFF_LEN;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: delta_field_done
+ *******************************************************************************
+ * Summary:
+ *  Stores a record field once its last LEB128 byte is read. The seek is
+ *  checked against the running image and the new image size before any byte
+ *  of the record is used, then the bytes copied from the running image are
+ *  written.
+ *
+ *******************************************************************************/
+static cy_rslt_t delta_field_done(cy_ota_storage_context_t *storage_ptr)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    int64_t base_end;
+    uint8_t base;
+
+    switch (delta_field)
+    {
+        case DELTA_FIELD_DIFF_LEN:
+            delta_copy = ((delta_value & 1u) != 0u);
+            delta_diff_len = delta_value >> 1;
+            delta_field = DELTA_FIELD_EXTRA_LEN;
+            break;
+
+        case DELTA_FIELD_EXTRA_LEN:
+            delta_extra_len = delta_value;
+            delta_field = DELTA_FIELD_SEEK;
+            break;
+
+        default:
+            /* Zigzag encoded */
+            delta_seek = (int32_t)(delta_value >> 1) ^ -(int32_t)(delta_value & 1u);
+            base_end = (int64_t)delta_base_pos + delta_diff_len;
+            if ((base_end > (int64_t)delta_base_size) ||
+                ((base_end + delta_seek) < 0) ||
+                ((base_end + delta_seek) > (int64_t)delta_base_size) ||
+                (delta_extra_len > (delta_out.image_size - delta_out.out_bytes)) ||
+                (delta_diff_len > (delta_out.image_size - delta_out.out_bytes - delta_extra_len)))
+            {
+                return OTA_DELTA_RSLT_CORRUPT;
+            }
+
+            /* Copied bytes take no patch bytes */
+            while (delta_copy && (delta_diff_len != 0u) && (result == CY_RSLT_SUCCESS))
+            {
+                result = delta_base_byte(&base);
+                if (result == CY_RSLT_SUCCESS)
+                {
+                    delta_stats.copy_bytes++;
+                    delta_diff_len--;
+                    result = ota_block_put(&delta_out, storage_ptr, base);
+                }
+            }
+            delta_next_part();
+            break;
+    }
+
+    delta_value = 0;
+    delta_shift = 0;
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: delta_byte
+ *******************************************************************************
+ * Summary:
+ *  Applies one byte of the patch.
+ *
+ *******************************************************************************/
+static cy_rslt_t delta_byte(cy_ota_storage_context_t *storage_ptr, uint8_t value)
+{
+    cy_rslt_t result;
+    uint8_t base;
+
+    switch (delta_field)
+    {
+        case DELTA_FIELD_DIFF:
+            result = delta_base_byte(&base);
+            if (result != CY_RSLT_SUCCESS)
+            {
+                return result;
+            }
+            delta_stats.diff_bytes++;
+            delta_diff_len--;
+            result = ota_block_put(&delta_out, storage_ptr, (uint8_t)(base + value));
+            if (delta_diff_len == 0u)
+            {
+                delta_next_part();
+            }
+            return result;
+
+        case DELTA_FIELD_EXTRA:
+            delta_stats.extra_bytes++;
+            delta_extra_len--;
+            result = ota_block_put(&delta_out, storage_ptr, value);
+            if (delta_extra_len == 0u)
+            {
+                delta_next_part();
+            }
+            return result;
+
+        default:
+            if (delta_shift > 28u)
+            {
+                return OTA_DELTA_RSLT_CORRUPT;
+            }
+            delta_value |= (uint32_t)(value & 0x7Fu) << delta_shift;
+            delta_shift += 7u;
+            if ((value & 0x80u) != 0u)
+            {
+                return CY_RSLT_SUCCESS;
+            }
+            return delta_field_done(storage_ptr);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: ota_delta_init
+ *******************************************************************************
+ * Summary:
+ *  Sets the callback the new image is written with.
+ *
+ *******************************************************************************/
+void ota_delta_init(ota_delta_write_t write)
+{
+    ota_block_init(&delta_out, delta_block, OTA_DELTA_BLOCK_SIZE, write);
+    ota_delta_reset();
+}
+
+/*******************************************************************************
+ * Function Name: ota_delta_reset
+ *******************************************************************************
+ * Summary:
+ *  Prepares for a new download. The running image found in the primary slot
+ *  is kept.
+ *
+ *******************************************************************************/
+void ota_delta_reset(void)
+{
+    delta_mode = DELTA_MODE_UNKNOWN;
+    delta_field = DELTA_FIELD_DIFF_LEN;
+    delta_image_crc = 0;
+    delta_consumed = 0;
+    delta_base_pos = 0;
+    delta_value = 0;
+    delta_shift = 0;
+    delta_diff_len = 0;
+    delta_extra_len = 0;
+    delta_seek = 0;
+    delta_copy = false;
+    ota_block_start(&delta_out, 0);
+    delta_base_buf_len = 0;
+    memset(&delta_stats, 0, sizeof(delta_stats));
+}
+
+/*******************************************************************************
+ * Function Name: ota_delta_storage_write
+ *******************************************************************************
+ * Summary:
+ *  OTA storage write callback. A patch is applied in order: a chunk already
+ *  applied is dropped, a chunk past the applied bytes fails the download.
+ *  Other images are passed on unchanged.
+ *
+ * Parameters:
+ *  storage_ptr : Pointer to the OTA Agent storage context
+ *  chunk_info  : Chunk of the download
+ *
+ * Return:
+ *  CY_RSLT_SUCCESS, or an error fails the download
+ *
+ *******************************************************************************/
+cy_rslt_t ota_delta_storage_write(cy_ota_storage_context_t *storage_ptr,
+        cy_ota_storage_write_info_t *chunk_info)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint32_t skip;
+    uint32_t i;
+
+    if (delta_mode == DELTA_MODE_UNKNOWN)
+    {
+        result = delta_start(chunk_info);
+        if (result != CY_RSLT_SUCCESS)
+        {
+            return result;
+        }
+    }
+
+    if (delta_mode == DELTA_MODE_PLAIN)
+    {
+        return delta_out.write(storage_ptr, chunk_info);
+    }
+
+    if ((chunk_info->offset + chunk_info->size) <= delta_consumed)
+    {
+        /* Not counted again by the OTA Agent */
+        delta_stats.duplicates++;
+        chunk_info->size = 0;
+        return CY_RSLT_SUCCESS;
+    }
+    if (chunk_info->offset > delta_consumed)
+    {
+        OTA_PRINTF("Delta: chunk at %u, patch applied up to %u\n",
+                (unsigned int)chunk_info->offset, (unsigned int)delta_consumed);
+        return OTA_DELTA_RSLT_GAP;
+    }
+
+    skip = delta_consumed - chunk_info->offset;
+    for (i = skip; (i < chunk_info->size) && (result == CY_RSLT_SUCCESS); i++)
+    {
+        result = delta_byte(storage_ptr, chunk_info->buffer[i]);
+    }
+    delta_consumed += chunk_info->size - skip;
+    delta_stats.patch_bytes = delta_consumed;
+
+    if ((result == CY_RSLT_SUCCESS) && (delta_consumed >= chunk_info->total_size))
+    {
+        if ((delta_out.out_bytes != delta_out.image_size) || (delta_out.crc != delta_image_crc))
+        {
+            OTA_PRINTF("Delta: patched image %u of %u bytes, CRC 0x%08x expected 0x%08x\n",
+                    (unsigned int)delta_out.out_bytes, (unsigned int)delta_out.image_size,
+                    (unsigned int)delta_out.crc, (unsigned int)delta_image_crc);
+            result = OTA_DELTA_RSLT_CORRUPT;
+        }
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: ota_delta_append
+ *******************************************************************************
+ * Summary:
+ *  Adds the "DeltaBaseSize" and "DeltaBaseCrc" members, the running image a
+ *  patch may apply to, to an update request. The document is left unchanged
+ *  when the primary slot holds no readable image, the document is not a JSON
+ *  object or the members do not fit.
+ *
+ * Parameters:
+ *  json_doc : NUL terminated JSON object
+ *  size     : Size of the json_doc buffer
+ *
+ * Return:
+ *  bool : true if the members were added
+ *
+ *******************************************************************************/
+bool ota_delta_append(char *json_doc, size_t size)
+{
+    if (!delta_base_load())
+    {
+        return false;
+    }
+
+    return ota_json_append(json_doc, size, OTA_DELTA_MEMBER,
+            (unsigned int)delta_base_size, (unsigned int)delta_base_crc);
+}
+
+/*******************************************************************************
+ * Function Name: ota_delta_get_stats
+ *******************************************************************************/
+void ota_delta_get_stats(ota_delta_stats_t *stats)
+{
+    if (stats != NULL)
+    {
+        *stats = delta_stats;
+        stats->out_bytes = delta_out.out_bytes;
+        stats->image_size = delta_out.image_size;
+    }
+}
+
+/* [] END OF FILE */
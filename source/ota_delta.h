@@ -0,0 +1,112 @@
+/******************************************************************************
+* File Name: ota_delta.h
+*
+* Description: This file contains the declarations of the delta OTA updates
+* applied against the image in the primary slot.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef SOURCE_OTA_DELTA_H_
+#define SOURCE_OTA_DELTA_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "cy_result.h"
+#include "cy_ota_api.h"
+#include "cy_ota_storage_api.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Header of a delta patch, all fields little endian:
+ *  magic[4]        "OTAD"
+ *  format          OTA_DELTA_FORMAT
+ *  reserved[3]
+ *  base_size       Bytes of the running image the patch applies to
+ *  base_crc        CRC-32 of those bytes
+ *  image_size      Size of the new image
+ *  image_crc       CRC-32 of the new image
+ *
+ * followed by records, as in bsdiff:
+ *  diff_len        LEB128 of (length << 1) | copy, new bytes made of a base
+ *                  byte plus a patch byte, or base bytes copied when copy is 1
+ *  extra_len       LEB128, new bytes taken from the patch
+ *  seek            LEB128 zigzag, moves the base position after the record
+ *  diff_len bytes unless copied, then extra_len bytes
+ */
+#define OTA_DELTA_HEADER_SIZE               (24u)
+#define OTA_DELTA_MAGIC                     "OTAD"
+#define OTA_DELTA_FORMAT                    (1u)
+
+/* The new image is written in blocks of this size */
+#ifndef OTA_DELTA_BLOCK_SIZE
+#define OTA_DELTA_BLOCK_SIZE                (4096u)
+#endif
+
+#define OTA_DELTA_RSLT_BAD_HEADER           (CY_RSLT_CREATE(CY_RSLT_TYPE_ERROR, CY_RSLT_MODULE_MIDDLEWARE_BASE, 0x30u))
+#define OTA_DELTA_RSLT_BASE_MISMATCH        (CY_RSLT_CREATE(CY_RSLT_TYPE_ERROR, CY_RSLT_MODULE_MIDDLEWARE_BASE, 0x31u))
+#define OTA_DELTA_RSLT_GAP                  (CY_RSLT_CREATE(CY_RSLT_TYPE_ERROR, CY_RSLT_MODULE_MIDDLEWARE_BASE, 0x32u))
+#define OTA_DELTA_RSLT_CORRUPT              (CY_RSLT_CREATE(CY_RSLT_TYPE_ERROR, CY_RSLT_MODULE_MIDDLEWARE_BASE, 0x33u))
+
+/*******************************************************************************
+* Data structure and enumeration
+********************************************************************************/
+typedef cy_rslt_t (*ota_delta_write_t)(cy_ota_storage_context_t *storage_ptr,
+        cy_ota_storage_write_info_t *chunk_info);
+
+typedef struct
+{
+    bool        delta;              /* The last download was a delta patch */
+    uint32_t    patch_bytes;        /* Patch bytes received */
+    uint32_t    out_bytes;          /* New image bytes written */
+    uint32_t    image_size;
+    uint32_t    copy_bytes;         /* New bytes copied from the base image */
+    uint32_t    diff_bytes;         /* New bytes made from a base byte and a patch byte */
+    uint32_t    extra_bytes;        /* New bytes taken from the patch */
+    uint32_t    base_reads;         /* Reads of the primary slot */
+    uint32_t    duplicates;         /* Chunks received again and dropped */
+} ota_delta_stats_t;
+
+/*******************************************************************************
+* Function prototype
+********************************************************************************/
+void ota_delta_init(ota_delta_write_t write);
+void ota_delta_reset(void);
+cy_rslt_t ota_delta_storage_write(cy_ota_storage_context_t *storage_ptr,
+        cy_ota_storage_write_info_t *chunk_info);
+bool ota_delta_append(char *json_doc, size_t size);
+void ota_delta_get_stats(ota_delta_stats_t *stats);
+
+#endif /* SOURCE_OTA_DELTA_H_ */
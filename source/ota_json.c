@@ -0,0 +1,98 @@
+/******************************************************************************
+* File Name: ota_json.c
+*
+* Description: This file contains the JSON helper shared by the modules that
+* add members to the update requests of the OTA agent.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+
+/*******************************************************************************
+ * Header file includes
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "ota_json.h"
+
+/*******************************************************************************
+ * Function Name: ota_json_append
+ *******************************************************************************
+ * Summary:
+ *  Adds members to a JSON object, in place before its closing brace. The
+ *  document is left unchanged when it is not a JSON object or the members do
+ *  not fit.
+ *
+ * Parameters:
+ *  json_doc : NUL terminated JSON object
+ *  size     : Size of the json_doc buffer
+ *  format   : printf format of the members, starting with a comma
+ *
+ * Return:
+ *  bool : true if the members were added
+ *
+ *******************************************************************************/
+bool ota_json_append(char *json_doc, size_t size, const char *format, ...)
+{
+    va_list args;
+    char *end;
+    size_t room;
+    int len;
+
+    end = strrchr(json_doc, '}');
+    if (end == NULL)
+    {
+        return false;
+    }
+
+    /* Formatted over the closing brace, one byte kept for it */
+    room = size - (size_t)(end - json_doc);
+    va_start(args, format);
+    len = vsnprintf(end, room - 1u, format, args);
+    va_end(args);
+
+    /* members, closing brace and NUL */
+    if ((len < 0) || (((size_t)len + 2u) > room))
+    {
+        end[0] = '}';
+        end[1] = '\0';
+        return false;
+    }
+
+    end[len] = '}';
+    end[len + 1] = '\0';
+    return true;
+}
+
+/* [] END OF FILE */
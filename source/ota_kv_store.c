@@ -0,0 +1,992 @@
+/******************************************************************************
+* File Name:   ota_kv_store.c
+*
+* Description: This file contains a compact, append-only key/value log used
+*              to keep the OTA session state (offsets, bitmaps, hash
+*              checkpoints and statistics) outside the code flash.
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2021-2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/*******************************************************************************
+ * Header file includes
+ ******************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include "cy_pdl.h"
+#include "cyhal.h"
+#include "ota_kv_store.h"
+#include "ota_cycles.h"
+#include "ota_log_token.h"
+#if !defined (XMC7100) && !defined (XMC7200)
+#include "cy_ota_flash.h"
+#include "cy_ota_flash_ext.h"
+#include "flash_map_backend.h"
+#include "sysflash.h"
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+#endif
+
+/*******************************************************************************
+ * Macros
+ ******************************************************************************/
+/*
+ * Log layout. The region is split into two halves; records are appended to
+ * the active half and, when it is full, the latest value of every key is
+ * compacted into the other half. A half is valid once its header (magic and
+ * generation) is programmed, which is done after the compaction completes.
+ *
+ *  half:   | magic | generation | record | record | ... | blank
+ *  record: | key << 16 | len | crc32(key, len, data) | data, padded |
+ *
+ * A record with len 0 deletes the key.
+ */
+#define KV_MAGIC                    (0x314B564FUL)  /* "OKV1" */
+#define KV_HALF_HEADER_SIZE         (8u)
+#define KV_RECORD_HEADER_SIZE       (8u)
+#define KV_KEY_INVALID_LOW          (0x0000u)
+#define KV_KEY_INVALID_HIGH         (0xFFFFu)
+
+#define KV_ALIGN(len, unit)         ((((len) + (unit) - 1u) / (unit)) * (unit))
+
+#if defined (XMC7100) || defined (XMC7200)
+/* Work flash region used by the store, clear of the MCUboot scratch and status areas */
+#ifndef OTA_KV_REGION_ADDR
+#define OTA_KV_REGION_ADDR          (0x14020000UL)
+#endif
+#ifndef OTA_KV_REGION_SECTORS
+#define OTA_KV_REGION_SECTORS       (8u)
+#endif
+/* Work flash large sector size */
+#define OTA_KV_SECTOR_SIZE          (0x800u)
+#define OTA_KV_PROGRAM_UNIT         (4u)
+#elif defined (CY_IP_MXSMIF) && !defined (ENABLE_ON_THE_FLY_ENCRYPTION)
+#define OTA_KV_EXTERNAL_FLASH
+/* External flash region used by the store: the last OTA_KV_REGION_SECTORS
+ * sectors of the flash, whose size is read by SFDP, unless OTA_KV_REGION_ADDR
+ * sets its offset in the flash. It must stay clear of the MCUboot secondary
+ * slot and scratch area, see kv_ext_flash_place().
+ */
+#ifndef OTA_KV_REGION_SECTORS
+#define OTA_KV_REGION_SECTORS       (2u)
+#endif
+#define OTA_KV_PROGRAM_UNIT         (4u)
+/* Bytes read at a time by the blank check */
+#define OTA_KV_BLANK_CHECK_SIZE     (32u)
+/* Records and erases queued to the flash worker at a time */
+#ifndef OTA_KV_QUEUE_SLOTS
+#define OTA_KV_QUEUE_SLOTS          (4u)
+#endif
+#endif /* XMC7100/XMC7200 */
+
+/*******************************************************************************
+ * Global Variables
+ ******************************************************************************/
+typedef struct
+{
+    uint16_t    key;
+    uint16_t    len;
+    uint32_t    offset;     /* Offset of the record data in the region */
+} kv_index_entry_t;
+
+static const ota_kv_backend_t   *kv_backend;
+static kv_index_entry_t         kv_index[OTA_KV_MAX_KEYS];
+static uint32_t                 kv_active_half;
+static uint32_t                 kv_generation;
+static uint32_t                 kv_cursor;      /* Offset of the next record */
+static ota_kv_stats_t           kv_stats;
+#ifdef OTA_KV_EXTERNAL_FLASH
+static uint32_t                 kv_region_addr; /* Offset of the region in the external flash */
+#endif
+
+/* Record staging buffer, also used when moving records during compaction */
+static uint32_t                 kv_buffer[(KV_RECORD_HEADER_SIZE + OTA_KV_MAX_VALUE_SIZE + 3u) / 4u];
+
+#ifdef OTA_KV_EXTERNAL_FLASH
+/* Program or erase queued to the flash worker, with its own copy of the record */
+typedef struct
+{
+    cy_ota_mem_op_t     op;
+    volatile bool       busy;
+    uint32_t            data[(KV_RECORD_HEADER_SIZE + OTA_KV_MAX_VALUE_SIZE + 3u) / 4u];
+} kv_queue_slot_t;
+
+static kv_queue_slot_t          kv_queue_slots[OTA_KV_QUEUE_SLOTS];
+static bool                     kv_queued;          /* Programs and erases go through the flash queue */
+static volatile bool            kv_queue_failed;    /* A queued operation failed since the last ota_kv_sync() */
+#endif
+
+/*******************************************************************************
+ * Work flash backend
+ ******************************************************************************/
+#if defined (XMC7100) || defined (XMC7200)
+static cy_rslt_t kv_work_flash_read(uint32_t offset, void *data, size_t len)
+{
+    memcpy(data, (const void *)(OTA_KV_REGION_ADDR + offset), len);
+    return CY_RSLT_SUCCESS;
+}
+
+static cy_rslt_t kv_work_flash_program(uint32_t offset, const void *data, size_t len)
+{
+    cy_stc_flash_programrow_config_t config;
+    cy_en_flashdrv_status_t status = CY_FLASH_DRV_SUCCESS;
+    const uint32_t *src = (const uint32_t *)data;
+    uint32_t i;
+
+    config.blocking = CY_FLASH_PROGRAMROW_BLOCKING;
+    config.skipBC = CY_FLASH_PROGRAMROW_SKIP_BLANK_CHECK;
+    config.dataSize = CY_FLASH_PROGRAMROW_DATA_SIZE_32BIT;
+    config.dataLoc = CY_FLASH_PROGRAMROW_DATA_LOCATION_SRAM;
+    config.intrMask = CY_FLASH_PROGRAMROW_NOT_SET_INTR_MASK;
+
+    for (i = 0u; (i < (len / OTA_KV_PROGRAM_UNIT)) && (status == CY_FLASH_DRV_SUCCESS); i++)
+    {
+        config.destAddr = (uint32_t *)(OTA_KV_REGION_ADDR + offset + (i * OTA_KV_PROGRAM_UNIT));
+        config.dataAddr = (uint32_t *)&src[i];
+        status = Cy_Flash_Program_WorkFlash(&config);
+    }
+
+    return (status == CY_FLASH_DRV_SUCCESS) ? CY_RSLT_SUCCESS : CY_RSLT_TYPE_ERROR;
+}
+
+static cy_rslt_t kv_work_flash_erase(uint32_t offset)
+{
+    return (Cy_Flash_EraseSector(OTA_KV_REGION_ADDR + offset) == CY_FLASH_DRV_SUCCESS) ?
+            CY_RSLT_SUCCESS : CY_RSLT_TYPE_ERROR;
+}
+
+/* Erased work flash is not guaranteed to read as a fixed pattern, use the blank check */
+static bool kv_work_flash_is_blank(uint32_t offset, size_t len)
+{
+    cy_stc_flash_blankcheck_config_t config;
+
+    config.addrToBeChecked = (uint32_t *)(OTA_KV_REGION_ADDR + offset);
+    config.numOfWordsToBeChecked = (uint32_t)(len / 4u);
+
+    return (Cy_Flash_BlankCheck(&config, CY_FLASH_DRIVER_BLOCKING) == CY_FLASH_DRV_SUCCESS);
+}
+
+static const ota_kv_backend_t kv_work_flash_backend =
+{
+    .sector_size    = OTA_KV_SECTOR_SIZE,
+    .sector_count   = OTA_KV_REGION_SECTORS,
+    .program_unit   = OTA_KV_PROGRAM_UNIT,
+    .read           = kv_work_flash_read,
+    .program        = kv_work_flash_program,
+    .erase          = kv_work_flash_erase,
+    .is_blank       = kv_work_flash_is_blank,
+};
+#endif /* XMC7100/XMC7200 */
+
+/*******************************************************************************
+ * External flash backend
+ ******************************************************************************/
+#ifdef OTA_KV_EXTERNAL_FLASH
+/*
+ * Programs and erases are queued to the flash worker of cy_ota_flash_queue.c
+ * and return once queued, so that a checkpoint saved from the storage chain
+ * does not wait for the flash. Records appended one after the other are
+ * merged into one page program. Reads are queued behind them and waited for,
+ * and ota_kv_sync() reports the programs and erases that failed.
+ */
+typedef struct
+{
+    StaticSemaphore_t   done_buffer;
+    SemaphoreHandle_t   done;
+    cy_rslt_t           result;
+} kv_queue_read_t;
+
+static void kv_queue_read_done(cy_ota_mem_op_t *op, cy_rslt_t result)
+{
+    kv_queue_read_t *read = (kv_queue_read_t *)op->cb_arg;
+
+    read->result = result;
+    xSemaphoreGive(read->done);
+}
+
+static void kv_queue_done(cy_ota_mem_op_t *op, cy_rslt_t result)
+{
+    if (result != CY_RSLT_SUCCESS)
+    {
+        kv_queue_failed = true;
+    }
+    ((kv_queue_slot_t *)op->cb_arg)->busy = false;
+}
+
+/* Takes a free slot, waiting for the queue to drain when all are in flight */
+static kv_queue_slot_t *kv_queue_slot_get(void)
+{
+    uint32_t i;
+
+    for (;;)
+    {
+        taskENTER_CRITICAL();
+        for (i = 0u; i < OTA_KV_QUEUE_SLOTS; i++)
+        {
+            if (!kv_queue_slots[i].busy)
+            {
+                kv_queue_slots[i].busy = true;
+                taskEXIT_CRITICAL();
+                memset(&kv_queue_slots[i].op, 0, sizeof(kv_queue_slots[i].op));
+                return &kv_queue_slots[i];
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        if (cy_ota_mem_flush() != CY_RSLT_SUCCESS)
+        {
+            return NULL;
+        }
+    }
+}
+
+static cy_rslt_t kv_queue_submit(kv_queue_slot_t *slot, cy_ota_mem_op_type_t type, uint32_t offset, size_t len)
+{
+    cy_rslt_t result;
+
+    slot->op.type = type;
+    slot->op.mem_type = CY_OTA_MEM_TYPE_EXTERNAL_FLASH;
+    slot->op.addr = kv_region_addr + offset;
+    slot->op.data = (type == CY_OTA_MEM_OP_WRITE) ? slot->data : NULL;
+    slot->op.len = len;
+    slot->op.cb = kv_queue_done;
+    slot->op.cb_arg = slot;
+
+    result = cy_ota_mem_submit(&slot->op);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        slot->busy = false;
+    }
+    return result;
+}
+
+/* A read of the page being merged programs it first, other pages stay pending */
+static cy_rslt_t kv_ext_flash_read(uint32_t offset, void *data, size_t len)
+{
+    cy_ota_mem_op_t op;
+    kv_queue_read_t read;
+    cy_rslt_t result;
+
+    if (!kv_queued)
+    {
+        return cy_ota_mem_read(CY_OTA_MEM_TYPE_EXTERNAL_FLASH, kv_region_addr + offset, data, len);
+    }
+
+    read.done = xSemaphoreCreateBinaryStatic(&read.done_buffer);
+    if (read.done == NULL)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    memset(&op, 0, sizeof(op));
+    op.type = CY_OTA_MEM_OP_READ;
+    op.mem_type = CY_OTA_MEM_TYPE_EXTERNAL_FLASH;
+    op.addr = kv_region_addr + offset;
+    op.data = data;
+    op.len = len;
+    op.cb = kv_queue_read_done;
+    op.cb_arg = &read;
+
+    result = cy_ota_mem_submit(&op);
+    if (result == CY_RSLT_SUCCESS)
+    {
+        (void)xSemaphoreTake(read.done, portMAX_DELAY);
+        result = read.result;
+    }
+
+    vSemaphoreDelete(read.done);
+    return result;
+}
+
+/* Appends land on erased bytes; the row read-modify-write of cy_ota_mem_write()
+ * programs the bytes already in the row with their own value, which NOR flash
+ * leaves unchanged.
+ */
+static cy_rslt_t kv_ext_flash_program(uint32_t offset, const void *data, size_t len)
+{
+    kv_queue_slot_t *slot;
+
+    if (!kv_queued)
+    {
+        return cy_ota_mem_write(CY_OTA_MEM_TYPE_EXTERNAL_FLASH, kv_region_addr + offset, (void *)data, len);
+    }
+
+    slot = kv_queue_slot_get();
+    if (slot == NULL)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+    memcpy(slot->data, data, len);
+    return kv_queue_submit(slot, CY_OTA_MEM_OP_WRITE, offset, len);
+}
+
+static cy_rslt_t kv_ext_flash_erase(uint32_t offset)
+{
+    size_t erase_size = cy_ota_mem_get_erase_size(CY_OTA_MEM_TYPE_EXTERNAL_FLASH, kv_region_addr + offset);
+    kv_queue_slot_t *slot;
+
+    if (!kv_queued)
+    {
+        return cy_ota_mem_erase(CY_OTA_MEM_TYPE_EXTERNAL_FLASH, kv_region_addr + offset, erase_size);
+    }
+
+    slot = kv_queue_slot_get();
+    if (slot == NULL)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+    return kv_queue_submit(slot, CY_OTA_MEM_OP_ERASE, offset, erase_size);
+}
+
+/* Erased external flash reads as 0xFF */
+static bool kv_ext_flash_is_blank(uint32_t offset, size_t len)
+{
+    uint8_t buffer[OTA_KV_BLANK_CHECK_SIZE];
+    size_t chunk;
+    size_t i;
+
+    while (len > 0u)
+    {
+        chunk = (len > sizeof(buffer)) ? sizeof(buffer) : len;
+        if (kv_ext_flash_read(offset, buffer, chunk) != CY_RSLT_SUCCESS)
+        {
+            return false;
+        }
+        for (i = 0u; i < chunk; i++)
+        {
+            if (buffer[i] != 0xFFu)
+            {
+                return false;
+            }
+        }
+        offset += chunk;
+        len -= chunk;
+    }
+    return true;
+}
+
+/* The sector size is read from the flash in ota_kv_init() */
+static ota_kv_backend_t kv_ext_flash_backend =
+{
+    .sector_count   = OTA_KV_REGION_SECTORS,
+    .program_unit   = OTA_KV_PROGRAM_UNIT,
+    .read           = kv_ext_flash_read,
+    .program        = kv_ext_flash_program,
+    .erase          = kv_ext_flash_erase,
+    .is_blank       = kv_ext_flash_is_blank,
+};
+
+/* Checks that the region is clear of an MCUboot area of the external flash */
+static bool kv_ext_flash_clear_of(uint8_t area_id, uint32_t region_end)
+{
+    const struct flash_area *fap = NULL;
+    uint32_t area_start;
+    bool clear = true;
+
+    if (flash_area_open(area_id, &fap) != 0)
+    {
+        return true;
+    }
+    if (fap->fa_device_id != FLASH_DEVICE_INTERNAL_FLASH)
+    {
+        area_start = (fap->fa_off >= CY_XIP_BASE) ? (fap->fa_off - CY_XIP_BASE) : fap->fa_off;
+        clear = (region_end <= area_start) || (kv_region_addr >= (area_start + fap->fa_size));
+    }
+    flash_area_close(fap);
+    return clear;
+}
+
+/*******************************************************************************
+* Function Name: kv_ext_flash_place
+********************************************************************************
+* Summary:
+* Places the region in the external flash and reads its sector size. The size
+* of the flash is only known once cy_ota_mem_init() has read SFDP, the region
+* must fit in it, in sectors of one size, clear of the MCUboot areas.
+*
+*******************************************************************************/
+static bool kv_ext_flash_place(void)
+{
+    uint32_t mem_size = (uint32_t)cy_ota_mem_get_size(CY_OTA_MEM_TYPE_EXTERNAL_FLASH);
+    uint32_t sector_size;
+    uint32_t region_end;
+
+    if (mem_size == 0u)
+    {
+        return false;
+    }
+#ifdef OTA_KV_REGION_ADDR
+    kv_region_addr = OTA_KV_REGION_ADDR;
+#else
+    sector_size = (uint32_t)cy_ota_mem_get_erase_size(CY_OTA_MEM_TYPE_EXTERNAL_FLASH, mem_size - 1u);
+    if ((sector_size == 0u) || ((OTA_KV_REGION_SECTORS * sector_size) > mem_size))
+    {
+        return false;
+    }
+    kv_region_addr = mem_size - (OTA_KV_REGION_SECTORS * sector_size);
+#endif
+
+    sector_size = (uint32_t)cy_ota_mem_get_erase_size(CY_OTA_MEM_TYPE_EXTERNAL_FLASH, kv_region_addr);
+    if ((sector_size == 0u) || (kv_region_addr >= mem_size) ||
+        ((mem_size - kv_region_addr) < (OTA_KV_REGION_SECTORS * sector_size)))
+    {
+        return false;
+    }
+    region_end = kv_region_addr + (OTA_KV_REGION_SECTORS * sector_size);
+    if (cy_ota_mem_get_erase_size(CY_OTA_MEM_TYPE_EXTERNAL_FLASH, region_end - 1u) != sector_size)
+    {
+        return false;
+    }
+
+    if (!kv_ext_flash_clear_of(FLASH_AREA_IMAGE_SECONDARY(0), region_end))
+    {
+        return false;
+    }
+#ifdef FLASH_AREA_IMAGE_SCRATCH
+    if (!kv_ext_flash_clear_of(FLASH_AREA_IMAGE_SCRATCH, region_end))
+    {
+        return false;
+    }
+#endif
+
+    kv_ext_flash_backend.sector_size = sector_size;
+    return true;
+}
+#endif /* OTA_KV_EXTERNAL_FLASH */
+
+/*******************************************************************************
+ * Function Definitions
+ ******************************************************************************/
+static uint32_t kv_crc32(uint32_t crc, const uint8_t *data, size_t len)
+{
+    uint32_t bit;
+
+    crc = ~crc;
+    while (len-- > 0u)
+    {
+        crc ^= *data++;
+        for (bit = 0u; bit < 8u; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320UL & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+static uint32_t kv_half_size(void)
+{
+    return (kv_backend->sector_count / 2u) * kv_backend->sector_size;
+}
+
+static uint32_t kv_half_base(uint32_t half)
+{
+    return half * kv_half_size();
+}
+
+static kv_index_entry_t *kv_index_find(uint16_t key)
+{
+    uint32_t i;
+
+    for (i = 0u; i < OTA_KV_MAX_KEYS; i++)
+    {
+        if ((kv_index[i].key == key) && (key != KV_KEY_INVALID_LOW))
+        {
+            return &kv_index[i];
+        }
+    }
+    return NULL;
+}
+
+static cy_rslt_t kv_index_update(uint16_t key, uint16_t len, uint32_t offset)
+{
+    kv_index_entry_t *entry = kv_index_find(key);
+
+    if (len == 0u)
+    {
+        /* Deleted */
+        if (entry != NULL)
+        {
+            entry->key = KV_KEY_INVALID_LOW;
+        }
+        return CY_RSLT_SUCCESS;
+    }
+
+    if (entry == NULL)
+    {
+        uint32_t i;
+
+        /* New key, take a free entry */
+        for (i = 0u; (i < OTA_KV_MAX_KEYS) && (kv_index[i].key != KV_KEY_INVALID_LOW); i++)
+        {
+        }
+        if (i == OTA_KV_MAX_KEYS)
+        {
+            return OTA_KV_RSLT_NO_SPACE;
+        }
+        entry = &kv_index[i];
+    }
+
+    entry->key = key;
+    entry->len = len;
+    entry->offset = offset;
+    return CY_RSLT_SUCCESS;
+}
+
+static bool kv_half_header(uint32_t half, uint32_t *generation)
+{
+    uint32_t header[2];
+
+    if (kv_backend->is_blank(kv_half_base(half), sizeof(header)))
+    {
+        return false;
+    }
+    if (kv_backend->read(kv_half_base(half), header, sizeof(header)) != CY_RSLT_SUCCESS)
+    {
+        return false;
+    }
+    *generation = header[1];
+    return (header[0] == KV_MAGIC);
+}
+
+static cy_rslt_t kv_half_erase(uint32_t half)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint32_t offset;
+
+    for (offset = 0u; (offset < kv_half_size()) && (result == CY_RSLT_SUCCESS); offset += kv_backend->sector_size)
+    {
+        result = kv_backend->erase(kv_half_base(half) + offset);
+    }
+    return result;
+}
+
+/* Rebuilds the RAM index and the write cursor from the active half */
+static void kv_scan(void)
+{
+    uint32_t base = kv_half_base(kv_active_half);
+    uint32_t end = base + kv_half_size();
+    uint32_t offset = base + KV_HALF_HEADER_SIZE;
+    uint8_t *buffer = (uint8_t *)kv_buffer;
+    uint32_t header[2];
+
+    memset(kv_index, 0, sizeof(kv_index));
+
+    while ((offset + KV_RECORD_HEADER_SIZE) <= end)
+    {
+        uint16_t key;
+        uint16_t len;
+        uint32_t size;
+
+        if (kv_backend->is_blank(offset, KV_RECORD_HEADER_SIZE) ||
+            (kv_backend->read(offset, header, sizeof(header)) != CY_RSLT_SUCCESS))
+        {
+            break;
+        }
+
+        key = (uint16_t)(header[0] >> 16);
+        len = (uint16_t)(header[0] & 0xFFFFu);
+        size = KV_ALIGN(KV_RECORD_HEADER_SIZE + len, kv_backend->program_unit);
+        if ((len > OTA_KV_MAX_VALUE_SIZE) || ((offset + size) > end))
+        {
+            /* Torn header, nothing can be appended after it */
+            offset = end;
+            break;
+        }
+
+        memcpy(buffer, header, sizeof(header[0]));
+        if ((len == 0u) || (kv_backend->read(offset + KV_RECORD_HEADER_SIZE, &buffer[4], len) == CY_RSLT_SUCCESS))
+        {
+            if (kv_crc32(0u, buffer, 4u + len) == header[1])
+            {
+                (void)kv_index_update(key, len, offset + KV_RECORD_HEADER_SIZE);
+            }
+        }
+
+        offset += size;
+    }
+
+    kv_cursor = offset;
+    kv_stats.used_bytes = offset - base;
+}
+
+/* Appends a record at the cursor of the active half */
+static cy_rslt_t kv_append(uint16_t key, const void *data, uint16_t len)
+{
+    uint8_t *buffer = (uint8_t *)kv_buffer;
+    uint32_t size = KV_ALIGN(KV_RECORD_HEADER_SIZE + len, kv_backend->program_unit);
+    uint32_t crc;
+    cy_rslt_t result;
+
+    if ((kv_cursor + size) > (kv_half_base(kv_active_half) + kv_half_size()))
+    {
+        return OTA_KV_RSLT_NO_SPACE;
+    }
+
+    /* The value may already be in place when moved by ota_kv_gc() */
+    if (len != 0u)
+    {
+        memmove(&buffer[KV_RECORD_HEADER_SIZE], data, len);
+    }
+    memset(&buffer[KV_RECORD_HEADER_SIZE + len], 0xFF, size - (KV_RECORD_HEADER_SIZE + len));
+    kv_buffer[0] = ((uint32_t)key << 16) | len;
+    crc = kv_crc32(0u, buffer, 4u);
+    crc = kv_crc32(crc, &buffer[KV_RECORD_HEADER_SIZE], len);
+    kv_buffer[1] = crc;
+
+    result = kv_backend->program(kv_cursor, buffer, size);
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = kv_index_update(key, len, kv_cursor + KV_RECORD_HEADER_SIZE);
+    }
+
+    /* The space is consumed even if programming failed */
+    kv_cursor += size;
+    kv_stats.used_bytes = kv_cursor - kv_half_base(kv_active_half);
+    return result;
+}
+
+/*******************************************************************************
+* Function Name: ota_kv_gc
+********************************************************************************
+* Summary:
+* Compacts the latest value of every key into the other half and makes it the
+* active half. The previous half stays valid until the new header is written.
+*
+*******************************************************************************/
+cy_rslt_t ota_kv_gc(void)
+{
+    kv_index_entry_t old_index[OTA_KV_MAX_KEYS];
+    uint32_t target = kv_active_half ^ 1u;
+    uint32_t header[2];
+    cy_rslt_t result;
+    uint32_t i;
+
+    if (kv_backend == NULL)
+    {
+        return OTA_KV_RSLT_NO_BACKEND;
+    }
+
+    result = kv_half_erase(target);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        return result;
+    }
+
+    memcpy(old_index, kv_index, sizeof(old_index));
+    memset(kv_index, 0, sizeof(kv_index));
+    kv_active_half = target;
+    kv_cursor = kv_half_base(target) + KV_HALF_HEADER_SIZE;
+
+    for (i = 0u; (i < OTA_KV_MAX_KEYS) && (result == CY_RSLT_SUCCESS); i++)
+    {
+        if (old_index[i].key == KV_KEY_INVALID_LOW)
+        {
+            continue;
+        }
+        /* Read into the value part of the staging buffer, kv_append() keeps it in place */
+        result = kv_backend->read(old_index[i].offset, &((uint8_t *)kv_buffer)[KV_RECORD_HEADER_SIZE], old_index[i].len);
+        if (result == CY_RSLT_SUCCESS)
+        {
+            result = kv_append(old_index[i].key, &((uint8_t *)kv_buffer)[KV_RECORD_HEADER_SIZE], old_index[i].len);
+        }
+    }
+
+    if (result == CY_RSLT_SUCCESS)
+    {
+        header[0] = KV_MAGIC;
+        header[1] = kv_generation + 1u;
+        result = kv_backend->program(kv_half_base(target), header, sizeof(header));
+    }
+
+    if (result == CY_RSLT_SUCCESS)
+    {
+        /* The new half is used only once it is in the flash */
+        result = ota_kv_sync();
+    }
+
+    if (result != CY_RSLT_SUCCESS)
+    {
+        /* The new half is not valid, keep using the previous one */
+        kv_active_half = target ^ 1u;
+        kv_scan();
+        return result;
+    }
+
+    kv_generation++;
+    kv_stats.gc_runs++;
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+* Function Name: ota_kv_init
+********************************************************************************
+* Summary:
+* Selects the storage backend, finds the valid half with the latest generation
+* and rebuilds the RAM index from it. A blank region is formatted.
+*
+*******************************************************************************/
+cy_rslt_t ota_kv_init(void)
+{
+    uint32_t generation[2] = { 0u, 0u };
+    bool valid[2];
+    uint32_t header[2];
+    cy_rslt_t result;
+
+#if defined (XMC7100) || defined (XMC7200)
+    Cy_Flashc_WorkWriteEnable();
+    kv_backend = &kv_work_flash_backend;
+#elif defined (OTA_KV_EXTERNAL_FLASH)
+    kv_backend = kv_ext_flash_place() ? &kv_ext_flash_backend : NULL;
+    if (kv_backend == NULL)
+    {
+        OTA_PRINTF("KV store: no room for %u sectors in the external flash\n",
+                (unsigned int)OTA_KV_REGION_SECTORS);
+    }
+    else
+    {
+        /* Without the flash worker the records are programmed synchronously */
+        kv_queued = (cy_ota_mem_queue_init() == CY_RSLT_SUCCESS);
+    }
+#else
+    kv_backend = NULL;
+#endif
+    if (kv_backend == NULL)
+    {
+        return OTA_KV_RSLT_NO_BACKEND;
+    }
+
+    /* Count the CPU cycles of each set for the statistics */
+    ota_cycles_enable();
+
+    kv_stats.half_size = kv_half_size();
+
+    valid[0] = kv_half_header(0u, &generation[0]);
+    valid[1] = kv_half_header(1u, &generation[1]);
+
+    if (!valid[0] && !valid[1])
+    {
+        /* Blank or unknown content, format the first half */
+        result = kv_half_erase(0u);
+        if (result == CY_RSLT_SUCCESS)
+        {
+            header[0] = KV_MAGIC;
+            header[1] = 1u;
+            result = kv_backend->program(kv_half_base(0u), header, sizeof(header));
+        }
+        if (result == CY_RSLT_SUCCESS)
+        {
+            result = ota_kv_sync();
+        }
+        if (result != CY_RSLT_SUCCESS)
+        {
+            kv_backend = NULL;
+            return result;
+        }
+        valid[0] = true;
+        generation[0] = 1u;
+    }
+
+    if (valid[0] && (!valid[1] || ((int32_t)(generation[0] - generation[1]) > 0)))
+    {
+        kv_active_half = 0u;
+    }
+    else
+    {
+        kv_active_half = 1u;
+    }
+    kv_generation = generation[kv_active_half];
+
+    kv_scan();
+
+    OTA_PRINTF("OTA KV store: generation %u, %u of %u bytes used\n", (unsigned int)kv_generation,
+            (unsigned int)kv_stats.used_bytes, (unsigned int)kv_stats.half_size);
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+* Function Name: ota_kv_set
+********************************************************************************
+* Summary:
+* Appends a new value for the key, compacting the log first if the active half
+* is full. In the external flash the record is only queued when this returns,
+* ota_kv_sync() waits until it is programmed.
+*
+*******************************************************************************/
+cy_rslt_t ota_kv_set(uint16_t key, const void *data, size_t len)
+{
+    uint32_t start = DWT->CYCCNT;
+    cy_rslt_t result;
+
+    if (kv_backend == NULL)
+    {
+        return OTA_KV_RSLT_NO_BACKEND;
+    }
+    if ((key == KV_KEY_INVALID_LOW) || (key == KV_KEY_INVALID_HIGH) ||
+        (len > OTA_KV_MAX_VALUE_SIZE) || ((data == NULL) && (len != 0u)))
+    {
+        return OTA_KV_RSLT_BAD_PARAM;
+    }
+
+    result = kv_append(key, data, (uint16_t)len);
+    if (result == OTA_KV_RSLT_NO_SPACE)
+    {
+        result = ota_kv_gc();
+        if (result == CY_RSLT_SUCCESS)
+        {
+            result = kv_append(key, data, (uint16_t)len);
+        }
+    }
+
+    kv_stats.sets++;
+    kv_stats.last_set_us = ota_cycles_to_us(DWT->CYCCNT - start);
+    return result;
+}
+
+/*******************************************************************************
+* Function Name: ota_kv_get
+********************************************************************************
+* Summary:
+* Reads the latest value of the key through the RAM index.
+*
+*******************************************************************************/
+cy_rslt_t ota_kv_get(uint16_t key, void *data, size_t max_len, size_t *len)
+{
+    kv_index_entry_t *entry;
+    size_t copy;
+
+    if (kv_backend == NULL)
+    {
+        return OTA_KV_RSLT_NO_BACKEND;
+    }
+
+    kv_stats.gets++;
+    entry = kv_index_find(key);
+    if (entry == NULL)
+    {
+        return OTA_KV_RSLT_NOT_FOUND;
+    }
+
+    copy = (entry->len < max_len) ? entry->len : max_len;
+    if (len != NULL)
+    {
+        *len = entry->len;
+    }
+    return kv_backend->read(entry->offset, data, copy);
+}
+
+/*******************************************************************************
+* Function Name: ota_kv_delete
+********************************************************************************
+* Summary:
+* Appends a deletion record for the key.
+*
+*******************************************************************************/
+cy_rslt_t ota_kv_delete(uint16_t key)
+{
+    if (kv_backend == NULL)
+    {
+        return OTA_KV_RSLT_NO_BACKEND;
+    }
+    if (kv_index_find(key) == NULL)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+    return ota_kv_set(key, NULL, 0u);
+}
+
+/*******************************************************************************
+* Function Name: ota_kv_sync
+********************************************************************************
+* Summary:
+* Waits until the records queued to the flash worker are programmed. Fails if
+* a queued program or erase failed since the previous call.
+*
+*******************************************************************************/
+cy_rslt_t ota_kv_sync(void)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    if (kv_backend == NULL)
+    {
+        return OTA_KV_RSLT_NO_BACKEND;
+    }
+
+#ifdef OTA_KV_EXTERNAL_FLASH
+    if (kv_queued)
+    {
+        result = cy_ota_mem_flush();
+        if (kv_queue_failed)
+        {
+            kv_queue_failed = false;
+            result = CY_RSLT_TYPE_ERROR;
+        }
+    }
+#endif
+    return result;
+}
+
+/*******************************************************************************
+* Function Name: ota_kv_get_stats
+********************************************************************************
+* Summary:
+* Returns the store counters.
+*
+*******************************************************************************/
+void ota_kv_get_stats(ota_kv_stats_t *stats)
+{
+    if (stats != NULL)
+    {
+        *stats = kv_stats;
+    }
+}
+
+/*******************************************************************************
+* Function Name: ota_kv_crc32
+********************************************************************************
+* Summary:
+* CRC-32 of a buffer, the one the records are checked with. Usable before
+* ota_kv_init(), e.g. for state kept in retained RAM. Pass 0 as crc for the
+* first buffer and the previous result to continue over the next one.
+*
+*******************************************************************************/
+uint32_t ota_kv_crc32(uint32_t crc, const void *data, size_t len)
+{
+    return kv_crc32(crc, (const uint8_t *)data, len);
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,120 @@
+/******************************************************************************
+* File Name: ota_kv_store.h
+*
+* Description: This file contains the declarations of the append-only key/value
+* store used for the OTA session state.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+
+#ifndef SOURCE_OTA_KV_STORE_H_
+#define SOURCE_OTA_KV_STORE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "cy_result.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Largest value that can be stored for a key */
+#ifndef OTA_KV_MAX_VALUE_SIZE
+#define OTA_KV_MAX_VALUE_SIZE               (256u)
+#endif
+
+/* Number of distinct keys kept in the RAM index */
+#ifndef OTA_KV_MAX_KEYS
+#define OTA_KV_MAX_KEYS                     (16u)
+#endif
+
+/* Result codes */
+#define OTA_KV_RSLT_NOT_FOUND               (CY_RSLT_CREATE(CY_RSLT_TYPE_ERROR, CY_RSLT_MODULE_MIDDLEWARE_BASE, 0x01u))
+#define OTA_KV_RSLT_NO_SPACE                (CY_RSLT_CREATE(CY_RSLT_TYPE_ERROR, CY_RSLT_MODULE_MIDDLEWARE_BASE, 0x02u))
+#define OTA_KV_RSLT_BAD_PARAM               (CY_RSLT_CREATE(CY_RSLT_TYPE_ERROR, CY_RSLT_MODULE_MIDDLEWARE_BASE, 0x03u))
+#define OTA_KV_RSLT_NO_BACKEND              (CY_RSLT_CREATE(CY_RSLT_TYPE_ERROR, CY_RSLT_MODULE_MIDDLEWARE_BASE, 0x04u))
+
+/*******************************************************************************
+* Data structure and enumeration
+********************************************************************************/
+/* Keys of the OTA session state, 0x0000 and 0xFFFF are reserved */
+typedef enum
+{
+    OTA_KV_KEY_OFFSET       = 0x0001,   /* Bytes of the image received so far */
+    OTA_KV_KEY_BITMAP       = 0x0002,   /* Received chunks bitmap */
+    OTA_KV_KEY_HASH         = 0x0003,   /* Hash checkpoint of the received data */
+    OTA_KV_KEY_STATS        = 0x0004,   /* Download statistics */
+    OTA_KV_KEY_IDENTITY     = 0x0005,   /* Identity of the image being downloaded */
+    OTA_KV_KEY_WIFI         = 0x0006,   /* Last good Wi-Fi AP and lease */
+} ota_kv_key_t;
+
+/*
+ * Storage the log is kept in. Offsets are relative to the start of the
+ * region; program() is called with offsets and lengths that are multiples of
+ * program_unit, erase() with the offset of a sector.
+ */
+typedef struct
+{
+    uint32_t    sector_size;
+    uint32_t    sector_count;   /* Must be even, the region is used as two halves */
+    uint32_t    program_unit;   /* 4 or a multiple of 4 */
+    cy_rslt_t   (*read)(uint32_t offset, void *data, size_t len);
+    cy_rslt_t   (*program)(uint32_t offset, const void *data, size_t len);
+    cy_rslt_t   (*erase)(uint32_t offset);
+    bool        (*is_blank)(uint32_t offset, size_t len);
+} ota_kv_backend_t;
+
+typedef struct
+{
+    uint32_t    sets;           /* Records appended */
+    uint32_t    gets;
+    uint32_t    gc_runs;        /* Compactions into the other half */
+    uint32_t    used_bytes;     /* Bytes used in the active half */
+    uint32_t    half_size;      /* Bytes available in one half */
+    uint32_t    last_set_us;    /* Duration of the last ota_kv_set() */
+} ota_kv_stats_t;
+
+/*******************************************************************************
+* Function prototype
+********************************************************************************/
+cy_rslt_t ota_kv_init(void);
+cy_rslt_t ota_kv_set(uint16_t key, const void *data, size_t len);
+cy_rslt_t ota_kv_get(uint16_t key, void *data, size_t max_len, size_t *len);
+cy_rslt_t ota_kv_delete(uint16_t key);
+cy_rslt_t ota_kv_gc(void);
+cy_rslt_t ota_kv_sync(void);
+void ota_kv_get_stats(ota_kv_stats_t *stats);
+uint32_t ota_kv_crc32(uint32_t crc, const void *data, size_t len);
+
+#endif /* SOURCE_OTA_KV_STORE_H_ */
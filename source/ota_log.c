@@ -0,0 +1,635 @@
+/******************************************************************************
+* File Name:   ota_log.c
+*
+* Description: This file contains the deferred OTA callback logger. The OTA
+*              callback copies the events into a lock-free ring buffer and a
+*              lowest priority task formats and prints them, so the OTA agent
+*              does not wait for the console UART.
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2021-2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/*******************************************************************************
+ * Header file includes
+ ******************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include "cy_pdl.h"
+#include "cyhal.h"
+#include "cy_ota_api.h"
+#include "cy_ota_flash_ext.h"
+#include "ota_log.h"
+#include "ota_log_token.h"
+#include "ota_cycles.h"
+#include "ota_telemetry.h"
+#include "ota_resume.h"
+#include "ota_decompress.h"
+#include "ota_delta.h"
+#include "ota_static_alloc.h"
+#include "retarget_io_dma.h"
+
+/* FreeRTOS header file */
+#include <FreeRTOS.h>
+#include <task.h>
+
+/*******************************************************************************
+ * Macros
+ ******************************************************************************/
+#if ((OTA_LOG_RING_SIZE & (OTA_LOG_RING_SIZE - 1u)) != 0u)
+#error "OTA_LOG_RING_SIZE must be a power of 2"
+#endif
+
+/* The logger also wakes up on its own in case a notification was missed */
+#define OTA_LOG_POLL_MS                     (100u)
+
+/*******************************************************************************
+ * Forward declaration
+ ******************************************************************************/
+void print_heap_usage(char *msg);
+
+/*******************************************************************************
+ * Global Variables
+ ******************************************************************************/
+/*
+ * Single producer, single consumer ring buffer. Only the OTA callback writes
+ * ring_head and fills the records, only the logger task writes ring_tail.
+ * Both indexes run freely and are masked when the ring is accessed.
+ */
+static ota_log_record_t     ring[OTA_LOG_RING_SIZE];
+static volatile uint32_t    ring_head;
+static volatile uint32_t    ring_tail;
+
+static volatile uint32_t    log_mask = OTA_LOG_DEFAULT_MASK;
+static ota_log_stats_t      log_stats;
+static uint32_t             log_dropped_reported;
+static TaskHandle_t         logger_task;
+
+/*******************************************************************************
+ * Function Name: ota_log_copy
+ *******************************************************************************
+ * Summary:
+ *  Copies a string of the callback data, truncated to the record field.
+ *
+ *******************************************************************************/
+static void ota_log_copy(char *dst, size_t size, const char *src)
+{
+    size_t len = 0;
+
+    if (src != NULL)
+    {
+        len = strnlen(src, size - 1u);
+        memcpy(dst, src, len);
+    }
+    dst[len] = '\0';
+}
+
+/*******************************************************************************
+ * Function Name: ota_log_print_flash_stats
+ *******************************************************************************
+ * Summary:
+ *  Prints the counters of the OTA flash APIs at the end of an update.
+ *
+ *******************************************************************************/
+static void ota_log_print_flash_stats(void)
+{
+    cy_ota_mem_trailer_stats_t trailer_stats;
+    cy_ota_mem_read_cache_stats_t cache_stats;
+    cy_ota_mem_program_stats_t program_stats;
+    cy_ota_mem_row_stats_t row_stats;
+    cy_ota_mem_transfer_stats_t transfer_stats;
+    cy_ota_mem_client_stats_t client_stats;
+    cy_ota_mem_queue_stats_t queue_stats;
+    ota_telemetry_stats_t telemetry_stats;
+    ota_resume_stats_t resume_stats;
+    ota_decompress_stats_t decompress_stats;
+    ota_delta_stats_t delta_stats;
+    ota_static_alloc_stats_t alloc_stats;
+    char phases[OTA_TELEMETRY_PHASES_SIZE];
+    uint32_t client;
+
+    cy_ota_mem_get_trailer_stats(&trailer_stats);
+    OTA_PRINTF("Trailer writes: in place:%u unchanged:%u rewritten:%u\n",
+            (unsigned int)trailer_stats.in_place,
+            (unsigned int)trailer_stats.unchanged,
+            (unsigned int)trailer_stats.fallback);
+    cy_ota_mem_get_read_cache_stats(&cache_stats);
+    OTA_PRINTF("Read cache: hits:%u misses:%u bypassed:%u invalidated:%u\n",
+            (unsigned int)cache_stats.hits,
+            (unsigned int)cache_stats.misses,
+            (unsigned int)cache_stats.bypassed,
+            (unsigned int)cache_stats.invalidations);
+    cy_ota_mem_get_row_stats(&row_stats);
+    OTA_PRINTF("Flash rows: in place:%u staged:%u merged:%u\n",
+            (unsigned int)row_stats.in_place,
+            (unsigned int)row_stats.staged,
+            (unsigned int)row_stats.merged);
+    cy_ota_mem_get_program_stats(&program_stats);
+    if (program_stats.bytes != 0u)
+    {
+        OTA_PRINTF("Flash program: cmd 0x%02x %u us/4KB bus cycles/4KB:%u\n",
+                program_stats.command,
+                (unsigned int)ota_cycles_to_us((program_stats.cycles * 4096u) / program_stats.bytes),
+                (unsigned int)program_stats.bus_cycles);
+    }
+    if (program_stats.basic_bytes != 0u)
+    {
+        OTA_PRINTF("Flash program: cmd 0x%02x %u us/4KB bus cycles/4KB:%u (basic)\n",
+                program_stats.basic_command,
+                (unsigned int)ota_cycles_to_us((program_stats.basic_cycles * 4096u) / program_stats.basic_bytes),
+                (unsigned int)program_stats.basic_bus_cycles);
+    }
+    cy_ota_mem_get_transfer_stats(&transfer_stats);
+    if ((transfer_stats.read_bytes + transfer_stats.write_bytes) != 0u)
+    {
+        uint64_t busy_cycles = transfer_stats.cycles - transfer_stats.idle_cycles;
+
+        OTA_PRINTF("Flash transfers (%s): read:%u written:%u CPU busy:%u%% %u cycles/KB\n",
+                transfer_stats.dma ? "DMA" : "CPU",
+                (unsigned int)transfer_stats.read_bytes,
+                (unsigned int)transfer_stats.write_bytes,
+                (unsigned int)((busy_cycles * 100u) / transfer_stats.cycles),
+                (unsigned int)((busy_cycles * 1024u) /
+                               (transfer_stats.read_bytes + transfer_stats.write_bytes)));
+    }
+    for (client = 0; cy_ota_mem_get_client_stats(client, &client_stats) == CY_RSLT_SUCCESS; client++)
+    {
+        OTA_PRINTF("Flash client %s: holds:%u waited:%u (max %u us, avg %u us) timeouts:%u max hold:%u us long holds:%u\n",
+                client_stats.name,
+                (unsigned int)client_stats.acquisitions,
+                (unsigned int)client_stats.contended,
+                (unsigned int)client_stats.max_wait_us,
+                (unsigned int)((client_stats.contended != 0u) ?
+                               (client_stats.total_wait_us / client_stats.contended) : 0u),
+                (unsigned int)client_stats.timeouts,
+                (unsigned int)client_stats.max_hold_us,
+                (unsigned int)client_stats.long_holds);
+    }
+    cy_ota_mem_get_queue_stats(&queue_stats);
+    if (queue_stats.submitted != 0u)
+    {
+        OTA_PRINTF("Flash queue: ops:%u failed:%u merged writes:%u pages:%u erases ahead:%u max depth:%u latency avg:%u max:%u ms\n",
+                (unsigned int)queue_stats.submitted,
+                (unsigned int)queue_stats.failed,
+                (unsigned int)queue_stats.merged_writes,
+                (unsigned int)queue_stats.page_writes,
+                (unsigned int)queue_stats.erases_ahead,
+                (unsigned int)queue_stats.max_depth,
+                (unsigned int)((queue_stats.completed != 0u) ?
+                               (queue_stats.total_latency_ms / queue_stats.completed) : 0u),
+                (unsigned int)queue_stats.max_latency_ms);
+    }
+    ota_telemetry_get_stats(&telemetry_stats);
+    if (telemetry_stats.chunks != 0u)
+    {
+        OTA_PRINTF("Download: chunks:%u interval avg:%u max:%u ms write avg:%u max:%u us telemetry sent:%u failed:%u\n",
+                (unsigned int)telemetry_stats.chunks,
+                (unsigned int)(telemetry_stats.total_interval_ms / telemetry_stats.chunks),
+                (unsigned int)telemetry_stats.max_interval_ms,
+                (unsigned int)(telemetry_stats.total_write_us / telemetry_stats.chunks),
+                (unsigned int)telemetry_stats.max_write_us,
+                (unsigned int)telemetry_stats.published,
+                (unsigned int)telemetry_stats.publish_failures);
+    }
+    ota_resume_get_stats(&resume_stats);
+    if (resume_stats.resumed || (resume_stats.checkpoints != 0u) || (resume_stats.requests != 0u))
+    {
+        OTA_PRINTF("Resume: kept:%u verified:%u of %u bytes out of order:%u duplicates:%u checkpoints:%u requests:%u timeouts:%u window:%u rtt:%u ms\n",
+                (unsigned int)resume_stats.resumed_bytes,
+                (unsigned int)resume_stats.verified_bytes,
+                (unsigned int)resume_stats.total_size,
+                (unsigned int)resume_stats.out_of_order,
+                (unsigned int)resume_stats.duplicates,
+                (unsigned int)resume_stats.checkpoints,
+                (unsigned int)resume_stats.requests,
+                (unsigned int)resume_stats.request_timeouts,
+                (unsigned int)resume_stats.window,
+                (unsigned int)resume_stats.rtt_ms);
+    }
+    ota_decompress_get_stats(&decompress_stats);
+    if (decompress_stats.compressed)
+    {
+        OTA_PRINTF("Decompress: received:%u written:%u of %u bytes (%u%%) duplicates:%u\n",
+                (unsigned int)decompress_stats.in_bytes,
+                (unsigned int)decompress_stats.out_bytes,
+                (unsigned int)decompress_stats.image_size,
+                (unsigned int)((decompress_stats.out_bytes != 0u) ?
+                               ((decompress_stats.in_bytes * 100u) / decompress_stats.out_bytes) : 0u),
+                (unsigned int)decompress_stats.duplicates);
+    }
+    ota_delta_get_stats(&delta_stats);
+    if (delta_stats.delta)
+    {
+        OTA_PRINTF("Delta: patch:%u written:%u of %u bytes (copy:%u diff:%u extra:%u) base reads:%u duplicates:%u\n",
+                (unsigned int)delta_stats.patch_bytes,
+                (unsigned int)delta_stats.out_bytes,
+                (unsigned int)delta_stats.image_size,
+                (unsigned int)delta_stats.copy_bytes,
+                (unsigned int)delta_stats.diff_bytes,
+                (unsigned int)delta_stats.extra_bytes,
+                (unsigned int)delta_stats.base_reads,
+                (unsigned int)delta_stats.duplicates);
+    }
+    ota_static_alloc_get_stats(&alloc_stats);
+    if (alloc_stats.measured)
+    {
+        OTA_PRINTF("Heap during update: at start:%u growth:%u peak growth:%u (%s build, TLS arena:%u)\n",
+                (unsigned int)alloc_stats.heap_at_start,
+                (unsigned int)alloc_stats.heap_growth,
+                (unsigned int)alloc_stats.heap_peak_growth,
+                alloc_stats.static_alloc ? "static" : "heap",
+                (unsigned int)alloc_stats.tls_arena_size);
+    }
+    if (ota_telemetry_format_phases(phases, sizeof(phases)) != 0u)
+    {
+        OTA_PRINTF("Phases [ms, retries]: %s\n", phases);
+    }
+    OTA_PRINTF("Log records: queued:%u printed:%u dropped:%u masked:%u max depth:%u\n",
+            (unsigned int)log_stats.queued, (unsigned int)log_stats.printed,
+            (unsigned int)log_stats.dropped, (unsigned int)log_stats.masked,
+            (unsigned int)log_stats.max_depth);
+#ifdef RETARGET_IO_DMA
+    {
+        retarget_io_dma_stats_t console_stats;
+
+        retarget_io_dma_get_stats(&console_stats);
+        OTA_PRINTF("Console: written:%u dropped:%u high water:%u/%u blocked:%u\n",
+                (unsigned int)console_stats.written, (unsigned int)console_stats.dropped,
+                (unsigned int)console_stats.high_water, (unsigned int)RETARGET_IO_DMA_BUFFER_SIZE,
+                (unsigned int)console_stats.blocked);
+    }
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: ota_log_print
+ *******************************************************************************
+ * Summary:
+ *  Formats and prints one callback event.
+ *
+ *******************************************************************************/
+static void ota_log_print(const ota_log_record_t *record)
+{
+    const char *state_string = cy_ota_get_state_string((cy_ota_agent_state_t)record->state);
+    const char *error_string = cy_ota_get_error_string(record->last_error);
+
+    print_heap_usage("In OTA Callback");
+
+    switch ((cy_ota_cb_reason_t)record->reason)
+    {
+        case CY_OTA_REASON_SUCCESS:
+            OTA_PRINTF(">> APP CB OTA SUCCESS state:%d %s last_error:%s\n\n",
+                    record->state, state_string, error_string);
+            break;
+
+        case CY_OTA_REASON_FAILURE:
+            OTA_PRINTF(">> APP CB OTA FAILURE state:%d %s last_error:%s\n\n",
+                    record->state, state_string, error_string);
+            break;
+
+        case CY_OTA_REASON_STATE_CHANGE:
+            switch ((cy_ota_agent_state_t)record->state)
+            {
+                case CY_OTA_STATE_START_UPDATE:
+                    OTA_PRINTF("APP CB OTA STATE CHANGE CY_OTA_STATE_START_UPDATE\n");
+                    break;
+
+                case CY_OTA_STATE_JOB_CONNECT:
+                    OTA_PRINTF("APP CB OTA CONNECT FOR JOB using ");
+                    if ((record->host[0] == '\0') || (record->port == 0) || (record->topic[0] == '\0'))
+                    {
+                        OTA_PRINTF("ERROR in callback data: MQTT: server: '%s' port: %d topic: '%s'\n",
+                                record->host, record->port, record->topic);
+                    }
+                    OTA_PRINTF("MQTT: server:%s port: %d topic: '%s'\n",
+                            record->host, record->port, record->topic);
+                    break;
+
+                case CY_OTA_STATE_JOB_DOWNLOAD:
+                    OTA_PRINTF("APP CB OTA JOB DOWNLOAD using ");
+                    OTA_PRINTF("MQTT: '%s'\n", record->doc);
+                    OTA_PRINTF("topic: '%s' \n", record->topic);
+                    break;
+
+                case CY_OTA_STATE_JOB_DISCONNECT:
+                    OTA_PRINTF("APP CB OTA JOB DISCONNECT\n");
+                    break;
+
+                case CY_OTA_STATE_JOB_PARSE:
+                    OTA_PRINTF("APP CB OTA PARSE JOB: '%s' \n", record->doc);
+                    break;
+
+                case CY_OTA_STATE_JOB_REDIRECT:
+                    OTA_PRINTF("APP CB OTA JOB REDIRECT\n");
+                    break;
+
+                case CY_OTA_STATE_DATA_CONNECT:
+                    OTA_PRINTF("APP CB OTA CONNECT FOR DATA using ");
+                    OTA_PRINTF("MQTT: %s:%d \n", record->host, record->port);
+                    break;
+
+                case CY_OTA_STATE_DATA_DOWNLOAD:
+                    OTA_PRINTF("APP CB OTA DATA DOWNLOAD using ");
+                    OTA_PRINTF("MQTT: '%s' \n", record->doc);
+                    OTA_PRINTF("topic: '%s'\n\n", record->topic);
+                    break;
+
+                case CY_OTA_STATE_DATA_DISCONNECT:
+                    OTA_PRINTF("APP CB OTA DATA DISCONNECT\n");
+                    break;
+
+                case CY_OTA_STATE_RESULT_CONNECT:
+                    OTA_PRINTF("APP CB OTA SEND RESULT CONNECT using ");
+                    OTA_PRINTF("MQTT: Broker:%s port: %d\n", record->host, record->port);
+                    OTA_PRINTF("topic: '%s' \n", record->topic);
+                    break;
+
+                case CY_OTA_STATE_RESULT_SEND:
+                    OTA_PRINTF("APP CB OTA SENDING RESULT using ");
+                    OTA_PRINTF("MQTT: '%s' \n", record->doc);
+                    break;
+
+                case CY_OTA_STATE_RESULT_RESPONSE:
+                    OTA_PRINTF("APP CB OTA Got Result response\n");
+                    break;
+
+                case CY_OTA_STATE_RESULT_DISCONNECT:
+                    OTA_PRINTF("APP CB OTA Result Disconnect\n");
+                    break;
+
+                case CY_OTA_STATE_OTA_COMPLETE:
+                    OTA_PRINTF("APP CB OTA Session Complete\n");
+                    ota_log_print_flash_stats();
+                    break;
+
+                case CY_OTA_STATE_STORAGE_OPEN:
+                    OTA_PRINTF("APP CB OTA STORAGE OPEN\n");
+                    break;
+
+                case CY_OTA_STATE_STORAGE_WRITE:
+                    OTA_PRINTF("APP CB OTA STORAGE WRITE %ld%% (%ld of %ld)\n",
+                            (unsigned long)record->percentage,
+                            (unsigned long)record->bytes_written,
+                            (unsigned long)record->total_size);
+
+                    /* Move cursor to previous line */
+                    OTA_PRINTF("\x1b[1F");
+                    break;
+
+                case CY_OTA_STATE_STORAGE_CLOSE:
+                    OTA_PRINTF("APP CB OTA STORAGE CLOSE\n");
+                    break;
+
+                case CY_OTA_STATE_VERIFY:
+                    OTA_PRINTF("APP CB OTA VERIFY\n");
+                    break;
+
+                case CY_OTA_STATE_RESULT_REDIRECT:
+                    OTA_PRINTF("APP CB OTA RESULT REDIRECT\n");
+                    break;
+
+                default:
+                    break;
+            }   /* switch state */
+            break;
+
+        default:
+            break;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: ota_log_event
+ *******************************************************************************
+ * Summary:
+ *  Copies an OTA callback event into the ring buffer. Called from the OTA
+ *  callback, the only producer. Events not in the event mask return before
+ *  anything is copied; when the ring buffer is full the event is counted as
+ *  dropped instead of waiting for the logger task.
+ *
+ * Parameters:
+ *  cb_data : OTA callback data
+ *
+ *******************************************************************************/
+void ota_log_event(const cy_ota_cb_struct_t *cb_data)
+{
+    ota_log_record_t *record;
+    uint32_t head = ring_head;
+    uint32_t depth;
+    uint32_t bit;
+
+    bit = (cb_data->reason == CY_OTA_REASON_STATE_CHANGE) ?
+            OTA_LOG_STATE(cb_data->ota_agt_state) : OTA_LOG_RESULT;
+    if ((cb_data->reason == CY_OTA_LAST_REASON) || ((log_mask & bit) == 0u))
+    {
+        log_stats.masked++;
+        return;
+    }
+
+    depth = head - ring_tail;
+    if (depth >= OTA_LOG_RING_SIZE)
+    {
+        log_stats.dropped++;
+        return;
+    }
+
+    record = &ring[head & (OTA_LOG_RING_SIZE - 1u)];
+    record->tick = (uint32_t)xTaskGetTickCount();
+    record->reason = (uint8_t)cb_data->reason;
+    record->state = (uint8_t)cb_data->ota_agt_state;
+    record->last_error = cy_ota_get_last_error();
+    record->port = 0;
+    record->percentage = 0;
+    record->bytes_written = 0;
+    record->total_size = 0;
+    record->host[0] = '\0';
+    record->topic[0] = '\0';
+    record->doc[0] = '\0';
+
+    /* Copy only what the logger prints for the event */
+    if (cb_data->reason == CY_OTA_REASON_STATE_CHANGE)
+    {
+        switch (cb_data->ota_agt_state)
+        {
+            case CY_OTA_STATE_JOB_CONNECT:
+            case CY_OTA_STATE_RESULT_CONNECT:
+                ota_log_copy(record->topic, sizeof(record->topic), cb_data->unique_topic);
+                /* Falls through */
+            case CY_OTA_STATE_DATA_CONNECT:
+                ota_log_copy(record->host, sizeof(record->host), cb_data->broker_server.host_name);
+                record->port = cb_data->broker_server.port;
+                break;
+
+            case CY_OTA_STATE_JOB_DOWNLOAD:
+            case CY_OTA_STATE_DATA_DOWNLOAD:
+                ota_log_copy(record->topic, sizeof(record->topic), cb_data->unique_topic);
+                /* Falls through */
+            case CY_OTA_STATE_JOB_PARSE:
+            case CY_OTA_STATE_RESULT_SEND:
+                ota_log_copy(record->doc, sizeof(record->doc), cb_data->json_doc);
+                break;
+
+            case CY_OTA_STATE_STORAGE_WRITE:
+                record->percentage = (uint32_t)cb_data->percentage;
+                record->bytes_written = (uint32_t)cb_data->bytes_written;
+                record->total_size = (uint32_t)cb_data->total_size;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    /* The record must be complete before the logger task can see it */
+    __DMB();
+    ring_head = head + 1u;
+
+    log_stats.queued++;
+    if ((depth + 1u) > log_stats.max_depth)
+    {
+        log_stats.max_depth = depth + 1u;
+    }
+
+    if (logger_task != NULL)
+    {
+        xTaskNotifyGive(logger_task);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: ota_log_flush
+ *******************************************************************************
+ * Summary:
+ *  Waits until the logger task printed every queued record. Used before the
+ *  device reboots at the end of an update.
+ *
+ * Parameters:
+ *  timeout_ms : Maximum time to wait
+ *
+ * Return:
+ *  bool : true if the ring buffer is empty
+ *
+ *******************************************************************************/
+bool ota_log_flush(uint32_t timeout_ms)
+{
+    TickType_t start = xTaskGetTickCount();
+
+    while (ring_tail != ring_head)
+    {
+        if ((logger_task == NULL) ||
+            ((xTaskGetTickCount() - start) >= pdMS_TO_TICKS(timeout_ms)))
+        {
+            return false;
+        }
+        xTaskNotifyGive(logger_task);
+        vTaskDelay(1);
+    }
+
+    /* The printed records may still wait in the console ring buffer */
+    return retarget_io_dma_flush(timeout_ms);
+}
+
+/*******************************************************************************
+ * Function Name: ota_log_set_mask
+ *******************************************************************************
+ * Summary:
+ *  Selects the callback events that are logged, see OTA_LOG_STATE() and
+ *  OTA_LOG_RESULT.
+ *
+ *******************************************************************************/
+void ota_log_set_mask(uint32_t mask)
+{
+    log_mask = mask;
+}
+
+uint32_t ota_log_get_mask(void)
+{
+    return log_mask;
+}
+
+void ota_log_get_stats(ota_log_stats_t *stats)
+{
+    if (stats != NULL)
+    {
+        *stats = log_stats;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: ota_log_task
+ *******************************************************************************
+ * Summary:
+ *  Lowest priority task printing the records queued by ota_log_event().
+ *
+ * Parameters:
+ *  void *args : Task parameter defined during task creation (unused)
+ *
+ *******************************************************************************/
+void ota_log_task(void *args)
+{
+    uint32_t tail;
+
+    (void)args;
+
+    logger_task = xTaskGetCurrentTaskHandle();
+
+    while (true)
+    {
+        (void)ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(OTA_LOG_POLL_MS));
+
+        tail = ring_tail;
+        while (tail != ring_head)
+        {
+            /* Read the record only after seeing the head that published it */
+            __DMB();
+            ota_log_print(&ring[tail & (OTA_LOG_RING_SIZE - 1u)]);
+            log_stats.printed++;
+
+            /* The slot can be reused once the record is printed */
+            __DMB();
+            tail++;
+            ring_tail = tail;
+        }
+
+        if (log_stats.dropped != log_dropped_reported)
+        {
+            OTA_PRINTF("\n[%u OTA log records dropped]\n",
+                    (unsigned int)(log_stats.dropped - log_dropped_reported));
+            log_dropped_reported = log_stats.dropped;
+        }
+    }
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,113 @@
+/******************************************************************************
+* File Name: ota_log.h
+*
+* Description: This file contains the declarations of the deferred OTA
+* callback logger.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+
+#ifndef SOURCE_OTA_LOG_H_
+#define SOURCE_OTA_LOG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cy_result.h"
+#include "cy_ota_api.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Number of records in the ring buffer, a power of 2 */
+#ifndef OTA_LOG_RING_SIZE
+#define OTA_LOG_RING_SIZE                   (16u)
+#endif
+
+/* Sizes of the strings copied from the callback data, including the NUL */
+#define OTA_LOG_HOST_SIZE                   (48u)
+#define OTA_LOG_TOPIC_SIZE                  (48u)
+#define OTA_LOG_DOC_SIZE                    (96u)
+
+/* Event mask bits: one per agent state change, and one for the session result */
+#define OTA_LOG_STATE(state)                (1UL << (uint32_t)(state))
+#define OTA_LOG_RESULT                      (1UL << 31)
+#define OTA_LOG_ALL                         (0xFFFFFFFFUL)
+
+/* Events logged by default, the agent start up and idle states are not */
+#define OTA_LOG_DEFAULT_MASK                (OTA_LOG_ALL &                                      \
+                                             ~(OTA_LOG_STATE(CY_OTA_STATE_NOT_INITIALIZED) |    \
+                                               OTA_LOG_STATE(CY_OTA_STATE_EXITING)         |    \
+                                               OTA_LOG_STATE(CY_OTA_STATE_INITIALIZING)    |    \
+                                               OTA_LOG_STATE(CY_OTA_STATE_AGENT_STARTED)   |    \
+                                               OTA_LOG_STATE(CY_OTA_STATE_AGENT_WAITING)))
+
+/*******************************************************************************
+* Data structure and enumeration
+********************************************************************************/
+/* Callback event, copied from cy_ota_cb_struct_t when the callback is called */
+typedef struct
+{
+    uint32_t    tick;
+    uint8_t     reason;         /* cy_ota_cb_reason_t */
+    uint8_t     state;          /* cy_ota_agent_state_t */
+    uint16_t    port;
+    cy_rslt_t   last_error;
+    uint32_t    percentage;
+    uint32_t    bytes_written;
+    uint32_t    total_size;
+    char        host[OTA_LOG_HOST_SIZE];
+    char        topic[OTA_LOG_TOPIC_SIZE];
+    char        doc[OTA_LOG_DOC_SIZE];
+} ota_log_record_t;
+
+typedef struct
+{
+    uint32_t    queued;         /* Records put in the ring buffer */
+    uint32_t    printed;        /* Records printed by the logger task */
+    uint32_t    dropped;        /* Records lost because the ring buffer was full */
+    uint32_t    masked;         /* Events skipped by the event mask */
+    uint32_t    max_depth;      /* Most records waiting in the ring buffer */
+} ota_log_stats_t;
+
+/*******************************************************************************
+* Function prototype
+********************************************************************************/
+void ota_log_task(void *arg);
+void ota_log_event(const cy_ota_cb_struct_t *cb_data);
+bool ota_log_flush(uint32_t timeout_ms);
+void ota_log_set_mask(uint32_t mask);
+uint32_t ota_log_get_mask(void);
+void ota_log_get_stats(ota_log_stats_t *stats);
+
+#endif /* SOURCE_OTA_LOG_H_ */
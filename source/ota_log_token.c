@@ -0,0 +1,217 @@
+/******************************************************************************
+* File Name: ota_log_token.c
+*
+* Description: This file contains the encoder of the tokenized console output,
+* see ota_log_token.h.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/*******************************************************************************
+ * Header file includes
+ ******************************************************************************/
+#include <stdarg.h>
+#include <string.h>
+#include "ota_log_token.h"
+
+#ifdef OTA_TOKENIZED_LOG
+
+/*******************************************************************************
+ * Macros
+ ******************************************************************************/
+/* '$', the base64 record, '\n' and the NUL */
+#define OTA_LOG_TOKEN_LINE_SIZE             (1u + (((OTA_LOG_TOKEN_MAX_RECORD + 2u) / 3u) * 4u) + 2u)
+
+/* Set in the length byte of a truncated string argument */
+#define OTA_LOG_STRING_TRUNCATED            (0x80u)
+#define OTA_LOG_STRING_MAX_LENGTH           (0x7Fu)
+
+/*******************************************************************************
+ * Global Variables
+ ******************************************************************************/
+static const char base64_chars[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/*******************************************************************************
+ * Function Name: ota_log_put_varint
+ *******************************************************************************
+ * Summary:
+ *  Appends a zigzag encoded variable length integer to the record.
+ *
+ * Return:
+ *  Number of bytes appended, 0 when the record is full.
+ *
+ *******************************************************************************/
+static size_t ota_log_put_varint(uint8_t *buf, size_t space, int64_t value)
+{
+    uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    size_t len = 0;
+
+    do
+    {
+        if (len == space)
+        {
+            return 0;
+        }
+        buf[len] = (uint8_t)(zigzag & 0x7Fu);
+        zigzag >>= 7;
+        if (zigzag != 0u)
+        {
+            buf[len] |= 0x80u;
+        }
+        len++;
+    } while (zigzag != 0u);
+
+    return len;
+}
+
+/*******************************************************************************
+ * Function Name: ota_log_token_printf
+ *******************************************************************************
+ * Summary:
+ *  Encodes the token and the arguments of one OTA_PRINTF() and prints them as
+ *  a '$' prefixed base64 line. Integers are zigzag varints, floating point
+ *  values are 4-byte floats and strings are a length byte followed by the
+ *  characters. Arguments that do not fit in OTA_LOG_TOKEN_MAX_RECORD are cut
+ *  and decoded as missing.
+ *
+ * Parameters:
+ *  token : OTA_LOG_TOKEN() of the format string
+ *  types : OTA_LOG_ARG_TYPES() of the arguments
+ *
+ *******************************************************************************/
+void ota_log_token_printf(uint32_t token, uint32_t types, ...)
+{
+    uint8_t record[OTA_LOG_TOKEN_MAX_RECORD];
+    char line[OTA_LOG_TOKEN_LINE_SIZE];
+    uint32_t count = types & 0x0Fu;
+    size_t len = 0;
+    size_t added;
+    size_t out = 0;
+    size_t i;
+    va_list args;
+
+    record[len++] = (uint8_t)(token);
+    record[len++] = (uint8_t)(token >> 8);
+    record[len++] = (uint8_t)(token >> 16);
+    record[len++] = (uint8_t)(token >> 24);
+
+    va_start(args, types);
+    for (types >>= 4; count > 0u; count--, types >>= 2)
+    {
+        added = 0;
+        switch (types & 0x03u)
+        {
+            case OTA_LOG_ARG_INT:
+                added = ota_log_put_varint(&record[len], sizeof(record) - len, va_arg(args, int));
+                break;
+
+            case OTA_LOG_ARG_INT64:
+                added = ota_log_put_varint(&record[len], sizeof(record) - len, va_arg(args, int64_t));
+                break;
+
+            case OTA_LOG_ARG_DOUBLE:
+            {
+                float value = (float)va_arg(args, double);
+
+                if ((sizeof(record) - len) >= sizeof(value))
+                {
+                    memcpy(&record[len], &value, sizeof(value));
+                    added = sizeof(value);
+                }
+                break;
+            }
+
+            default:
+            {
+                const char *string = va_arg(args, const char *);
+                size_t string_len = (string != NULL) ? strlen(string) : 0u;
+                size_t space = sizeof(record) - len;
+                uint8_t flags = 0;
+
+                if (space == 0u)
+                {
+                    break;
+                }
+                if (string_len > OTA_LOG_STRING_MAX_LENGTH)
+                {
+                    string_len = OTA_LOG_STRING_MAX_LENGTH;
+                    flags = OTA_LOG_STRING_TRUNCATED;
+                }
+                if (string_len > (space - 1u))
+                {
+                    string_len = space - 1u;
+                    flags = OTA_LOG_STRING_TRUNCATED;
+                }
+                record[len] = (uint8_t)string_len | flags;
+                memcpy(&record[len + 1u], string, string_len);
+                added = string_len + 1u;
+                break;
+            }
+        }
+        if (added == 0u)
+        {
+            break;
+        }
+        len += added;
+    }
+    va_end(args);
+
+    /* Base64, so the records can be told apart from the plain printf() output */
+    line[out++] = '$';
+    for (i = 0; i < len; i += 3u)
+    {
+        uint32_t bits = (uint32_t)record[i] << 16;
+
+        if ((i + 1u) < len)
+        {
+            bits |= (uint32_t)record[i + 1u] << 8;
+        }
+        if ((i + 2u) < len)
+        {
+            bits |= (uint32_t)record[i + 2u];
+        }
+        line[out++] = base64_chars[(bits >> 18) & 0x3Fu];
+        line[out++] = base64_chars[(bits >> 12) & 0x3Fu];
+        line[out++] = ((i + 1u) < len) ? base64_chars[(bits >> 6) & 0x3Fu] : '=';
+        line[out++] = ((i + 2u) < len) ? base64_chars[bits & 0x3Fu] : '=';
+    }
+    line[out++] = '\n';
+    line[out] = '\0';
+
+    fputs(line, stdout);
+}
+
+#endif /* OTA_TOKENIZED_LOG */
+
+/* [] END OF FILE */
@@ -0,0 +1,241 @@
+/******************************************************************************
+* File Name: ota_log_token.h
+*
+* Description: This file contains the macros of the tokenized console output.
+* With OTA_TOKENIZED_LOG defined, OTA_PRINTF() stores the format string in the
+* non-loaded .ota_log_fmt section and prints only a 32-bit hash of it with the
+* binary arguments; scripts/decode_log_tokens.py rebuilds the text from the
+* ELF file. Without it, OTA_PRINTF() is printf().
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef SOURCE_OTA_LOG_TOKEN_H_
+#define SOURCE_OTA_LOG_TOKEN_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef OTA_TOKENIZED_LOG
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Characters of the format string included in the token, the length of the
+ * string always is. Must match HASH_LENGTH in scripts/decode_log_tokens.py.
+ */
+#define OTA_LOG_TOKEN_HASH_LENGTH           (96u)
+
+/* Largest encoded record, longer string arguments are truncated */
+#define OTA_LOG_TOKEN_MAX_RECORD            (96u)
+
+/* Argument types, 2 bits per argument. Character arrays, uint8_t ones too, are strings */
+#define OTA_LOG_ARG_INT                     (0u)    /* Up to 32 bits, pointers and char */
+#define OTA_LOG_ARG_INT64                   (1u)
+#define OTA_LOG_ARG_DOUBLE                  (2u)    /* Sent as a float */
+#define OTA_LOG_ARG_STRING                  (3u)
+
+/* Most arguments of one OTA_PRINTF() */
+#define OTA_LOG_MAX_ARGS                    (12u)
+
+/*
+ * 65599 hash of the first OTA_LOG_TOKEN_HASH_LENGTH characters of a string
+ * literal, seeded with its length. The compiler folds it to a constant, so
+ * the string literal itself is not placed in the image.
+ */
+#define OTA_LOG_TOKEN_CHAR(str, i, k)                                           \
+    (((i) < sizeof(str) - 1u) ?                                                 \
+     ((uint32_t)(uint8_t)(str)[((i) < sizeof(str) - 1u) ? (i) : 0u] * (k)) : 0u)
+
+#define OTA_LOG_TOKEN(str) ((uint32_t)(                                         \
+    (uint32_t)(sizeof(str) - 1u) +                                              \
+    OTA_LOG_TOKEN_CHAR(str,  0, 0x0001003Fu) + \
+    OTA_LOG_TOKEN_CHAR(str,  1, 0x007E0F81u) + \
+    OTA_LOG_TOKEN_CHAR(str,  2, 0x2E86D0BFu) + \
+    OTA_LOG_TOKEN_CHAR(str,  3, 0x43EC5F01u) + \
+    OTA_LOG_TOKEN_CHAR(str,  4, 0x162C613Fu) + \
+    OTA_LOG_TOKEN_CHAR(str,  5, 0xD62AEE81u) + \
+    OTA_LOG_TOKEN_CHAR(str,  6, 0xA311B1BFu) + \
+    OTA_LOG_TOKEN_CHAR(str,  7, 0xD319BE01u) + \
+    OTA_LOG_TOKEN_CHAR(str,  8, 0xB156C23Fu) + \
+    OTA_LOG_TOKEN_CHAR(str,  9, 0x6698CD81u) + \
+    OTA_LOG_TOKEN_CHAR(str, 10, 0x0D1B92BFu) + \
+    OTA_LOG_TOKEN_CHAR(str, 11, 0xCC881D01u) + \
+    OTA_LOG_TOKEN_CHAR(str, 12, 0x7280233Fu) + \
+    OTA_LOG_TOKEN_CHAR(str, 13, 0x50C7AC81u) + \
+    OTA_LOG_TOKEN_CHAR(str, 14, 0x8DA473BFu) + \
+    OTA_LOG_TOKEN_CHAR(str, 15, 0x4F377C01u) + \
+    OTA_LOG_TOKEN_CHAR(str, 16, 0xFAA8843Fu) + \
+    OTA_LOG_TOKEN_CHAR(str, 17, 0x33B78B81u) + \
+    OTA_LOG_TOKEN_CHAR(str, 18, 0x45AC54BFu) + \
+    OTA_LOG_TOKEN_CHAR(str, 19, 0x7A27DB01u) + \
+    OTA_LOG_TOKEN_CHAR(str, 20, 0xEACFE53Fu) + \
+    OTA_LOG_TOKEN_CHAR(str, 21, 0xAE686A81u) + \
+    OTA_LOG_TOKEN_CHAR(str, 22, 0x563335BFu) + \
+    OTA_LOG_TOKEN_CHAR(str, 23, 0x6C593A01u) + \
+    OTA_LOG_TOKEN_CHAR(str, 24, 0xE3F6463Fu) + \
+    OTA_LOG_TOKEN_CHAR(str, 25, 0x5FDA4981u) + \
+    OTA_LOG_TOKEN_CHAR(str, 26, 0xE03916BFu) + \
+    OTA_LOG_TOKEN_CHAR(str, 27, 0x44CB9901u) + \
+    OTA_LOG_TOKEN_CHAR(str, 28, 0x871BA73Fu) + \
+    OTA_LOG_TOKEN_CHAR(str, 29, 0xE70D2881u) + \
+    OTA_LOG_TOKEN_CHAR(str, 30, 0x04BDF7BFu) + \
+    OTA_LOG_TOKEN_CHAR(str, 31, 0x227EF801u) + \
+    OTA_LOG_TOKEN_CHAR(str, 32, 0x7540083Fu) + \
+    OTA_LOG_TOKEN_CHAR(str, 33, 0xE3010781u) + \
+    OTA_LOG_TOKEN_CHAR(str, 34, 0xE4C1D8BFu) + \
+    OTA_LOG_TOKEN_CHAR(str, 35, 0x24735701u) + \
+    OTA_LOG_TOKEN_CHAR(str, 36, 0x4F63693Fu) + \
+    OTA_LOG_TOKEN_CHAR(str, 37, 0xF2B5E681u) + \
+    OTA_LOG_TOKEN_CHAR(str, 38, 0xA144B9BFu) + \
+    OTA_LOG_TOKEN_CHAR(str, 39, 0x69A8B601u) + \
+    OTA_LOG_TOKEN_CHAR(str, 40, 0xB685CA3Fu) + \
+    OTA_LOG_TOKEN_CHAR(str, 41, 0xB52BC581u) + \
+    OTA_LOG_TOKEN_CHAR(str, 42, 0x5B469ABFu) + \
+    OTA_LOG_TOKEN_CHAR(str, 43, 0x111F1501u) + \
+    OTA_LOG_TOKEN_CHAR(str, 44, 0x4BA72B3Fu) + \
+    OTA_LOG_TOKEN_CHAR(str, 45, 0xC962A481u) + \
+    OTA_LOG_TOKEN_CHAR(str, 46, 0x33C77BBFu) + \
+    OTA_LOG_TOKEN_CHAR(str, 47, 0x39D67401u) + \
+    OTA_LOG_TOKEN_CHAR(str, 48, 0xAFC78C3Fu) + \
+    OTA_LOG_TOKEN_CHAR(str, 49, 0xCE5A8381u) + \
+    OTA_LOG_TOKEN_CHAR(str, 50, 0x4BC75CBFu) + \
+    OTA_LOG_TOKEN_CHAR(str, 51, 0x02CED301u) + \
+    OTA_LOG_TOKEN_CHAR(str, 52, 0x83E6ED3Fu) + \
+    OTA_LOG_TOKEN_CHAR(str, 53, 0x63136281u) + \
+    OTA_LOG_TOKEN_CHAR(str, 54, 0xC4463DBFu) + \
+    OTA_LOG_TOKEN_CHAR(str, 55, 0x8B083201u) + \
+    OTA_LOG_TOKEN_CHAR(str, 56, 0x69054E3Fu) + \
+    OTA_LOG_TOKEN_CHAR(str, 57, 0x268D4181u) + \
+    OTA_LOG_TOKEN_CHAR(str, 58, 0xBE441EBFu) + \
+    OTA_LOG_TOKEN_CHAR(str, 59, 0xF1829101u) + \
+    OTA_LOG_TOKEN_CHAR(str, 60, 0x0022AF3Fu) + \
+    OTA_LOG_TOKEN_CHAR(str, 61, 0xB7C82081u) + \
+    OTA_LOG_TOKEN_CHAR(str, 62, 0x5AC0FFBFu) + \
+    OTA_LOG_TOKEN_CHAR(str, 63, 0x553DF001u) + \
+    OTA_LOG_TOKEN_CHAR(str, 64, 0xEA3F103Fu) + \
+    OTA_LOG_TOKEN_CHAR(str, 65, 0xB5C3FF81u) + \
+    OTA_LOG_TOKEN_CHAR(str, 66, 0xBABCE0BFu) + \
+    OTA_LOG_TOKEN_CHAR(str, 67, 0xD53A4F01u) + \
+    OTA_LOG_TOKEN_CHAR(str, 68, 0xC85A713Fu) + \
+    OTA_LOG_TOKEN_CHAR(str, 69, 0xBF80DE81u) + \
+    OTA_LOG_TOKEN_CHAR(str, 70, 0xFF37C1BFu) + \
+    OTA_LOG_TOKEN_CHAR(str, 71, 0x9077AE01u) + \
+    OTA_LOG_TOKEN_CHAR(str, 72, 0x3B74D23Fu) + \
+    OTA_LOG_TOKEN_CHAR(str, 73, 0x73FEBD81u) + \
+    OTA_LOG_TOKEN_CHAR(str, 74, 0x4931A2BFu) + \
+    OTA_LOG_TOKEN_CHAR(str, 75, 0xA5F60D01u) + \
+    OTA_LOG_TOKEN_CHAR(str, 76, 0xE48E333Fu) + \
+    OTA_LOG_TOKEN_CHAR(str, 77, 0x723D9C81u) + \
+    OTA_LOG_TOKEN_CHAR(str, 78, 0xB9AA83BFu) + \
+    OTA_LOG_TOKEN_CHAR(str, 79, 0x34B56C01u) + \
+    OTA_LOG_TOKEN_CHAR(str, 80, 0x64A6943Fu) + \
+    OTA_LOG_TOKEN_CHAR(str, 81, 0x593D7B81u) + \
+    OTA_LOG_TOKEN_CHAR(str, 82, 0x71A264BFu) + \
+    OTA_LOG_TOKEN_CHAR(str, 83, 0x5BB5CB01u) + \
+    OTA_LOG_TOKEN_CHAR(str, 84, 0x5CBDF53Fu) + \
+    OTA_LOG_TOKEN_CHAR(str, 85, 0xC7FE5A81u) + \
+    OTA_LOG_TOKEN_CHAR(str, 86, 0x921945BFu) + \
+    OTA_LOG_TOKEN_CHAR(str, 87, 0x39F72A01u) + \
+    OTA_LOG_TOKEN_CHAR(str, 88, 0x6DD4563Fu) + \
+    OTA_LOG_TOKEN_CHAR(str, 89, 0x5D803981u) + \
+    OTA_LOG_TOKEN_CHAR(str, 90, 0x3C0F26BFu) + \
+    OTA_LOG_TOKEN_CHAR(str, 91, 0xEE798901u) + \
+    OTA_LOG_TOKEN_CHAR(str, 92, 0x38E9B73Fu) + \
+    OTA_LOG_TOKEN_CHAR(str, 93, 0xB8C31881u) + \
+    OTA_LOG_TOKEN_CHAR(str, 94, 0x908407BFu) + \
+    OTA_LOG_TOKEN_CHAR(str, 95, 0x983CE801u) + \
+    0u))
+
+/* Number of arguments, 0 to OTA_LOG_MAX_ARGS */
+#define OTA_LOG_NARGS(...)                  OTA_LOG_NARGS_(0, ##__VA_ARGS__,    \
+                                            12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define OTA_LOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, n, ...) n
+
+#define OTA_LOG_CAT(a, b)                   OTA_LOG_CAT_(a, b)
+#define OTA_LOG_CAT_(a, b)                  a ## b
+
+#define OTA_LOG_ARG_TYPE(arg) _Generic((arg),                                   \
+        char *: OTA_LOG_ARG_STRING,                                             \
+        const char *: OTA_LOG_ARG_STRING,                                       \
+        unsigned char *: OTA_LOG_ARG_STRING,                                    \
+        const unsigned char *: OTA_LOG_ARG_STRING,                              \
+        long long: OTA_LOG_ARG_INT64,                                           \
+        unsigned long long: OTA_LOG_ARG_INT64,                                  \
+        float: OTA_LOG_ARG_DOUBLE,                                              \
+        double: OTA_LOG_ARG_DOUBLE,                                             \
+        default: OTA_LOG_ARG_INT)
+
+/* Argument count in bits 0..3, argument types from bit 4 */
+#define OTA_LOG_ARG_TYPES(...)              ((uint32_t)OTA_LOG_NARGS(__VA_ARGS__) |            \
+                                             (OTA_LOG_CAT(OTA_LOG_ARG_BITS_, OTA_LOG_NARGS(__VA_ARGS__))(__VA_ARGS__) << 4))
+#define OTA_LOG_ARG_BITS_0()                (0u)
+#define OTA_LOG_ARG_BITS_1(a)               ((uint32_t)OTA_LOG_ARG_TYPE(a))
+#define OTA_LOG_ARG_BITS_2(a, ...)          ((uint32_t)OTA_LOG_ARG_TYPE(a) | (OTA_LOG_ARG_BITS_1(__VA_ARGS__) << 2))
+#define OTA_LOG_ARG_BITS_3(a, ...)          ((uint32_t)OTA_LOG_ARG_TYPE(a) | (OTA_LOG_ARG_BITS_2(__VA_ARGS__) << 2))
+#define OTA_LOG_ARG_BITS_4(a, ...)          ((uint32_t)OTA_LOG_ARG_TYPE(a) | (OTA_LOG_ARG_BITS_3(__VA_ARGS__) << 2))
+#define OTA_LOG_ARG_BITS_5(a, ...)          ((uint32_t)OTA_LOG_ARG_TYPE(a) | (OTA_LOG_ARG_BITS_4(__VA_ARGS__) << 2))
+#define OTA_LOG_ARG_BITS_6(a, ...)          ((uint32_t)OTA_LOG_ARG_TYPE(a) | (OTA_LOG_ARG_BITS_5(__VA_ARGS__) << 2))
+#define OTA_LOG_ARG_BITS_7(a, ...)          ((uint32_t)OTA_LOG_ARG_TYPE(a) | (OTA_LOG_ARG_BITS_6(__VA_ARGS__) << 2))
+#define OTA_LOG_ARG_BITS_8(a, ...)          ((uint32_t)OTA_LOG_ARG_TYPE(a) | (OTA_LOG_ARG_BITS_7(__VA_ARGS__) << 2))
+#define OTA_LOG_ARG_BITS_9(a, ...)          ((uint32_t)OTA_LOG_ARG_TYPE(a) | (OTA_LOG_ARG_BITS_8(__VA_ARGS__) << 2))
+#define OTA_LOG_ARG_BITS_10(a, ...)         ((uint32_t)OTA_LOG_ARG_TYPE(a) | (OTA_LOG_ARG_BITS_9(__VA_ARGS__) << 2))
+#define OTA_LOG_ARG_BITS_11(a, ...)         ((uint32_t)OTA_LOG_ARG_TYPE(a) | (OTA_LOG_ARG_BITS_10(__VA_ARGS__) << 2))
+#define OTA_LOG_ARG_BITS_12(a, ...)         ((uint32_t)OTA_LOG_ARG_TYPE(a) | (OTA_LOG_ARG_BITS_11(__VA_ARGS__) << 2))
+
+/*
+ * The format string must be a string literal. It is kept in the ELF file for
+ * the decoder only: the linker scripts place .ota_log_fmt in a non-loaded
+ * (INFO) output section.
+ */
+#define OTA_PRINTF(fmt, ...)                                                    \
+    do                                                                          \
+    {                                                                           \
+        static const char ota_log_fmt[]                                         \
+            __attribute__((section(".ota_log_fmt"), used)) = fmt;               \
+        ota_log_token_printf(OTA_LOG_TOKEN(fmt),                                \
+                             OTA_LOG_ARG_TYPES(__VA_ARGS__), ##__VA_ARGS__);    \
+    } while (0)
+
+/*******************************************************************************
+* Function prototype
+********************************************************************************/
+void ota_log_token_printf(uint32_t token, uint32_t types, ...);
+
+#else
+
+#define OTA_PRINTF(...)                     printf(__VA_ARGS__)
+
+#endif /* OTA_TOKENIZED_LOG */
+
+#endif /* SOURCE_OTA_LOG_TOKEN_H_ */
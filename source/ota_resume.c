@@ -0,0 +1,1366 @@
+/******************************************************************************
+* File Name: ota_resume.c
+*
+* Description: This file contains the resumable OTA download. The received
+* chunks, the image identity and a CRC checkpoint of the received data are
+* kept in the KV store, so that after a reset the download asks the publisher
+* for the missing chunks only ("Request Data Chunk") instead of the whole
+* image.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+
+/*******************************************************************************
+ * Header file includes
+ ******************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include "cy_pdl.h"
+#include "cy_ota_flash.h"
+#include "cy_ota_flash_ext.h"
+#include "flash_map_backend.h"
+#include "sysflash.h"
+#include "ota_resume.h"
+#include "ota_chunk_size.h"
+#include "ota_cycles.h"
+#include "ota_log_token.h"
+
+/* FreeRTOS header file */
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+
+/*******************************************************************************
+ * Macros
+ ******************************************************************************/
+#define OTA_RESUME_NO_BLOCK                 (0xFFFFFFFFu)
+
+/* Bytes read at a time when the checkpoint is checked against the storage */
+#define OTA_RESUME_READ_SIZE                (512u)
+
+/* Request message and unique topic buffers */
+#define OTA_RESUME_REQUEST_SIZE             (384u)
+#define OTA_RESUME_TOPIC_SIZE               (128u)
+
+/* MCUboot image header: the version of the image is read from block 0 */
+#define OTA_RESUME_IMAGE_MAGIC              (0x96f3b83dUL)
+#define OTA_RESUME_IMAGE_VERSION_OFFSET     (20u)
+
+/* Device message to the Publisher asking for one chunk of the image. The
+ * publisher answers on UniqueTopicName with a single chunk of Size bytes at
+ * Offset, see send_image_chunk_thread() in publisher.py.
+ */
+#define OTA_RESUME_CHUNK_REQUEST \
+"{\
+\"Message\":\"Request Data Chunk\", \
+\"Manufacturer\": \"Infineon\", \
+\"ManufacturerID\": \"ABCD123\", \
+\"ProductID\": \"EFGH456\", \
+\"SerialNumber\": \"ABC213450001\", \
+\"BoardName\": \"CY8CPROTO_062_4343W\", \
+\"Offset\": \"%u\", \
+\"Size\": \"%u\", \
+\"UniqueTopicName\": \"%s\"\
+}"
+
+/*******************************************************************************
+ * Data structure and enumeration
+ ******************************************************************************/
+typedef enum
+{
+    RESUME_STATE_IDLE,          /* Nothing known about the session yet */
+    RESUME_STATE_LOADED,        /* Records of an earlier download loaded, storage not open */
+    RESUME_STATE_TRACKING,      /* Storage open, the chunks are tracked */
+    RESUME_STATE_OFF            /* The download cannot be tracked or is done */
+} ota_resume_state_t;
+
+/* OTA_KV_KEY_IDENTITY record */
+typedef struct
+{
+    uint32_t    total_size;
+    uint32_t    block_size;
+    uint8_t     version[8];     /* ih_ver of the MCUboot header, zero if unknown */
+} ota_resume_identity_t;
+
+/* OTA_KV_KEY_HASH record: CRC-32 of the first verified_bytes of the image */
+typedef struct
+{
+    uint32_t    verified_bytes;
+    uint32_t    crc;
+} ota_resume_checkpoint_t;
+
+/* Chunk request in flight */
+typedef struct
+{
+    uint32_t    block;          /* OTA_RESUME_NO_BLOCK when the slot is free */
+    uint32_t    sent_ms;
+    bool        resent;         /* A resent request gives no round trip sample */
+} ota_resume_request_t;
+
+/*******************************************************************************
+ * Global Variables
+ ******************************************************************************/
+/* Updated by the OTA agent through the storage callbacks. The bitmap, the
+ * geometry and the counters are also read by the request loop, under a
+ * critical section.
+ */
+static ota_resume_state_t       resume_state;
+static ota_resume_identity_t    resume_identity;
+static ota_resume_checkpoint_t  resume_checkpoint;
+static uint8_t                  resume_bitmap[OTA_RESUME_MAX_BLOCKS / 8u];
+static ota_resume_stats_t       resume_stats;
+static bool                     resume_version_known;
+static bool                     resume_identity_saved;
+static uint32_t                 resume_unsaved_bytes;   /* Received since the last checkpoint */
+static uint32_t                 resume_credit;          /* Bytes kept, see ota_resume_take_credit() */
+static bool                     resume_credited;
+static bool                     resume_requesting;
+
+static uint8_t                  resume_read_buffer[OTA_RESUME_READ_SIZE];
+
+static uint32_t                 resume_checkpoint_bytes;
+static ota_resume_write_t       resume_next_write;
+
+/* The mutex keeps the connection from being closed in the middle of a publish */
+static StaticSemaphore_t        request_mutex_buffer;
+static SemaphoreHandle_t        request_mutex;
+static cy_mqtt_t                request_connection;
+static const char               *request_topic;
+static char                     request_unique_topic[OTA_RESUME_TOPIC_SIZE];
+static TaskHandle_t             request_task;
+static bool                     request_all;
+
+/* Request window, shared by the request loop and the storage write under a
+ * critical section. The window is the number of round trips' worth of chunks
+ * the storage can write (request_srtt_ms / request_write_us), limited by
+ * request_cap, which is halved on a timeout and grows by one for every
+ * window of chunks received.
+ */
+static ota_resume_request_t     request_slots[OTA_RESUME_WINDOW_MAX];
+static uint32_t                 request_in_flight;
+static uint32_t                 request_cursor;     /* Blocks before it were requested */
+static uint32_t                 request_cap;
+static uint32_t                 request_received;   /* Chunks received since request_cap grew */
+static uint32_t                 request_srtt_ms;    /* Smoothed round trip, 0 until measured */
+static uint32_t                 request_rttvar_ms;
+static uint32_t                 request_write_us;   /* Smoothed storage write time of a chunk */
+
+static char                     request_payload[OTA_RESUME_REQUEST_SIZE];
+
+/*******************************************************************************
+ * Function Name: resume_now_ms
+ *******************************************************************************/
+static uint32_t resume_now_ms(void)
+{
+    return (uint32_t)xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+/*******************************************************************************
+ * Function Name: resume_block_bytes
+ *******************************************************************************
+ * Summary:
+ *  Size of a block, the last one may be short.
+ *
+ *******************************************************************************/
+static uint32_t resume_block_bytes(uint32_t block)
+{
+    uint32_t start = block * resume_identity.block_size;
+
+    return ((resume_identity.total_size - start) < resume_identity.block_size) ?
+           (resume_identity.total_size - start) : resume_identity.block_size;
+}
+
+static bool resume_bit_get(uint32_t block)
+{
+    return (resume_bitmap[block / 8u] & (1u << (block % 8u))) != 0u;
+}
+
+static void resume_bit_set(uint32_t block)
+{
+    resume_bitmap[block / 8u] |= (uint8_t)(1u << (block % 8u));
+}
+
+static void resume_bit_clear(uint32_t block)
+{
+    resume_bitmap[block / 8u] &= (uint8_t)~(1u << (block % 8u));
+}
+
+static size_t resume_bitmap_len(void)
+{
+    return (size_t)((resume_stats.blocks + 7u) / 8u);
+}
+
+/*******************************************************************************
+ * Function Name: resume_delete_records
+ *******************************************************************************/
+static void resume_delete_records(void)
+{
+    (void)ota_kv_delete(OTA_KV_KEY_IDENTITY);
+    (void)ota_kv_delete(OTA_KV_KEY_BITMAP);
+    (void)ota_kv_delete(OTA_KV_KEY_HASH);
+}
+
+/*******************************************************************************
+ * Function Name: resume_discard
+ *******************************************************************************
+ * Summary:
+ *  Deletes the records of the download and forgets the received blocks. The
+ *  geometry is kept, a download in progress continues from scratch.
+ *
+ *******************************************************************************/
+static void resume_discard(void)
+{
+    resume_delete_records();
+
+    taskENTER_CRITICAL();
+    memset(resume_bitmap, 0, sizeof(resume_bitmap));
+    memset(&resume_checkpoint, 0, sizeof(resume_checkpoint));
+    resume_stats.blocks_received = 0;
+    resume_stats.verified_bytes = 0;
+    resume_stats.resumed_bytes = 0;
+    resume_stats.resumed = false;
+    taskEXIT_CRITICAL();
+
+    resume_version_known = false;
+    resume_identity_saved = false;
+    resume_unsaved_bytes = 0;
+    resume_credit = 0;
+}
+
+/*******************************************************************************
+ * Function Name: resume_load
+ *******************************************************************************
+ * Summary:
+ *  Loads the records of an earlier download from the KV store. Only the
+ *  blocks covered by the checkpoint are kept, the data of the blocks received
+ *  after it cannot be checked.
+ *
+ * Return:
+ *  true if there is something to resume
+ *
+ *******************************************************************************/
+static bool resume_load(void)
+{
+    ota_resume_identity_t identity;
+    ota_resume_checkpoint_t checkpoint;
+    uint32_t blocks;
+    uint32_t held;
+    uint32_t block;
+    size_t len = 0;
+
+    if ((ota_kv_get(OTA_KV_KEY_IDENTITY, &identity, sizeof(identity), &len) != CY_RSLT_SUCCESS) ||
+        (len != sizeof(identity)) || (identity.block_size == 0u) || (identity.total_size == 0u))
+    {
+        return false;
+    }
+    blocks = (identity.total_size + identity.block_size - 1u) / identity.block_size;
+    if (blocks > OTA_RESUME_MAX_BLOCKS)
+    {
+        return false;
+    }
+
+    if ((ota_kv_get(OTA_KV_KEY_HASH, &checkpoint, sizeof(checkpoint), &len) != CY_RSLT_SUCCESS) ||
+        (len != sizeof(checkpoint)) || (checkpoint.verified_bytes == 0u) ||
+        (checkpoint.verified_bytes > identity.total_size) ||
+        (((checkpoint.verified_bytes % identity.block_size) != 0u) &&
+         (checkpoint.verified_bytes != identity.total_size)))
+    {
+        return false;
+    }
+
+    taskENTER_CRITICAL();
+    memset(resume_bitmap, 0, sizeof(resume_bitmap));
+    taskEXIT_CRITICAL();
+    if ((ota_kv_get(OTA_KV_KEY_BITMAP, resume_bitmap, sizeof(resume_bitmap), &len) != CY_RSLT_SUCCESS) ||
+        (len != (size_t)((blocks + 7u) / 8u)))
+    {
+        return false;
+    }
+
+    /* The blocks of the checkpoint must all have been received */
+    held = (checkpoint.verified_bytes + identity.block_size - 1u) / identity.block_size;
+    for (block = 0; block < held; block++)
+    {
+        if (!resume_bit_get(block))
+        {
+            return false;
+        }
+    }
+
+    resume_identity = identity;
+    resume_checkpoint = checkpoint;
+
+    taskENTER_CRITICAL();
+    for (block = held; block < blocks; block++)
+    {
+        resume_bit_clear(block);
+    }
+    resume_stats.total_size = identity.total_size;
+    resume_stats.block_size = identity.block_size;
+    resume_stats.blocks = blocks;
+    resume_stats.verified_bytes = checkpoint.verified_bytes;
+    taskEXIT_CRITICAL();
+
+    resume_version_known = true;
+    resume_identity_saved = true;
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: resume_crc_storage
+ *******************************************************************************
+ * Summary:
+ *  Continues a CRC-32 over image data already in the storage.
+ *
+ *******************************************************************************/
+static bool resume_crc_storage(cy_ota_storage_context_t *storage_ptr, uint32_t offset,
+        uint32_t len, uint32_t *crc)
+{
+    cy_ota_storage_read_info_t read_info;
+    uint32_t chunk;
+
+    while (len > 0u)
+    {
+        chunk = (len > sizeof(resume_read_buffer)) ? sizeof(resume_read_buffer) : len;
+        memset(&read_info, 0, sizeof(read_info));
+        read_info.offset = offset;
+        read_info.size = chunk;
+        read_info.buffer = resume_read_buffer;
+        if (cy_ota_storage_read(storage_ptr, &read_info) != CY_RSLT_SUCCESS)
+        {
+            return false;
+        }
+        *crc = ota_kv_crc32(*crc, resume_read_buffer, chunk);
+        offset += chunk;
+        len -= chunk;
+    }
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: resume_block_matches
+ *******************************************************************************
+ * Summary:
+ *  Compares a chunk with the data already in the storage at its offset.
+ *
+ *******************************************************************************/
+static bool resume_block_matches(cy_ota_storage_context_t *storage_ptr,
+        const cy_ota_storage_write_info_t *chunk_info)
+{
+    cy_ota_storage_read_info_t read_info;
+    uint32_t done = 0;
+    uint32_t chunk;
+
+    while (done < (uint32_t)chunk_info->size)
+    {
+        chunk = (uint32_t)chunk_info->size - done;
+        if (chunk > sizeof(resume_read_buffer))
+        {
+            chunk = sizeof(resume_read_buffer);
+        }
+        memset(&read_info, 0, sizeof(read_info));
+        read_info.offset = (uint32_t)chunk_info->offset + done;
+        read_info.size = chunk;
+        read_info.buffer = resume_read_buffer;
+        if ((cy_ota_storage_read(storage_ptr, &read_info) != CY_RSLT_SUCCESS) ||
+            (memcmp(resume_read_buffer, &chunk_info->buffer[done], chunk) != 0))
+        {
+            return false;
+        }
+        done += chunk;
+    }
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: resume_save
+ *******************************************************************************
+ * Summary:
+ *  Writes a checkpoint. The bitmap goes first: a reset in between leaves an
+ *  older checkpoint, and the blocks past it are dropped by resume_load().
+ *
+ *******************************************************************************/
+static void resume_save(void)
+{
+    if (!resume_identity_saved)
+    {
+        if (ota_kv_set(OTA_KV_KEY_IDENTITY, &resume_identity, sizeof(resume_identity)) != CY_RSLT_SUCCESS)
+        {
+            return;
+        }
+        resume_identity_saved = true;
+    }
+
+    if ((ota_kv_set(OTA_KV_KEY_BITMAP, resume_bitmap, resume_bitmap_len()) == CY_RSLT_SUCCESS) &&
+        (ota_kv_set(OTA_KV_KEY_HASH, &resume_checkpoint, sizeof(resume_checkpoint)) == CY_RSLT_SUCCESS))
+    {
+        resume_unsaved_bytes = 0;
+        taskENTER_CRITICAL();
+        resume_stats.checkpoints++;
+        taskEXIT_CRITICAL();
+    }
+}
+
+/*******************************************************************************
+ * Function Name: resume_extend_checkpoint
+ *******************************************************************************
+ * Summary:
+ *  Extends the CRC of the contiguous data when a block lands at its end. The
+ *  blocks received earlier past that point are read back from the storage.
+ *
+ *******************************************************************************/
+static void resume_extend_checkpoint(cy_ota_storage_context_t *storage_ptr, uint32_t block,
+        const uint8_t *data)
+{
+    uint32_t verified = resume_checkpoint.verified_bytes;
+    uint32_t crc = resume_checkpoint.crc;
+    uint32_t next;
+
+    if ((verified >= resume_identity.total_size) || (block != (verified / resume_identity.block_size)))
+    {
+        return;
+    }
+
+    crc = ota_kv_crc32(crc, data, resume_block_bytes(block));
+    verified += resume_block_bytes(block);
+
+    for (next = block + 1u; (next < resume_stats.blocks) && resume_bit_get(next); next++)
+    {
+        if (!resume_crc_storage(storage_ptr, verified, resume_block_bytes(next), &crc))
+        {
+            break;
+        }
+        verified += resume_block_bytes(next);
+    }
+
+    resume_checkpoint.verified_bytes = verified;
+    resume_checkpoint.crc = crc;
+    taskENTER_CRITICAL();
+    resume_stats.verified_bytes = verified;
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+ * Function Name: resume_stop_tracking
+ *******************************************************************************
+ * Summary:
+ *  Stops tracking a download whose chunks do not fit the records. When data
+ *  of an earlier session is kept, or the chunks were requested from the
+ *  records, the download cannot complete: it fails and the next session
+ *  starts from scratch.
+ *
+ *******************************************************************************/
+static cy_rslt_t resume_stop_tracking(const char *reason)
+{
+    bool fatal = resume_stats.resumed || resume_requesting;
+
+    OTA_PRINTF("Resume: %s, %s\n", reason,
+            fatal ? "the download restarts from scratch" : "the download is not resumable");
+    resume_delete_records();
+    resume_state = RESUME_STATE_OFF;
+
+    return fatal ? OTA_RESUME_RSLT_IMAGE_CHANGED : CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: resume_chunk_block_size
+ *******************************************************************************
+ * Summary:
+ *  Block size of a download from any of its chunks: the size of a full chunk,
+ *  or for the short last chunk its offset divided by its payload index.
+ *
+ * Return:
+ *  The block size, 0 if it cannot be told from the chunk
+ *
+ *******************************************************************************/
+static uint32_t resume_chunk_block_size(const cy_ota_storage_write_info_t *chunk_info)
+{
+    uint32_t offset = (uint32_t)chunk_info->offset;
+    uint32_t size = (uint32_t)chunk_info->size;
+    uint32_t index = (uint32_t)chunk_info->packet_number;
+
+    if (((offset + size) < (uint32_t)chunk_info->total_size) || (offset == 0u))
+    {
+        return size;
+    }
+    if ((index != 0u) && ((offset % index) == 0u) && ((offset / index) >= size))
+    {
+        return offset / index;
+    }
+    return 0u;
+}
+
+/*******************************************************************************
+ * Function Name: resume_check_chunk
+ *******************************************************************************
+ * Summary:
+ *  Checks a chunk against the image identity and returns its block. The
+ *  first chunk of a new download, in whatever order the chunks arrive, sets
+ *  the block size; block 0 sets the image version.
+ *
+ *******************************************************************************/
+static cy_rslt_t resume_check_chunk(const cy_ota_storage_write_info_t *chunk_info, uint32_t *block)
+{
+    uint32_t offset = (uint32_t)chunk_info->offset;
+    uint32_t size = (uint32_t)chunk_info->size;
+    uint32_t total = (uint32_t)chunk_info->total_size;
+    uint32_t block_size;
+    const uint8_t *version;
+    uint32_t magic;
+
+    if (resume_identity.block_size == 0u)
+    {
+        block_size = resume_chunk_block_size(chunk_info);
+        if ((block_size == 0u) || (total == 0u) ||
+            (((total + block_size - 1u) / block_size) > OTA_RESUME_MAX_BLOCKS))
+        {
+            return resume_stop_tracking("chunks cannot be tracked");
+        }
+
+        taskENTER_CRITICAL();
+        resume_identity.total_size = total;
+        resume_identity.block_size = block_size;
+        resume_stats.total_size = total;
+        resume_stats.block_size = block_size;
+        resume_stats.blocks = (total + block_size - 1u) / block_size;
+        taskEXIT_CRITICAL();
+    }
+
+    if (total != resume_identity.total_size)
+    {
+        return resume_stop_tracking("the image size changed");
+    }
+    if (((offset % resume_identity.block_size) != 0u) || (offset >= total) ||
+        (size != resume_block_bytes(offset / resume_identity.block_size)))
+    {
+        return resume_stop_tracking("chunk does not match the block size");
+    }
+
+    *block = offset / resume_identity.block_size;
+    if ((*block != 0u) || (size < (OTA_RESUME_IMAGE_VERSION_OFFSET + sizeof(resume_identity.version))))
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    memcpy(&magic, chunk_info->buffer, sizeof(magic));
+    if (magic != OTA_RESUME_IMAGE_MAGIC)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+    version = &chunk_info->buffer[OTA_RESUME_IMAGE_VERSION_OFFSET];
+    if (!resume_version_known)
+    {
+        memcpy(resume_identity.version, version, sizeof(resume_identity.version));
+        resume_version_known = true;
+        resume_identity_saved = false;
+    }
+    else if (memcmp(resume_identity.version, version, sizeof(resume_identity.version)) != 0)
+    {
+        return resume_stop_tracking("the image version changed");
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: ota_resume_init
+ *******************************************************************************
+ * Summary:
+ *  Sets up the resumable download. Called once from the task that runs
+ *  ota_resume_request_loop(), before the OTA agent is started.
+ *
+ * Parameters:
+ *  topic            : MQTT topic the Publisher listens to for chunk requests
+ *  checkpoint_bytes : Bytes received between two checkpoints in the KV store
+ *  all_downloads    : Request the chunks of every download, not only of the
+ *                     resumed ones
+ *  write            : Storage write the chunks are passed on to
+ *
+ *******************************************************************************/
+void ota_resume_init(const char *topic, uint32_t checkpoint_bytes, bool all_downloads,
+        ota_resume_write_t write)
+{
+    request_topic = topic;
+    resume_checkpoint_bytes = checkpoint_bytes;
+    request_all = all_downloads;
+    resume_next_write = write;
+    request_mutex = xSemaphoreCreateMutexStatic(&request_mutex_buffer);
+    CY_ASSERT(request_mutex != NULL);
+    request_task = xTaskGetCurrentTaskHandle();
+
+    /* Storage write times are measured with the cycle counter */
+    ota_cycles_enable();
+
+    ota_resume_reset();
+}
+
+/*******************************************************************************
+ * Function Name: ota_resume_reset
+ *******************************************************************************
+ * Summary:
+ *  Forgets the state of the previous session, called when a new update
+ *  session starts. The records in the KV store are kept.
+ *
+ *******************************************************************************/
+void ota_resume_reset(void)
+{
+    taskENTER_CRITICAL();
+    memset(&resume_stats, 0, sizeof(resume_stats));
+    memset(&resume_identity, 0, sizeof(resume_identity));
+    memset(&resume_checkpoint, 0, sizeof(resume_checkpoint));
+    memset(resume_bitmap, 0, sizeof(resume_bitmap));
+    taskEXIT_CRITICAL();
+
+    resume_state = RESUME_STATE_IDLE;
+    resume_version_known = false;
+    resume_identity_saved = false;
+    resume_unsaved_bytes = 0;
+    resume_credit = 0;
+    resume_credited = false;
+    resume_requesting = false;
+}
+
+/*******************************************************************************
+ * Function Name: resume_keep_storage
+ *******************************************************************************
+ * Summary:
+ *  Checks the kept data against the checkpoint and makes the rest of the
+ *  image writable again. The blocks received after the checkpoint were
+ *  programmed, possibly out of order and after the last bitmap was saved, and
+ *  they are all fetched again: the image is erased from the start of the erase
+ *  sector holding the first of them to its end. When that sector also holds
+ *  checked data, the checkpoint is cut back to the sector start and saved
+ *  before the erase.
+ *
+ * Return:
+ *  true if data is kept and the storage past it is erased
+ *
+ *******************************************************************************/
+static bool resume_keep_storage(cy_ota_storage_context_t *storage_ptr)
+{
+    const struct flash_area *fap = NULL;
+    cy_ota_mem_type_t mem_type;
+    uint32_t slot_addr;
+    uint32_t erase_size;
+    uint32_t verified = resume_checkpoint.verified_bytes;
+    uint32_t keep = verified;
+    uint32_t keep_crc;
+    uint32_t crc = 0;
+    uint32_t block;
+
+    if (flash_area_open(FLASH_AREA_IMAGE_SECONDARY(0), &fap) != 0)
+    {
+        return false;
+    }
+    slot_addr = fap->fa_off;
+    mem_type = (fap->fa_device_id == FLASH_DEVICE_INTERNAL_FLASH) ?
+            CY_OTA_MEM_TYPE_INTERNAL_FLASH : CY_OTA_MEM_TYPE_EXTERNAL_FLASH;
+    flash_area_close(fap);
+
+    if (keep < resume_identity.total_size)
+    {
+        erase_size = (uint32_t)cy_ota_mem_get_erase_size(mem_type, slot_addr + keep);
+        if (erase_size == 0u)
+        {
+            return false;
+        }
+        keep -= (slot_addr + keep) % erase_size;
+        keep -= keep % resume_identity.block_size;
+        if (((slot_addr + keep) % erase_size) != 0u)
+        {
+            return false;
+        }
+    }
+
+    /* Block 0 is kept, it is compared when it is fetched again */
+    if ((keep == 0u) || !resume_crc_storage(storage_ptr, 0u, keep, &crc))
+    {
+        return false;
+    }
+    keep_crc = crc;
+    if (!resume_crc_storage(storage_ptr, keep, verified - keep, &crc) || (crc != resume_checkpoint.crc))
+    {
+        return false;
+    }
+
+    if (keep < verified)
+    {
+        resume_checkpoint.verified_bytes = keep;
+        resume_checkpoint.crc = keep_crc;
+        taskENTER_CRITICAL();
+        for (block = keep / resume_identity.block_size; block < resume_stats.blocks; block++)
+        {
+            resume_bit_clear(block);
+        }
+        resume_stats.verified_bytes = keep;
+        taskEXIT_CRITICAL();
+        resume_save();
+    }
+
+    /* The checkpoint must be in the flash before the data past it is erased */
+    if (ota_kv_sync() != CY_RSLT_SUCCESS)
+    {
+        return false;
+    }
+
+    if ((keep < resume_identity.total_size) &&
+        (cy_ota_mem_erase(mem_type, slot_addr + keep, resume_identity.total_size - keep) != CY_RSLT_SUCCESS))
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: ota_resume_storage_open
+ *******************************************************************************
+ * Summary:
+ *  OTA storage open callback. With the records of an earlier download, the
+ *  storage is opened without erasing it, the kept data is checked against
+ *  the checkpoint and the storage past it is erased, see
+ *  resume_keep_storage(); if it does not match, or there are no records, the
+ *  storage is opened (and erased) as usual.
+ *
+ *******************************************************************************/
+cy_rslt_t ota_resume_storage_open(cy_ota_storage_context_t *storage_ptr)
+{
+    cy_rslt_t result;
+    uint32_t block;
+
+    if ((resume_state != RESUME_STATE_LOADED) && resume_load())
+    {
+        resume_state = RESUME_STATE_LOADED;
+    }
+
+    if (resume_state == RESUME_STATE_LOADED)
+    {
+        cy_ota_mem_erase_hold(true);
+        result = cy_ota_storage_open(storage_ptr);
+        cy_ota_mem_erase_hold(false);
+
+        if ((result == CY_RSLT_SUCCESS) && resume_keep_storage(storage_ptr))
+        {
+            /* Block 0 is fetched again, its header confirms the image version */
+            taskENTER_CRITICAL();
+            resume_bit_clear(0u);
+            resume_credit = 0;
+            resume_stats.blocks_received = 0;
+            for (block = 0; block < resume_stats.blocks; block++)
+            {
+                if (resume_bit_get(block))
+                {
+                    resume_stats.blocks_received++;
+                    resume_credit += resume_block_bytes(block);
+                }
+            }
+            resume_stats.resumed_bytes = resume_credit;
+            resume_stats.resumed = true;
+            taskEXIT_CRITICAL();
+
+            resume_state = RESUME_STATE_TRACKING;
+            OTA_PRINTF("Resuming the download: %u of %u bytes kept\n",
+                    (unsigned int)resume_credit, (unsigned int)resume_identity.total_size);
+            return CY_RSLT_SUCCESS;
+        }
+
+        if (result == CY_RSLT_SUCCESS)
+        {
+            (void)cy_ota_storage_close(storage_ptr);
+        }
+        OTA_PRINTF("Resume: the kept data does not match its checkpoint\n");
+    }
+
+    /* New download, the geometry is set by the first chunk unless the
+     * chunks are already requested from the records.
+     */
+    resume_discard();
+    if (!resume_requesting)
+    {
+        taskENTER_CRITICAL();
+        memset(&resume_identity, 0, sizeof(resume_identity));
+        taskEXIT_CRITICAL();
+    }
+    resume_state = RESUME_STATE_TRACKING;
+
+    return cy_ota_storage_open(storage_ptr);
+}
+
+/*******************************************************************************
+ * Function Name: resume_request_done
+ *******************************************************************************
+ * Summary:
+ *  Frees the request slot of a received block and takes the round trip and
+ *  storage write samples, as TCP does (RFC 6298). Called in a critical
+ *  section.
+ *
+ * Return:
+ *  true if the block was requested, the request loop can send another one
+ *
+ *******************************************************************************/
+static bool resume_request_done(uint32_t block, uint32_t write_us)
+{
+    ota_resume_request_t *slot = NULL;
+    uint32_t rtt_ms;
+    uint32_t delta_ms;
+    uint32_t i;
+
+    for (i = 0; i < OTA_RESUME_WINDOW_MAX; i++)
+    {
+        if (request_slots[i].block == block)
+        {
+            slot = &request_slots[i];
+            break;
+        }
+    }
+    if (slot == NULL)
+    {
+        return false;
+    }
+
+    if (write_us != 0u)
+    {
+        request_write_us = (request_write_us == 0u) ? write_us : (((7u * request_write_us) + write_us) / 8u);
+    }
+    if (!slot->resent)
+    {
+        rtt_ms = resume_now_ms() - slot->sent_ms;
+        if (request_srtt_ms == 0u)
+        {
+            request_srtt_ms = (rtt_ms != 0u) ? rtt_ms : 1u;
+            request_rttvar_ms = rtt_ms / 2u;
+        }
+        else
+        {
+            delta_ms = (rtt_ms > request_srtt_ms) ? (rtt_ms - request_srtt_ms) : (request_srtt_ms - rtt_ms);
+            request_rttvar_ms = ((3u * request_rttvar_ms) + delta_ms) / 4u;
+            request_srtt_ms = ((7u * request_srtt_ms) + rtt_ms) / 8u;
+        }
+        resume_stats.rtt_ms = request_srtt_ms;
+    }
+
+    slot->block = OTA_RESUME_NO_BLOCK;
+    request_in_flight--;
+    if ((++request_received >= request_cap) && (request_cap < OTA_RESUME_WINDOW_MAX))
+    {
+        request_cap++;
+        request_received = 0;
+    }
+
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: ota_resume_storage_write
+ *******************************************************************************
+ * Summary:
+ *  OTA storage write callback. The chunks are written at their image offset
+ *  in whatever order they arrive. Passes a new chunk on, marks its block as
+ *  received, extends the checkpoint and writes it to the KV store every
+ *  checkpoint_bytes and at the end of the download. A chunk whose block was
+ *  already received (a redelivered or re-requested message) is dropped. The
+ *  block 0 of a resumed download is already in the storage: it is compared
+ *  instead of programmed over itself.
+ *
+ *******************************************************************************/
+cy_rslt_t ota_resume_storage_write(cy_ota_storage_context_t *storage_ptr,
+        cy_ota_storage_write_info_t *chunk_info)
+{
+    uint32_t block = OTA_RESUME_NO_BLOCK;
+    uint32_t start;
+    uint32_t write_us;
+    bool notify;
+    cy_rslt_t result;
+
+    if (resume_state == RESUME_STATE_TRACKING)
+    {
+        result = resume_check_chunk(chunk_info, &block);
+        if (result != CY_RSLT_SUCCESS)
+        {
+            return result;
+        }
+    }
+
+    if ((block != OTA_RESUME_NO_BLOCK) && (resume_state == RESUME_STATE_TRACKING) && resume_bit_get(block))
+    {
+        /* Not counted again by the agent, see ota_resume_take_credit() */
+        taskENTER_CRITICAL();
+        resume_stats.duplicates++;
+        taskEXIT_CRITICAL();
+        chunk_info->size = 0;
+        return CY_RSLT_SUCCESS;
+    }
+
+    if ((block != OTA_RESUME_NO_BLOCK) && (resume_state == RESUME_STATE_TRACKING) &&
+        ((block * resume_identity.block_size) < resume_checkpoint.verified_bytes))
+    {
+        if (!resume_block_matches(storage_ptr, chunk_info))
+        {
+            return resume_stop_tracking("block 0 does not match the kept data");
+        }
+        result = CY_RSLT_SUCCESS;
+        write_us = 0;
+    }
+    else
+    {
+        start = DWT->CYCCNT;
+        result = resume_next_write(storage_ptr, chunk_info);
+        write_us = ota_cycles_to_us(DWT->CYCCNT - start);
+    }
+    if ((result != CY_RSLT_SUCCESS) || (block == OTA_RESUME_NO_BLOCK) ||
+        (resume_state != RESUME_STATE_TRACKING))
+    {
+        return result;
+    }
+
+    taskENTER_CRITICAL();
+    resume_bit_set(block);
+    resume_stats.blocks_received++;
+    if (block > (resume_checkpoint.verified_bytes / resume_identity.block_size))
+    {
+        resume_stats.out_of_order++;
+    }
+    notify = resume_request_done(block, write_us);
+    taskEXIT_CRITICAL();
+
+    /* Ask for the next blocks before the checkpoint is written */
+    if (notify && (request_task != NULL))
+    {
+        xTaskNotifyGive(request_task);
+    }
+
+    resume_unsaved_bytes += (uint32_t)chunk_info->size;
+    resume_extend_checkpoint(storage_ptr, block, chunk_info->buffer);
+    if ((resume_unsaved_bytes >= resume_checkpoint_bytes) ||
+        ((resume_unsaved_bytes != 0u) && (resume_stats.blocks_received == resume_stats.blocks)))
+    {
+        resume_save();
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: ota_resume_take_credit
+ *******************************************************************************
+ * Summary:
+ *  Returns the bytes kept by a resumed download, once. See ota_resume.h.
+ *
+ *******************************************************************************/
+uint32_t ota_resume_take_credit(void)
+{
+    if ((resume_state != RESUME_STATE_TRACKING) || !resume_requesting || resume_credited)
+    {
+        return 0u;
+    }
+    resume_credited = true;
+    return resume_credit;
+}
+
+/*******************************************************************************
+ * Function Name: ota_resume_storage_verify
+ *******************************************************************************
+ * Summary:
+ *  OTA storage verify callback. Once the image is verified, complete or not,
+ *  there is nothing left to resume.
+ *
+ *******************************************************************************/
+cy_rslt_t ota_resume_storage_verify(cy_ota_storage_context_t *storage_ptr)
+{
+    cy_rslt_t result = cy_ota_storage_verify(storage_ptr);
+
+    resume_delete_records();
+    resume_state = RESUME_STATE_OFF;
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: ota_resume_start_requests
+ *******************************************************************************
+ * Summary:
+ *  Called when the agent is about to ask for the image. If an earlier download
+ *  can be resumed, or all_downloads was set, the chunks are requested on the
+ *  agent's connection instead, several at a time.
+ *
+ * Return:
+ *  true if the chunks are requested, the agent must not send its own request
+ *
+ *******************************************************************************/
+bool ota_resume_start_requests(cy_mqtt_t mqtt_handle, const char *unique_topic)
+{
+    uint32_t i;
+
+    if ((request_mutex == NULL) || (unique_topic == NULL) ||
+        (strlen(unique_topic) >= sizeof(request_unique_topic)))
+    {
+        return false;
+    }
+
+    if ((resume_state == RESUME_STATE_IDLE) && resume_load())
+    {
+        resume_state = RESUME_STATE_LOADED;
+    }
+    if ((resume_state != RESUME_STATE_LOADED) &&
+        !((resume_state == RESUME_STATE_TRACKING) && resume_stats.resumed && !resume_credited) &&
+        !(request_all && ((resume_state == RESUME_STATE_IDLE) ||
+                          ((resume_state == RESUME_STATE_TRACKING) && (resume_stats.blocks_received == 0u)))))
+    {
+        return false;
+    }
+
+    resume_requesting = true;
+
+    (void)xSemaphoreTake(request_mutex, portMAX_DELAY);
+    strcpy(request_unique_topic, unique_topic);
+    request_connection = mqtt_handle;
+    (void)xSemaphoreGive(request_mutex);
+
+    taskENTER_CRITICAL();
+    for (i = 0; i < OTA_RESUME_WINDOW_MAX; i++)
+    {
+        request_slots[i].block = OTA_RESUME_NO_BLOCK;
+    }
+    request_in_flight = 0;
+    request_cursor = 0;
+    request_cap = (OTA_RESUME_WINDOW_MAX < 2u) ? OTA_RESUME_WINDOW_MAX : 2u;
+    request_received = 0;
+    request_srtt_ms = 0;
+    request_rttvar_ms = 0;
+    taskEXIT_CRITICAL();
+
+    if (request_task != NULL)
+    {
+        xTaskNotifyGive(request_task);
+    }
+
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: ota_resume_stop_requests
+ *******************************************************************************
+ * Summary:
+ *  Stops the chunk requests. Waits for a publish in progress, so the agent
+ *  can close the connection afterwards.
+ *
+ *******************************************************************************/
+void ota_resume_stop_requests(void)
+{
+    if (request_mutex == NULL)
+    {
+        return;
+    }
+
+    (void)xSemaphoreTake(request_mutex, portMAX_DELAY);
+    request_connection = NULL;
+    (void)xSemaphoreGive(request_mutex);
+}
+
+/*******************************************************************************
+ * Function Name: resume_request_window
+ *******************************************************************************
+ * Summary:
+ *  Requests to keep in flight: enough to cover a round trip at the rate the
+ *  storage writes the chunks, limited by request_cap. Called in a critical
+ *  section.
+ *
+ *******************************************************************************/
+static uint32_t resume_request_window(void)
+{
+    uint32_t window = OTA_RESUME_WINDOW_MAX;
+
+    if ((request_srtt_ms != 0u) && (request_write_us != 0u))
+    {
+        window = ((request_srtt_ms * 1000u) / request_write_us) + 1u;
+    }
+    if (window > request_cap)
+    {
+        window = request_cap;
+    }
+
+    /* Only block 0 until its chunk gives the geometry of a new download */
+    if (resume_identity.block_size == 0u)
+    {
+        window = 1u;
+    }
+    return (window != 0u) ? window : 1u;
+}
+
+/*******************************************************************************
+ * Function Name: resume_request_timeout_ms
+ *******************************************************************************
+ * Summary:
+ *  Retransmission timeout, srtt + 4 * rttvar, within
+ *  OTA_RESUME_REQUEST_MIN_TIMEOUT_MS and OTA_RESUME_REQUEST_TIMEOUT_MS.
+ *
+ *******************************************************************************/
+static uint32_t resume_request_timeout_ms(void)
+{
+    uint32_t timeout_ms = OTA_RESUME_REQUEST_TIMEOUT_MS;
+
+    if (request_srtt_ms != 0u)
+    {
+        timeout_ms = request_srtt_ms + (4u * request_rttvar_ms);
+        if (timeout_ms < OTA_RESUME_REQUEST_MIN_TIMEOUT_MS)
+        {
+            timeout_ms = OTA_RESUME_REQUEST_MIN_TIMEOUT_MS;
+        }
+        if (timeout_ms > OTA_RESUME_REQUEST_TIMEOUT_MS)
+        {
+            timeout_ms = OTA_RESUME_REQUEST_TIMEOUT_MS;
+        }
+    }
+    return timeout_ms;
+}
+
+/*******************************************************************************
+ * Function Name: resume_request_next
+ *******************************************************************************
+ * Summary:
+ *  Takes a free slot for the next block that is neither received nor
+ *  requested, if the window allows one more request. Called in a critical
+ *  section.
+ *
+ * Return:
+ *  The block, OTA_RESUME_NO_BLOCK if there is nothing to request
+ *
+ *******************************************************************************/
+static uint32_t resume_request_next(uint32_t now_ms)
+{
+    uint32_t block;
+    uint32_t i;
+
+    if (request_in_flight >= resume_request_window())
+    {
+        return OTA_RESUME_NO_BLOCK;
+    }
+
+    if (resume_identity.block_size == 0u)
+    {
+        block = (request_cursor == 0u) ? 0u : OTA_RESUME_NO_BLOCK;
+    }
+    else
+    {
+        for (block = request_cursor; (block < resume_stats.blocks) && resume_bit_get(block); block++)
+        {
+        }
+        if (block >= resume_stats.blocks)
+        {
+            return OTA_RESUME_NO_BLOCK;
+        }
+    }
+    if (block == OTA_RESUME_NO_BLOCK)
+    {
+        return OTA_RESUME_NO_BLOCK;
+    }
+
+    for (i = 0; i < OTA_RESUME_WINDOW_MAX; i++)
+    {
+        if (request_slots[i].block == OTA_RESUME_NO_BLOCK)
+        {
+            request_slots[i].block = block;
+            request_slots[i].sent_ms = now_ms;
+            request_slots[i].resent = false;
+            request_in_flight++;
+            request_cursor = block + 1u;
+            return block;
+        }
+    }
+    return OTA_RESUME_NO_BLOCK;
+}
+
+/*******************************************************************************
+ * Function Name: resume_send_request
+ *******************************************************************************
+ * Summary:
+ *  Asks the Publisher for one block, QoS 0 so that the publish never waits on
+ *  the MQTT receive thread delivering the chunks. Called with the request
+ *  mutex taken.
+ *
+ *******************************************************************************/
+static void resume_send_request(uint32_t block)
+{
+    cy_mqtt_publish_info_t publish_info;
+    uint32_t offset;
+    uint32_t size;
+    size_t len;
+
+    taskENTER_CRITICAL();
+    if (resume_identity.block_size == 0u)
+    {
+        offset = 0u;
+        size = ota_chunk_size_preferred();
+    }
+    else
+    {
+        /* A whole block also for the last one, the Publisher numbers the
+         * chunks by Offset / Size and stops at the end of the image.
+         */
+        offset = block * resume_identity.block_size;
+        size = resume_identity.block_size;
+    }
+    resume_stats.requests++;
+    taskEXIT_CRITICAL();
+
+    len = (size_t)snprintf(request_payload, sizeof(request_payload), OTA_RESUME_CHUNK_REQUEST,
+            (unsigned int)offset, (unsigned int)size, request_unique_topic);
+    if (len >= sizeof(request_payload))
+    {
+        OTA_PRINTF("Resume: request does not fit in %u bytes\n", (unsigned int)sizeof(request_payload));
+        return;
+    }
+
+    memset(&publish_info, 0, sizeof(publish_info));
+    publish_info.qos = CY_MQTT_QOS0;
+    publish_info.topic = request_topic;
+    publish_info.topic_len = (uint16_t)strlen(request_topic);
+    publish_info.payload = request_payload;
+    publish_info.payload_len = len;
+
+    if (cy_mqtt_publish(request_connection, &publish_info) != CY_RSLT_SUCCESS)
+    {
+        OTA_PRINTF("Resume: request of the chunk at %u failed\n", (unsigned int)offset);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: ota_resume_request_loop
+ *******************************************************************************
+ * Summary:
+ *  Keeps the window of chunk requests full while ota_resume_start_requests()
+ *  is in effect. A request that is not answered within the retransmission
+ *  timeout is sent again on its own, and the window is halved; the other
+ *  requests in flight are not repeated. Runs in the task that called
+ *  ota_resume_init() and does not return.
+ *
+ *******************************************************************************/
+void ota_resume_request_loop(void)
+{
+    TickType_t wait = portMAX_DELAY;
+    uint32_t now_ms;
+    uint32_t timeout_ms;
+    uint32_t next_ms;
+    uint32_t block;
+    bool timed_out;
+    uint32_t i;
+
+    while (true)
+    {
+        (void)ulTaskNotifyTake(pdTRUE, wait);
+
+        (void)xSemaphoreTake(request_mutex, portMAX_DELAY);
+        if (request_connection == NULL)
+        {
+            (void)xSemaphoreGive(request_mutex);
+            wait = portMAX_DELAY;
+            continue;
+        }
+
+        /* Selective repeat of the requests that timed out */
+        now_ms = resume_now_ms();
+        timed_out = false;
+        for (i = 0; i < OTA_RESUME_WINDOW_MAX; i++)
+        {
+            block = OTA_RESUME_NO_BLOCK;
+            taskENTER_CRITICAL();
+            timeout_ms = resume_request_timeout_ms();
+            if ((request_slots[i].block != OTA_RESUME_NO_BLOCK) &&
+                ((now_ms - request_slots[i].sent_ms) >= timeout_ms))
+            {
+                block = request_slots[i].block;
+                request_slots[i].sent_ms = now_ms;
+                request_slots[i].resent = true;
+                resume_stats.request_timeouts++;
+                timed_out = true;
+            }
+            taskEXIT_CRITICAL();
+
+            if (block != OTA_RESUME_NO_BLOCK)
+            {
+                resume_send_request(block);
+            }
+        }
+        if (timed_out)
+        {
+            taskENTER_CRITICAL();
+            request_cap = (request_cap > 1u) ? (request_cap / 2u) : 1u;
+            request_received = 0;
+            taskEXIT_CRITICAL();
+        }
+
+        /* Fill the window */
+        while (true)
+        {
+            taskENTER_CRITICAL();
+            block = resume_request_next(now_ms);
+            taskEXIT_CRITICAL();
+            if (block == OTA_RESUME_NO_BLOCK)
+            {
+                break;
+            }
+            resume_send_request(block);
+        }
+
+        /* Sleep until the first request times out or a chunk arrives */
+        next_ms = OTA_RESUME_NO_BLOCK;
+        taskENTER_CRITICAL();
+        timeout_ms = resume_request_timeout_ms();
+        for (i = 0; i < OTA_RESUME_WINDOW_MAX; i++)
+        {
+            if ((request_slots[i].block != OTA_RESUME_NO_BLOCK) &&
+                ((request_slots[i].sent_ms + timeout_ms - now_ms) < next_ms))
+            {
+                next_ms = request_slots[i].sent_ms + timeout_ms - now_ms;
+            }
+        }
+        resume_stats.window = resume_request_window();
+        taskEXIT_CRITICAL();
+        wait = (next_ms != OTA_RESUME_NO_BLOCK) ? pdMS_TO_TICKS(next_ms + 1u) : portMAX_DELAY;
+
+        (void)xSemaphoreGive(request_mutex);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: ota_resume_get_stats
+ *******************************************************************************/
+void ota_resume_get_stats(ota_resume_stats_t *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = resume_stats;
+    taskEXIT_CRITICAL();
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,128 @@
+/******************************************************************************
+* File Name: ota_resume.h
+*
+* Description: This file contains the declarations of the resumable OTA
+* download.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef SOURCE_OTA_RESUME_H_
+#define SOURCE_OTA_RESUME_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cy_result.h"
+#include "cy_mqtt_api.h"
+#include "cy_ota_api.h"
+#include "cy_ota_storage_api.h"
+#include "ota_kv_store.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Blocks tracked by the received bitmap, one bit per block in one KV record */
+#define OTA_RESUME_MAX_BLOCKS               (OTA_KV_MAX_VALUE_SIZE * 8u)
+
+/* Chunk requests kept in flight at most */
+#ifndef OTA_RESUME_WINDOW_MAX
+#define OTA_RESUME_WINDOW_MAX               (8u)
+#endif
+
+/* Bounds of the time a requested block may take to arrive before it is
+ * requested again. The timeout follows the measured round trip, it is the
+ * upper bound until the first round trip is measured.
+ */
+#ifndef OTA_RESUME_REQUEST_TIMEOUT_MS
+#define OTA_RESUME_REQUEST_TIMEOUT_MS       (10000u)
+#endif
+#ifndef OTA_RESUME_REQUEST_MIN_TIMEOUT_MS
+#define OTA_RESUME_REQUEST_MIN_TIMEOUT_MS   (500u)
+#endif
+
+/* The chunks do not match the image the kept data belongs to */
+#define OTA_RESUME_RSLT_IMAGE_CHANGED       (CY_RSLT_CREATE(CY_RSLT_TYPE_ERROR, CY_RSLT_MODULE_MIDDLEWARE_BASE, 0x10u))
+
+/*******************************************************************************
+* Data structure and enumeration
+********************************************************************************/
+/* Storage write the resume layer hands the chunks to */
+typedef cy_rslt_t (*ota_resume_write_t)(cy_ota_storage_context_t *storage_ptr,
+        cy_ota_storage_write_info_t *chunk_info);
+
+typedef struct
+{
+    uint32_t    total_size;         /* Size of the OTA image */
+    uint32_t    block_size;         /* Size of the chunks tracked by the bitmap */
+    uint32_t    blocks;
+    uint32_t    blocks_received;
+    uint32_t    out_of_order;       /* Blocks received past a missing one */
+    uint32_t    duplicates;         /* Chunks of blocks already received, dropped */
+    uint32_t    resumed_bytes;      /* Bytes kept from an earlier session */
+    uint32_t    verified_bytes;     /* Contiguous bytes covered by the hash checkpoint */
+    uint32_t    checkpoints;        /* Checkpoints written to the KV store */
+    uint32_t    requests;           /* Chunk requests sent */
+    uint32_t    request_timeouts;   /* Chunk requests sent again */
+    uint32_t    window;             /* Chunk requests allowed in flight */
+    uint32_t    rtt_ms;             /* Smoothed request round trip */
+    bool        resumed;            /* The session continued an earlier download */
+} ota_resume_stats_t;
+
+/*******************************************************************************
+* Function prototype
+********************************************************************************/
+void ota_resume_init(const char *topic, uint32_t checkpoint_bytes, bool all_downloads,
+        ota_resume_write_t write);
+void ota_resume_reset(void);
+
+cy_rslt_t ota_resume_storage_open(cy_ota_storage_context_t *storage_ptr);
+cy_rslt_t ota_resume_storage_write(cy_ota_storage_context_t *storage_ptr,
+        cy_ota_storage_write_info_t *chunk_info);
+cy_rslt_t ota_resume_storage_verify(cy_ota_storage_context_t *storage_ptr);
+
+/* The OTA agent adds chunk_info->size to the bytes downloaded after each
+ * storage write and ends the download at the image size, so the bytes kept
+ * by a resumed download must be counted once. The stages of the storage chain
+ * pass chunk_info->size unchanged (0 for a dropped chunk); the storage write
+ * callback given to the agent adds ota_resume_take_credit() to it after the
+ * chain returned success, just before it returns to the agent.
+ */
+uint32_t ota_resume_take_credit(void);
+
+bool ota_resume_start_requests(cy_mqtt_t mqtt_handle, const char *unique_topic);
+void ota_resume_stop_requests(void);
+void ota_resume_request_loop(void);
+
+void ota_resume_get_stats(ota_resume_stats_t *stats);
+
+#endif /* SOURCE_OTA_RESUME_H_ */
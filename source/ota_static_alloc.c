@@ -0,0 +1,174 @@
+/******************************************************************************
+* File Name: ota_static_alloc.c
+*
+* Description: This file contains the static allocation build mode. With
+* OTA_STATIC_ALLOCATION the application tasks, the flash queue, the encryption
+* write buffer and mbedtls take their memory from buffers sized at compile
+* time, so that their RAM is in the linker map instead of the heap. The heap
+* in use is sampled on every OTA callback, so that the summary of an update
+* shows what the libraries still allocate from the heap.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+
+/*******************************************************************************
+ * Header file includes
+ ******************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include "ota_static_alloc.h"
+
+#ifdef OTA_STATIC_ALLOCATION
+/* Pulls in mbedtls_user_config.h, which defines OTA_MBEDTLS_STATIC_ARENA */
+#include "mbedtls/memory_buffer_alloc.h"
+#endif
+
+/* ARM compiler also defines __GNUC__ */
+#if defined (__GNUC__) && !defined(__ARMCC_VERSION)
+#include <malloc.h>
+#define OTA_STATIC_ALLOC_HEAP_MEASURED      (1)
+#endif /* #if defined (__GNUC__) && !defined(__ARMCC_VERSION) */
+
+/* FreeRTOS header file */
+#include <FreeRTOS.h>
+#include <task.h>
+
+/*******************************************************************************
+ * Global Variables
+ ******************************************************************************/
+static ota_static_alloc_stats_t static_alloc_stats;
+
+#ifdef OTA_MBEDTLS_STATIC_ARENA
+static unsigned char            static_alloc_tls_arena[OTA_MBEDTLS_ARENA_SIZE];
+#endif
+
+/*******************************************************************************
+ * Function Name: static_alloc_heap_in_use
+ *******************************************************************************
+ * Summary:
+ *  Returns the heap allocated at this point, 0 if it cannot be told with this
+ *  toolchain.
+ *
+ *******************************************************************************/
+static uint32_t static_alloc_heap_in_use(void)
+{
+#ifdef OTA_STATIC_ALLOC_HEAP_MEASURED
+    struct mallinfo mall_info = mallinfo();
+
+    return (uint32_t)mall_info.uordblks;
+#else
+    return 0u;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: ota_static_alloc_init
+ *******************************************************************************
+ * Summary:
+ *  Hands the static mbedtls buffer to mbedtls. Must be called before the
+ *  network stack and MQTT are initialized.
+ *
+ *  The buffer allocator is not thread safe without MBEDTLS_THREADING_C, it
+ *  relies on the handshakes of the MQTT connection being made by one task at
+ *  a time; the record layer does not allocate once the session is up.
+ *
+ *******************************************************************************/
+void ota_static_alloc_init(void)
+{
+    memset(&static_alloc_stats, 0, sizeof(static_alloc_stats));
+
+#ifdef OTA_STATIC_ALLOCATION
+    static_alloc_stats.static_alloc = true;
+#endif
+#ifdef OTA_STATIC_ALLOC_HEAP_MEASURED
+    static_alloc_stats.measured = true;
+#endif
+#ifdef OTA_MBEDTLS_STATIC_ARENA
+    mbedtls_memory_buffer_alloc_init(static_alloc_tls_arena, sizeof(static_alloc_tls_arena));
+    static_alloc_stats.tls_arena_size = sizeof(static_alloc_tls_arena);
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: ota_static_alloc_reset
+ *******************************************************************************
+ * Summary:
+ *  Takes the heap in use at the start of an update as the reference of the
+ *  following samples.
+ *
+ *******************************************************************************/
+void ota_static_alloc_reset(void)
+{
+    uint32_t heap_in_use = static_alloc_heap_in_use();
+
+    taskENTER_CRITICAL();
+    static_alloc_stats.heap_at_start = heap_in_use;
+    static_alloc_stats.heap_growth = 0u;
+    static_alloc_stats.heap_peak_growth = 0u;
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+ * Function Name: ota_static_alloc_sample
+ *******************************************************************************
+ * Summary:
+ *  Samples the heap in use, called on every OTA callback. A static build
+ *  should show no growth from the start of the update to its end.
+ *
+ *******************************************************************************/
+void ota_static_alloc_sample(void)
+{
+    uint32_t heap_in_use = static_alloc_heap_in_use();
+
+    taskENTER_CRITICAL();
+    static_alloc_stats.heap_growth = (heap_in_use > static_alloc_stats.heap_at_start) ?
+            (heap_in_use - static_alloc_stats.heap_at_start) : 0u;
+    if (static_alloc_stats.heap_growth > static_alloc_stats.heap_peak_growth)
+    {
+        static_alloc_stats.heap_peak_growth = static_alloc_stats.heap_growth;
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+ * Function Name: ota_static_alloc_get_stats
+ *******************************************************************************/
+void ota_static_alloc_get_stats(ota_static_alloc_stats_t *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = static_alloc_stats;
+    taskEXIT_CRITICAL();
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,78 @@
+/******************************************************************************
+* File Name: ota_static_alloc.h
+*
+* Description: This file contains the declarations of the static allocation
+* build mode (STATIC_ALLOC=1) and of the heap use measured during an update.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef SOURCE_OTA_STATIC_ALLOC_H_
+#define SOURCE_OTA_STATIC_ALLOC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Static buffer that replaces the heap of mbedtls in OTA_STATIC_ALLOCATION
+ * builds. It holds the TLS contexts, the record buffers and the certificates
+ * parsed during the handshake of the MQTT connection.
+ */
+#ifndef OTA_MBEDTLS_ARENA_SIZE
+#define OTA_MBEDTLS_ARENA_SIZE              (48u * 1024u)
+#endif
+
+/*******************************************************************************
+* Data structure and enumeration
+********************************************************************************/
+typedef struct
+{
+    bool        static_alloc;       /* Built with OTA_STATIC_ALLOCATION */
+    bool        measured;           /* The heap use can be told with this toolchain */
+    uint32_t    tls_arena_size;     /* Static mbedtls buffer, 0 if mbedtls uses the heap */
+    uint32_t    heap_at_start;      /* Heap in use when the update started */
+    uint32_t    heap_growth;        /* Heap in use at the last sample above heap_at_start */
+    uint32_t    heap_peak_growth;   /* Largest growth sampled during the update */
+} ota_static_alloc_stats_t;
+
+/*******************************************************************************
+* Function prototype
+********************************************************************************/
+void ota_static_alloc_init(void);
+void ota_static_alloc_reset(void);
+void ota_static_alloc_sample(void);
+void ota_static_alloc_get_stats(ota_static_alloc_stats_t *stats);
+
+#endif /* SOURCE_OTA_STATIC_ALLOC_H_ */
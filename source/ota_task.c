@@ -47,12 +47,25 @@
 /* FreeRTOS */
 #include <FreeRTOS.h>
 #include <task.h>
+#include <event_groups.h>
 /* OTA app specific configuration */
 #include "ota_app_config.h"
 /* OTA API */
 #include "cy_ota_api.h"
 /* OTA storage api */
 #include "cy_ota_storage_api.h"
+/* OTA flash extensions */
+#include "cy_ota_flash_ext.h"
+/* OTA session state store */
+#include "ota_kv_store.h"
+#include "ota_log.h"
+#include "ota_log_token.h"
+#include "ota_telemetry.h"
+#include "ota_resume.h"
+#include "ota_chunk_size.h"
+#include "ota_decompress.h"
+#include "ota_delta.h"
+#include "ota_static_alloc.h"
 
 /*******************************************************************************
 * Macros
@@ -60,18 +73,95 @@
 /* MAX connection retries to join WI-FI AP */
 #define MAX_CONNECTION_RETRIES              (10)
 
-/* Wait between connection retries */
-#define WIFI_CONN_RETRY_DELAY_MS            (500)
+/* Wait before the first connection retry, doubled on every further retry */
+#define WIFI_CONN_RETRY_DELAY_MS            (500u)
+
+/* Upper bound of the wait between connection retries */
+#define WIFI_CONN_RETRY_MAX_DELAY_MS        (8000u)
+
+/* Time the Wi-Fi connect waits for BRINGUP_KV_READY when the cached AP is not
+ * in retained RAM (power-on reset), before falling back to a full scan.
+ */
+#define WIFI_CACHE_LOAD_WAIT_MS             (300)
+
+/* Marks a valid Wi-Fi cache */
+#define WIFI_CACHE_MAGIC                    (0x57494649UL)
+
+/* MQTT session kept by the broker across reconnects or not */
+#if (OTA_MQTT_PERSISTENT_SESSION == 1)
+#define OTA_MQTT_SESSION_TYPE               CY_OTA_MQTT_SESSION_PERSISTENT
+#else
+#define OTA_MQTT_SESSION_TYPE               CY_OTA_MQTT_SESSION_CLEAN
+#endif
+
+/* OTA_MQTT_ID_PREFIX, 12 hex digits of the MAC address and the terminator */
+#define OTA_MQTT_ID_SIZE                    (sizeof(OTA_MQTT_ID_PREFIX) + 12)
+
+/* Time the callback waits for the logger task before a possible reboot */
+#define OTA_LOG_FLUSH_TIMEOUT_MS            (2000)
 
 /* Application ID */
 #define APP_ID                              (0)
 
+/* Storage bring-up task, runs while the Wi-Fi joins */
+#define STORAGE_INIT_TASK_STACK_SIZE        (1024 * 3)
+#define STORAGE_INIT_TASK_PRIORITY          (configMAX_PRIORITIES - 3)
+
+/* Bring-up event group bits, the OTA agent starts once all are set */
+#define BRINGUP_STORAGE_READY               (1u << 0)
+#define BRINGUP_NETWORK_READY               (1u << 1)
+
+/* Set as soon as the KV store is open, ahead of the image validation */
+#define BRINGUP_KV_READY                    (1u << 2)
+#define BRINGUP_ALL_READY                   (BRINGUP_STORAGE_READY | BRINGUP_NETWORK_READY)
+
+/*******************************************************************************
+* Data structure and enumeration
+********************************************************************************/
+/* Steps of the boot timeline */
+typedef enum
+{
+    BRINGUP_STORAGE_INIT,
+    BRINGUP_KV_INIT,
+    BRINGUP_IMAGE_VALIDATE,
+    BRINGUP_WIFI_CONNECT,
+    BRINGUP_NETWORK_INIT,
+    BRINGUP_MQTT_INIT,
+    BRINGUP_AGENT_START,
+    BRINGUP_STEPS
+} bringup_step_id_t;
+
+typedef struct
+{
+    const char  *name;
+    uint32_t    start_ms;       /* Since the scheduler started */
+    uint32_t    end_ms;
+} bringup_step_t;
+
+/* Last AP the device joined and the lease it got, kept in retained RAM and
+ * in the KV store so that the next connection can skip the full scan.
+ */
+typedef struct
+{
+    uint32_t                magic;
+    cy_wcm_ssid_t           ssid;
+    cy_wcm_mac_t            bssid;
+    uint8_t                 channel;
+    cy_wcm_security_t       security;
+    cy_wcm_ip_setting_t     lease;
+    uint32_t                crc;        /* Of all the fields above */
+} wifi_cache_t;
+
 /*******************************************************************************
 * Forward declaration
 ********************************************************************************/
 cy_rslt_t connect_to_wifi_ap(void);
 cy_ota_callback_results_t ota_callback(cy_ota_cb_struct_t *cb_data);
-void print_heap_usage(char *msg);
+static void storage_init_task(void *args);
+static cy_rslt_t ota_storage_write(cy_ota_storage_context_t *storage_ptr,
+        cy_ota_storage_write_info_t *chunk_info);
+static void wifi_cache_persist(void);
+static void mqtt_client_id_init(void);
 
 /*******************************************************************************
 * Global Variables
@@ -90,7 +180,7 @@ cy_ota_network_params_t ota_network_params =
             .port = MQTT_SERVER_PORT
         },
         .pTopicFilters = my_topics,
-        .session_type = CY_OTA_MQTT_SESSION_CLEAN,
+        .session_type = OTA_MQTT_SESSION_TYPE,
         .numTopicFilters = MQTT_TOPIC_FILTER_NUM,
         .pIdentifier = OTA_MQTT_ID,
     #if (ENABLE_TLS == true)
@@ -121,26 +211,121 @@ cy_ota_agent_params_t ota_agent_params =
     .cb_arg = &ota_context,
     .reboot_upon_completion = 1, /* Reboot after completing OTA with success. */
     .validate_after_reboot = 1,
-    .do_not_send_result = 1
+    .do_not_send_result = 0    /* The result carries the phase times of the session */
 };
 
+/* External flash arbiter client of the OTA agent task */
+cy_ota_mem_client_t ota_flash_client;
+
+/* Bring-up join point and boot timeline */
+static EventGroupHandle_t bringup_events;
+static StaticEventGroup_t bringup_events_buffer;
+static bringup_step_t bringup_steps[BRINGUP_STEPS] =
+{
+    [BRINGUP_STORAGE_INIT]      = { .name = "storage init" },
+    [BRINGUP_KV_INIT]           = { .name = "KV store init" },
+    [BRINGUP_IMAGE_VALIDATE]    = { .name = "image validate" },
+    [BRINGUP_WIFI_CONNECT]      = { .name = "Wi-Fi connect" },
+    [BRINGUP_NETWORK_INIT]      = { .name = "network init" },
+    [BRINGUP_MQTT_INIT]         = { .name = "MQTT init" },
+    [BRINGUP_AGENT_START]       = { .name = "OTA agent start" },
+};
+
+#ifdef OTA_STATIC_ALLOCATION
+/* Stack and control block of the storage bring-up task */
+static StackType_t  storage_init_task_stack[STORAGE_INIT_TASK_STACK_SIZE];
+static StaticTask_t storage_init_task_tcb;
+#endif
+
+/* Wi-Fi cache, survives soft resets in .noinit. wifi_cache_dirty is set when
+ * it changed and has to be written to the KV store.
+ */
+static wifi_cache_t wifi_cache CY_NOINIT;
+static bool wifi_cache_dirty;
+
+/* State of the retry jitter generator */
+static uint32_t wifi_jitter_state;
+
+#if (OTA_MQTT_PERSISTENT_SESSION == 1)
+/* Stable client identifier of the persistent MQTT session */
+static char mqtt_client_id[OTA_MQTT_ID_SIZE];
+#endif
+
 /* OTA storage interface callbacks */
 cy_ota_storage_interface_t ota_interfaces =
 {
-   .ota_file_open            = cy_ota_storage_open,
+   .ota_file_open            = ota_resume_storage_open,
    .ota_file_read            = cy_ota_storage_read,
-   .ota_file_write           = cy_ota_storage_write,
+   .ota_file_write           = ota_storage_write,
    .ota_file_close           = cy_ota_storage_close,
-   .ota_file_verify          = cy_ota_storage_verify,
+   .ota_file_verify          = ota_resume_storage_verify,
    .ota_file_validate        = cy_ota_storage_image_validate,
    .ota_file_get_app_info    = cy_ota_storage_get_app_info
 };
 
+/*******************************************************************************
+ * Function Name: bringup_now_ms
+ *******************************************************************************/
+static uint32_t bringup_now_ms(void)
+{
+    return (uint32_t)xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+/*******************************************************************************
+ * Function Name: bringup_step_begin / bringup_step_end
+ *******************************************************************************
+ * Summary:
+ *  Record the start and end of a bring-up step for the boot timeline.
+ *
+ *******************************************************************************/
+static void bringup_step_begin(bringup_step_id_t step)
+{
+    bringup_steps[step].start_ms = bringup_now_ms();
+}
+
+static void bringup_step_end(bringup_step_id_t step)
+{
+    bringup_steps[step].end_ms = bringup_now_ms();
+}
+
+/*******************************************************************************
+ * Function Name: bringup_print_timeline
+ *******************************************************************************
+ * Summary:
+ *  Prints when each bring-up step ran, and compares the time to OTA ready
+ *  with the time the steps would take one after the other.
+ *
+ *******************************************************************************/
+static void bringup_print_timeline(void)
+{
+    uint32_t sequential_ms = 0;
+    uint32_t i;
+
+    OTA_PRINTF("\nBoot timeline (ms since scheduler start):\n");
+    for (i = 0; i < BRINGUP_STEPS; i++)
+    {
+        if (bringup_steps[i].end_ms == 0u)
+        {
+            continue;
+        }
+        OTA_PRINTF("  %-16s %6u .. %6u (%u ms)\n", bringup_steps[i].name,
+                (unsigned int)bringup_steps[i].start_ms, (unsigned int)bringup_steps[i].end_ms,
+                (unsigned int)(bringup_steps[i].end_ms - bringup_steps[i].start_ms));
+        sequential_ms += bringup_steps[i].end_ms - bringup_steps[i].start_ms;
+    }
+    OTA_PRINTF("OTA ready at %u ms, the steps add up to %u ms\n\n",
+            (unsigned int)bringup_steps[BRINGUP_AGENT_START].end_ms, (unsigned int)sequential_ms);
+}
+
 /*******************************************************************************
  * Function Name: ota_task
  *******************************************************************************
  * Summary:
- *  Task to initialize required libraries and start OTA agent.
+ *  Task to initialize required libraries and start OTA agent. The storage
+ *  steps run in storage_init_task() while this task joins the Wi-Fi network
+ *  and initializes the network stack and MQTT; the agent starts once both
+ *  sides are done. The task then sends the chunk requests of resumed
+ *  downloads.
  *
  * Parameters:
  *  void *args : Task parameter defined during task creation (unused)
@@ -151,59 +336,339 @@ cy_ota_storage_interface_t ota_interfaces =
  *******************************************************************************/
 void ota_task(void *args)
 {
-    /* initialize OTA storage */
-    if (CY_RSLT_SUCCESS != cy_ota_storage_init())
-    {
-        printf("\n Initializing ota storage failed.\n");
-        CY_ASSERT(0);
-    }
-
-#ifndef TEST_REVERT
-    /* Validate the update so we do not revert */
-    if(CY_RSLT_SUCCESS != cy_ota_storage_image_validate(APP_ID))
+    /* Before anything that may use mbedtls */
+    ota_static_alloc_init();
+
+    bringup_events = xEventGroupCreateStatic(&bringup_events_buffer);
+    CY_ASSERT(bringup_events != NULL);
+
+    ota_telemetry_init(OTA_TELEMETRY_TOPIC, OTA_MQTT_ID, OTA_TELEMETRY_PERIOD_MS);
+    ota_resume_init(OTA_CHUNK_REQUEST_TOPIC, OTA_RESUME_CHECKPOINT_BYTES, (OTA_CHUNK_REQUESTS != 0),
+            ota_telemetry_storage_write);
+    ota_decompress_init(ota_delta_storage_write);
+    ota_delta_init(ota_resume_storage_write);
+
+    /* The storage steps do not depend on the network, run them while the
+     * Wi-Fi associates and gets its address.
+     */
+#ifdef OTA_STATIC_ALLOCATION
+    if (NULL == xTaskCreateStatic(storage_init_task, "STORAGE INIT", STORAGE_INIT_TASK_STACK_SIZE,
+                                  NULL, STORAGE_INIT_TASK_PRIORITY, storage_init_task_stack,
+                                  &storage_init_task_tcb))
+#else
+    if (pdPASS != xTaskCreate(storage_init_task, "STORAGE INIT", STORAGE_INIT_TASK_STACK_SIZE,
+                              NULL, STORAGE_INIT_TASK_PRIORITY, NULL))
+#endif
     {
-        printf("\n Failed to validate the update.\n");
+        OTA_PRINTF("\n Creating the storage init task failed.\n");
         CY_ASSERT(0);
     }
-#endif
 
     /* Connect to Wi-Fi AP */
+    bringup_step_begin(BRINGUP_WIFI_CONNECT);
     if(CY_RSLT_SUCCESS != connect_to_wifi_ap())
     {
-        printf("\n Failed to connect to Wi-FI AP.\n");
+        OTA_PRINTF("\n Failed to connect to Wi-FI AP.\n");
         CY_ASSERT(0);
     }
+    bringup_step_end(BRINGUP_WIFI_CONNECT);
+
+    mqtt_client_id_init();
 
     /* Initialize underlying support code that is needed for OTA and MQTT */
+    bringup_step_begin(BRINGUP_NETWORK_INIT);
     if (CY_RSLT_SUCCESS != cy_awsport_network_init())
     {
-        printf("\n Initializing secure sockets failed.\n");
+        OTA_PRINTF("\n Initializing secure sockets failed.\n");
         CY_ASSERT(0);
     }
+    bringup_step_end(BRINGUP_NETWORK_INIT);
 
     /* Initialize the MQTT subsystem */
+    bringup_step_begin(BRINGUP_MQTT_INIT);
     if (CY_RSLT_SUCCESS != cy_mqtt_init())
     {
-        printf("\n Initializing MQTT failed.\n");
+        OTA_PRINTF("\n Initializing MQTT failed.\n");
         CY_ASSERT(0);
     }
+    bringup_step_end(BRINGUP_MQTT_INIT);
+    (void)xEventGroupSetBits(bringup_events, BRINGUP_NETWORK_READY);
+
+    /* Join: the agent needs both the storage and the network */
+    (void)xEventGroupWaitBits(bringup_events, BRINGUP_ALL_READY, pdFALSE, pdTRUE, portMAX_DELAY);
+
+    /* The KV store is open now, keep the AP for the next power-on */
+    wifi_cache_persist();
 
     /* Initialize and start the OTA agent */
+    bringup_step_begin(BRINGUP_AGENT_START);
     if(CY_RSLT_SUCCESS != cy_ota_agent_start(&ota_network_params, &ota_agent_params, &ota_interfaces, &ota_context))
     {
-        printf("\n Initializing and starting the OTA agent failed.\n");
+        OTA_PRINTF("\n Initializing and starting the OTA agent failed.\n");
         CY_ASSERT(0);
     }
+    bringup_step_end(BRINGUP_AGENT_START);
+
+    bringup_print_timeline();
 
-    vTaskSuspend( NULL );
+    /* This task requests the missing chunks of a resumed download */
+    ota_resume_request_loop();
  }
 
+/*******************************************************************************
+ * Function Name: storage_init_task
+ *******************************************************************************
+ * Summary:
+ *  Initializes the OTA storage, opens the KV store and validates the running
+ *  image in parallel with the network bring-up of ota_task(). The KV store is
+ *  opened first and BRINGUP_KV_READY set right after, so that the Wi-Fi
+ *  connect does not wait for the image validation to read the cached AP.
+ *  Sets BRINGUP_STORAGE_READY at the end and deletes itself.
+ *
+ * Parameters:
+ *  void *args : Task parameter defined during task creation (unused)
+ *
+ *******************************************************************************/
+static void storage_init_task(void *args)
+{
+    (void)args;
+
+    /* initialize OTA storage */
+    bringup_step_begin(BRINGUP_STORAGE_INIT);
+    if (CY_RSLT_SUCCESS != cy_ota_storage_init())
+    {
+        OTA_PRINTF("\n Initializing ota storage failed.\n");
+        CY_ASSERT(0);
+    }
+    bringup_step_end(BRINGUP_STORAGE_INIT);
+
+    /* OTA session state store, not available on every platform */
+    bringup_step_begin(BRINGUP_KV_INIT);
+    (void)ota_kv_init();
+    bringup_step_end(BRINGUP_KV_INIT);
+
+    (void)xEventGroupSetBits(bringup_events, BRINGUP_KV_READY);
+
+#ifndef TEST_REVERT
+    /* Validate the update so we do not revert */
+    bringup_step_begin(BRINGUP_IMAGE_VALIDATE);
+    if(CY_RSLT_SUCCESS != cy_ota_storage_image_validate(APP_ID))
+    {
+        OTA_PRINTF("\n Failed to validate the update.\n");
+        CY_ASSERT(0);
+    }
+    bringup_step_end(BRINGUP_IMAGE_VALIDATE);
+#endif
+
+    (void)xEventGroupSetBits(bringup_events, BRINGUP_STORAGE_READY);
+
+    vTaskDelete(NULL);
+}
+
+/*******************************************************************************
+ * Function Name: ota_storage_write
+ *******************************************************************************
+ * Summary:
+ *  Storage write callback of the OTA agent, the head of the storage chain
+ *  (decompression, delta, resume, telemetry). The bytes kept by a resumed
+ *  download are added to the size of the first chunk here, after every stage
+ *  has handled the chunk, see ota_resume_take_credit().
+ *
+ *******************************************************************************/
+static cy_rslt_t ota_storage_write(cy_ota_storage_context_t *storage_ptr,
+        cy_ota_storage_write_info_t *chunk_info)
+{
+    cy_rslt_t result = ota_decompress_storage_write(storage_ptr, chunk_info);
+
+    if (result == CY_RSLT_SUCCESS)
+    {
+        chunk_info->size += ota_resume_take_credit();
+    }
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: wifi_cache_is_valid
+ *******************************************************************************
+ * Summary:
+ *  Checks that a Wi-Fi cache is intact and was made for the configured SSID.
+ *
+ *******************************************************************************/
+static bool wifi_cache_is_valid(const wifi_cache_t *cache)
+{
+    return (cache->magic == WIFI_CACHE_MAGIC) &&
+           (cache->crc == ota_kv_crc32(0u, cache, offsetof(wifi_cache_t, crc))) &&
+           (strncmp((const char *)cache->ssid, WIFI_SSID, sizeof(cache->ssid)) == 0);
+}
+
+/*******************************************************************************
+ * Function Name: wifi_cache_load
+ *******************************************************************************
+ * Summary:
+ *  Makes the last good AP available in wifi_cache. The retained RAM copy is
+ *  used after a soft reset; after a power-on reset the copy in the KV store is
+ *  read, waiting at most WIFI_CACHE_LOAD_WAIT_MS for storage_init_task() to
+ *  open it (BRINGUP_KV_READY).
+ *
+ * Return:
+ *  true if wifi_cache holds a valid AP
+ *
+ *******************************************************************************/
+static bool wifi_cache_load(void)
+{
+    wifi_cache_t stored;
+    size_t len = 0;
+
+    wifi_cache_dirty = false;
+    if (wifi_cache_is_valid(&wifi_cache))
+    {
+        return true;
+    }
+
+    if ((xEventGroupWaitBits(bringup_events, BRINGUP_KV_READY, pdFALSE, pdTRUE,
+                             pdMS_TO_TICKS(WIFI_CACHE_LOAD_WAIT_MS)) & BRINGUP_KV_READY) == 0u)
+    {
+        return false;
+    }
+
+    if ((ota_kv_get(OTA_KV_KEY_WIFI, &stored, sizeof(stored), &len) != CY_RSLT_SUCCESS) ||
+        (len != sizeof(stored)) || !wifi_cache_is_valid(&stored))
+    {
+        return false;
+    }
+
+    wifi_cache = stored;
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: wifi_cache_update
+ *******************************************************************************
+ * Summary:
+ *  Records the AP the device is associated with and its lease in the retained
+ *  RAM copy, and marks the copy for wifi_cache_persist() if it changed.
+ *
+ *******************************************************************************/
+static void wifi_cache_update(const cy_wcm_ip_address_t *ip_address)
+{
+    cy_wcm_associated_ap_info_t ap_info;
+    wifi_cache_t cache;
+
+    if (cy_wcm_get_associated_ap_info(&ap_info) != CY_RSLT_SUCCESS)
+    {
+        return;
+    }
+
+    memset(&cache, 0, sizeof(cache));
+    cache.magic = WIFI_CACHE_MAGIC;
+    memcpy(cache.ssid, WIFI_SSID, sizeof(WIFI_SSID));
+    memcpy(cache.bssid, ap_info.BSSID, sizeof(cache.bssid));
+    cache.channel = ap_info.channel;
+    cache.security = ap_info.security;
+    cache.lease.ip_address = *ip_address;
+    (void)cy_wcm_get_ip_netmask(CY_WCM_INTERFACE_TYPE_STA, &cache.lease.netmask);
+    (void)cy_wcm_get_gateway_ip_address(CY_WCM_INTERFACE_TYPE_STA, &cache.lease.gateway);
+    cache.crc = ota_kv_crc32(0u, &cache, offsetof(wifi_cache_t, crc));
+
+    if (memcmp(&cache, &wifi_cache, sizeof(cache)) != 0)
+    {
+        wifi_cache = cache;
+        wifi_cache_dirty = true;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: wifi_cache_persist
+ *******************************************************************************
+ * Summary:
+ *  Writes the Wi-Fi cache to the KV store when it changed, so that it also
+ *  survives a power-on reset. Must be called once the KV store is open.
+ *
+ *******************************************************************************/
+static void wifi_cache_persist(void)
+{
+    if (wifi_cache_dirty &&
+        (ota_kv_set(OTA_KV_KEY_WIFI, &wifi_cache, sizeof(wifi_cache)) == CY_RSLT_SUCCESS))
+    {
+        wifi_cache_dirty = false;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: wifi_retry_delay_ms
+ *******************************************************************************
+ * Summary:
+ *  Exponential backoff with jitter: the nth retry waits a random time between
+ *  half and all of WIFI_CONN_RETRY_DELAY_MS * 2^n, capped at
+ *  WIFI_CONN_RETRY_MAX_DELAY_MS. The generator is seeded from the MAC address
+ *  so that devices rebooting together after an outage spread their retries.
+ *
+ *******************************************************************************/
+static uint32_t wifi_retry_delay_ms(uint32_t retry)
+{
+    uint32_t delay_ms = WIFI_CONN_RETRY_MAX_DELAY_MS;
+    cy_wcm_mac_t mac;
+
+    if (wifi_jitter_state == 0u)
+    {
+        memset(mac, 0, sizeof(mac));
+        (void)cy_wcm_get_mac_addr(CY_WCM_INTERFACE_TYPE_STA, &mac);
+        wifi_jitter_state = ota_kv_crc32(0u, mac, sizeof(mac)) ^ (uint32_t)xTaskGetTickCount();
+        if (wifi_jitter_state == 0u)
+        {
+            wifi_jitter_state = 1u;
+        }
+    }
+
+    /* xorshift32 */
+    wifi_jitter_state ^= wifi_jitter_state << 13;
+    wifi_jitter_state ^= wifi_jitter_state >> 17;
+    wifi_jitter_state ^= wifi_jitter_state << 5;
+
+    if ((retry < 16u) && ((WIFI_CONN_RETRY_DELAY_MS << retry) < WIFI_CONN_RETRY_MAX_DELAY_MS))
+    {
+        delay_ms = WIFI_CONN_RETRY_DELAY_MS << retry;
+    }
+
+    return (delay_ms / 2u) + (wifi_jitter_state % ((delay_ms / 2u) + 1u));
+}
+
+/*******************************************************************************
+ * Function Name: mqtt_client_id_init
+ *******************************************************************************
+ * Summary:
+ *  With OTA_MQTT_PERSISTENT_SESSION, replaces OTA_MQTT_ID with an identifier
+ *  derived from the Wi-Fi MAC address, so that the device finds its session
+ *  again after a reconnect or a reset and no two devices share a session.
+ *
+ *******************************************************************************/
+static void mqtt_client_id_init(void)
+{
+#if (OTA_MQTT_PERSISTENT_SESSION == 1)
+    cy_wcm_mac_t mac;
+
+    if (cy_wcm_get_mac_addr(CY_WCM_INTERFACE_TYPE_STA, &mac) != CY_RSLT_SUCCESS)
+    {
+        OTA_PRINTF("\n Reading the MAC address failed, using '%s' as MQTT client ID.\n", OTA_MQTT_ID);
+        return;
+    }
+
+    snprintf(mqtt_client_id, sizeof(mqtt_client_id), OTA_MQTT_ID_PREFIX "%02X%02X%02X%02X%02X%02X",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    ota_network_params.mqtt.pIdentifier = mqtt_client_id;
+    OTA_PRINTF("MQTT persistent session with client ID '%s'\n", mqtt_client_id);
+#endif
+}
+
 /*******************************************************************************
  * Function Name: connect_to_wifi_ap()
  *******************************************************************************
  * Summary:
- *  Connects to Wi-Fi AP using the user-configured credentials, retries up to a
- *  configured number of times until the connection succeeds.
+ *  Connects to Wi-Fi AP using the user-configured credentials. The first
+ *  attempt goes directly to the AP and band of the last good connection; if
+ *  there is none or it fails, the connection falls back to a scan of all
+ *  channels and retries with a jittered exponential backoff up to a configured
+ *  number of times until the connection succeeds.
  *
  *******************************************************************************/
 cy_rslt_t connect_to_wifi_ap(void)
@@ -212,6 +677,7 @@ cy_rslt_t connect_to_wifi_ap(void)
     cy_wcm_connect_params_t wifi_conn_param;
     cy_wcm_ip_address_t ip_address;
     cy_rslt_t result = CY_RSLT_TYPE_ERROR;
+    uint32_t delay_ms;
 
     /* Variable to track the number of connection retries to the Wi-Fi AP specified
      * by WIFI_SSID macro. */
@@ -222,17 +688,46 @@ cy_rslt_t connect_to_wifi_ap(void)
 
     if (CY_RSLT_SUCCESS != result)
     {
-        printf("\n Initializing WCM failed.\n");
+        OTA_PRINTF("\n Initializing WCM failed.\n");
         CY_ASSERT(0);
     }
 
-    printf("\n Successfully initialized WCM.\n");
+    OTA_PRINTF("\n Successfully initialized WCM.\n");
 
      /* Set the Wi-Fi SSID, password and security type. */
     memset(&wifi_conn_param, 0, sizeof(cy_wcm_connect_params_t));
     memcpy(wifi_conn_param.ap_credentials.SSID, WIFI_SSID, sizeof(WIFI_SSID));
     memcpy(wifi_conn_param.ap_credentials.password, WIFI_PASSWORD, sizeof(WIFI_PASSWORD));
+
+    /* Directed attempt to the last good AP: the join is restricted to its
+     * BSSID and to the band of its channel.
+     */
+    if (wifi_cache_load())
+    {
+        memcpy(wifi_conn_param.BSSID, wifi_cache.bssid, sizeof(wifi_conn_param.BSSID));
+        wifi_conn_param.ap_credentials.security = wifi_cache.security;
+        wifi_conn_param.band = (wifi_cache.channel > 14u) ? CY_WCM_WIFI_BAND_5GHZ : CY_WCM_WIFI_BAND_2_4GHZ;
+    #if (WIFI_CACHED_STATIC_IP == 1)
+        wifi_conn_param.static_ip_settings = &wifi_cache.lease;
+    #endif
+
+        result = cy_wcm_connect_ap( &wifi_conn_param, &ip_address );
+        if (CY_RSLT_SUCCESS == result)
+        {
+            OTA_PRINTF( "Successfully connected to Wi-Fi network '%s' (cached AP, channel %u).\n",
+                    wifi_conn_param.ap_credentials.SSID, (unsigned int)wifi_cache.channel);
+            wifi_cache_update(&ip_address);
+            return result;
+        }
+
+        OTA_PRINTF( "Connection to the cached AP failed with error code %d, scanning...\n", (int) result );
+    }
+
+    /* Full connection: any AP of the SSID on any band, address from DHCP */
+    memset(wifi_conn_param.BSSID, 0, sizeof(wifi_conn_param.BSSID));
     wifi_conn_param.ap_credentials.security = WIFI_SECURITY;
+    wifi_conn_param.band = CY_WCM_WIFI_BAND_ANY;
+    wifi_conn_param.static_ip_settings = NULL;
 
     /* Connect to the Wi-Fi AP */
     for(conn_retries = 0; conn_retries < MAX_CONNECTION_RETRIES; conn_retries++)
@@ -241,17 +736,19 @@ cy_rslt_t connect_to_wifi_ap(void)
 
         if (CY_RSLT_SUCCESS == result)
         {
-            printf( "Successfully connected to Wi-Fi network '%s'.\n",
+            OTA_PRINTF( "Successfully connected to Wi-Fi network '%s'.\n",
                     wifi_conn_param.ap_credentials.SSID);
+            wifi_cache_update(&ip_address);
             return result;
         }
 
-        printf( "Connection to Wi-Fi network failed with error code %d."
-                "Retrying in %d ms...\n", (int) result, WIFI_CONN_RETRY_DELAY_MS );
-        vTaskDelay(pdMS_TO_TICKS(WIFI_CONN_RETRY_DELAY_MS));
+        delay_ms = wifi_retry_delay_ms(conn_retries);
+        OTA_PRINTF( "Connection to Wi-Fi network failed with error code %d."
+                "Retrying in %u ms...\n", (int) result, (unsigned int)delay_ms );
+        vTaskDelay(pdMS_TO_TICKS(delay_ms));
     }
 
-    printf( "Exceeded maximum Wi-Fi connection attempts\n" );
+    OTA_PRINTF( "Exceeded maximum Wi-Fi connection attempts\n" );
 
     return result;
 }
@@ -260,9 +757,9 @@ cy_rslt_t connect_to_wifi_ap(void)
  * Function Name: ota_callback()
  *******************************************************************************
  * Summary:
- *  Prints the status of the OTA agent on every event. This callback is optional,
- *  but be aware that the OTA middleware will not print the status of OTA agent
- *  on its own.
+ *  Queues the status of the OTA agent on every event for the logger task to
+ *  print. This callback is optional, but be aware that the OTA middleware will
+ *  not print the status of OTA agent on its own.
  *
  * Return:
  *  CY_OTA_CB_RSLT_OTA_CONTINUE - OTA Agent to continue with function.
@@ -274,175 +771,101 @@ cy_rslt_t connect_to_wifi_ap(void)
 cy_ota_callback_results_t ota_callback(cy_ota_cb_struct_t *cb_data)
 {
     cy_ota_callback_results_t   cb_result = CY_OTA_CB_RSLT_OTA_CONTINUE;
-    const char                  *state_string;
-    const char                  *error_string;
 
     if (cb_data == NULL)
     {
         return CY_OTA_CB_RSLT_OTA_STOP;
     }
 
-    state_string  = cy_ota_get_state_string(cb_data->ota_agt_state);
-    error_string  = cy_ota_get_error_string(cy_ota_get_last_error());
-
-    print_heap_usage("In OTA Callback");
+    /* Printing is deferred to the logger task, the event is only copied here */
+    ota_log_event(cb_data);
+    ota_static_alloc_sample();
 
     switch (cb_data->reason)
     {
-
-        case CY_OTA_LAST_REASON:
-            break;
-
         case CY_OTA_REASON_SUCCESS:
-            printf(">> APP CB OTA SUCCESS state:%d %s last_error:%s\n\n",
-                    cb_data->ota_agt_state,
-                    state_string, error_string);
-            break;
-
         case CY_OTA_REASON_FAILURE:
-            printf(">> APP CB OTA FAILURE state:%d %s last_error:%s\n\n",
-                    cb_data->ota_agt_state, state_string, error_string);
+            ota_telemetry_set_connection(NULL);
+            ota_resume_stop_requests();
+            /* The records queued to the flash worker and the log must be out before a possible reboot */
+            (void)ota_kv_sync();
+            (void)ota_log_flush(OTA_LOG_FLUSH_TIMEOUT_MS);
             break;
 
         case CY_OTA_REASON_STATE_CHANGE:
+            ota_telemetry_phase_event(cb_data->ota_agt_state);
+
             switch (cb_data->ota_agt_state)
             {
-                case CY_OTA_STATE_NOT_INITIALIZED:
-                case CY_OTA_STATE_EXITING:
-                case CY_OTA_STATE_INITIALIZING:
-                case CY_OTA_STATE_AGENT_STARTED:
-                case CY_OTA_STATE_AGENT_WAITING:
-                    break;
-
                 case CY_OTA_STATE_START_UPDATE:
-                    printf("APP CB OTA STATE CHANGE CY_OTA_STATE_START_UPDATE\n");
+                    ota_resume_reset();
+                    ota_decompress_reset();
+                    ota_delta_reset();
+                    ota_static_alloc_reset();
                     break;
 
                 case CY_OTA_STATE_JOB_CONNECT:
-                    printf("APP CB OTA CONNECT FOR JOB using ");
-                    /* NOTE:
-                     *  HTTP - json_doc holds the MQTT JSON request doc
-                     */
                     if ((cb_data->broker_server.host_name == NULL)  ||
                         ( cb_data->broker_server.port == 0)         ||
                         ( strlen(cb_data->unique_topic) == 0))
                     {
-                        printf("ERROR in callback data: MQTT: server: %p port: %d topic: '%p'\n",
-                                cb_data->broker_server.host_name,
-                                cb_data->broker_server.port,
-                                cb_data->unique_topic);
                         cb_result = CY_OTA_CB_RSLT_OTA_STOP;
                     }
-                    printf("MQTT: server:%s port: %d topic: '%s'\n",
-                            cb_data->broker_server.host_name,
-                            cb_data->broker_server.port,
-                            cb_data->unique_topic);
-
                     break;
 
                 case CY_OTA_STATE_JOB_DOWNLOAD:
-                    printf("APP CB OTA JOB DOWNLOAD using ");
-                    /* NOTE:
-                     *  HTTP - json_doc holds the MQTT JSON request doc
-                     */
-                    printf("MQTT: '%s'\n", cb_data->json_doc);
-                    printf("topic: '%s' \n", cb_data->unique_topic);
-                    break;
-
-                case CY_OTA_STATE_JOB_DISCONNECT:
-                    printf("APP CB OTA JOB DISCONNECT\n");
-                    break;
-
-                case CY_OTA_STATE_JOB_PARSE:
-                    printf("APP CB OTA PARSE JOB: '%.*s' \n",
-                    strlen(cb_data->json_doc),
-                    cb_data->json_doc);
-                    break;
-
-                case CY_OTA_STATE_JOB_REDIRECT:
-                    printf("APP CB OTA JOB REDIRECT\n");
-                    break;
-
-                case CY_OTA_STATE_DATA_CONNECT:
-                    printf("APP CB OTA CONNECT FOR DATA using ");
-                    printf("MQTT: %s:%d \n", cb_data->broker_server.host_name,
-                    cb_data->broker_server.port);
+                    /* json_doc holds the CY_OTA_SUBSCRIBE_UPDATES_AVAIL request, the agent sends it on return */
+                    ota_chunk_size_update();
+                    (void)ota_chunk_size_append(cb_data->json_doc, sizeof(cb_data->json_doc));
+                    (void)ota_decompress_append(cb_data->json_doc, sizeof(cb_data->json_doc));
+                    (void)ota_delta_append(cb_data->json_doc, sizeof(cb_data->json_doc));
                     break;
 
                 case CY_OTA_STATE_DATA_DOWNLOAD:
-                    printf("APP CB OTA DATA DOWNLOAD using ");
-                    /* NOTE:
-                     *  MQTT - json_doc holds the MQTT JSON request doc
+                    /* json_doc holds the CY_OTA_DOWNLOAD_REQUEST request */
+                    ota_chunk_size_update();
+                    (void)ota_chunk_size_append(cb_data->json_doc, sizeof(cb_data->json_doc));
+                    (void)ota_decompress_append(cb_data->json_doc, sizeof(cb_data->json_doc));
+                    (void)ota_delta_append(cb_data->json_doc, sizeof(cb_data->json_doc));
+
+                    /* Publish the telemetry on the agent's connection while it is open */
+                    ota_telemetry_set_connection(cb_data->mqtt_connection);
+                    /* A resumed download asks for the missing chunks only, in
+                     * place of the agent's request for the whole image.
                      */
-                    printf("MQTT: '%.*s' \n", strlen(cb_data->json_doc), cb_data->json_doc);
-                    printf("topic: '%s'\n\n", cb_data->unique_topic);
+                    if (ota_resume_start_requests(cb_data->mqtt_connection, cb_data->unique_topic))
+                    {
+                        cb_result = CY_OTA_CB_RSLT_APP_SUCCESS;
+                    }
                     break;
 
                 case CY_OTA_STATE_DATA_DISCONNECT:
-                    printf("APP CB OTA DATA DISCONNECT\n");
-                    break;
-
-                case CY_OTA_STATE_RESULT_CONNECT:
-                    printf("APP CB OTA SEND RESULT CONNECT using ");
-                    /* NOTE:
-                     *  MQTT - json_doc holds the MQTT JSON request doc
-                     */
-                    printf("MQTT: Broker:%s port: %d\n",
-                            cb_data->broker_server.host_name,
-                            cb_data->broker_server.port);
-                    printf("topic: '%s' \n", cb_data->unique_topic);
+                    ota_telemetry_set_connection(NULL);
+                    ota_resume_stop_requests();
                     break;
 
                 case CY_OTA_STATE_RESULT_SEND:
-                    printf("APP CB OTA SENDING RESULT using ");
-                    /* NOTE:
-                     *  MQTT - json_doc holds the MQTT JSON request doc
-                     */
-                    printf("MQTT: '%s' \n", cb_data->json_doc);
-                    break;
-
-                case CY_OTA_STATE_RESULT_RESPONSE:
-                    printf("APP CB OTA Got Result response\n");
-                    break;
-
-                case CY_OTA_STATE_RESULT_DISCONNECT:
-                    printf("APP CB OTA Result Disconnect\n");
+                    /* json_doc holds the CY_OTA_MQTT_RESULT_JSON report, the agent sends it on return */
+                    (void)ota_telemetry_append_phases(cb_data->json_doc, sizeof(cb_data->json_doc));
                     break;
 
                 case CY_OTA_STATE_OTA_COMPLETE:
-                    printf("APP CB OTA Session Complete\n");
+                    (void)ota_log_flush(OTA_LOG_FLUSH_TIMEOUT_MS);
                     break;
 
                 case CY_OTA_STATE_STORAGE_OPEN:
-                    printf("APP CB OTA STORAGE OPEN\n");
+                    /* The storage callbacks run in the agent task */
+                    (void)cy_ota_mem_client_register(&ota_flash_client, "ota");
+                    ota_telemetry_reset();
                     break;
 
-                case CY_OTA_STATE_STORAGE_WRITE:
-                    printf("APP CB OTA STORAGE WRITE %ld%% (%ld of %ld)\n",
-                            (unsigned long)cb_data->percentage,
-                            (unsigned long)cb_data->bytes_written,
-                            (unsigned long)cb_data->total_size);
-
-                    /* Move cursor to previous line */
-                    printf("\x1b[1F");
-                    break;
-
-                case CY_OTA_STATE_STORAGE_CLOSE:
-                    printf("APP CB OTA STORAGE CLOSE\n");
-                    break;
-
-                case CY_OTA_STATE_VERIFY:
-                    printf("APP CB OTA VERIFY\n");
-                    break;
-
-                case CY_OTA_STATE_RESULT_REDIRECT:
-                    printf("APP CB OTA RESULT REDIRECT\n");
-                    break;
-
-                case CY_OTA_NUM_STATES:
+                default:
                     break;
             }   /* switch state */
             break;
+
+        default:
+            break;
     }
 
     return cb_result;
@@ -0,0 +1,675 @@
+/******************************************************************************
+* File Name: ota_telemetry.c
+*
+* Description: This file contains the OTA download telemetry: throughput,
+* chunk inter-arrival and storage write latencies, readable through
+* ota_telemetry_get_stats() and published on the telemetry topic while the
+* image is downloaded.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/*******************************************************************************
+ * Header file includes
+ ******************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include "cy_pdl.h"
+#include "ota_telemetry.h"
+#include "ota_cycles.h"
+#include "ota_json.h"
+#include "ota_log_token.h"
+
+/* FreeRTOS header file */
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+
+/*******************************************************************************
+ * Macros
+ ******************************************************************************/
+/* Telemetry message buffer, enough for both histograms */
+#define OTA_TELEMETRY_PAYLOAD_SIZE          (448u)
+
+#define OTA_TELEMETRY_NO_SECOND             (0xFFFFFFFFu)
+
+/*******************************************************************************
+ * Global Variables
+ ******************************************************************************/
+/* Updated by the OTA agent through ota_telemetry_storage_write(), read under
+ * a critical section by the telemetry task.
+ */
+static ota_telemetry_stats_t    telemetry_stats;
+static uint32_t                 last_chunk_ms;
+static uint32_t                 start_ms;
+
+/* Bytes written in each of the last OTA_TELEMETRY_RATE_SECS seconds */
+static uint32_t                 rate_bytes[OTA_TELEMETRY_RATE_SECS];
+static uint32_t                 rate_second[OTA_TELEMETRY_RATE_SECS];
+
+/* The mutex keeps the connection from being closed in the middle of a publish */
+static StaticSemaphore_t        telemetry_mutex_buffer;
+static SemaphoreHandle_t        telemetry_mutex;
+static cy_mqtt_t                telemetry_connection;
+static const char               *telemetry_topic;
+static const char               *telemetry_device_id;
+static uint32_t                 telemetry_period_ms;
+static TaskHandle_t             telemetry_task;
+
+static char                     telemetry_payload[OTA_TELEMETRY_PAYLOAD_SIZE];
+
+/* Session phases, updated from the OTA callback */
+static ota_telemetry_phases_t   phases;
+static ota_phase_t              phase_current = OTA_PHASE_NONE;
+static uint32_t                 phase_start_ms;
+static uint32_t                 phase_entered;      /* Bit per phase entered in the session */
+static cy_ota_agent_state_t     phase_last_state = CY_OTA_STATE_NOT_INITIALIZED;
+static uint32_t                 session_start_ms;
+static uint32_t                 download_start_ms;
+static bool                     first_chunk_seen;
+
+static const char * const       phase_names[OTA_PHASE_COUNT] =
+{
+    "JobConnect", "Job", "DataConnect", "Download", "Verify", "Result"
+};
+
+/*******************************************************************************
+ * Function Name: ota_telemetry_now_ms
+ *******************************************************************************/
+static uint32_t ota_telemetry_now_ms(void)
+{
+    return (uint32_t)xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+/*******************************************************************************
+ * Function Name: ota_telemetry_bucket
+ *******************************************************************************
+ * Summary:
+ *  Returns the log2 histogram bucket of a value, see OTA_TELEMETRY_HIST_BUCKETS.
+ *
+ *******************************************************************************/
+static uint32_t ota_telemetry_bucket(uint32_t value)
+{
+    uint32_t bucket = 32u - (uint32_t)__CLZ(value);
+
+    return (bucket < OTA_TELEMETRY_HIST_BUCKETS) ? bucket : (OTA_TELEMETRY_HIST_BUCKETS - 1u);
+}
+
+/*******************************************************************************
+ * Function Name: ota_telemetry_init
+ *******************************************************************************
+ * Summary:
+ *  Sets where the telemetry is published. Called once from the OTA task
+ *  before the OTA agent is started.
+ *
+ * Parameters:
+ *  topic     : MQTT topic of the telemetry messages
+ *  device_id : Device name included in the messages
+ *  period_ms : Time between two telemetry messages during a download
+ *
+ *******************************************************************************/
+void ota_telemetry_init(const char *topic, const char *device_id, uint32_t period_ms)
+{
+    telemetry_topic = topic;
+    telemetry_device_id = device_id;
+    telemetry_period_ms = period_ms;
+    telemetry_mutex = xSemaphoreCreateMutexStatic(&telemetry_mutex_buffer);
+    CY_ASSERT(telemetry_mutex != NULL);
+
+    /* Storage write times are measured with the cycle counter */
+    ota_cycles_enable();
+
+    ota_telemetry_reset();
+}
+
+/*******************************************************************************
+ * Function Name: ota_telemetry_reset
+ *******************************************************************************
+ * Summary:
+ *  Clears the counters at the start of a download. The publish counters are
+ *  kept.
+ *
+ *******************************************************************************/
+void ota_telemetry_reset(void)
+{
+    uint32_t published;
+    uint32_t publish_failures;
+    uint32_t i;
+
+    taskENTER_CRITICAL();
+    published = telemetry_stats.published;
+    publish_failures = telemetry_stats.publish_failures;
+    memset(&telemetry_stats, 0, sizeof(telemetry_stats));
+    telemetry_stats.published = published;
+    telemetry_stats.publish_failures = publish_failures;
+    for (i = 0; i < OTA_TELEMETRY_RATE_SECS; i++)
+    {
+        rate_bytes[i] = 0;
+        rate_second[i] = OTA_TELEMETRY_NO_SECOND;
+    }
+    start_ms = ota_telemetry_now_ms();
+    last_chunk_ms = start_ms;
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+ * Function Name: ota_telemetry_storage_write
+ *******************************************************************************
+ * Summary:
+ *  OTA storage write callback. Times cy_ota_storage_write() and the time since
+ *  the previous chunk, and adds the chunk to the counters.
+ *
+ *******************************************************************************/
+cy_rslt_t ota_telemetry_storage_write(cy_ota_storage_context_t *storage_ptr,
+        cy_ota_storage_write_info_t *chunk_info)
+{
+    uint32_t now_ms = ota_telemetry_now_ms();
+    uint32_t start = DWT->CYCCNT;
+    uint32_t write_us;
+    uint32_t interval_ms;
+    uint32_t second;
+    uint32_t slot;
+    cy_rslt_t result;
+
+    result = cy_ota_storage_write(storage_ptr, chunk_info);
+    write_us = ota_cycles_to_us(DWT->CYCCNT - start);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        return result;
+    }
+
+    second = now_ms / 1000u;
+    slot = second % OTA_TELEMETRY_RATE_SECS;
+
+    taskENTER_CRITICAL();
+    if (!first_chunk_seen)
+    {
+        first_chunk_seen = true;
+        phases.first_chunk_ms = now_ms - download_start_ms;
+    }
+
+    /* The first interval is measured from ota_telemetry_reset() */
+    interval_ms = now_ms - last_chunk_ms;
+    last_chunk_ms = now_ms;
+
+    telemetry_stats.chunks++;
+    telemetry_stats.bytes += (uint32_t)chunk_info->size;
+    telemetry_stats.total_size = (uint32_t)chunk_info->total_size;
+
+    telemetry_stats.last_interval_ms = interval_ms;
+    telemetry_stats.total_interval_ms += interval_ms;
+    if (interval_ms > telemetry_stats.max_interval_ms)
+    {
+        telemetry_stats.max_interval_ms = interval_ms;
+    }
+    telemetry_stats.interval_hist[ota_telemetry_bucket(interval_ms)]++;
+
+    telemetry_stats.last_write_us = write_us;
+    telemetry_stats.total_write_us += write_us;
+    if (write_us > telemetry_stats.max_write_us)
+    {
+        telemetry_stats.max_write_us = write_us;
+    }
+    telemetry_stats.write_hist[ota_telemetry_bucket(write_us)]++;
+
+    if (rate_second[slot] != second)
+    {
+        rate_second[slot] = second;
+        rate_bytes[slot] = 0;
+    }
+    rate_bytes[slot] += (uint32_t)chunk_info->size;
+    taskEXIT_CRITICAL();
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: ota_telemetry_get_stats
+ *******************************************************************************
+ * Summary:
+ *  Returns a copy of the counters. The throughput is computed over the last
+ *  complete seconds, or since the download started if that was less than a
+ *  second ago.
+ *
+ *******************************************************************************/
+void ota_telemetry_get_stats(ota_telemetry_stats_t *stats)
+{
+    uint32_t now_ms = ota_telemetry_now_ms();
+    uint32_t now_second = now_ms / 1000u;
+    uint32_t span;
+    uint32_t bytes = 0;
+    uint32_t i;
+
+    if (stats == NULL)
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    *stats = telemetry_stats;
+    span = now_second - (start_ms / 1000u);
+    if (span > (OTA_TELEMETRY_RATE_SECS - 1u))
+    {
+        span = OTA_TELEMETRY_RATE_SECS - 1u;
+    }
+    for (i = 0; i < OTA_TELEMETRY_RATE_SECS; i++)
+    {
+        uint32_t age = now_second - rate_second[i];
+
+        if ((rate_second[i] != OTA_TELEMETRY_NO_SECOND) && (age >= 1u) && (age <= span))
+        {
+            bytes += rate_bytes[i];
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    if (span != 0u)
+    {
+        stats->bytes_per_sec = bytes / span;
+    }
+    else if (now_ms != start_ms)
+    {
+        stats->bytes_per_sec = (uint32_t)(((uint64_t)stats->bytes * 1000u) / (now_ms - start_ms));
+    }
+    else
+    {
+        stats->bytes_per_sec = 0;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: ota_telemetry_phase_of
+ *******************************************************************************
+ * Summary:
+ *  Returns the phase an OTA agent state belongs to. The storage states are
+ *  reported from within the download and do not change the phase.
+ *
+ * Return:
+ *  uint32_t : the ota_phase_t, or OTA_PHASE_COUNT + 1 to keep the current phase
+ *
+ *******************************************************************************/
+static uint32_t ota_telemetry_phase_of(cy_ota_agent_state_t state)
+{
+    switch (state)
+    {
+        case CY_OTA_STATE_JOB_CONNECT:
+            return OTA_PHASE_JOB_CONNECT;
+
+        case CY_OTA_STATE_JOB_DOWNLOAD:
+        case CY_OTA_STATE_JOB_DISCONNECT:
+        case CY_OTA_STATE_JOB_PARSE:
+        case CY_OTA_STATE_JOB_REDIRECT:
+            return OTA_PHASE_JOB;
+
+        case CY_OTA_STATE_DATA_CONNECT:
+            return OTA_PHASE_DATA_CONNECT;
+
+        case CY_OTA_STATE_DATA_DOWNLOAD:
+        case CY_OTA_STATE_DATA_DISCONNECT:
+            return OTA_PHASE_DOWNLOAD;
+
+        case CY_OTA_STATE_VERIFY:
+            return OTA_PHASE_VERIFY;
+
+        case CY_OTA_STATE_RESULT_REDIRECT:
+        case CY_OTA_STATE_RESULT_CONNECT:
+        case CY_OTA_STATE_RESULT_SEND:
+        case CY_OTA_STATE_RESULT_RESPONSE:
+        case CY_OTA_STATE_RESULT_DISCONNECT:
+            return OTA_PHASE_RESULT;
+
+        case CY_OTA_STATE_STORAGE_OPEN:
+        case CY_OTA_STATE_STORAGE_WRITE:
+        case CY_OTA_STATE_STORAGE_CLOSE:
+            return OTA_PHASE_COUNT + 1u;
+
+        default:
+            return OTA_PHASE_NONE;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: ota_telemetry_phase_event
+ *******************************************************************************
+ * Summary:
+ *  Accounts the time since the previous state change to the phase it was in.
+ *  Called from the OTA callback on every state change; START_UPDATE starts
+ *  a new session and clears the phase times.
+ *
+ * Parameters:
+ *  state : New OTA agent state
+ *
+ *******************************************************************************/
+void ota_telemetry_phase_event(cy_ota_agent_state_t state)
+{
+    uint32_t now_ms = ota_telemetry_now_ms();
+    uint32_t next = ota_telemetry_phase_of(state);
+
+    if (next > OTA_PHASE_COUNT)
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    if (state == CY_OTA_STATE_START_UPDATE)
+    {
+        memset(&phases, 0, sizeof(phases));
+        phase_current = OTA_PHASE_NONE;
+        phase_entered = 0;
+        session_start_ms = now_ms;
+        first_chunk_seen = false;
+    }
+
+    if ((state == phase_last_state) && ((ota_phase_t)next != OTA_PHASE_NONE))
+    {
+        /* The same state reported twice in a row: the agent retries it */
+        phases.phase[next].retries++;
+    }
+    phase_last_state = state;
+
+    if ((ota_phase_t)next != phase_current)
+    {
+        if (phase_current != OTA_PHASE_NONE)
+        {
+            phases.phase[phase_current].ms += now_ms - phase_start_ms;
+        }
+        if ((ota_phase_t)next != OTA_PHASE_NONE)
+        {
+            /* Entered again after it was left once: the agent retries it */
+            if ((phase_entered & (1UL << next)) != 0u)
+            {
+                phases.phase[next].retries++;
+            }
+            phase_entered |= (1UL << next);
+            if (next == OTA_PHASE_DOWNLOAD)
+            {
+                download_start_ms = now_ms;
+                first_chunk_seen = false;
+            }
+        }
+        phase_current = (ota_phase_t)next;
+        phase_start_ms = now_ms;
+    }
+    phases.total_ms = now_ms - session_start_ms;
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+ * Function Name: ota_telemetry_get_phases
+ *******************************************************************************
+ * Summary:
+ *  Returns the phase times of the current or last session, including the
+ *  time spent so far in the current phase.
+ *
+ *******************************************************************************/
+void ota_telemetry_get_phases(ota_telemetry_phases_t *phases_out)
+{
+    uint32_t now_ms = ota_telemetry_now_ms();
+
+    if (phases_out == NULL)
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    *phases_out = phases;
+    if (phase_current != OTA_PHASE_NONE)
+    {
+        phases_out->phase[phase_current].ms += now_ms - phase_start_ms;
+        phases_out->total_ms = now_ms - session_start_ms;
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+ * Function Name: ota_telemetry_format_phases
+ *******************************************************************************
+ * Summary:
+ *  Formats the phase times as a JSON object: one [ms, retries] pair per
+ *  phase, the time to the first chunk and the session time.
+ *
+ * Return:
+ *  size_t : length of the object, 0 if it does not fit in the buffer
+ *
+ *******************************************************************************/
+size_t ota_telemetry_format_phases(char *buf, size_t size)
+{
+    ota_telemetry_phases_t times;
+    size_t len = 0;
+    uint32_t i;
+
+    ota_telemetry_get_phases(&times);
+
+    for (i = 0; (i < OTA_PHASE_COUNT) && (len < size); i++)
+    {
+        len += (size_t)snprintf(&buf[len], size - len, "%s\"%s\":[%u,%u]",
+                                (i == 0u) ? "{" : ",", phase_names[i],
+                                (unsigned int)times.phase[i].ms,
+                                (unsigned int)times.phase[i].retries);
+    }
+    if (len < size)
+    {
+        len += (size_t)snprintf(&buf[len], size - len, ",\"FirstChunkMs\":%u,\"TotalMs\":%u}",
+                                (unsigned int)times.first_chunk_ms, (unsigned int)times.total_ms);
+    }
+
+    return (len < size) ? len : 0u;
+}
+
+/*******************************************************************************
+ * Function Name: ota_telemetry_append_phases
+ *******************************************************************************
+ * Summary:
+ *  Adds a "Phases" member with the phase times to a JSON document, used on
+ *  the result report. The document is left unchanged when it is not a JSON
+ *  object or the member does not fit.
+ *
+ * Parameters:
+ *  json_doc : NUL terminated JSON object
+ *  size     : Size of the json_doc buffer
+ *
+ * Return:
+ *  bool : true if the member was added
+ *
+ *******************************************************************************/
+bool ota_telemetry_append_phases(char *json_doc, size_t size)
+{
+    char object[OTA_TELEMETRY_PHASES_SIZE];
+
+    if (ota_telemetry_format_phases(object, sizeof(object)) == 0u)
+    {
+        return false;
+    }
+
+    return ota_json_append(json_doc, size, ",\"Phases\":%s", object);
+}
+
+/*******************************************************************************
+ * Function Name: ota_telemetry_put_hist
+ *******************************************************************************
+ * Summary:
+ *  Appends a histogram to the telemetry message as a JSON array.
+ *
+ *******************************************************************************/
+static size_t ota_telemetry_put_hist(char *buf, size_t size, const uint32_t *hist)
+{
+    size_t len = 0;
+    uint32_t i;
+
+    for (i = 0; (i < OTA_TELEMETRY_HIST_BUCKETS) && (len < size); i++)
+    {
+        len += (size_t)snprintf(&buf[len], size - len, "%s%u",
+                                (i == 0u) ? "[" : ",", (unsigned int)hist[i]);
+    }
+    if (len < size)
+    {
+        len += (size_t)snprintf(&buf[len], size - len, "]");
+    }
+    return len;
+}
+
+/*******************************************************************************
+ * Function Name: ota_telemetry_publish
+ *******************************************************************************
+ * Summary:
+ *  Publishes the counters on the telemetry topic, QoS 0 so a lost message
+ *  never holds up the download.
+ *
+ *******************************************************************************/
+static void ota_telemetry_publish(void)
+{
+    ota_telemetry_stats_t stats;
+    cy_mqtt_publish_info_t publish_info;
+    size_t size = sizeof(telemetry_payload);
+    size_t len;
+    cy_rslt_t result;
+
+    ota_telemetry_get_stats(&stats);
+
+    len = (size_t)snprintf(telemetry_payload, size,
+            "{\"Device\":\"%s\",\"Chunks\":%u,\"Bytes\":%u,\"Total\":%u,\"BytesPerSec\":%u,"
+            "\"IntervalMs\":{\"Last\":%u,\"Max\":%u,\"Avg\":%u},"
+            "\"WriteUs\":{\"Last\":%u,\"Max\":%u,\"Avg\":%u},\"IntervalHist\":",
+            telemetry_device_id,
+            (unsigned int)stats.chunks, (unsigned int)stats.bytes,
+            (unsigned int)stats.total_size, (unsigned int)stats.bytes_per_sec,
+            (unsigned int)stats.last_interval_ms, (unsigned int)stats.max_interval_ms,
+            (unsigned int)((stats.chunks != 0u) ? (stats.total_interval_ms / stats.chunks) : 0u),
+            (unsigned int)stats.last_write_us, (unsigned int)stats.max_write_us,
+            (unsigned int)((stats.chunks != 0u) ? (stats.total_write_us / stats.chunks) : 0u));
+    if (len < size)
+    {
+        len += ota_telemetry_put_hist(&telemetry_payload[len], size - len, stats.interval_hist);
+    }
+    if (len < size)
+    {
+        len += (size_t)snprintf(&telemetry_payload[len], size - len, ",\"WriteHist\":");
+    }
+    if (len < size)
+    {
+        len += ota_telemetry_put_hist(&telemetry_payload[len], size - len, stats.write_hist);
+    }
+    if (len < size)
+    {
+        len += (size_t)snprintf(&telemetry_payload[len], size - len, "}");
+    }
+    if (len >= size)
+    {
+        OTA_PRINTF("OTA telemetry: message does not fit in %u bytes\n", (unsigned int)size);
+        return;
+    }
+
+    memset(&publish_info, 0, sizeof(publish_info));
+    publish_info.qos = CY_MQTT_QOS0;
+    publish_info.topic = telemetry_topic;
+    publish_info.topic_len = (uint16_t)strlen(telemetry_topic);
+    publish_info.payload = telemetry_payload;
+    publish_info.payload_len = len;
+
+    (void)xSemaphoreTake(telemetry_mutex, portMAX_DELAY);
+    if (telemetry_connection == NULL)
+    {
+        /* The download ended while the message was built */
+        (void)xSemaphoreGive(telemetry_mutex);
+        return;
+    }
+    result = cy_mqtt_publish(telemetry_connection, &publish_info);
+    (void)xSemaphoreGive(telemetry_mutex);
+
+    taskENTER_CRITICAL();
+    if (result == CY_RSLT_SUCCESS)
+    {
+        telemetry_stats.published++;
+    }
+    else
+    {
+        telemetry_stats.publish_failures++;
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*******************************************************************************
+ * Function Name: ota_telemetry_set_connection
+ *******************************************************************************
+ * Summary:
+ *  Starts publishing on the MQTT connection of the OTA agent, or stops when
+ *  the handle is NULL. Stopping waits for a publish in progress, so the agent
+ *  can close the connection afterwards.
+ *
+ *******************************************************************************/
+void ota_telemetry_set_connection(cy_mqtt_t mqtt_handle)
+{
+    if (telemetry_mutex == NULL)
+    {
+        return;
+    }
+
+    (void)xSemaphoreTake(telemetry_mutex, portMAX_DELAY);
+    telemetry_connection = mqtt_handle;
+    (void)xSemaphoreGive(telemetry_mutex);
+
+    if ((mqtt_handle != NULL) && (telemetry_task != NULL))
+    {
+        xTaskNotifyGive(telemetry_task);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: ota_telemetry_task
+ *******************************************************************************
+ * Summary:
+ *  Publishes the telemetry every period while a connection is set.
+ *
+ * Parameters:
+ *  void *args : Task parameter defined during task creation (unused)
+ *
+ *******************************************************************************/
+void ota_telemetry_task(void *args)
+{
+    (void)args;
+
+    telemetry_task = xTaskGetCurrentTaskHandle();
+
+    while (true)
+    {
+        (void)ulTaskNotifyTake(pdTRUE, (telemetry_connection != NULL) ?
+                               pdMS_TO_TICKS(telemetry_period_ms) : portMAX_DELAY);
+
+        if ((telemetry_mutex != NULL) && (telemetry_connection != NULL))
+        {
+            ota_telemetry_publish();
+        }
+    }
+}
+
+/* [] END OF FILE */
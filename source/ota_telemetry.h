@@ -0,0 +1,128 @@
+/******************************************************************************
+* File Name: ota_telemetry.h
+*
+* Description: This file contains the declarations of the OTA download
+* telemetry.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef SOURCE_OTA_TELEMETRY_H_
+#define SOURCE_OTA_TELEMETRY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "cy_result.h"
+#include "cy_mqtt_api.h"
+#include "cy_ota_api.h"
+#include "cy_ota_storage_api.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Buckets of the latency histograms. Bucket 0 counts the values of 0, bucket n
+ * the values from 2^(n-1) to 2^n - 1, the last bucket everything above.
+ */
+#define OTA_TELEMETRY_HIST_BUCKETS          (16u)
+
+/* Throughput window, in seconds */
+#define OTA_TELEMETRY_RATE_SECS             (8u)
+
+/* Buffer for the JSON object of ota_telemetry_format_phases() */
+#define OTA_TELEMETRY_PHASES_SIZE           (224u)
+
+/*******************************************************************************
+* Data structure and enumeration
+********************************************************************************/
+/* Phases of an update session, each covering one or more OTA agent states */
+typedef enum
+{
+    OTA_PHASE_JOB_CONNECT,      /* DNS, TCP, TLS, MQTT connect and subscribe for the job */
+    OTA_PHASE_JOB,              /* Job request, download and parse */
+    OTA_PHASE_DATA_CONNECT,     /* DNS, TCP, TLS, MQTT connect and subscribe for the data */
+    OTA_PHASE_DOWNLOAD,         /* Data request and download, including the storage writes */
+    OTA_PHASE_VERIFY,
+    OTA_PHASE_RESULT,           /* Connect and send the result */
+    OTA_PHASE_COUNT,
+    OTA_PHASE_NONE = OTA_PHASE_COUNT
+} ota_phase_t;
+
+typedef struct
+{
+    uint32_t    ms;             /* Time spent in the phase */
+    uint32_t    retries;        /* Times the phase was entered again */
+} ota_phase_time_t;
+
+typedef struct
+{
+    ota_phase_time_t    phase[OTA_PHASE_COUNT];
+    uint32_t            first_chunk_ms;     /* From the start of the download to the first chunk */
+    uint32_t            total_ms;           /* Since the session started */
+} ota_telemetry_phases_t;
+
+typedef struct
+{
+    uint32_t    chunks;             /* Chunks written to the storage */
+    uint32_t    bytes;              /* Bytes written to the storage */
+    uint32_t    total_size;         /* Size of the OTA image */
+    uint32_t    bytes_per_sec;      /* Over the last OTA_TELEMETRY_RATE_SECS seconds */
+    uint32_t    last_interval_ms;   /* Time between the last two chunks */
+    uint32_t    max_interval_ms;
+    uint32_t    total_interval_ms;  /* Sum of the times between chunks */
+    uint32_t    last_write_us;      /* Time spent in the storage write of the last chunk */
+    uint32_t    max_write_us;
+    uint32_t    total_write_us;
+    uint32_t    interval_hist[OTA_TELEMETRY_HIST_BUCKETS];  /* Times between chunks, in ms */
+    uint32_t    write_hist[OTA_TELEMETRY_HIST_BUCKETS];     /* Storage write times, in us */
+    uint32_t    published;          /* Telemetry messages sent */
+    uint32_t    publish_failures;
+} ota_telemetry_stats_t;
+
+/*******************************************************************************
+* Function prototype
+********************************************************************************/
+void ota_telemetry_init(const char *topic, const char *device_id, uint32_t period_ms);
+void ota_telemetry_task(void *arg);
+void ota_telemetry_reset(void);
+void ota_telemetry_set_connection(cy_mqtt_t mqtt_handle);
+cy_rslt_t ota_telemetry_storage_write(cy_ota_storage_context_t *storage_ptr,
+        cy_ota_storage_write_info_t *chunk_info);
+void ota_telemetry_get_stats(ota_telemetry_stats_t *stats);
+
+void ota_telemetry_phase_event(cy_ota_agent_state_t state);
+void ota_telemetry_get_phases(ota_telemetry_phases_t *phases);
+size_t ota_telemetry_format_phases(char *buf, size_t size);
+bool ota_telemetry_append_phases(char *json_doc, size_t size);
+
+#endif /* SOURCE_OTA_TELEMETRY_H_ */
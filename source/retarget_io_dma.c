@@ -0,0 +1,444 @@
+/******************************************************************************
+* File Name:   retarget_io_dma.c
+*
+* Description: This file contains the non-blocking console output backend.
+*              The newlib _write() of retarget-io is replaced by one that
+*              copies the output into a ring buffer drained by UART DMA.
+*              Supports only GCC_ARM compiler. Enabled by RETARGET_IO_DMA=1
+*              in the Makefile.
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2021-2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+/*******************************************************************************
+ * Header file includes
+ ******************************************************************************/
+#include <string.h>
+#include "cy_pdl.h"
+#include "cyhal.h"
+#include "cy_retarget_io.h"
+#include "retarget_io_dma.h"
+
+/* FreeRTOS header file */
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+
+#if defined(RETARGET_IO_DMA)
+
+#if !defined (__GNUC__) || defined (__ARMCC_VERSION)
+#error "RETARGET_IO_DMA is supported only with the GCC_ARM toolchain"
+#endif
+
+/*******************************************************************************
+ * Macros
+ ******************************************************************************/
+#if ((RETARGET_IO_DMA_BUFFER_SIZE & (RETARGET_IO_DMA_BUFFER_SIZE - 1u)) != 0u)
+#error "RETARGET_IO_DMA_BUFFER_SIZE must be a power of 2"
+#endif
+
+#define RETARGET_IO_DMA_MASK                (RETARGET_IO_DMA_BUFFER_SIZE - 1u)
+
+/* Priority of the UART DMA and the TX done interrupt */
+#define RETARGET_IO_DMA_PRIORITY            (7u)
+
+#if defined (__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+#define RETARGET_IO_DMA_ALIGN               (__SCB_DCACHE_LINE_SIZE)
+#else
+#define RETARGET_IO_DMA_ALIGN               (4u)
+#endif
+
+/*******************************************************************************
+ * Global Variables
+ ******************************************************************************/
+/*
+ * The indexes run freely and are masked when the ring is accessed. head is
+ * advanced by _write(), tail by the TX done interrupt. Both, and the start
+ * of a transfer, are updated in critical sections since any task, and the
+ * interrupt, can write.
+ */
+CY_ALIGN(RETARGET_IO_DMA_ALIGN) static uint8_t ring[RETARGET_IO_DMA_BUFFER_SIZE];
+static volatile uint32_t                ring_head;
+static volatile uint32_t                ring_tail;
+static volatile uint32_t                dma_len;    /* Bytes of the transfer in flight, 0 if idle */
+
+static bool                             dma_ready;
+static retarget_io_dma_stats_t          dma_stats;
+static SemaphoreHandle_t                space_sem;
+static StaticSemaphore_t                space_sem_buffer;
+
+/*******************************************************************************
+ * Function Name: retarget_io_dma_start
+ *******************************************************************************
+ * Summary:
+ *  Starts the transfer of the contiguous bytes at the tail, if the DMA is
+ *  idle. Must be called in a critical section.
+ *
+ *******************************************************************************/
+static void retarget_io_dma_start(void)
+{
+    uint32_t used = ring_head - ring_tail;
+    uint32_t offset = ring_tail & RETARGET_IO_DMA_MASK;
+    uint32_t len;
+
+    if ((dma_len != 0u) || (used == 0u))
+    {
+        return;
+    }
+
+    len = RETARGET_IO_DMA_BUFFER_SIZE - offset;
+    if (len > used)
+    {
+        len = used;
+    }
+
+#if defined (__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+    /* The DMA reads the ring from memory, not from the cache */
+    SCB_CleanDCache_by_Addr((void *)&ring[offset], (int32_t)len);
+#endif
+
+    if (cyhal_uart_write_async(&cy_retarget_io_uart_obj, &ring[offset], len) == CY_RSLT_SUCCESS)
+    {
+        dma_len = len;
+        dma_stats.transfers++;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: retarget_io_dma_event
+ *******************************************************************************
+ * Summary:
+ *  UART event callback, releases the transmitted bytes and starts the next
+ *  transfer. Called from the UART interrupt.
+ *
+ *******************************************************************************/
+static void retarget_io_dma_event(void *callback_arg, cyhal_uart_event_t event)
+{
+    BaseType_t woken = pdFALSE;
+    uint32_t state;
+
+    (void)callback_arg;
+
+    if ((event & CYHAL_UART_IRQ_TX_DONE) != 0u)
+    {
+        state = Cy_SysLib_EnterCriticalSection();
+        ring_tail += dma_len;
+        dma_len = 0u;
+        retarget_io_dma_start();
+        Cy_SysLib_ExitCriticalSection(state);
+
+        if (space_sem != NULL)
+        {
+            xSemaphoreGiveFromISR(space_sem, &woken);
+        }
+        portYIELD_FROM_ISR(woken);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: retarget_io_dma_put
+ *******************************************************************************
+ * Summary:
+ *  Copies as much of the data as fits into the ring buffer and starts a
+ *  transfer if the DMA is idle.
+ *
+ * Return:
+ *  uint32_t : number of bytes copied
+ *
+ *******************************************************************************/
+static uint32_t retarget_io_dma_put(const uint8_t *data, uint32_t len)
+{
+    uint32_t state;
+    uint32_t used;
+    uint32_t offset;
+    uint32_t first;
+
+    state = Cy_SysLib_EnterCriticalSection();
+
+    used = ring_head - ring_tail;
+    if (len > (RETARGET_IO_DMA_BUFFER_SIZE - used))
+    {
+        len = RETARGET_IO_DMA_BUFFER_SIZE - used;
+    }
+
+    offset = ring_head & RETARGET_IO_DMA_MASK;
+    first = RETARGET_IO_DMA_BUFFER_SIZE - offset;
+    if (first > len)
+    {
+        first = len;
+    }
+    memcpy(&ring[offset], data, first);
+    memcpy(&ring[0], &data[first], len - first);
+    ring_head += len;
+
+    used += len;
+    dma_stats.written += len;
+    if (used > dma_stats.high_water)
+    {
+        dma_stats.high_water = used;
+    }
+
+    retarget_io_dma_start();
+
+    Cy_SysLib_ExitCriticalSection(state);
+
+    return len;
+}
+
+/*******************************************************************************
+ * Function Name: retarget_io_dma_can_block
+ *******************************************************************************
+ * Summary:
+ *  Whether the caller is a task that may wait for space in the ring buffer.
+ *
+ *******************************************************************************/
+static bool retarget_io_dma_can_block(void)
+{
+#if defined(RETARGET_IO_DMA_POLICY_BLOCK)
+    return ((__get_IPSR() == 0u) && (space_sem != NULL) &&
+            (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING));
+#else
+    return false;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: retarget_io_dma_write
+ *******************************************************************************
+ * Summary:
+ *  Queues console output, applying the overflow policy when the ring buffer
+ *  is full: the bytes that do not fit are dropped, after waiting up to
+ *  RETARGET_IO_DMA_BLOCK_TIMEOUT_MS with RETARGET_IO_DMA_POLICY_BLOCK.
+ *
+ *******************************************************************************/
+static void retarget_io_dma_write(const uint8_t *data, uint32_t len)
+{
+    TickType_t start = 0;
+    bool waited = false;
+    uint32_t done;
+
+    while (len > 0u)
+    {
+        done = retarget_io_dma_put(data, len);
+        data += done;
+        len -= done;
+
+        if (len == 0u)
+        {
+            break;
+        }
+
+        if (!retarget_io_dma_can_block())
+        {
+            break;
+        }
+        if (!waited)
+        {
+            waited = true;
+            start = xTaskGetTickCount();
+            dma_stats.blocked++;
+        }
+        if ((xTaskGetTickCount() - start) >= pdMS_TO_TICKS(RETARGET_IO_DMA_BLOCK_TIMEOUT_MS))
+        {
+            break;
+        }
+        (void)xSemaphoreTake(space_sem, pdMS_TO_TICKS(RETARGET_IO_DMA_BLOCK_TIMEOUT_MS));
+    }
+
+    if (len > 0u)
+    {
+        uint32_t state = Cy_SysLib_EnterCriticalSection();
+        dma_stats.dropped += len;
+        Cy_SysLib_ExitCriticalSection(state);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: _write
+ *******************************************************************************
+ * Summary:
+ *  newlib output hook, replaces the blocking one of retarget-io once
+ *  retarget_io_dma_init() succeeded.
+ *
+ *******************************************************************************/
+int _write(int fd, const char *ptr, int len)
+{
+    int i;
+
+    (void)fd;
+
+    if (!dma_ready)
+    {
+        for (i = 0; i < len; i++)
+        {
+#ifdef CY_RETARGET_IO_CONVERT_LF_TO_CRLF
+            if (ptr[i] == '\n')
+            {
+                (void)cyhal_uart_putc(&cy_retarget_io_uart_obj, '\r');
+            }
+#endif
+            (void)cyhal_uart_putc(&cy_retarget_io_uart_obj, (uint32_t)ptr[i]);
+        }
+        return len;
+    }
+
+#ifdef CY_RETARGET_IO_CONVERT_LF_TO_CRLF
+    {
+        int start = 0;
+
+        for (i = 0; i < len; i++)
+        {
+            if (ptr[i] == '\n')
+            {
+                retarget_io_dma_write((const uint8_t *)&ptr[start], (uint32_t)(i - start));
+                retarget_io_dma_write((const uint8_t *)"\r\n", 2u);
+                start = i + 1;
+            }
+        }
+        retarget_io_dma_write((const uint8_t *)&ptr[start], (uint32_t)(len - start));
+    }
+#else
+    retarget_io_dma_write((const uint8_t *)ptr, (uint32_t)len);
+#endif
+
+    return len;
+}
+
+/*******************************************************************************
+ * Function Name: retarget_io_dma_init
+ *******************************************************************************
+ * Summary:
+ *  Switches the retarget-io UART to DMA transmit. Must be called after
+ *  cy_retarget_io_init(); the output is blocking until then.
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS, or the error of the UART HAL
+ *
+ *******************************************************************************/
+cy_rslt_t retarget_io_dma_init(void)
+{
+    cy_rslt_t result;
+
+    space_sem = xSemaphoreCreateBinaryStatic(&space_sem_buffer);
+    if (space_sem == NULL)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    result = cyhal_uart_set_async_mode(&cy_retarget_io_uart_obj, CYHAL_ASYNC_DMA,
+                                       RETARGET_IO_DMA_PRIORITY);
+    if (result == CY_RSLT_SUCCESS)
+    {
+        cyhal_uart_register_callback(&cy_retarget_io_uart_obj, retarget_io_dma_event, NULL);
+        cyhal_uart_enable_event(&cy_retarget_io_uart_obj, CYHAL_UART_IRQ_TX_DONE,
+                                RETARGET_IO_DMA_PRIORITY, true);
+        dma_ready = true;
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: retarget_io_dma_flush
+ *******************************************************************************
+ * Summary:
+ *  Waits until the ring buffer is empty, e.g. before a reboot.
+ *
+ * Return:
+ *  bool : true if everything was transmitted
+ *
+ *******************************************************************************/
+bool retarget_io_dma_flush(uint32_t timeout_ms)
+{
+    uint32_t elapsed_ms = 0;
+
+    while (dma_ready && (ring_head != ring_tail))
+    {
+        if (elapsed_ms >= timeout_ms)
+        {
+            return false;
+        }
+        if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+        {
+            vTaskDelay(pdMS_TO_TICKS(1));
+        }
+        else
+        {
+            Cy_SysLib_Delay(1u);
+        }
+        elapsed_ms++;
+    }
+    return true;
+}
+
+#else /* RETARGET_IO_DMA */
+
+cy_rslt_t retarget_io_dma_init(void)
+{
+    return CY_RSLT_SUCCESS;
+}
+
+bool retarget_io_dma_flush(uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+    return true;
+}
+
+#endif /* RETARGET_IO_DMA */
+
+/*******************************************************************************
+ * Function Name: retarget_io_dma_get_stats
+ *******************************************************************************
+ * Summary:
+ *  Returns the counters of the console output ring buffer. They stay 0 when
+ *  RETARGET_IO_DMA is not enabled.
+ *
+ *******************************************************************************/
+void retarget_io_dma_get_stats(retarget_io_dma_stats_t *stats)
+{
+    if (stats != NULL)
+    {
+#if defined(RETARGET_IO_DMA)
+        uint32_t state = Cy_SysLib_EnterCriticalSection();
+        *stats = dma_stats;
+        Cy_SysLib_ExitCriticalSection(state);
+#else
+        memset(stats, 0x00, sizeof(retarget_io_dma_stats_t));
+#endif
+    }
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,83 @@
+/******************************************************************************
+* File Name: retarget_io_dma.h
+*
+* Description: This file contains the declarations of the non-blocking
+* console output backend.
+*
+********************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+
+#ifndef SOURCE_RETARGET_IO_DMA_H_
+#define SOURCE_RETARGET_IO_DMA_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cy_result.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Size of the console output ring buffer, a power of 2 */
+#ifndef RETARGET_IO_DMA_BUFFER_SIZE
+#define RETARGET_IO_DMA_BUFFER_SIZE         (4096u)
+#endif
+
+/* With RETARGET_IO_DMA_POLICY_BLOCK, the longest a task waits for space in
+ * the ring buffer before the rest of its output is dropped. Without it, the
+ * output that does not fit is dropped right away.
+ */
+#ifndef RETARGET_IO_DMA_BLOCK_TIMEOUT_MS
+#define RETARGET_IO_DMA_BLOCK_TIMEOUT_MS    (50u)
+#endif
+
+/*******************************************************************************
+* Data structure and enumeration
+********************************************************************************/
+typedef struct
+{
+    uint32_t    written;        /* Bytes put in the ring buffer */
+    uint32_t    dropped;        /* Bytes lost because the ring buffer was full */
+    uint32_t    high_water;     /* Most bytes waiting in the ring buffer */
+    uint32_t    transfers;      /* DMA transfers started */
+    uint32_t    blocked;        /* Writes that waited for space */
+} retarget_io_dma_stats_t;
+
+/*******************************************************************************
+* Function prototype
+********************************************************************************/
+cy_rslt_t retarget_io_dma_init(void);
+bool retarget_io_dma_flush(uint32_t timeout_ms);
+void retarget_io_dma_get_stats(retarget_io_dma_stats_t *stats);
+
+#endif /* SOURCE_RETARGET_IO_DMA_H_ */